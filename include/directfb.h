@@ -5019,6 +5019,44 @@ typedef struct {
      int                           sensitivity;   /* Sensitivity value for X/Y axes (8.8 fixed point), default 0x100 */
 } DFBInputDeviceConfig;
 
+/*
+ * Stages of input event delivery measured for latency statistics,
+ * each relative to the timestamp of the event set by the driver.
+ */
+typedef enum {
+     DILST_DRIVER        = 0,      /* event handed over by the driver */
+     DILST_DISPATCH      = 1,      /* event processed and dispatched by the core */
+     DILST_WM            = 2,      /* event handled by the window manager */
+     DILST_BUFFER        = 3,      /* event queued in an event buffer */
+     DILST_CLIENT        = 4,      /* event fetched from an event buffer */
+
+     DILST_NUM           = 5       /* number of stages */
+} DFBInputLatencyStage;
+
+/*
+ * Number of buckets in a latency histogram.
+ */
+#define DFB_INPUT_LATENCY_BUCKETS  16
+
+/*
+ * Latency histogram of one stage, all values in microseconds.
+ */
+typedef struct {
+     unsigned int                  num;           /* number of events measured */
+     unsigned int                  buckets[DFB_INPUT_LATENCY_BUCKETS];
+                                                  /* bucket n counts latencies below 32 << n,
+                                                     the last one also counts all higher ones */
+     unsigned long long            total;         /* sum of all latencies */
+     unsigned int                  max;           /* highest latency */
+} DFBInputLatencyHistogram;
+
+/*
+ * Input latency statistics of a device.
+ */
+typedef struct {
+     DFBInputLatencyHistogram      stages[DILST_NUM];
+} DFBInputLatencyStats;
+
 
 /************************
  * IDirectFBInputDevice *
@@ -5192,6 +5230,27 @@ D_DEFINE_INTERFACE(   IDirectFBInputDevice,
           IDirectFBInputDevice          *thiz,
           const DFBInputDeviceConfig    *config
      );
+
+
+   /** Statistics **/
+
+     /*
+      * Get latency histograms of events from this device.
+      *
+      * Events are only measured with the "input-latency-stats"
+      * option, and only in stages passed within this process.
+      */
+     DFBResult (*GetLatencyStatistics) (
+          IDirectFBInputDevice          *thiz,
+          DFBInputLatencyStats          *ret_stats
+     );
+
+     /*
+      * Clear latency histograms of this device.
+      */
+     DFBResult (*ResetLatencyStatistics) (
+          IDirectFBInputDevice          *thiz
+     );
 )
 
 
@@ -5205,7 +5264,8 @@ typedef enum {
      DFEC_USER           = 0x03,   /* custom event for the user of this library */
      DFEC_UNIVERSAL      = 0x04,   /* universal event for custom usage with variable size */
      DFEC_VIDEOPROVIDER  = 0x05,   /* video provider event */
-     DFEC_SURFACE        = 0x06    /* surface event */
+     DFEC_SURFACE        = 0x06,   /* surface event */
+     DFEC_IMAGEPROVIDER  = 0x07    /* image provider event */
 } DFBEventClass;
 
 /*
@@ -5499,6 +5559,30 @@ typedef struct {
      long long                        time_stamp; /* Micro seconds from DIRECT_CLOCK_MONOTONIC */
 } DFBSurfaceEvent;
 
+/*
+ * Type of an image provider event.
+ */
+typedef enum {
+     DIPET_NONE           = 0x00000000,
+     DIPET_PROGRESS       = 0x00000001,  /* Another part of the image has been rendered */
+     DIPET_FINISHED       = 0x00000002,  /* Rendering has finished, successfully or not */
+     DIPET_CANCELED       = 0x00000004   /* Rendering has been canceled */
+} DFBImageProviderEventType;
+
+/*
+ * Event from asynchronous rendering of an image provider
+ */
+typedef struct {
+     DFBEventClass                    clazz;      /* clazz of event */
+
+     DFBImageProviderEventType        type;       /* type of event */
+     unsigned int                     render_id;  /* returned by IDirectFBImageProvider::RenderToAsync() */
+
+     DFBRectangle                     rect;       /* DIPET_PROGRESS: part of the image rendered since the last
+                                                     event, like passed to a DIRenderCallback */
+     DFBResult                        result;     /* DIPET_FINISHED: result of the rendering */
+} DFBImageProviderEvent;
+
 /*
  * Event for usage by the user of this library.
  */
@@ -5532,6 +5616,7 @@ typedef union {
      DFBUniversalEvent               universal;     /* field for universal events */
      DFBVideoProviderEvent           videoprovider; /* field for video provider */
      DFBSurfaceEvent                 surface;       /* field for surface events */
+     DFBImageProviderEvent           imageprovider; /* field for image provider events */
 } DFBEvent;
 
 #define DFB_EVENT(e)          ((DFBEvent *) (e))
@@ -5585,6 +5670,10 @@ typedef struct {
      unsigned int   DVPET_DATAHIGH;
      unsigned int   DVPET_BUFFERTIMELOW;
      unsigned int   DVPET_BUFFERTIMEHIGH;
+
+     unsigned int   DFEC_IMAGEPROVIDER;      /* Number of image provider events. */
+
+     unsigned int   num_coalesced;           /* Number of motion events merged into queued ones. */
 } DFBEventBufferStats;
 
 
@@ -5721,6 +5810,22 @@ D_DEFINE_INTERFACE(   IDirectFBEventBuffer,
           IDirectFBEventBuffer     *thiz,
           DFBEventBufferStats      *ret_stats
      );
+
+
+   /** Fetching events **/
+
+     /*
+      * Get up to <b>max</b> events at once and remove them from the FIFO.
+      *
+      * The events are copied in order into the array, <b>ret_num</b>
+      * returns how many. Returns DFB_BUFFEREMPTY if there was no event.
+      */
+     DFBResult (*GetEvents) (
+          IDirectFBEventBuffer     *thiz,
+          DFBEvent                 *ret_events,
+          unsigned int              max,
+          unsigned int             *ret_num
+     );
 )
 
 /*
@@ -6839,6 +6944,47 @@ D_DEFINE_INTERFACE(   IDirectFBImageProvider,
           const DFBRectangle       *src_rect,
           const char               *filename
      );
+
+
+   /** Asynchronous rendering **/
+
+     /*
+      * Render the file contents like RenderTo(), but in a
+      * background thread, returning immediately.
+      *
+      * Progress and the end of rendering are posted to the
+      * event buffer as DFEC_IMAGEPROVIDER events carrying the
+      * returned render id. Each rendering ends with either
+      * DIPET_FINISHED or DIPET_CANCELED.
+      *
+      * Renderings with higher priority are started first,
+      * those with equal priority in the order of the calls.
+      * The provider, the destination and the event buffer
+      * are referenced until the rendering has ended. Don't
+      * use the provider from other threads meanwhile.
+      */
+     DFBResult (*RenderToAsync) (
+          IDirectFBImageProvider   *thiz,
+          IDirectFBSurface         *destination,
+          const DFBRectangle       *destination_rect,
+          IDirectFBEventBuffer     *buffer,
+          int                       priority,
+          unsigned int             *ret_render_id
+     );
+
+     /*
+      * Cancel an asynchronous rendering.
+      *
+      * A rendering that has not been started is dropped, a
+      * running one is aborted with the next rendered part if
+      * the provider supports progressive rendering.
+      *
+      * Returns DFB_IDNOTFOUND if the rendering has ended already.
+      */
+     DFBResult (*CancelRender) (
+          IDirectFBImageProvider   *thiz,
+          unsigned int              render_id
+     );
 )
 
 /*
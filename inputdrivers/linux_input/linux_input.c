@@ -94,6 +94,7 @@ typedef unsigned long kernel_ulong_t;
 #include <core/coredefs.h>
 #include <core/coretypes.h>
 #include <core/input.h>
+#include <core/input_loop.h>
 #include <core/system.h>
 
 #include <direct/debug.h>
@@ -149,12 +150,33 @@ typedef struct input_absinfo Input_AbsInfo;
 #endif
 
 
+/*
+ * Touchpads related stuff
+ */
+enum {
+     TOUCHPAD_FSM_START,
+     TOUCHPAD_FSM_MAIN,
+     TOUCHPAD_FSM_DRAG_START,
+     TOUCHPAD_FSM_DRAG_MAIN,
+};
+struct touchpad_axis {
+     int old, min, max;
+};
+struct touchpad_fsm_state {
+     int fsm_state;
+     struct touchpad_axis x;
+     struct touchpad_axis y;
+     struct timeval timeout;
+};
+
 /*
  * declaration of private data
  */
 typedef struct {
      CoreInputDevice         *device;
-     DirectThread            *thread;
+     DirectThread            *thread;       /* reading thread if not serviced by the input loop */
+     InputLoopWatch          *watch;        /* input loop watch if not using a thread */
+     bool                     started;      /* initial key states have been dispatched */
 
      int                      fd;
      int                      quitpipe[2];
@@ -169,7 +191,15 @@ typedef struct {
      int                      dx;
      int                      dy;
 
+     int                      ax;            /* latest absolute position if ax_set */
+     int                      ay;            /* latest absolute position if ay_set */
+     bool                     ax_set;
+     bool                     ay_set;
+
+     unsigned int             coalesced;     /* number of motion events merged by compression */
+
      bool                     touchpad;
+     struct touchpad_fsm_state fsm_state;
 
      /* Indice of the associated device_nums and device_names array entry.
       * Used as the second parameter of the driver_open_device function.
@@ -365,25 +395,6 @@ int ext_keycodes [] = {
      DIKS_PREVIOUS, DIKS_NEXT, DIKS_DIGITS, DIKS_TEEN, DIKS_TWEN, DIKS_BREAK
 };
 
-/*
- * Touchpads related stuff
- */
-enum {
-     TOUCHPAD_FSM_START,
-     TOUCHPAD_FSM_MAIN,
-     TOUCHPAD_FSM_DRAG_START,
-     TOUCHPAD_FSM_DRAG_MAIN,
-};
-struct touchpad_axis {
-     int old, min, max;
-};
-struct touchpad_fsm_state {
-     int fsm_state;
-     struct touchpad_axis x;
-     struct touchpad_axis y;
-     struct timeval timeout;
-};
-
 static void
 touchpad_fsm_init( struct touchpad_fsm_state *state );
 static int
@@ -789,19 +800,22 @@ set_led( const LinuxInputData *data, int led, int state )
      (void)res;
 }
 
+/*
+ * Dispatches accumulated motion, stamped with the time of the kernel event causing the flush.
+ */
 static void
-flush_xy( LinuxInputData *data, bool last )
+flush_xy( LinuxInputData *data, bool last, const struct timeval *time )
 {
-     DFBInputEvent evt = { .type = DIET_UNKNOWN };
+     DFBInputEvent evt = { .type = DIET_UNKNOWN, .timestamp = *time };
 
      if (data->dx) {
           evt.type    = DIET_AXISMOTION;
-          evt.flags   = DIEF_AXISREL;
+          evt.flags   = DIEF_TIMESTAMP | DIEF_AXISREL;
           evt.axis    = DIAI_X;
           evt.axisrel = data->dx;
 
           /* Signal immediately following event. */
-          if (!last || data->dy)
+          if (!last || data->dy || data->ax_set || data->ay_set)
                evt.flags |= DIEF_FOLLOW;
 
           dfb_input_dispatch( data->device, &evt );
@@ -811,52 +825,71 @@ flush_xy( LinuxInputData *data, bool last )
 
      if (data->dy) {
           evt.type    = DIET_AXISMOTION;
-          evt.flags   = DIEF_AXISREL;
+          evt.flags   = DIEF_TIMESTAMP | DIEF_AXISREL;
           evt.axis    = DIAI_Y;
           evt.axisrel = data->dy;
 
           /* Signal immediately following event. */
-          if (!last)
+          if (!last || data->ax_set || data->ay_set)
                evt.flags |= DIEF_FOLLOW;
 
           dfb_input_dispatch( data->device, &evt );
 
           data->dy = 0;
      }
+
+     if (data->ax_set) {
+          evt.type    = DIET_AXISMOTION;
+          evt.flags   = DIEF_TIMESTAMP | DIEF_AXISABS;
+          evt.axis    = DIAI_X;
+          evt.axisabs = data->ax;
+
+          /* Signal immediately following event. */
+          if (!last || data->ay_set)
+               evt.flags |= DIEF_FOLLOW;
+
+          dfb_input_dispatch( data->device, &evt );
+
+          data->ax_set = false;
+     }
+
+     if (data->ay_set) {
+          evt.type    = DIET_AXISMOTION;
+          evt.flags   = DIEF_TIMESTAMP | DIEF_AXISABS;
+          evt.axis    = DIAI_Y;
+          evt.axisabs = data->ay;
+
+          /* Signal immediately following event. */
+          if (!last)
+               evt.flags |= DIEF_FOLLOW;
+
+          dfb_input_dispatch( data->device, &evt );
+
+          data->ay_set = false;
+     }
 }
 
 /*
- * Input thread reading from device.
- * Generates events on incoming data.
+ * Initializes the touchpad state and synthesizes events for the current key states.
  */
-static void*
-linux_input_EventThread( DirectThread *thread, void *driver_data )
+static void
+linux_input_start( LinuxInputData *data )
 {
-     LinuxInputData    *data = (LinuxInputData*) driver_data;
-     int                readlen, status;
-     unsigned int       i;
-     int                fdmax;
-     struct input_event levt[64];
-     fd_set             set;
-     struct touchpad_fsm_state fsm_state;
-
      D_DEBUG_AT( Debug_LinuxInput, "%s()\n", __FUNCTION__ );
 
-     fdmax = MAX( data->fd, data->quitpipe[0] );
-
      /* Query min/max coordinates. */
      if (data->touchpad) {
           Input_AbsInfo absinfo;
 
-          touchpad_fsm_init( &fsm_state );
+          touchpad_fsm_init( &data->fsm_state );
 
           ioctl( data->fd, EVIOCGABS(ABS_X), &absinfo );
-          fsm_state.x.min = absinfo.minimum;
-          fsm_state.x.max = absinfo.maximum;
+          data->fsm_state.x.min = absinfo.minimum;
+          data->fsm_state.x.max = absinfo.maximum;
 
           ioctl( data->fd, EVIOCGABS(ABS_Y), &absinfo );
-          fsm_state.y.min = absinfo.minimum;
-          fsm_state.y.max = absinfo.maximum;
+          data->fsm_state.y.min = absinfo.minimum;
+          data->fsm_state.y.max = absinfo.maximum;
      }
 
      /* Query key states. */
@@ -892,63 +925,54 @@ linux_input_EventThread( DirectThread *thread, void *driver_data )
           }
      }
 
-     while (1) {
-          DFBInputEvent devt = { .type = DIET_UNKNOWN };
-
-          FD_ZERO( &set );
-          FD_SET( data->fd, &set );
-          FD_SET( data->quitpipe[0], &set );
-
-          if (data->touchpad && timeout_is_set( &fsm_state.timeout )) {
-               struct timeval time;
-               gettimeofday( &time, NULL );
-
-               if (!timeout_passed( &fsm_state.timeout, &time )) {
-                    struct timeval timeout = fsm_state.timeout;
-                    timeout_sub( &timeout, &time );
-                    status = select( fdmax + 1, &set, NULL, NULL, &timeout );
-               } else {
-                    status = 0;
-               }
-          }
-          else {
-               status = select( fdmax + 1, &set, NULL, NULL, NULL );
-          }
-
-          if (status < 0 && errno != EINTR)
-               break;
-
-          if (status > 0 && FD_ISSET( data->quitpipe[0], &set ))
-               break;
+     data->started = true;
+}
 
-          direct_thread_testcancel( thread );
+/*
+ * Runs the touchpad state machine after its timeout.
+ */
+static void
+linux_input_timeout( LinuxInputData *data )
+{
+     DFBInputEvent devt = { .type = DIET_UNKNOWN };
 
-          if (status < 0)
-               continue;
+     if (data->touchpad && touchpad_fsm( &data->fsm_state, NULL, &devt ) > 0)
+          dfb_input_dispatch( data->device, &devt );
+}
 
-          /* timeout? */
-          if (status == 0) {
-               if (data->touchpad && touchpad_fsm( &fsm_state, NULL, &devt ) > 0)
-                    dfb_input_dispatch( data->device, &devt );
+/*
+ * Reads and dispatches pending events, with the input loop until the device has no more.
+ * Returns false if the device can't be read anymore.
+ */
+static bool
+linux_input_read( LinuxInputData *data )
+{
+     int                readlen, status;
+     unsigned int       i;
+     struct input_event levt[64];
+     DFBInputEvent      devt = { .type = DIET_UNKNOWN };
+     bool               ok   = true;
+     struct timeval     last_time;
 
-               continue;
-          }
+     gettimeofday( &last_time, NULL );
 
+     do {
           readlen = read( data->fd, levt, sizeof(levt) );
 
-          if (readlen < 0 && errno != EINTR)
-               break;
-
-          direct_thread_testcancel( thread );
+          if (readlen < 0) {
+               if (errno != EINTR && errno != EAGAIN)
+                    ok = false;
 
-          if (readlen <= 0)
-               continue;
+               break;
+          }
 
           for (i=0; i<readlen / sizeof(levt[0]); i++) {
                DFBInputEvent temp = { .type = DIET_UNKNOWN };
 
+               last_time = levt[i].time;
+
                if (data->touchpad) {
-                    status = touchpad_fsm( &fsm_state, &levt[i], &temp );
+                    status = touchpad_fsm( &data->fsm_state, &levt[i], &temp );
                     if (status < 0) {
                          /* Not handled. Try the direct approach. */
                          if (!translate_event( data, &levt[i], &temp ))
@@ -966,7 +990,7 @@ linux_input_EventThread( DirectThread *thread, void *driver_data )
 
                /* Flush previous event with DIEF_FOLLOW? */
                if (devt.type != DIET_UNKNOWN) {
-                    flush_xy( data, false );
+                    flush_xy( data, false, &levt[i].time );
 
                     /* Signal immediately following event. */
                     devt.flags |= DIEF_FOLLOW;
@@ -984,18 +1008,44 @@ linux_input_EventThread( DirectThread *thread, void *driver_data )
                     devt.flags = DIEF_NONE;
                }
 
-               devt = temp;
+               if (D_FLAGS_IS_SET( temp.flags, DIEF_AXISREL ) && temp.type == DIET_AXISMOTION &&
+                   dfb_config->mouse_motion_compression)
+               {
+                    switch (temp.axis) {
+                         case DIAI_X:
+                              if (data->dx)
+                                   data->coalesced++;
+                              data->dx += temp.axisrel;
+                              continue;
 
-               if (D_FLAGS_IS_SET( devt.flags, DIEF_AXISREL ) && devt.type == DIET_AXISMOTION &&
+                         case DIAI_Y:
+                              if (data->dy)
+                                   data->coalesced++;
+                              data->dy += temp.axisrel;
+                              continue;
+
+                         default:
+                              break;
+                    }
+               }
+
+               /* Only the latest absolute position of a batch matters. */
+               if (D_FLAGS_IS_SET( temp.flags, DIEF_AXISABS ) && temp.type == DIET_AXISMOTION &&
                    dfb_config->mouse_motion_compression)
                {
-                    switch (devt.axis) {
+                    switch (temp.axis) {
                          case DIAI_X:
-                              data->dx += devt.axisrel;
+                              if (data->ax_set)
+                                   data->coalesced++;
+                              data->ax     = temp.axisabs;
+                              data->ax_set = true;
                               continue;
 
                          case DIAI_Y:
-                              data->dy += devt.axisrel;
+                              if (data->ay_set)
+                                   data->coalesced++;
+                              data->ay     = temp.axisabs;
+                              data->ay_set = true;
                               continue;
 
                          default:
@@ -1003,24 +1053,91 @@ linux_input_EventThread( DirectThread *thread, void *driver_data )
                     }
                }
 
+               devt = temp;
+
                /* Event is dispatched in next round of loop. */
           }
+     } while (data->watch && readlen == sizeof(levt));
 
-          /* Flush last event without DIEF_FOLLOW. */
-          if (devt.type != DIET_UNKNOWN) {
-               flush_xy( data, false );
+     /* Flush last event without DIEF_FOLLOW. */
+     if (devt.type != DIET_UNKNOWN) {
+          flush_xy( data, false, &last_time );
 
-               dfb_input_dispatch( data->device, &devt );
+          dfb_input_dispatch( data->device, &devt );
 
-               if (data->has_leds && (devt.locks != data->locks)) {
-                    set_led( data, LED_SCROLLL, devt.locks & DILS_SCROLL );
-                    set_led( data, LED_NUML, devt.locks & DILS_NUM );
-                    set_led( data, LED_CAPSL, devt.locks & DILS_CAPS );
-                    data->locks = devt.locks;
+          if (data->has_leds && (devt.locks != data->locks)) {
+               set_led( data, LED_SCROLLL, devt.locks & DILS_SCROLL );
+               set_led( data, LED_NUML, devt.locks & DILS_NUM );
+               set_led( data, LED_CAPSL, devt.locks & DILS_CAPS );
+               data->locks = devt.locks;
+          }
+     }
+     else
+          flush_xy( data, true, &last_time );
+
+     return ok;
+}
+
+/*
+ * Input thread reading from device.
+ * Generates events on incoming data.
+ */
+static void*
+linux_input_EventThread( DirectThread *thread, void *driver_data )
+{
+     LinuxInputData    *data = (LinuxInputData*) driver_data;
+     int                status;
+     int                fdmax;
+     fd_set             set;
+
+     D_DEBUG_AT( Debug_LinuxInput, "%s()\n", __FUNCTION__ );
+
+     fdmax = MAX( data->fd, data->quitpipe[0] );
+
+     linux_input_start( data );
+
+     while (1) {
+          FD_ZERO( &set );
+          FD_SET( data->fd, &set );
+          FD_SET( data->quitpipe[0], &set );
+
+          if (data->touchpad && timeout_is_set( &data->fsm_state.timeout )) {
+               struct timeval time;
+               gettimeofday( &time, NULL );
+
+               if (!timeout_passed( &data->fsm_state.timeout, &time )) {
+                    struct timeval timeout = data->fsm_state.timeout;
+                    timeout_sub( &timeout, &time );
+                    status = select( fdmax + 1, &set, NULL, NULL, &timeout );
+               } else {
+                    status = 0;
                }
           }
-          else
-               flush_xy( data, true );
+          else {
+               status = select( fdmax + 1, &set, NULL, NULL, NULL );
+          }
+
+          if (status < 0 && errno != EINTR)
+               break;
+
+          if (status > 0 && FD_ISSET( data->quitpipe[0], &set ))
+               break;
+
+          direct_thread_testcancel( thread );
+
+          if (status < 0)
+               continue;
+
+          /* timeout? */
+          if (status == 0) {
+               linux_input_timeout( data );
+               continue;
+          }
+
+          if (!linux_input_read( data ))
+               break;
+
+          direct_thread_testcancel( thread );
      }
 
      if (status <= 0)
@@ -1029,6 +1146,49 @@ linux_input_EventThread( DirectThread *thread, void *driver_data )
      return NULL;
 }
 
+/*
+ * Called by the input loop instead of running linux_input_EventThread().
+ */
+static bool
+linux_input_handle( InputLoopWatch  *watch,
+                    InputLoopEvents  events,
+                    void            *ctx )
+{
+     LinuxInputData *data = ctx;
+
+     if (!data->started)
+          linux_input_start( data );
+
+     if (events & ILEV_TIMEOUT)
+          linux_input_timeout( data );
+
+     if ((events & ILEV_READ) && !linux_input_read( data )) {
+          D_PERROR( "DirectFB/linux_input: reading device failed, no more events!\n" );
+          return false;
+     }
+
+     /* Arm the timeout of the touchpad state machine. */
+     if (data->touchpad) {
+          long long micros = 0;
+
+          if (timeout_is_set( &data->fsm_state.timeout )) {
+               struct timeval time;
+
+               gettimeofday( &time, NULL );
+
+               micros = (data->fsm_state.timeout.tv_sec  - time.tv_sec) * 1000000LL +
+                        (data->fsm_state.timeout.tv_usec - time.tv_usec);
+
+               if (micros < 1)
+                    micros = 1;
+          }
+
+          dfb_input_loop_set_timeout( watch, micros );
+     }
+
+     return true;
+}
+
 /*
  * Fill device information.
  * Queries the input device and tries to classify it.
@@ -2086,15 +2246,26 @@ driver_open_device( CoreInputDevice  *device,
           set_led( data, LED_CAPSL, 0 );
      }
 
-     /* open a pipe to awake the reader thread when we want to quit */
-     ret = pipe( data->quitpipe );
-     if (ret < 0) {
-          D_PERROR( "DirectFB/linux_input: could not open quitpipe" );
-          goto driver_open_device_error;
+     /* service the device from the input loop, reading all pending events at once */
+     fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+
+     if (dfb_input_loop_add( fd, linux_input_handle, data, &data->watch ) == DFB_OK) {
+          /* dispatch initial key states from the loop like the input thread does */
+          dfb_input_loop_set_timeout( data->watch, 1 );
      }
+     else {
+          fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_NONBLOCK );
 
-     /* start input thread */
-     data->thread = direct_thread_create( DTT_INPUT, linux_input_EventThread, data, "Linux Input" );
+          /* open a pipe to awake the reader thread when we want to quit */
+          ret = pipe( data->quitpipe );
+          if (ret < 0) {
+               D_PERROR( "DirectFB/linux_input: could not open quitpipe" );
+               goto driver_open_device_error;
+          }
+
+          /* start input thread */
+          data->thread = direct_thread_create( DTT_INPUT, linux_input_EventThread, data, "Linux Input" );
+     }
 
      /* set private data pointer */
      *driver_data = data;
@@ -2233,13 +2404,21 @@ driver_close_device( void *driver_data )
 
      D_DEBUG_AT( Debug_LinuxInput, "%s()\n", __FUNCTION__ );
 
-     /* stop input thread */
-     res = write( data->quitpipe[1], " ", 1 );
-     (void)res;
-     direct_thread_join( data->thread );
-     direct_thread_destroy( data->thread );
-     close( data->quitpipe[0] );
-     close( data->quitpipe[1] );
+     if (data->watch) {
+          /* stop watching the device */
+          dfb_input_loop_remove( data->watch );
+     }
+     else {
+          /* stop input thread */
+          res = write( data->quitpipe[1], " ", 1 );
+          (void)res;
+          direct_thread_join( data->thread );
+          direct_thread_destroy( data->thread );
+          close( data->quitpipe[0] );
+          close( data->quitpipe[1] );
+     }
+
+     D_DEBUG_AT( Debug_LinuxInput, "  -> %u motion events coalesced\n", data->coalesced );
 
      if (data->has_leds) {
           /* restore LED state */
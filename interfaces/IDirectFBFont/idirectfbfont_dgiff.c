@@ -345,10 +345,12 @@ Construct( IDirectFBFont               *thiz,
 
           D_MAGIC_SET( glyph_data, CoreGlyphData );
 
-          direct_hash_insert( font->layers[0].glyph_hash, glyph->unicode, glyph_data );
-
-          if (glyph->unicode < 128)
-               font->layers[0].glyph_data[glyph->unicode] = glyph_data;
+          ret = dfb_font_insert_glyph( font, glyph->unicode, 0, glyph_data );
+          if (ret) {
+               D_MAGIC_CLEAR( glyph_data );
+               D_FREE( glyph_data );
+               goto error;
+          }
      }
 
 
@@ -45,9 +45,11 @@
 
 #include <media/idirectfbfont.h>
 
+#include <direct/hash.h>
 #include <direct/mem.h>
 #include <direct/memcpy.h>
 #include <direct/messages.h>
+#include <direct/thread.h>
 #include <direct/utf8.h>
 #include <direct/util.h>
 
@@ -85,10 +87,15 @@ Construct( IDirectFBFont               *thiz,
 
 DIRECT_INTERFACE_IMPLEMENTATION( IDirectFBFont, FT2 )
 
+/* Only used for probing, each font has its own library instance. */
 static FT_Library      library           = NULL;
 static int             library_ref_count = 0;
 static pthread_mutex_t library_mutex     = PTHREAD_MUTEX_INITIALIZER;
 
+/* Maximum number of additional face instances for rasterizing glyphs in parallel. */
+#define FT2_MAX_SHARDS       4
+#define FT2_MAX_PREFETCHED   256
+
 #define KERNING_CACHE_MIN    0
 #define KERNING_CACHE_MAX  127
 #define KERNING_CACHE_SIZE (KERNING_CACHE_MAX - KERNING_CACHE_MIN + 1)
@@ -104,15 +111,45 @@ static pthread_mutex_t library_mutex     = PTHREAD_MUTEX_INITIALIZER;
 #define CHAR_INDEX(c)    (((c) < 256) ? data->indices[c] : FT_Get_Char_Index( data->face, c ))
 
 typedef struct {
+     FT_Library   library;
      FT_Face      face;
-     int          disable_charmap;
-     int          fixed_advance;
-     bool         fixed_clip;
-     unsigned int indices[256];
-     int          outline_radius;
-     int          outline_opacity;
-     float        up_unit_x;     /* unit vector pointing 'up' in for */
-     float        up_unit_y;     /* this font's rotation             */
+} FT2Shard;
+
+typedef struct {
+     FT_Bitmap    bitmap;        /* copy of the rendered glyph, buffer follows the struct */
+     int          left;
+     int          top;
+     FT_Vector    advance;
+} FT2Prefetched;
+
+typedef struct {
+     FT_Library       library;       /* per font, so that different fonts don't serialize */
+     FT_Face          face;
+     pthread_mutex_t  lock;          /* protects library, face and prefetched */
+
+     FT_Int           load_flags;
+
+     const void      *content;       /* for creating the shard faces */
+     int              content_size;
+     int              face_index;
+     FT_F26Dot6       char_width;
+     FT_F26Dot6       char_height;
+     bool             transform;
+     FT_Matrix        matrix;
+
+     pthread_mutex_t  prefetch_lock;
+     FT2Shard         shards[FT2_MAX_SHARDS];
+     int              num_shards;    /* -1 if not available */
+     DirectHash      *prefetched;    /* rasterized in advance, indexed by glyph index */
+
+     int              disable_charmap;
+     int              fixed_advance;
+     bool             fixed_clip;
+     unsigned int     indices[256];
+     int              outline_radius;
+     int              outline_opacity;
+     float            up_unit_x;     /* unit vector pointing 'up' in for */
+     float            up_unit_y;     /* this font's rotation             */
 } FT2ImplData;
 
 typedef struct {
@@ -141,11 +178,11 @@ ft2UTF8GetCharacterIndex( CoreFont     *thiz,
      if (data->disable_charmap)
           *ret_index = character;
      else {
-          pthread_mutex_lock ( &library_mutex );
+          pthread_mutex_lock( &data->lock );
 
           *ret_index = CHAR_INDEX( character );
 
-          pthread_mutex_unlock ( &library_mutex );
+          pthread_mutex_unlock( &data->lock );
      }
 
      return DFB_OK;
@@ -168,7 +205,7 @@ ft2UTF8DecodeText( CoreFont       *thiz,
      D_ASSERT( ret_indices != NULL );
      D_ASSERT( ret_num != NULL );
 
-     pthread_mutex_lock ( &library_mutex );
+     pthread_mutex_lock( &data->lock );
 
      while (pos < length) {
           unsigned int c;
@@ -186,7 +223,7 @@ ft2UTF8DecodeText( CoreFont       *thiz,
                ret_indices[num++] = CHAR_INDEX( c );
      }
 
-     pthread_mutex_unlock ( &library_mutex );
+     pthread_mutex_unlock( &data->lock );
 
      *ret_num = num;
 
@@ -260,49 +297,65 @@ render_glyph( CoreFont      *thiz,
               unsigned int   index,
               CoreGlyphData *info )
 {
-     FT_Error     err;
-     FT_Face      face;
-     FT_Int       load_flags;
-     u8          *src;
-     int          y;
-     FT2ImplData *data    = thiz->impl_data;
-     CoreSurface *surface = info->surface;
+     FT_Error         err;
+     FT_Face          face;
+     u8              *src;
+     int              y;
+     const FT_Bitmap *bitmap;
+     int              bitmap_left;
+     int              bitmap_top;
+     FT2Prefetched   *prefetched;
+     FT2ImplData     *data    = thiz->impl_data;
+     CoreSurface     *surface = info->surface;
      CoreSurfaceBufferLock  lock;
 
-     pthread_mutex_lock ( &library_mutex );
+     pthread_mutex_lock( &data->lock );
 
      face = data->face;
 
-     load_flags = (unsigned long) face->generic.data;
-     load_flags |= FT_LOAD_RENDER;
+     /* Use the glyph if it has been rasterized in advance, it's taken only once. */
+     prefetched = data->prefetched ? direct_hash_lookup( data->prefetched, index ) : NULL;
+     if (prefetched) {
+          direct_hash_remove( data->prefetched, index );
 
-     if ((err = FT_Load_Glyph( face, index, load_flags ))) {
-          D_DEBUG( "DirectFB/FontFT2: Could not render glyph for character index #%d!\n", index );
-          pthread_mutex_unlock ( &library_mutex );
-          return DFB_FAILURE;
+          bitmap      = &prefetched->bitmap;
+          bitmap_left = prefetched->left;
+          bitmap_top  = prefetched->top;
      }
+     else {
+          if ((err = FT_Load_Glyph( face, index, data->load_flags | FT_LOAD_RENDER ))) {
+               D_DEBUG( "DirectFB/FontFT2: Could not render glyph for character index #%d!\n", index );
+               pthread_mutex_unlock( &data->lock );
+               return DFB_FAILURE;
+          }
 
-     pthread_mutex_unlock ( &library_mutex );
+          bitmap      = &face->glyph->bitmap;
+          bitmap_left = face->glyph->bitmap_left;
+          bitmap_top  = face->glyph->bitmap_top;
+     }
 
      err = dfb_surface_lock_buffer( surface, CSBR_BACK, CSAID_CPU, CSAF_WRITE, &lock );
      if (err) {
           D_DERROR( err, "DirectFB/FontFT2: Unable to lock surface!\n" );
+          pthread_mutex_unlock( &data->lock );
+          if (prefetched)
+               D_FREE( prefetched );
           return err;
      }
 
-     info->width = face->glyph->bitmap.width;
+     info->width = bitmap->width;
      if (info->width + info->start > surface->config.size.w)
           info->width = surface->config.size.w - info->start;
 
-     info->height = face->glyph->bitmap.rows;
-     if (info->height > surface->config.size.h)
-          info->height = surface->config.size.h;
+     info->height = bitmap->rows;
+     if (info->height + info->start_y > surface->config.size.h)
+          info->height = surface->config.size.h - info->start_y;
 
      /* bitmap_left and bitmap_top are relative to the glyph's origin on the
         baseline.  info->left and info->top are relative to the top-left of the
         character cell. */
-     info->left =   face->glyph->bitmap_left - thiz->ascender*thiz->up_unit_x;
-     info->top  = - face->glyph->bitmap_top  - thiz->ascender*thiz->up_unit_y;
+     info->left =   bitmap_left - thiz->ascender*thiz->up_unit_x;
+     info->top  = - bitmap_top  - thiz->ascender*thiz->up_unit_y;
 
      if (info->layer == 1 && info->width > 0 && info->height > 0) {
           int   xoffset, yoffset;
@@ -310,13 +363,13 @@ render_glyph( CoreFont      *thiz,
           void *blurred = NULL;
           int   radius  = data->outline_radius;
 
-          switch (face->glyph->bitmap.pixel_mode) {
+          switch (bitmap->pixel_mode) {
                case ft_pixel_mode_grays:
                     blurred = D_CALLOC( 1, (info->width + radius) * (info->height + radius) );
                     if (blurred) {
                          for (yoffset=0; yoffset<radius; yoffset++) {
                               for (xoffset=0; xoffset<radius; xoffset++) {
-                                   src = face->glyph->bitmap.buffer;
+                                   src = bitmap->buffer;
 
                                    for (y=0; y < info->height; y++) {
                                         int  i;
@@ -328,7 +381,7 @@ render_glyph( CoreFont      *thiz,
                                              dst8[i] = (val < 255) ? val : 255;
                                         }
 
-                                        src += face->glyph->bitmap.pitch;
+                                        src += bitmap->pitch;
                                    }
                               }
                          }
@@ -354,7 +407,7 @@ render_glyph( CoreFont      *thiz,
           info->top    -= (radius - 1) / 2;
 
           if (blurred) {
-               addr = lock.addr + DFB_BYTES_PER_LINE(surface->config.format, info->start);
+               addr = lock.addr + info->start_y * lock.pitch + DFB_BYTES_PER_LINE(surface->config.format, info->start);
                src  = blurred;
 
                for (y=0; y < info->height; y++) {
@@ -362,7 +415,7 @@ render_glyph( CoreFont      *thiz,
                     u8  *dst8  = addr;
                     u32 *dst32 = addr;
 
-                    switch (face->glyph->bitmap.pixel_mode) {
+                    switch (bitmap->pixel_mode) {
                          case ft_pixel_mode_grays:
                               switch (surface->config.format) {
                                    case DSPF_ARGB:
@@ -414,8 +467,8 @@ render_glyph( CoreFont      *thiz,
                     info->width = data->fixed_advance;
           }
 
-          src = face->glyph->bitmap.buffer;
-          lock.addr += DFB_BYTES_PER_LINE(surface->config.format, info->start);
+          src = bitmap->buffer;
+          lock.addr += info->start_y * lock.pitch + DFB_BYTES_PER_LINE(surface->config.format, info->start);
 
           for (y=0; y < info->height; y++) {
                int  i, j, n;
@@ -423,7 +476,7 @@ render_glyph( CoreFont      *thiz,
                u16 *dst16 = lock.addr;
                u32 *dst32 = lock.addr;
 
-               switch (face->glyph->bitmap.pixel_mode) {
+               switch (bitmap->pixel_mode) {
                     case ft_pixel_mode_grays:
                          switch (surface->config.format) {
                               case DSPF_ARGB:
@@ -644,7 +697,7 @@ render_glyph( CoreFont      *thiz,
 
                }
 
-               src += face->glyph->bitmap.pitch;
+               src += bitmap->pitch;
 
                lock.addr += lock.pitch;
           }
@@ -652,6 +705,11 @@ render_glyph( CoreFont      *thiz,
 
      dfb_surface_unlock_buffer( surface, &lock );
 
+     pthread_mutex_unlock( &data->lock );
+
+     if (prefetched)
+          D_FREE( prefetched );
+
      return DFB_OK;
 }
 
@@ -661,49 +719,66 @@ get_glyph_info( CoreFont      *thiz,
                 unsigned int   index,
                 CoreGlyphData *info )
 {
-     FT_Error err;
-     FT_Face  face;
-     FT_Int   load_flags;
-     FT2ImplData *data = (FT2ImplData*) thiz->impl_data;
+     FT_Error       err;
+     FT_Face        face;
+     FT_Vector      advance;
+     FT2Prefetched *prefetched;
+     FT2ImplData   *data = (FT2ImplData*) thiz->impl_data;
 
-     pthread_mutex_lock ( &library_mutex );
+     pthread_mutex_lock( &data->lock );
 
      face = data->face;
 
-     load_flags = (unsigned long) face->generic.data;
+     prefetched = data->prefetched ? direct_hash_lookup( data->prefetched, index ) : NULL;
+     if (prefetched) {
+          info->width   = prefetched->bitmap.width;
+          info->height  = prefetched->bitmap.rows;
 
-     if ((err = FT_Load_Glyph( face, index, load_flags ))) {
-          D_DEBUG( "DirectFB/FontFT2: Could not load glyph for character index #%d!\n", index );
+          advance = prefetched->advance;
 
-          pthread_mutex_unlock ( &library_mutex );
+          /* Nothing to render, so it won't be used anymore. */
+          if (info->width < 1 || info->height < 1) {
+               direct_hash_remove( data->prefetched, index );
 
-          return DFB_FAILURE;
+               D_FREE( prefetched );
+          }
      }
+     else {
+          if ((err = FT_Load_Glyph( face, index, data->load_flags ))) {
+               D_DEBUG( "DirectFB/FontFT2: Could not load glyph for character index #%d!\n", index );
 
-     if (face->glyph->format != ft_glyph_format_bitmap) {
-          err = FT_Render_Glyph( face->glyph,
-                                 (load_flags & FT_LOAD_TARGET_MONO) ? ft_render_mode_mono : ft_render_mode_normal );
-          if (err) {
-               D_ERROR( "DirectFB/FontFT2: Could not render glyph for character index #%d!\n", index );
-
-               pthread_mutex_unlock ( &library_mutex );
+               pthread_mutex_unlock( &data->lock );
 
                return DFB_FAILURE;
           }
-     }
 
-     pthread_mutex_unlock ( &library_mutex );
+          if (face->glyph->format != ft_glyph_format_bitmap) {
+               err = FT_Render_Glyph( face->glyph,
+                                      (data->load_flags & FT_LOAD_TARGET_MONO) ? ft_render_mode_mono : ft_render_mode_normal );
+               if (err) {
+                    D_ERROR( "DirectFB/FontFT2: Could not render glyph for character index #%d!\n", index );
+
+                    pthread_mutex_unlock( &data->lock );
+
+                    return DFB_FAILURE;
+               }
+          }
+
+          info->width   = face->glyph->bitmap.width;
+          info->height  = face->glyph->bitmap.rows;
 
-     info->width   = face->glyph->bitmap.width;
-     info->height  = face->glyph->bitmap.rows;
+          advance = face->glyph->advance;
+     }
+
+     pthread_mutex_unlock( &data->lock );
 
      if (data->fixed_advance) {
           info->xadvance = - data->fixed_advance * thiz->up_unit_y;
           info->yadvance =   data->fixed_advance * thiz->up_unit_x;
      }
      else {
-          info->xadvance =   face->glyph->advance.x << 2;
-          info->yadvance = - face->glyph->advance.y << 2;
+          info->xadvance =   advance.x << 2;
+          info->yadvance = - advance.y << 2;
      }
 
      if (data->fixed_clip && info->width > data->fixed_advance)
@@ -742,7 +817,7 @@ get_kerning( CoreFont     *thiz,
           if (!cache->initialised && FT_HAS_KERNING(data->base.face)) {
                FT_Vector vector;
 
-               pthread_mutex_lock ( &library_mutex );
+               pthread_mutex_lock( &data->base.lock );
 
                /* Lookup kerning values for the character pair. */
                FT_Get_Kerning( data->base.face,
@@ -753,7 +828,7 @@ get_kerning( CoreFont     *thiz,
 
                cache->initialised = true;
 
-               pthread_mutex_unlock ( &library_mutex );
+               pthread_mutex_unlock( &data->base.lock );
           }
 
           if (kern_x)
@@ -765,14 +840,14 @@ get_kerning( CoreFont     *thiz,
           return DFB_OK;
      }
 
-     pthread_mutex_lock ( &library_mutex );
+     pthread_mutex_lock( &data->base.lock );
 
      /* Lookup kerning values for the character pair. */
      /* The vector returned by FreeType does not allow for any rotation. */
      FT_Get_Kerning( data->base.face,
                      prev, current, ft_kerning_default, &vector );
 
-     pthread_mutex_unlock ( &library_mutex );
+     pthread_mutex_unlock( &data->base.lock );
 
      /* Convert to integer. */
      if (kern_x)
@@ -784,6 +859,210 @@ get_kerning( CoreFont     *thiz,
      return DFB_OK;
 }
 
+/**********************************************************************************************************************/
+
+typedef struct {
+     FT2ImplData         *data;
+     FT_Face              face;
+     const unsigned int  *indices;
+     unsigned int         num_indices;
+     unsigned int         first;
+     unsigned int         step;
+     FT2Prefetched      **results;
+} FT2PrefetchJob;
+
+static FT2Prefetched *
+rasterize_glyph( FT_Face       face,
+                 FT_Int        load_flags,
+                 unsigned int  index )
+{
+     FT2Prefetched *prefetched;
+     FT_GlyphSlot   slot = face->glyph;
+
+     if (FT_Load_Glyph( face, index, load_flags | FT_LOAD_RENDER ))
+          return NULL;
+
+     if (slot->format != ft_glyph_format_bitmap || slot->bitmap.pitch < 0)
+          return NULL;
+
+     prefetched = D_MALLOC( sizeof(FT2Prefetched) + slot->bitmap.pitch * slot->bitmap.rows );
+     if (!prefetched)
+          return NULL;
+
+     prefetched->bitmap        = slot->bitmap;
+     prefetched->bitmap.buffer = (unsigned char*) (prefetched + 1);
+     prefetched->left          = slot->bitmap_left;
+     prefetched->top           = slot->bitmap_top;
+     prefetched->advance       = slot->advance;
+
+     direct_memcpy( prefetched->bitmap.buffer, slot->bitmap.buffer, slot->bitmap.pitch * slot->bitmap.rows );
+
+     return prefetched;
+}
+
+static void *
+prefetch_worker( DirectThread *thread,
+                 void         *arg )
+{
+     unsigned int    i;
+     FT2PrefetchJob *job = arg;
+
+     for (i=job->first; i<job->num_indices; i+=job->step)
+          job->results[i] = rasterize_glyph( job->face, job->data->load_flags, job->indices[i] );
+
+     return NULL;
+}
+
+/*
+ * Creates additional instances of the face, each with its own library,
+ * to be used by one prefetch worker at a time.
+ */
+static int
+create_shards( FT2ImplData *data )
+{
+     int  i;
+     long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+     int  num  = MIN( cpus, FT2_MAX_SHARDS );
+
+     /* Nothing to gain on a single CPU. */
+     if (num < 2)
+          return 0;
+
+     for (i=0; i<num; i++) {
+          FT2Shard *shard = &data->shards[i];
+
+          if (FT_Init_FreeType( &shard->library ))
+               break;
+
+          if (FT_New_Memory_Face( shard->library, data->content, data->content_size, data->face_index, &shard->face )) {
+               FT_Done_FreeType( shard->library );
+               break;
+          }
+
+          if (data->transform)
+               FT_Set_Transform( shard->face, &data->matrix, NULL );
+
+          if ((data->char_width || data->char_height) &&
+              FT_Set_Char_Size( shard->face, data->char_width, data->char_height, 0, 0 ))
+          {
+               FT_Done_FreeType( shard->library );
+               break;
+          }
+     }
+
+     if (i < 2) {
+          while (i--)
+               FT_Done_FreeType( data->shards[i].library );
+
+          return 0;
+     }
+
+     D_DEBUG( "DirectFB/FontFT2: Using %d face instances for prefetching.\n", i );
+
+     return i;
+}
+
+static bool
+free_prefetched( DirectHash    *hash,
+                 unsigned long  key,
+                 void          *value,
+                 void          *ctx )
+{
+     D_FREE( value );
+
+     return true;
+}
+
+static DFBResult
+prefetch_glyphs( CoreFont           *thiz,
+                 const unsigned int *indices,
+                 unsigned int        num_indices )
+{
+     unsigned int     i;
+     unsigned int     num_jobs;
+     FT2PrefetchJob   jobs[FT2_MAX_SHARDS];
+     DirectThread    *threads[FT2_MAX_SHARDS];
+     FT2Prefetched  **results;
+     FT2ImplData     *data = thiz->impl_data;
+
+     pthread_mutex_lock( &data->prefetch_lock );
+
+     if (!data->num_shards) {
+          data->num_shards = create_shards( data );
+          if (!data->num_shards)
+               data->num_shards = -1;
+     }
+
+     if (data->num_shards < 0) {
+          pthread_mutex_unlock( &data->prefetch_lock );
+          return DFB_UNSUPPORTED;
+     }
+
+     results = D_CALLOC( num_indices, sizeof(FT2Prefetched*) );
+     if (!results) {
+          pthread_mutex_unlock( &data->prefetch_lock );
+          return D_OOM();
+     }
+
+     num_jobs = MIN( data->num_shards, num_indices );
+
+     /* Rasterize interleaved parts of the glyphs on each face instance... */
+     for (i=0; i<num_jobs; i++) {
+          jobs[i].data        = data;
+          jobs[i].face        = data->shards[i].face;
+          jobs[i].indices     = indices;
+          jobs[i].num_indices = num_indices;
+          jobs[i].first       = i;
+          jobs[i].step        = num_jobs;
+          jobs[i].results     = results;
+
+          threads[i] = direct_thread_create( DTT_DEFAULT, prefetch_worker, &jobs[i], "FT2 Prefetch" );
+          if (!threads[i])
+               prefetch_worker( NULL, &jobs[i] );
+     }
+
+     for (i=0; i<num_jobs; i++) {
+          if (threads[i]) {
+               direct_thread_join( threads[i] );
+               direct_thread_destroy( threads[i] );
+          }
+     }
+
+     /* ...and keep them until they're rendered into the glyph cache. */
+     pthread_mutex_lock( &data->lock );
+
+     /* Drop leftovers of earlier batches that never got rendered, e.g. if the cache was full. */
+     if (data->prefetched && direct_hash_count( data->prefetched ) + num_indices > FT2_MAX_PREFETCHED) {
+          direct_hash_iterate( data->prefetched, free_prefetched, NULL );
+          direct_hash_destroy( data->prefetched );
+
+          data->prefetched = NULL;
+     }
+
+     if (!data->prefetched && direct_hash_create( 163, &data->prefetched ))
+          data->prefetched = NULL;
+
+     for (i=0; i<num_indices; i++) {
+          if (!results[i])
+               continue;
+
+          if (!data->prefetched || direct_hash_count( data->prefetched ) >= FT2_MAX_PREFETCHED ||
+              direct_hash_lookup( data->prefetched, indices[i] ) ||
+              direct_hash_insert( data->prefetched, indices[i], results[i] ))
+               D_FREE( results[i] );
+     }
+
+     pthread_mutex_unlock( &data->lock );
+
+     pthread_mutex_unlock( &data->prefetch_lock );
+
+     D_FREE( results );
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+
 static DFBResult
 init_freetype( void )
 {
@@ -831,11 +1110,22 @@ IDirectFBFont_FT2_Destruct( IDirectFBFont *thiz )
      IDirectFBFont_data *data = (IDirectFBFont_data*)thiz->priv;
 
      if (data->font->impl_data) {
+          int          i;
           FT2ImplData *impl_data = (FT2ImplData*) data->font->impl_data;
 
-          pthread_mutex_lock ( &library_mutex );
+          for (i=0; i<impl_data->num_shards; i++)
+               FT_Done_FreeType( impl_data->shards[i].library );
+
+          if (impl_data->prefetched) {
+               direct_hash_iterate( impl_data->prefetched, free_prefetched, NULL );
+               direct_hash_destroy( impl_data->prefetched );
+          }
+
           FT_Done_Face( impl_data->face );
-          pthread_mutex_unlock ( &library_mutex );
+          FT_Done_FreeType( impl_data->library );
+
+          pthread_mutex_destroy( &impl_data->prefetch_lock );
+          pthread_mutex_destroy( &impl_data->lock );
 
           D_FREE( impl_data );
 
@@ -843,8 +1133,6 @@ IDirectFBFont_FT2_Destruct( IDirectFBFont *thiz )
      }
 
      IDirectFBFont_Destruct( thiz );
-
-     release_freetype();
 }
 
 
@@ -903,6 +1191,7 @@ Construct( IDirectFBFont               *thiz,
      int                 i;
      DFBResult           ret;
      CoreFont           *font;
+     FT_Library          font_library;
      FT_Face             face;
      FT_Error            err;
      FT_Int              load_flags = FT_LOAD_DEFAULT;
@@ -917,6 +1206,10 @@ Construct( IDirectFBFont               *thiz,
      float sin_rot = 0.0;
      float cos_rot = 1.0;
 
+     FT_Matrix  matrix    = { 0x10000, 0, 0, 0x10000 };
+     bool       transform = false;
+     int        fw = 0, fh = 0;
+
      D_DEBUG( "DirectFB/FontFT2: "
               "Construct font from file `%s' (index %d) at pixel size %d x %d and rotation %d.\n",
               filename,
@@ -925,16 +1218,18 @@ Construct( IDirectFBFont               *thiz,
               (desc->flags & DFDESC_HEIGHT)   ? desc->height   : 0,
               (desc->flags & DFDESC_ROTATION) ? desc->rotation : 0 );
 
-     if (init_freetype() != DFB_OK) {
+     /* Each font gets its own library instance to avoid serializing glyph loading of different fonts. */
+     err = FT_Init_FreeType( &font_library );
+     if (err) {
+          D_ERROR( "DirectFB/FontFT2: "
+                    "Initialization of the FreeType2 library failed!\n" );
           DIRECT_DEALLOCATE_INTERFACE( thiz );
           return DFB_FAILURE;
      }
 
-     pthread_mutex_lock ( &library_mutex );
-     err = FT_New_Memory_Face( library, ctx->content, ctx->content_size,
+     err = FT_New_Memory_Face( font_library, ctx->content, ctx->content_size,
                                (desc->flags & DFDESC_INDEX) ? desc->index : 0,
                                &face );
-     pthread_mutex_unlock ( &library_mutex );
      if (err) {
           switch (err) {
                case FT_Err_Unknown_File_Format:
@@ -948,6 +1243,7 @@ Construct( IDirectFBFont               *thiz,
                               filename );
                     break;
           }
+          FT_Done_FreeType( font_library );
           DIRECT_DEALLOCATE_INTERFACE( thiz );
           return DFB_FAILURE;
      }
@@ -958,9 +1254,8 @@ Construct( IDirectFBFont               *thiz,
                          "Face %d from font file `%s' is not scalable so cannot be rotated\n",
                          (desc->flags & DFDESC_INDEX) ? desc->index : 0,
                          filename );
-               pthread_mutex_lock ( &library_mutex );
                FT_Done_Face( face );
-               pthread_mutex_unlock ( &library_mutex );
+               FT_Done_FreeType( font_library );
                DIRECT_DEALLOCATE_INTERFACE( thiz );
                return DFB_UNSUPPORTED;
           }
@@ -971,17 +1266,16 @@ Construct( IDirectFBFont               *thiz,
 
           int sin_rot_fx = (int)(sin_rot*65536.0);
           int cos_rot_fx = (int)(cos_rot*65536.0);
-          FT_Matrix matrix;
           matrix.xx =  cos_rot_fx;
           matrix.xy = -sin_rot_fx;
           matrix.yx =  sin_rot_fx;
           matrix.yy =  cos_rot_fx;
 
-          pthread_mutex_lock ( &library_mutex );
           FT_Set_Transform( face, &matrix, NULL );
           /* FreeType docs suggest FT_Set_Transform returns an error code, but it seems
              that this is not the case. */
-          pthread_mutex_unlock ( &library_mutex );
+
+          transform = true;
      }
 
      if (dfb_config->font_format == DSPF_A1 ||
@@ -1020,9 +1314,7 @@ Construct( IDirectFBFont               *thiz,
           load_flags |= FT_LOAD_TARGET_MONO;
 
      if (!disable_charmap) {
-          pthread_mutex_lock ( &library_mutex );
           err = FT_Select_Charmap( face, ft_encoding_unicode );
-          pthread_mutex_unlock ( &library_mutex );
 
 #if FREETYPE_MINOR > 0
 
@@ -1031,18 +1323,14 @@ Construct( IDirectFBFont               *thiz,
                D_DEBUG( "DirectFB/FontFT2: "
                         "Couldn't select Unicode encoding, "
                         "falling back to Latin1.\n");
-               pthread_mutex_lock ( &library_mutex );
                err = FT_Select_Charmap( face, ft_encoding_latin_1 );
-               pthread_mutex_unlock ( &library_mutex );
           }
 #endif
           if (err) {
                D_DEBUG( "DirectFB/FontFT2: "
                         "Couldn't select Unicode/Latin1 encoding, "
                         "trying Symbol.\n");
-               pthread_mutex_lock ( &library_mutex );
                err = FT_Select_Charmap( face, ft_encoding_symbol );
-               pthread_mutex_unlock ( &library_mutex );
 
                if (!err)
                     mask = 0xf000;
@@ -1064,8 +1352,6 @@ Construct( IDirectFBFont               *thiz,
      if (desc->flags & (DFDESC_HEIGHT       | DFDESC_WIDTH |
                         DFDESC_FRACT_HEIGHT | DFDESC_FRACT_WIDTH))
      {
-          int fw = 0, fh = 0;
-
           if (desc->flags & DFDESC_FRACT_HEIGHT)
                fh = desc->fract_height;
           else if (desc->flags & DFDESC_HEIGHT)
@@ -1076,17 +1362,14 @@ Construct( IDirectFBFont               *thiz,
           else if (desc->flags & DFDESC_WIDTH)
                fw = desc->width << 6;
 
-          pthread_mutex_lock ( &library_mutex );
           err = FT_Set_Char_Size( face, fw, fh, 0, 0 );
-          pthread_mutex_unlock ( &library_mutex );
           if (err) {
                D_ERROR( "DirectB/FontFT2: "
                          "Could not set pixel size to %d x %d!\n",
                          (desc->flags & DFDESC_WIDTH)  ? desc->width  : 0,
                          (desc->flags & DFDESC_HEIGHT) ? desc->height : 0 );
-               pthread_mutex_lock ( &library_mutex );
                FT_Done_Face( face );
-               pthread_mutex_unlock ( &library_mutex );
+               FT_Done_FreeType( font_library );
                DIRECT_DEALLOCATE_INTERFACE( thiz );
                return DFB_FAILURE;
           }
@@ -1097,9 +1380,8 @@ Construct( IDirectFBFont               *thiz,
 
      ret = dfb_font_create( core, desc, filename, &font );
      if (ret) {
-          pthread_mutex_lock ( &library_mutex );
           FT_Done_Face( face );
-          pthread_mutex_unlock ( &library_mutex );
+          FT_Done_FreeType( font_library );
           DIRECT_DEALLOCATE_INTERFACE( thiz );
           return ret;
      }
@@ -1133,8 +1415,9 @@ Construct( IDirectFBFont               *thiz,
      D_DEBUG( "DirectFB/FontFT2: height = %d, ascender = %d, descender = %d, maxadvance = %d, up unit: %5.2f,%5.2f\n",
               font->height, font->ascender, font->descender, font->maxadvance, font->up_unit_x, font->up_unit_y );
 
-     font->GetGlyphData = get_glyph_info;
-     font->RenderGlyph  = render_glyph;
+     font->GetGlyphData   = get_glyph_info;
+     font->RenderGlyph    = render_glyph;
+     font->PrefetchGlyphs = prefetch_glyphs;
 
      if (FT_HAS_KERNING(face) && !disable_kerning) {
           font->GetKerning = get_kerning;
@@ -1143,9 +1426,22 @@ Construct( IDirectFBFont               *thiz,
      else
           data = D_CALLOC( 1, sizeof(FT2ImplData) );
 
+     data->library         = font_library;
      data->face            = face;
+     data->load_flags      = load_flags;
+     data->content         = ctx->content;
+     data->content_size    = ctx->content_size;
+     data->face_index      = (desc->flags & DFDESC_INDEX) ? desc->index : 0;
+     data->char_width      = fw;
+     data->char_height     = fh;
+     data->transform       = transform;
+     data->matrix          = matrix;
      data->disable_charmap = disable_charmap;
 
+     direct_util_recursive_pthread_mutex_init( &data->lock );
+
+     pthread_mutex_init( &data->prefetch_lock, NULL );
+
      if (attributes & DFFA_OUTLINED) {
           if (desc->flags & DFDESC_OUTLINE_WIDTH)
                data->outline_radius = 1 + (desc->outline_width >> 16) * 2;
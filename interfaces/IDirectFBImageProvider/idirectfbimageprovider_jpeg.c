@@ -39,18 +39,21 @@
 
 #include <display/idirectfbsurface.h>
 
+#include <media/idirectfbdatabuffer.h>
 #include <media/idirectfbimageprovider.h>
 
 #include <core/layers.h>
 
 #include <core/CoreSurface.h>
 
+#include <misc/conf.h>
 #include <misc/gfx_util.h>
 #include <misc/util.h>
 #include <direct/interface.h>
 #include <direct/mem.h>
 #include <direct/memcpy.h>
 #include <direct/messages.h>
+#include <direct/thread.h>
 
 #include <setjmp.h>
 #include <math.h>
@@ -58,6 +61,7 @@
 #undef HAVE_STDLIB_H
 #include <jpeglib.h>
 
+D_DEBUG_DOMAIN( imageProviderJPEG, "ImageProvider/JPEG", "libjpeg based image decoder" );
 
 static DFBResult
 Probe( IDirectFBImageProvider_ProbeContext *ctx );
@@ -184,10 +188,43 @@ buffer_term_source (j_decompress_ptr cinfo)
      D_UNUSED_P( cinfo );
 }
 
+static void
+memory_init_source (j_decompress_ptr cinfo)
+{
+     D_UNUSED_P( cinfo );
+}
+
+static boolean
+memory_fill_input_buffer (j_decompress_ptr cinfo)
+{
+     static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+     /* Insert a fake EOI marker after the end of the data */
+     cinfo->src->next_input_byte = eoi;
+     cinfo->src->bytes_in_buffer = 2;
+
+     return TRUE;
+}
+
+static void
+memory_skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+     if (num_bytes > 0) {
+          if (num_bytes > (long) cinfo->src->bytes_in_buffer) {
+               (void)memory_fill_input_buffer(cinfo);
+          }
+          else {
+               cinfo->src->next_input_byte += (size_t) num_bytes;
+               cinfo->src->bytes_in_buffer -= (size_t) num_bytes;
+          }
+     }
+}
+
 static void
 jpeg_buffer_src (j_decompress_ptr cinfo, IDirectFBDataBuffer *buffer, int peekonly)
 {
-     buffer_src_ptr src;
+     buffer_src_ptr            src;
+     IDirectFBDataBuffer_data *buffer_data = buffer->priv;
 
      cinfo->src = (struct jpeg_source_mgr *)
                   cinfo->mem->alloc_small ((j_common_ptr) cinfo, JPOOL_PERMANENT,
@@ -195,6 +232,20 @@ jpeg_buffer_src (j_decompress_ptr cinfo, IDirectFBDataBuffer *buffer, int peekon
 
      src = (buffer_src_ptr) cinfo->src;
 
+     /* Decode right from memory or the mapped file, neither reading nor consuming the buffer. */
+     if (buffer_data && buffer_data->content) {
+          src->buffer = buffer;
+
+          src->pub.init_source       = memory_init_source;
+          src->pub.fill_input_buffer = memory_fill_input_buffer;
+          src->pub.skip_input_data   = memory_skip_input_data;
+          src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
+          src->pub.term_source       = buffer_term_source;
+          src->pub.bytes_in_buffer   = buffer_data->content_length;
+          src->pub.next_input_byte   = buffer_data->content;
+          return;
+     }
+
      src->data = (JOCTET *)
                   cinfo->mem->alloc_small ((j_common_ptr) cinfo, JPOOL_PERMANENT,
                                            JPEG_PROG_BUF_SIZE * sizeof (JOCTET));
@@ -293,6 +344,688 @@ copy_line_uyvy( u32 *uyvy, const u8 *src_ycbcr, int width )
 }
 
 
+/**********************************************************************************************************************/
+
+/*
+ * Parallel decoding
+ *
+ * Images with restart markers at MCU row boundaries are split into bands of whole MCU rows, each decoded
+ * by a worker thread from a copy of the headers, patched to the height of the band, followed by the band's
+ * entropy coded data with renumbered restart markers. Chroma upsampling does not look across the band
+ * boundaries, which may slightly change the pixels next to them.
+ *
+ * Other images are decoded by libjpeg in a worker thread while RenderTo() converts and writes the rows.
+ */
+
+#define JPEG_PARALLEL_MIN_PIXELS   (256 * 256)    /* smaller images are decoded serially */
+#define JPEG_BANDS_PER_THREAD      4              /* for balancing bands that decode faster than others */
+#define JPEG_PIPELINE_SLOTS        4
+#define JPEG_PIPELINE_ROWS         16
+
+typedef struct {
+     JOCTET                        *data;         /* headers, entropy coded data and EOI of the band */
+     unsigned int                   length;
+
+     int                            y;            /* first output row */
+     int                            height;       /* number of output rows, known after decoding */
+     bool                           done;
+} JPEGBand;
+
+typedef struct {
+     DirectMutex                    lock;
+     DirectWaitQueue                cond;
+
+     JPEGBand                      *bands;
+     int                            num_bands;
+     int                            next;         /* next band to be decoded */
+     bool                           failed;
+     bool                           abort;
+
+     J_COLOR_SPACE                  jpeg_color_space;
+     unsigned int                   scale_num;
+     unsigned int                   scale_denom;
+     J_DCT_METHOD                   dct_method;
+
+     u32                           *image;
+     int                            width;
+     int                            height;
+} JPEGBandDecoder;
+
+typedef struct {
+     DirectMutex                    lock;
+     DirectWaitQueue                cond;
+
+     struct jpeg_decompress_struct *cinfo;
+     struct my_error_mgr           *jerr;
+     jmp_buf                        setjmp_buffer; /* return point of RenderTo(), while the worker uses jerr */
+
+     JSAMPARRAY                     slots[JPEG_PIPELINE_SLOTS];
+     int                            rows[JPEG_PIPELINE_SLOTS];    /* number of rows decoded into each slot */
+     unsigned int                   produced;     /* number of slots filled by the decoder */
+     unsigned int                   consumed;     /* number of slots released by RenderTo() */
+     int                            row;          /* next row in the slot being consumed */
+     bool                           done;
+     bool                           failed;
+     bool                           abort;
+
+     DirectThread                  *thread;
+} JPEGPipeline;
+
+static void
+jpeg_memory_src( j_decompress_ptr cinfo, const JOCTET *data, unsigned int length )
+{
+     cinfo->src = (struct jpeg_source_mgr *)
+                  cinfo->mem->alloc_small ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+                                           sizeof (struct jpeg_source_mgr));
+
+     cinfo->src->init_source       = memory_init_source;
+     cinfo->src->fill_input_buffer = memory_fill_input_buffer;
+     cinfo->src->skip_input_data   = memory_skip_input_data;
+     cinfo->src->resync_to_restart = jpeg_resync_to_restart; /* use default method */
+     cinfo->src->term_source       = buffer_term_source;
+     cinfo->src->bytes_in_buffer   = length;
+     cinfo->src->next_input_byte   = data;
+}
+
+/* Returns the offset of the next marker in entropy coded data, skipping stuffed zero and fill bytes. */
+static unsigned int
+find_marker( const JOCTET *data, unsigned int pos, unsigned int length )
+{
+     while (pos + 1 < length) {
+          if (data[pos] == 0xFF && data[pos+1] != 0x00 && data[pos+1] != 0xFF)
+               return pos;
+
+          pos++;
+     }
+
+     return length;
+}
+
+static int
+gcd( int a, int b )
+{
+     while (b) {
+          int t = a % b;
+
+          a = b;
+          b = t;
+     }
+
+     return a;
+}
+
+/*
+ * Splits a sequential image with restart markers at MCU row boundaries into bands.
+ *
+ * Returns DFB_UNSUPPORTED if the image cannot be split.
+ */
+static DFBResult
+split_bands( JPEGBandDecoder               *dec,
+             struct jpeg_decompress_struct *cinfo,
+             const JOCTET                  *content,
+             unsigned int                   length,
+             int                            max_bands )
+{
+     unsigned int  pos = 2;
+     unsigned int  sof = 0;
+     unsigned int  sos_end;
+     unsigned int  end;
+     unsigned int *starts;
+     int           mcu_width, mcu_height;
+     int           mcus_per_row, mcu_rows;
+     int           group, group_markers, num_groups;
+     int           num_markers = 0;
+     int           i;
+
+     if (cinfo->progressive_mode || cinfo->arith_code || !cinfo->restart_interval ||
+         cinfo->comps_in_scan != cinfo->num_components)
+          return DFB_UNSUPPORTED;
+
+     if (cinfo->comps_in_scan == 1) {
+          mcu_width  = DCTSIZE;
+          mcu_height = DCTSIZE;
+     }
+     else {
+          mcu_width  = cinfo->max_h_samp_factor * DCTSIZE;
+          mcu_height = cinfo->max_v_samp_factor * DCTSIZE;
+     }
+
+     mcus_per_row = (cinfo->image_width  + mcu_width  - 1) / mcu_width;
+     mcu_rows     = (cinfo->image_height + mcu_height - 1) / mcu_height;
+
+     /* Number of MCU rows from one restart marker at a row boundary to the next one. */
+     group         = cinfo->restart_interval / gcd( cinfo->restart_interval, mcus_per_row );
+     group_markers = group * mcus_per_row / cinfo->restart_interval;
+     num_groups    = (mcu_rows + group - 1) / group;
+
+     if (num_groups < 2)
+          return DFB_UNSUPPORTED;
+
+     /* Find the frame header and the end of the scan header. */
+     while (true) {
+          int marker;
+
+          if (pos + 4 > length || content[pos] != 0xFF)
+               return DFB_UNSUPPORTED;
+
+          marker = content[pos+1];
+          if (marker == 0xFF) {
+               pos++;
+               continue;
+          }
+
+          if (marker == 0xC0 || marker == 0xC1)  /* SOF0, SOF1 */
+               sof = pos;
+
+          pos += 2 + ((content[pos+2] << 8) | content[pos+3]);
+
+          if (marker == 0xDA)                    /* SOS */
+               break;
+     }
+
+     sos_end = pos;
+
+     if (!sof || sos_end >= length)
+          return DFB_UNSUPPORTED;
+
+     /* Find the restart markers at the group boundaries. */
+     starts = D_CALLOC( num_groups, sizeof(unsigned int) );
+     if (!starts)
+          return D_OOM();
+
+     end = sos_end;
+
+     while ((end = find_marker( content, end, length )) < length) {
+          if (content[end+1] < 0xD0 || content[end+1] > 0xD7)
+               break;
+
+          num_markers++;
+
+          if (num_markers % group_markers == 0 && num_markers / group_markers < num_groups)
+               starts[num_markers / group_markers] = end;
+
+          end += 2;
+     }
+
+     if (num_markers < (num_groups - 1) * group_markers) {
+          D_FREE( starts );
+          return DFB_UNSUPPORTED;
+     }
+
+     dec->num_bands = MIN( num_groups, max_bands );
+     dec->bands     = D_CALLOC( dec->num_bands, sizeof(JPEGBand) );
+     if (!dec->bands) {
+          D_FREE( starts );
+          return D_OOM();
+     }
+
+     for (i = 0; i < dec->num_bands; i++) {
+          JPEGBand     *band  = &dec->bands[i];
+          int           first = i       * num_groups / dec->num_bands;
+          int           last  = (i + 1) * num_groups / dec->num_bands;
+          int           row   = first * group * mcu_height;
+          int           rows  = MIN( last * group * mcu_height, (int) cinfo->image_height ) - row;
+          unsigned int  from  = first ? starts[first] + 2 : sos_end;
+          unsigned int  to    = (last < num_groups) ? starts[last] : end;
+          unsigned int  n     = 0;
+
+          band->length = sos_end + (to - from) + 2;
+          band->data   = D_MALLOC( band->length );
+          if (!band->data) {
+               D_FREE( starts );
+               return D_OOM();
+          }
+
+          direct_memcpy( band->data, content, sos_end );
+          direct_memcpy( band->data + sos_end, content + from, to - from );
+
+          band->data[band->length-2] = 0xFF;
+          band->data[band->length-1] = JPEG_EOI;
+
+          /* Patch the frame height. */
+          band->data[sof+5] = rows >> 8;
+          band->data[sof+6] = rows & 0xFF;
+
+          /* Renumber the restart markers starting from zero. */
+          pos = sos_end;
+
+          while ((pos = find_marker( band->data, pos, band->length - 2 )) < band->length - 2) {
+               band->data[pos+1] = 0xD0 + (n++ & 7);
+
+               pos += 2;
+          }
+
+          band->y = row * cinfo->scale_num / cinfo->scale_denom;
+     }
+
+     D_FREE( starts );
+
+     return DFB_OK;
+}
+
+static bool
+decode_band( JPEGBandDecoder *dec, JPEGBand *band )
+{
+     struct jpeg_decompress_struct cinfo;
+     struct my_error_mgr           jerr;
+     JSAMPARRAY                    buffer;
+     u32                          *row_ptr;
+
+     cinfo.err = jpeg_std_error( &jerr.pub );
+     jerr.pub.error_exit = jpeglib_panic;
+
+     if (setjmp( jerr.setjmp_buffer )) {
+          D_ERROR( "ImageProvider/JPEG: Error during decoding of band at %d!\n", band->y );
+
+          jpeg_destroy_decompress( &cinfo );
+
+          return false;
+     }
+
+     jpeg_create_decompress( &cinfo );
+     jpeg_memory_src( &cinfo, band->data, band->length );
+     jpeg_read_header( &cinfo, TRUE );
+
+     cinfo.jpeg_color_space  = dec->jpeg_color_space;
+     cinfo.out_color_space   = JCS_RGB;
+     cinfo.output_components = 3;
+     cinfo.scale_num         = dec->scale_num;
+     cinfo.scale_denom       = dec->scale_denom;
+     cinfo.dct_method        = dec->dct_method;
+
+     jpeg_start_decompress( &cinfo );
+
+     if (cinfo.output_width != (unsigned) dec->width || band->y + (int) cinfo.output_height > dec->height) {
+          D_ERROR( "ImageProvider/JPEG: Unexpected size %ux%u of band at %d!\n",
+                   cinfo.output_width, cinfo.output_height, band->y );
+
+          jpeg_destroy_decompress( &cinfo );
+
+          return false;
+     }
+
+     buffer = (*cinfo.mem->alloc_sarray)( (j_common_ptr) &cinfo,
+                                          JPOOL_IMAGE, cinfo.output_width * 3, 1 );
+
+     row_ptr = dec->image + band->y * dec->width;
+
+     while (cinfo.output_scanline < cinfo.output_height && !dec->abort) {
+          jpeg_read_scanlines( &cinfo, buffer, 1 );
+
+          copy_line32( row_ptr, *buffer, dec->width );
+
+          row_ptr += dec->width;
+     }
+
+     band->height = cinfo.output_height;
+
+     if (dec->abort)
+          jpeg_abort_decompress( &cinfo );
+     else
+          jpeg_finish_decompress( &cinfo );
+
+     jpeg_destroy_decompress( &cinfo );
+
+     return true;
+}
+
+static void *
+band_decoder_main( DirectThread *thread, void *arg )
+{
+     JPEGBandDecoder *dec = arg;
+
+     D_UNUSED_P( thread );
+
+     direct_mutex_lock( &dec->lock );
+
+     while (!dec->abort && dec->next < dec->num_bands) {
+          JPEGBand *band = &dec->bands[dec->next++];
+          bool      ok;
+
+          direct_mutex_unlock( &dec->lock );
+
+          ok = decode_band( dec, band );
+
+          direct_mutex_lock( &dec->lock );
+
+          if (!ok)
+               dec->failed = true;
+
+          band->done = true;
+
+          direct_waitqueue_broadcast( &dec->cond );
+     }
+
+     direct_mutex_unlock( &dec->lock );
+
+     return NULL;
+}
+
+/*
+ * Decodes the image in bands on multiple threads, writing each band to the destination as it
+ * is done if there's no scaling, otherwise scaling the whole image afterwards.
+ * Progress is reported for what has been written to the destination.
+ *
+ * Returns DFB_UNSUPPORTED if the image cannot be split, leaving the decompressor untouched.
+ */
+static DFBResult
+render_bands( IDirectFBImageProvider_JPEG_data *data,
+              struct jpeg_decompress_struct    *cinfo,
+              bool                              direct,
+              CoreSurface                      *dst_surface,
+              CoreSurfaceBufferLock            *lock,
+              const DFBRectangle               *rect,
+              const DFBRegion                  *clip )
+{
+     DFBResult                 ret;
+     JPEGBandDecoder           dec;
+     IDirectFBDataBuffer_data *buffer_data = data->base.buffer->priv;
+     DIRenderCallbackResult    cb_result   = DIRCR_OK;
+     DirectThread             *threads[DFB_JPEG_DECODE_THREADS_MAX];
+     int                       num_threads = 0;
+     int                       i;
+
+     if (!buffer_data || !buffer_data->content)
+          return DFB_UNSUPPORTED;
+
+     memset( &dec, 0, sizeof(dec) );
+
+     ret = split_bands( &dec, cinfo, buffer_data->content, buffer_data->content_length,
+                        dfb_config->jpeg_decode_threads * JPEG_BANDS_PER_THREAD );
+     if (ret)
+          goto out;
+
+     D_DEBUG_AT( imageProviderJPEG, "%s( %ux%u ) <- %d bands, %d threads\n", __FUNCTION__,
+                 cinfo->output_width, cinfo->output_height, dec.num_bands, dfb_config->jpeg_decode_threads );
+
+     dec.jpeg_color_space = cinfo->jpeg_color_space;
+     dec.scale_num        = cinfo->scale_num;
+     dec.scale_denom      = cinfo->scale_denom;
+     dec.dct_method       = cinfo->dct_method;
+     dec.width            = cinfo->output_width;
+     dec.height           = cinfo->output_height;
+
+     dec.image = D_CALLOC( dec.height, dec.width * 4 );
+     if (!dec.image) {
+          ret = D_OOM();
+          goto out;
+     }
+
+     direct_mutex_init( &dec.lock );
+     direct_waitqueue_init( &dec.cond );
+
+     D_ASSERT( dfb_config->jpeg_decode_threads <= DFB_JPEG_DECODE_THREADS_MAX );
+
+     for (i = 0; i < MIN( dfb_config->jpeg_decode_threads, dec.num_bands ); i++) {
+          threads[num_threads] = direct_thread_create( DTT_DEFAULT, band_decoder_main, &dec, "JPEG Decoder" );
+          if (threads[num_threads])
+               num_threads++;
+     }
+
+     if (!num_threads)
+          band_decoder_main( NULL, &dec );
+
+     /* Write and report the bands in order. */
+     for (i = 0; i < dec.num_bands && cb_result == DIRCR_OK; i++) {
+          JPEGBand *band = &dec.bands[i];
+
+          direct_mutex_lock( &dec.lock );
+
+          while (!band->done)
+               direct_waitqueue_wait( &dec.cond, &dec.lock );
+
+          direct_mutex_unlock( &dec.lock );
+
+          if (!band->height)
+               continue;
+
+          /* Without scaling, write and report each band right away. */
+          if (direct) {
+               DFBRectangle r = { rect->x, rect->y + band->y, rect->w, band->height };
+
+               dfb_copy_buffer_32( dec.image + band->y * dec.width, lock->addr, lock->pitch,
+                                   &r, dst_surface, clip );
+
+               if (data->base.render_callback) {
+                    r = (DFBRectangle) { 0, band->y, dec.width, band->height };
+
+                    cb_result = data->base.render_callback( &r, data->base.render_callback_context );
+               }
+          }
+     }
+
+     direct_mutex_lock( &dec.lock );
+
+     if (cb_result != DIRCR_OK)
+          dec.abort = true;
+
+     direct_mutex_unlock( &dec.lock );
+
+     for (i = 0; i < num_threads; i++) {
+          direct_thread_join( threads[i] );
+          direct_thread_destroy( threads[i] );
+     }
+
+     direct_waitqueue_deinit( &dec.cond );
+     direct_mutex_deinit( &dec.lock );
+
+     if (cb_result != DIRCR_OK) {
+          D_FREE( dec.image );
+          ret = DFB_INTERRUPTED;
+          goto out;
+     }
+
+     if (direct) {
+          /* Keep the image for rendering it again at the same size. */
+          data->image        = dec.image;
+          data->image_width  = dec.width;
+          data->image_height = dec.height;
+     }
+     else {
+          DFBRowScaler scaler;
+
+          if (dec.width >= rect->w && dec.height >= rect->h &&
+              dfb_row_scaler_init( &scaler, dec.width, dec.height,
+                                   lock->addr, lock->pitch, rect, dst_surface, clip ) == DFB_OK)
+          {
+               for (i = 0; i < dec.height; i++)
+                    dfb_row_scaler_push( &scaler, dec.image + i * dec.width );
+
+               dfb_row_scaler_deinit( &scaler );
+          }
+          else {
+               DFBRectangle r = *rect;
+
+               dfb_scale_linear_32( dec.image, dec.width, dec.height,
+                                    lock->addr, lock->pitch, &r, dst_surface, clip );
+          }
+
+          D_FREE( dec.image );
+
+          if (data->base.render_callback) {
+               DFBRectangle r = { 0, 0, dec.width, dec.height };
+
+               cb_result = data->base.render_callback( &r, data->base.render_callback_context );
+          }
+     }
+
+     if (cb_result != DIRCR_OK)
+          ret = DFB_INTERRUPTED;
+     else
+          ret = dec.failed ? DFB_INCOMPLETE : DFB_OK;
+
+out:
+     for (i = 0; i < dec.num_bands; i++) {
+          if (dec.bands[i].data)
+               D_FREE( dec.bands[i].data );
+     }
+
+     if (dec.bands)
+          D_FREE( dec.bands );
+
+     return ret;
+}
+
+static void *
+pipeline_main( DirectThread *thread, void *arg )
+{
+     JPEGPipeline                  *pipeline = arg;
+     struct jpeg_decompress_struct *cinfo    = pipeline->cinfo;
+
+     D_UNUSED_P( thread );
+
+     if (setjmp( pipeline->jerr->setjmp_buffer )) {
+          D_ERROR( "ImageProvider/JPEG: Error during decoding!\n" );
+
+          direct_mutex_lock( &pipeline->lock );
+
+          pipeline->failed = true;
+          pipeline->done   = true;
+
+          direct_waitqueue_broadcast( &pipeline->cond );
+          direct_mutex_unlock( &pipeline->lock );
+
+          return NULL;
+     }
+
+     while (cinfo->output_scanline < cinfo->output_height) {
+          int slot;
+          int n = 0;
+
+          direct_mutex_lock( &pipeline->lock );
+
+          while (!pipeline->abort && pipeline->produced - pipeline->consumed == JPEG_PIPELINE_SLOTS)
+               direct_waitqueue_wait( &pipeline->cond, &pipeline->lock );
+
+          if (pipeline->abort) {
+               direct_mutex_unlock( &pipeline->lock );
+               break;
+          }
+
+          slot = pipeline->produced % JPEG_PIPELINE_SLOTS;
+
+          direct_mutex_unlock( &pipeline->lock );
+
+          while (n < JPEG_PIPELINE_ROWS && cinfo->output_scanline < cinfo->output_height)
+               n += jpeg_read_scanlines( cinfo, pipeline->slots[slot] + n, JPEG_PIPELINE_ROWS - n );
+
+          direct_mutex_lock( &pipeline->lock );
+
+          pipeline->rows[slot] = n;
+          pipeline->produced++;
+
+          direct_waitqueue_broadcast( &pipeline->cond );
+          direct_mutex_unlock( &pipeline->lock );
+     }
+
+     if (pipeline->abort)
+          jpeg_abort_decompress( cinfo );
+     else
+          jpeg_finish_decompress( cinfo );
+
+     direct_mutex_lock( &pipeline->lock );
+
+     pipeline->done = true;
+
+     direct_waitqueue_broadcast( &pipeline->cond );
+     direct_mutex_unlock( &pipeline->lock );
+
+     return NULL;
+}
+
+/*
+ * Starts decoding in a worker thread, which from now on is the only one to use the decompressor
+ * until pipeline_stop() is called.
+ */
+static DFBResult
+pipeline_start( JPEGPipeline                  *pipeline,
+                struct jpeg_decompress_struct *cinfo,
+                struct my_error_mgr           *jerr )
+{
+     int i;
+
+     memset( pipeline, 0, sizeof(JPEGPipeline) );
+
+     pipeline->cinfo = cinfo;
+     pipeline->jerr  = jerr;
+
+     /* The worker sets its own return point for errors, keep the one of the calling thread. */
+     memcpy( pipeline->setjmp_buffer, jerr->setjmp_buffer, sizeof(jmp_buf) );
+
+     for (i = 0; i < JPEG_PIPELINE_SLOTS; i++)
+          pipeline->slots[i] = (*cinfo->mem->alloc_sarray)( (j_common_ptr) cinfo, JPOOL_PERMANENT,
+                                                            cinfo->output_width * 3, JPEG_PIPELINE_ROWS );
+
+     direct_mutex_init( &pipeline->lock );
+     direct_waitqueue_init( &pipeline->cond );
+
+     pipeline->thread = direct_thread_create( DTT_DEFAULT, pipeline_main, pipeline, "JPEG Decoder" );
+     if (!pipeline->thread) {
+          direct_waitqueue_deinit( &pipeline->cond );
+          direct_mutex_deinit( &pipeline->lock );
+          return DFB_FAILURE;
+     }
+
+     return DFB_OK;
+}
+
+/* Returns the next decoded row or NULL at the end of the image or after an error. */
+static JSAMPROW
+pipeline_get_row( JPEGPipeline *pipeline )
+{
+     JSAMPROW row = NULL;
+
+     direct_mutex_lock( &pipeline->lock );
+
+     /* Release the slot after its last row has been converted. */
+     if (pipeline->produced != pipeline->consumed &&
+         pipeline->row == pipeline->rows[pipeline->consumed % JPEG_PIPELINE_SLOTS])
+     {
+          pipeline->consumed++;
+          pipeline->row = 0;
+
+          direct_waitqueue_broadcast( &pipeline->cond );
+     }
+
+     while (pipeline->produced == pipeline->consumed && !pipeline->done)
+          direct_waitqueue_wait( &pipeline->cond, &pipeline->lock );
+
+     if (pipeline->produced != pipeline->consumed)
+          row = pipeline->slots[pipeline->consumed % JPEG_PIPELINE_SLOTS][pipeline->row++];
+
+     direct_mutex_unlock( &pipeline->lock );
+
+     return row;
+}
+
+/* Stops the worker thread, returns true if the image has been decoded without errors. */
+static bool
+pipeline_stop( JPEGPipeline *pipeline, bool abort )
+{
+     direct_mutex_lock( &pipeline->lock );
+
+     if (abort)
+          pipeline->abort = true;
+
+     direct_waitqueue_broadcast( &pipeline->cond );
+     direct_mutex_unlock( &pipeline->lock );
+
+     direct_thread_join( pipeline->thread );
+     direct_thread_destroy( pipeline->thread );
+
+     direct_waitqueue_deinit( &pipeline->cond );
+     direct_mutex_deinit( &pipeline->lock );
+
+     pipeline->thread = NULL;
+
+     /* Errors of the decompressor return to the calling thread again. */
+     memcpy( pipeline->jerr->setjmp_buffer, pipeline->setjmp_buffer, sizeof(jmp_buf) );
+
+     return !pipeline->failed;
+}
+
+/**********************************************************************************************************************/
+
 static void
 IDirectFBImageProvider_JPEG_Destruct( IDirectFBImageProvider *thiz )
 {
@@ -414,6 +1147,7 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
 {
      DFBResult              ret;
      bool                   direct = false;
+     bool                   incomplete = false;
      DFBRegion              clip;
      DFBRectangle           rect;
      DFBSurfacePixelFormat  format;
@@ -474,6 +1208,12 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
           u32 *row_ptr;
           int y = 0;
           int uv_offset = 0;
+          DFBRowScaler scaler;    /* Downscaling while decoding */
+          JPEGPipeline pipeline;  /* Decoding in another thread */
+          bool parallel;
+          bool pipelined = false;
+
+          memset( &scaler, 0, sizeof(scaler) );
 
           cinfo.err = jpeg_std_error(&jerr.pub);
           jerr.pub.error_exit = jpeglib_panic;
@@ -483,6 +1223,12 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
 
                jpeg_destroy_decompress( &cinfo );
 
+               if (scaler.accum) {
+                    dfb_row_scaler_deinit( &scaler );
+                    dfb_surface_unlock_buffer( dst_surface, &lock );
+                    return DFB_INCOMPLETE;
+               }
+
                if (data->image) {
                     dfb_scale_linear_32( data->image, data->image_width, data->image_height,
                                          lock.addr, lock.pitch, &rect, dst_surface, &clip );
@@ -519,7 +1265,7 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
           if (cinfo.output_width == (unsigned)rect.w && cinfo.output_height == (unsigned)rect.h) {
                direct = true;
           }
-          else if (rect.x == 0 && rect.y == 0) {
+          else {
 #if JPEG_LIB_VERSION >= 70
                /*  The supported scaling ratios in libjpeg 7 and 8
                 *  are N/8 with all N from 1 to 16.
@@ -580,6 +1326,18 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
           if (data->flags & DIRENDER_FAST)
                cinfo.dct_method = JDCT_IFAST;
 
+          parallel = dfb_config->jpeg_decode_threads > 1 &&
+                     cinfo.output_width * cinfo.output_height >= JPEG_PARALLEL_MIN_PIXELS;
+
+          if (parallel && cinfo.out_color_space == JCS_RGB) {
+               ret = render_bands( data, &cinfo, direct, dst_surface, &lock, &rect, &clip );
+               if (ret != DFB_UNSUPPORTED) {
+                    jpeg_destroy_decompress( &cinfo );
+                    dfb_surface_unlock_buffer( dst_surface, &lock );
+                    return ret;
+               }
+          }
+
           jpeg_start_decompress( &cinfo );
 
           data->image_width = cinfo.output_width;
@@ -590,15 +1348,45 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
           buffer = (*cinfo.mem->alloc_sarray)( (j_common_ptr) &cinfo,
                                                JPOOL_IMAGE, row_stride, 1 );
 
-          data->image = D_CALLOC( data->image_height, data->image_width * 4 );
-          if (!data->image) {
-               dfb_surface_unlock_buffer( dst_surface, &lock );
-               return D_OOM();
+          /*
+           * Downscaling is done while decoding, without keeping the image at the decoded size.
+           */
+          if (!direct && cinfo.output_width >= (unsigned)rect.w && cinfo.output_height >= (unsigned)rect.h) {
+               ret = dfb_row_scaler_init( &scaler, cinfo.output_width, cinfo.output_height,
+                                          lock.addr, lock.pitch, &rect, dst_surface, &clip );
+               if (ret) {
+                    jpeg_destroy_decompress( &cinfo );
+                    dfb_surface_unlock_buffer( dst_surface, &lock );
+                    return ret;
+               }
+
+               row_ptr = (*cinfo.mem->alloc_large)( (j_common_ptr) &cinfo,
+                                                    JPOOL_PERMANENT, data->image_width * 4 );
+          }
+          else {
+               data->image = D_CALLOC( data->image_height, data->image_width * 4 );
+               if (!data->image) {
+                    dfb_surface_unlock_buffer( dst_surface, &lock );
+                    return D_OOM();
+               }
+               row_ptr = data->image;
           }
-          row_ptr = data->image;
 
-          while (cinfo.output_scanline < cinfo.output_height && cb_result == DIRCR_OK) {
-               jpeg_read_scanlines( &cinfo, buffer, 1 );
+          if (parallel && pipeline_start( &pipeline, &cinfo, &jerr ) == DFB_OK)
+               pipelined = true;
+
+          while (y < data->image_height && cb_result == DIRCR_OK) {
+               JSAMPROW line;
+
+               if (pipelined) {
+                    line = pipeline_get_row( &pipeline );
+                    if (!line)
+                         break;
+               }
+               else {
+                    jpeg_read_scanlines( &cinfo, buffer, 1 );
+                    line = *buffer;
+               }
 
                switch (dst_surface->config.format) {
                     case DSPF_NV16:
@@ -606,11 +1394,11 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
                          if (direct) {
                               switch (dst_surface->config.format) {
                                    case DSPF_NV16:
-                                        copy_line_nv16( lock.addr, (u16*)lock.addr + uv_offset, *buffer, rect.w );
+                                        copy_line_nv16( lock.addr, (u16*)lock.addr + uv_offset, line, rect.w );
                                         break;
 
                                    case DSPF_UYVY:
-                                        copy_line_uyvy( lock.addr, *buffer, rect.w );
+                                        copy_line_uyvy( lock.addr, line, rect.w );
                                         break;
 
                                    default:
@@ -629,7 +1417,19 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
                          }
 
                     default:
-                         copy_line32( row_ptr, *buffer, data->image_width );
+                         copy_line32( row_ptr, line, data->image_width );
+
+                         if (scaler.accum) {
+                              dfb_row_scaler_push( &scaler, row_ptr );
+
+                              if (data->base.render_callback) {
+                                   DFBRectangle r = { 0, y, data->image_width, 1 };
+
+                                   cb_result = data->base.render_callback( &r,
+                                                                           data->base.render_callback_context );
+                              }
+                              break;
+                         }
 
                          if (direct) {
                               DFBRectangle r = { rect.x, rect.y+y, rect.w, 1 };
@@ -644,11 +1444,19 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
                          break;
                }
 
-               row_ptr += data->image_width;
+               if (!scaler.accum)
+                    row_ptr += data->image_width;
+
                y++;
           }
 
-          if (!direct) {
+          if (pipelined && !pipeline_stop( &pipeline, cb_result != DIRCR_OK ))
+               incomplete = true;
+
+          if (scaler.accum) {
+               dfb_row_scaler_deinit( &scaler );
+          }
+          else if (!direct) {
                dfb_scale_linear_32( data->image, data->image_width, data->image_height,
                                     lock.addr, lock.pitch, &rect, dst_surface, &clip );
                if (data->base.render_callback) {
@@ -658,12 +1466,17 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
                }
           }
 
+          /* Decoding has been finished or aborted by the pipeline already. */
           if (cb_result != DIRCR_OK) {
-               jpeg_abort_decompress( &cinfo );
-               D_FREE( data->image );
-               data->image = NULL;
+               if (!pipelined)
+                    jpeg_abort_decompress( &cinfo );
+
+               if (data->image) {
+                    D_FREE( data->image );
+                    data->image = NULL;
+               }
           }
-          else {
+          else if (!pipelined) {
                jpeg_finish_decompress( &cinfo );
           }
           jpeg_destroy_decompress( &cinfo );
@@ -673,8 +1486,8 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
                                lock.addr, lock.pitch, &rect, dst_surface, &clip );
           if (data->base.render_callback) {
                DFBRectangle r = { 0, 0, data->image_width, data->image_height };
-               data->base.render_callback( &r,
-                                           data->base.render_callback_context );
+               cb_result = data->base.render_callback( &r,
+                                                       data->base.render_callback_context );
           }
      }
 
@@ -683,7 +1496,7 @@ IDirectFBImageProvider_JPEG_RenderTo( IDirectFBImageProvider *thiz,
      if (cb_result != DIRCR_OK)
           return DFB_INTERRUPTED;
 
-     return DFB_OK;
+     return incomplete ? DFB_INCOMPLETE : DFB_OK;
 }
 
 static DFBResult
@@ -40,6 +40,7 @@
 
 #include <display/idirectfbsurface.h>
 
+#include <media/idirectfbdatabuffer.h>
 #include <media/idirectfbimageprovider.h>
 
 #include <core/coredefs.h>
@@ -116,6 +117,8 @@ typedef struct {
      int                  pitch;
      u32                  palette[256];
      DFBColor             colors[256];
+
+     DFBRowScaler        *scaler;   /* set while decoding straight into a smaller destination */
 } IDirectFBImageProvider_PNG_data;
 
 
@@ -156,6 +159,17 @@ push_data_until_stage (IDirectFBImageProvider_PNG_data *data,
                        int                              stage,
                        int                              buffer_size);
 
+/* Starts decoding again from the beginning of the data buffer. */
+static DFBResult
+restart_decoding      (IDirectFBImageProvider_PNG_data *data);
+
+/* Decodes the image into a smaller destination without keeping it at full size. */
+static DFBResult
+render_downscaled     (IDirectFBImageProvider_PNG_data *data,
+                       CoreSurface                     *dst_surface,
+                       const DFBRectangle              *rect,
+                       const DFBRegion                 *clip);
+
 /**********************************************************************************************************************/
 
 static void
@@ -272,6 +286,7 @@ IDirectFBImageProvider_PNG_RenderTo( IDirectFBImageProvider *thiz,
      DFBRectangle           rect;
      int                    x, y;
      DFBRectangle           clipped;
+     IDirectFBDataBuffer_data *buffer_data;
 
      DIRECT_INTERFACE_GET_DATA (IDirectFBImageProvider_PNG)
 
@@ -298,6 +313,29 @@ IDirectFBImageProvider_PNG_RenderTo( IDirectFBImageProvider *thiz,
           rect = dst_data->area.wanted;
      }
 
+     /* The image has not been kept after decoding it into a smaller destination, start over. */
+     if (!data->image && (data->stage >= STAGE_END || data->stage < 0)) {
+          ret = restart_decoding( data );
+          if (ret)
+               return ret;
+     }
+
+     buffer_data = data->base.buffer->priv;
+
+     /*
+      * Downscale non-interlaced ARGB rows as they are decoded if the image has not been decoded yet,
+      * the data can be read again for another rendering and the destination is smaller.
+      */
+     if (data->stage < STAGE_IMAGE && buffer_data && buffer_data->content &&
+         png_get_interlace_type( data->png_ptr, data->info_ptr ) == PNG_INTERLACE_NONE &&
+         data->color_type != PNG_COLOR_TYPE_PALETTE &&
+         !(data->color_type == PNG_COLOR_TYPE_GRAY && data->bpp < 16) &&
+         !(data->bpp == 16 && data->color_keyed) &&
+         rect.w <= data->width && rect.h <= data->height &&
+         (rect.w < data->width || rect.h < data->height) &&
+         dfb_rectangle_region_intersects( &rect, &clip ))
+          return render_downscaled( data, dst_surface, &rect, &clip );
+
      if (setjmp( png_jmpbuf(data->png_ptr) )) {
           D_ERROR( "ImageProvider/PNG: Error during decoding!\n" );
 
@@ -314,6 +352,9 @@ IDirectFBImageProvider_PNG_RenderTo( IDirectFBImageProvider *thiz,
                return ret;
      }
 
+     if (!data->image)
+          return DFB_FAILURE;
+
      clipped = rect;
 
      if (!dfb_rectangle_intersect_by_region( &clipped, &clip ))
@@ -837,6 +878,23 @@ png_row_callback( png_structp png_read_ptr,
      /* set image decoding stage */
      data->stage = STAGE_IMAGE;
 
+     /* downscale right into the destination? */
+     if (data->scaler) {
+          if (new_row)
+               dfb_row_scaler_push( data->scaler, (const u32*) new_row );
+
+          data->rows++;
+
+          if (data->base.render_callback) {
+               DFBRectangle rect = { 0, row_num, data->width, 1 };
+
+               if (data->base.render_callback( &rect, data->base.render_callback_context ) != DIRCR_OK)
+                    data->stage = STAGE_ABORT;
+          }
+
+          return;
+     }
+
      /* check image data pointer */
      if (!data->image) {
           // FIXME: allocates four additional bytes because the scaling functions
@@ -991,8 +1049,37 @@ push_data_until_stage (IDirectFBImageProvider_PNG_data *data,
                        int                              stage,
                        int                              buffer_size)
 {
-     DFBResult            ret;
-     IDirectFBDataBuffer *buffer = data->base.buffer;
+     DFBResult                 ret;
+     IDirectFBDataBuffer      *buffer      = data->base.buffer;
+     IDirectFBDataBuffer_data *buffer_data = buffer->priv;
+
+     /* Pipe data right from memory or the mapped file. */
+     if (buffer_data && buffer_data->content) {
+          unsigned int pos;
+
+          buffer->GetPosition( buffer, &pos );
+
+          while (data->stage >= 0 && data->stage < stage) {
+               unsigned int len = MIN( buffer_size, buffer_data->content_length - pos );
+
+               if (!len)
+                    break;
+
+               D_DEBUG_AT( imageProviderPNG, "Processing %d bytes at %u...\n", len, pos );
+
+               png_process_data( data->png_ptr, data->info_ptr, (png_bytep) buffer_data->content + pos, len );
+
+               pos += len;
+          }
+
+          buffer->SeekTo( buffer, pos );
+
+          switch (data->stage) {
+               case STAGE_ABORT: return DFB_INTERRUPTED;
+               case STAGE_ERROR: return DFB_FAILURE;
+               default:          return (data->stage < stage) ? DFB_FAILURE : DFB_OK;
+          }
+     }
 
      while (data->stage < stage) {
           unsigned int  len;
@@ -1034,3 +1121,91 @@ push_data_until_stage (IDirectFBImageProvider_PNG_data *data,
 
      return DFB_OK;
 }
+
+/* Starts decoding again from the beginning of the data buffer. */
+static DFBResult
+restart_decoding( IDirectFBImageProvider_PNG_data *data )
+{
+     DFBResult            ret;
+     IDirectFBDataBuffer *buffer = data->base.buffer;
+
+     D_DEBUG_AT( imageProviderPNG, "%s(%d)\n", __FUNCTION__, __LINE__ );
+
+     ret = buffer->SeekTo( buffer, 0 );
+     if (ret)
+          return ret;
+
+     png_destroy_read_struct( &data->png_ptr, &data->info_ptr, NULL );
+
+     data->stage       = STAGE_START;
+     data->rows        = 0;
+     data->color_keyed = false;
+
+     data->png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING,
+                                             NULL, NULL, NULL );
+     if (!data->png_ptr)
+          return DFB_FAILURE;
+
+     if (setjmp( png_jmpbuf(data->png_ptr) )) {
+          D_ERROR( "ImageProvider/PNG: Error reading header!\n" );
+          data->stage = STAGE_ERROR;
+          return DFB_FAILURE;
+     }
+
+     data->info_ptr = png_create_info_struct( data->png_ptr );
+     if (!data->info_ptr)
+          return DFB_FAILURE;
+
+     png_set_progressive_read_fn( data->png_ptr, data,
+                                  png_info_callback,
+                                  png_row_callback,
+                                  png_end_callback );
+
+     return push_data_until_stage( data, STAGE_INFO, 64 );
+}
+
+/* Decodes the image into a smaller destination without keeping it at full size. */
+static DFBResult
+render_downscaled( IDirectFBImageProvider_PNG_data *data,
+                   CoreSurface                     *dst_surface,
+                   const DFBRectangle              *rect,
+                   const DFBRegion                 *clip )
+{
+     DFBResult             ret;
+     DFBRowScaler          scaler;
+     CoreSurfaceBufferLock lock;
+
+     D_DEBUG_AT( imageProviderPNG, "%s( %dx%d -> %d,%d-%dx%d )\n", __FUNCTION__,
+                 (int) data->width, (int) data->height, DFB_RECTANGLE_VALS( rect ) );
+
+     ret = dfb_surface_lock_buffer( dst_surface, CSBR_BACK, CSAID_CPU, CSAF_WRITE, &lock );
+     if (ret)
+          return ret;
+
+     ret = dfb_row_scaler_init( &scaler, data->width, data->height,
+                                lock.addr, lock.pitch, rect, dst_surface, clip );
+     if (ret) {
+          dfb_surface_unlock_buffer( dst_surface, &lock );
+          return ret;
+     }
+
+     data->scaler = &scaler;
+
+     if (setjmp( png_jmpbuf(data->png_ptr) )) {
+          D_ERROR( "ImageProvider/PNG: Error during decoding!\n" );
+
+          ret = (data->stage < STAGE_IMAGE) ? DFB_FAILURE : DFB_INCOMPLETE;
+
+          data->stage = STAGE_ERROR;
+     }
+     else
+          ret = push_data_until_stage( data, STAGE_END, 16384 );
+
+     data->scaler = NULL;
+
+     dfb_row_scaler_deinit( &scaler );
+
+     dfb_surface_unlock_buffer( dst_surface, &lock );
+
+     return ret;
+}
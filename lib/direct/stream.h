@@ -84,6 +84,14 @@ unsigned int DIRECT_API  direct_stream_length  ( DirectStream   *stream );
  */
 unsigned int DIRECT_API  direct_stream_offset  ( DirectStream   *stream );
 
+/*
+ * Get the whole content of a regular file mapped into memory, independent of the stream position.
+ * Returns DR_UNSUPPORTED if the stream is not mapped.
+ */
+DirectResult DIRECT_API  direct_stream_memory  ( DirectStream   *stream,
+                                                 const void    **ret_data,
+                                                 unsigned int   *ret_length );
+
 /*
  * Wait for data to be available.
  * If 'timeout' is NULL, the function blocks indefinitely.
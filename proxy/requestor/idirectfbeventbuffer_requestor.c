@@ -166,6 +166,19 @@ IDirectFBEventBuffer_Requestor_GetEvent( IDirectFBEventBuffer *thiz,
      return DFB_UNIMPLEMENTED;
 }
 
+static DFBResult
+IDirectFBEventBuffer_Requestor_GetEvents( IDirectFBEventBuffer *thiz,
+                                          DFBEvent             *events,
+                                          unsigned int          max,
+                                          unsigned int         *ret_num )
+{
+     DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer_Requestor)
+
+     D_UNIMPLEMENTED();
+
+     return DFB_UNIMPLEMENTED;
+}
+
 static DFBResult
 IDirectFBEventBuffer_Requestor_PeekEvent( IDirectFBEventBuffer *thiz,
                                           DFBEvent             *event )
@@ -247,6 +260,7 @@ Construct( IDirectFBEventBuffer *thiz,
      thiz->WaitForEvent            = IDirectFBEventBuffer_Requestor_WaitForEvent;
      thiz->WaitForEventWithTimeout = IDirectFBEventBuffer_Requestor_WaitForEventWithTimeout;
      thiz->GetEvent                = IDirectFBEventBuffer_Requestor_GetEvent;
+     thiz->GetEvents               = IDirectFBEventBuffer_Requestor_GetEvents;
      thiz->PeekEvent               = IDirectFBEventBuffer_Requestor_PeekEvent;
      thiz->HasEvent                = IDirectFBEventBuffer_Requestor_HasEvent;
      thiz->PostEvent               = IDirectFBEventBuffer_Requestor_PostEvent;
@@ -269,7 +283,8 @@ feed_thread( DirectThread *thread, void *arg )
      IDirectFBEventBuffer                *dst  = data->dst;
 
      while (!data->stop) {
-          DFBEvent event;
+          DFBEvent     events[16];
+          unsigned int i, num;
 
           ret = src->WaitForEvent( src );
           if (ret) {
@@ -283,11 +298,13 @@ feed_thread( DirectThread *thread, void *arg )
           if (data->stop)
                return NULL;
 
-          while (src->GetEvent( src, &event ) == DFB_OK) {
-               ret = dst->PostEvent( dst, &event );
-               if (ret) {
-                    DirectFBError( "IDirectFBEventBuffer::PostEvent", ret );
-                    return NULL;
+          while (src->GetEvents( src, events, D_ARRAY_SIZE(events), &num ) == DFB_OK) {
+               for (i=0; i<num; i++) {
+                    ret = dst->PostEvent( dst, &events[i] );
+                    if (ret) {
+                         DirectFBError( "IDirectFBEventBuffer::PostEvent", ret );
+                         return NULL;
+                    }
                }
 
                if (data->stop)
@@ -92,6 +92,7 @@ D_DEBUG_DOMAIN( DirectFB_Core, "DirectFB/Core", "DirectFB Core" );
 extern CorePart dfb_clipboard_core;
 extern CorePart dfb_colorhash_core;
 extern CorePart dfb_graphics_core;
+extern CorePart dfb_image_cache_core;
 extern CorePart dfb_input_core;
 extern CorePart dfb_layer_core;
 extern CorePart dfb_screen_core;
@@ -106,6 +107,7 @@ static CorePart *core_parts[] = {
      &dfb_system_core,
      &dfb_input_core,
      &dfb_graphics_core,
+     &dfb_image_cache_core,
      &dfb_screen_core,
      &dfb_layer_core,
      &dfb_wm_core
@@ -125,6 +127,9 @@ dfb_core_get_part( CoreDFB        *core,
           case DFCP_GRAPHICS:
                return dfb_graphics_core.data_local;
 
+          case DFCP_IMAGECACHE:
+               return dfb_image_cache_core.data_local;
+
           case DFCP_INPUT:
                return dfb_input_core.data_local;
 
@@ -1484,6 +1489,9 @@ dfb_core_shutdown( CoreDFB *core, bool emergency )
      /* Destroy graphics state objects. */
      fusion_object_pool_destroy( shared->graphics_state_pool, core->world );
 
+     /* Release cached images. */
+     dfb_core_part_shutdown( core, &dfb_image_cache_core, emergency );
+
      /* Shutdown graphics core. */
      dfb_core_part_shutdown( core, &dfb_graphics_core, emergency );
 
@@ -43,13 +43,14 @@
 #include <core/surface.h>
 
 
-#define DIRECTFB_CORE_ABI     46
+#define DIRECTFB_CORE_ABI     47
 
 
 typedef enum {
      DFCP_CLIPBOARD,
      DFCP_COLORHASH,
      DFCP_GRAPHICS,
+     DFCP_IMAGECACHE,
      DFCP_INPUT,
      DFCP_LAYER,
      DFCP_SCREEN,
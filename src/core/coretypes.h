@@ -38,6 +38,7 @@ typedef struct __DFB_CoreDFBShared           CoreDFBShared;
 typedef struct __DFB_DFBClipboardCore        DFBClipboardCore;
 typedef struct __DFB_DFBColorHashCore        DFBColorHashCore;
 typedef struct __DFB_DFBGraphicsCore         DFBGraphicsCore;
+typedef struct __DFB_DFBImageCacheCore       DFBImageCacheCore;
 typedef struct __DFB_DFBInputCore            DFBInputCore;
 typedef struct __DFB_DFBLayerCore            DFBLayerCore;
 typedef struct __DFB_DFBScreenCore           DFBScreenCore;
@@ -55,6 +56,7 @@ typedef struct _CoreCleanup                  CoreCleanup;
 
 typedef struct _CoreFont                     CoreFont;
 typedef struct _CoreGlyphData                CoreGlyphData;
+typedef struct _CoreFontTextRun              CoreFontTextRun;
 typedef struct _CorePalette                  CorePalette;
 
 typedef struct _CardState                    CardState;
@@ -62,7 +64,8 @@ typedef struct _CardState                    CardState;
 
 typedef struct __DFB_DFBFontManager          DFBFontManager;
 typedef struct __DFB_DFBFontCache            DFBFontCache;
-typedef struct __DFB_DFBFontCacheRow         DFBFontCacheRow;
+typedef struct __DFB_DFBFontCacheAtlas       DFBFontCacheAtlas;
+typedef struct __DFB_DFBFontGlyphFile        DFBFontGlyphFile;
 
 
 typedef struct __DFB_CoreGraphicsSerial      CoreGraphicsSerial;
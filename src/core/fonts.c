@@ -28,6 +28,8 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -44,9 +46,11 @@
 #include <core/surface.h>
 
 #include <direct/debug.h>
+#include <direct/filesystem.h>
 #include <direct/hash.h>
 #include <direct/map.h>
 #include <direct/mem.h>
+#include <direct/memcpy.h>
 #include <direct/messages.h>
 #include <direct/utf8.h>
 #include <direct/util.h>
@@ -62,7 +66,7 @@ D_DEBUG_DOMAIN( Core_FontSurfaces, "Core/Font/Surf", "DirectFB Core Font Surface
 
 D_DEBUG_DOMAIN( Font_Manager,      "Core/Font/Manager",  "DirectFB Core Font Manager" );
 D_DEBUG_DOMAIN( Font_Cache,        "Core/Font/Cache",    "DirectFB Core Font Cache" );
-D_DEBUG_DOMAIN( Font_CacheRow,     "Core/Font/CacheRow", "DirectFB Core Font Cache Row" );
+D_DEBUG_DOMAIN( Font_CacheAtlas,   "Core/Font/CacheAtlas", "DirectFB Core Font Cache Atlas" );
 
 /**********************************************************************************************************************/
 
@@ -71,6 +75,8 @@ static bool free_glyphs( DirectHash    *hash,
                          void          *value,
                          void          *ctx );
 
+static void text_runs_clear( CoreFont *font );
+
 /**********************************************************************************************************************/
 
 struct __DFB_DFBFontManager {
@@ -79,12 +85,17 @@ struct __DFB_DFBFontManager {
      CoreDFB            *core;
 
      pthread_mutex_t     lock;
+     int                 lock_count;    /* recursion depth of the lock */
 
      DirectMap          *caches;
 
-     unsigned int        max_rows;
+     unsigned int        max_rows;      /* limit of atlas space in rows of the cache height */
      unsigned int        num_rows;
-     unsigned long long  row_stamp;     // FIXME: lru calculation wrong if value overruns (non-fatal)
+
+     unsigned int        stamp;         /* incremented with each (outer) lock, see dfb_font_manager_lock() */
+
+     unsigned int        evictions;
+     unsigned int        compactions;
 };
 
 #define DFB_FONT_MANAGER_ASSERT( manager )                            \
@@ -103,9 +114,13 @@ struct __DFB_DFBFontCache {
 
      DFBFontCacheType    type;
 
-     unsigned int        row_width;
+     unsigned int        atlas_width;
+     unsigned int        atlas_height;
+     unsigned int        atlas_rows;    /* maximum rows of the cache height per atlas */
+     unsigned int        num_rows;      /* rows of all atlases of this cache */
 
-     DirectLink         *rows;
+     DirectLink         *atlases;
+     DirectLink         *glyphs;        /* glyphs in any atlas, most recently used first */
 };
 
 #define DFB_FONT_CACHE_ASSERT( cache )                                \
@@ -115,24 +130,50 @@ struct __DFB_DFBFontCache {
 
 /**********************************************************************************************************************/
 
-struct __DFB_DFBFontCacheRow {
+/* Maximum number of rows of the cache height per atlas. */
+#define DFB_FONT_ATLAS_ROWS   16
+
+/* Number of rows of the first atlas, following atlases grow with the cache up to DFB_FONT_ATLAS_ROWS. */
+#define DFB_FONT_ATLAS_MIN_ROWS 2
+
+/* Maximum number of free rectangles (left by evicted glyphs) per atlas. */
+#define DFB_FONT_ATLAS_FREE   32
+
+typedef struct {
+     int                 x;
+     int                 y;             /* first free line at x ... x+w-1 */
+     int                 w;
+} AtlasSegment;
+
+struct __DFB_DFBFontCacheAtlas {
      DirectLink          link;
 
      int                 magic;
 
      DFBFontCache       *cache;
 
-     unsigned long long  stamp;
+     unsigned int        stamp;         /* manager stamp of last use of any glyph */
 
      CoreSurface        *surface;
-     unsigned int        next_x;
+     int                 width;
+     int                 height;
+     unsigned int        rows;          /* accounted in the manager, height in rows of the cache height */
 
-     DirectLink         *glyphs;
+     AtlasSegment       *skyline;       /* top of used space from left to right */
+     int                 num_segments;
+
+     DFBRectangle        free[DFB_FONT_ATLAS_FREE];
+     int                 num_free;
+
+     unsigned int        num_glyphs;
+     unsigned long       used;          /* pixels occupied by glyphs */
 };
 
-#define DFB_FONT_CACHE_ROW_ASSERT( row )                              \
+#define DFB_FONT_CACHE_ATLAS_ASSERT( atlas )                          \
      do {                                                             \
-          D_MAGIC_ASSERT( row, DFBFontCacheRow );                     \
+          D_MAGIC_ASSERT( atlas, DFBFontCacheAtlas );                 \
+          D_ASSERT( (atlas)->num_segments > 0 );                      \
+          D_ASSERT( (atlas)->num_free <= DFB_FONT_ATLAS_FREE );       \
      } while (0)
 
 /**********************************************************************************************************************/
@@ -163,6 +204,8 @@ font_cache_map_hash( DirectMap    *map,
 /**********************************************************************************************************************/
 /**********************************************************************************************************************/
 
+static void dump_stats( DFBFontManager *manager );
+
 DFBResult
 dfb_font_manager_create( CoreDFB         *core,
                          DFBFontManager **ret_manager )
@@ -252,6 +295,9 @@ dfb_font_manager_deinit( DFBFontManager *manager )
 
      DFB_FONT_MANAGER_ASSERT( manager );
 
+     if (D_DEBUG_CHECK( Font_Manager ))
+          dump_stats( manager );
+
      direct_map_iterate( manager->caches, destroy_caches, NULL );
      direct_map_destroy( manager->caches );
 
@@ -271,8 +317,13 @@ dfb_font_manager_lock( DFBFontManager *manager )
 
      pthread_mutex_lock( &manager->lock );
 
-     // FIXME: remember row stamp here, avoiding destruction of any row used before the unlock,
-     //        might happen with looong string and smaaaall maximum of rows
+     /*
+      * Start a new period of use. Glyphs used during this period are not evicted
+      * before the final unlock, because their data and their place in the atlas
+      * may still be referenced, e.g. by glyph blits not yet issued.
+      */
+     if (!manager->lock_count++)
+          manager->stamp++;
 
      return DFB_OK;
 }
@@ -283,9 +334,9 @@ dfb_font_manager_unlock( DFBFontManager *manager )
      D_DEBUG_AT( Font_Manager, "%s()\n", __func__ );
 
      DFB_FONT_MANAGER_ASSERT( manager );
+     D_ASSERT( manager->lock_count > 0 );
 
-     // FIXME: destroy LRU row until maximum number of rows is no longer exceeded,
-     //        might happen when rows are preserved due to being used after lock is called
+     manager->lock_count--;
 
      pthread_mutex_unlock( &manager->lock );
 
@@ -335,73 +386,157 @@ dfb_font_manager_get_cache( DFBFontManager          *manager,
 }
 
 typedef struct {
-     unsigned int     lru_stamp;
-     DFBFontCacheRow *lru_row;
-} FindLruRowContext;
+     DFBFontManager    *manager;
+     DFBFontCacheAtlas *lru_atlas;
+} FindLruAtlasContext;
 
 static DirectEnumerationResult
-find_lru_row( DirectMap *map,
-              void      *object,
-              void      *ctx )
+find_lru_atlas( DirectMap *map,
+                void      *object,
+                void      *ctx )
 {
      D_DEBUG_AT( Font_Manager, "%s( object %p )\n", __func__, object );
 
-     FindLruRowContext *context = ctx;
-     DFBFontCache      *cache   = object;
-     DFBFontCacheRow   *row;
+     FindLruAtlasContext *context = ctx;
+     DFBFontManager      *manager = context->manager;
+     DFBFontCache        *cache   = object;
+     DFBFontCacheAtlas   *atlas;
 
      DFB_FONT_CACHE_ASSERT( cache );
 
-     direct_list_foreach (row, cache->rows) {
-          D_DEBUG_AT( Font_Manager, "  -> stamp %llu\n", row->stamp );
+     direct_list_foreach (atlas, cache->atlases) {
+          D_DEBUG_AT( Font_Manager, "  -> stamp %u\n", atlas->stamp );
 
-          if (!context->lru_row || context->lru_stamp > row->stamp) {
-               context->lru_row   = row;
-               context->lru_stamp = row->stamp;
-          }
+          /* Skip atlases used since the lock. */
+          if (atlas->stamp == manager->stamp)
+               continue;
+
+          if (!context->lru_atlas || manager->stamp - context->lru_atlas->stamp < manager->stamp - atlas->stamp)
+               context->lru_atlas = atlas;
      }
 
      return DENUM_OK;
 }
 
+/*
+ * Removes the least recently used atlas. Atlases used since the lock are never removed,
+ * their glyphs may still be referenced.
+ */
 DFBResult
-dfb_font_manager_remove_lru_row( DFBFontManager *manager )
+dfb_font_manager_remove_lru_atlas( DFBFontManager *manager )
 {
      D_DEBUG_AT( Font_Manager, "%s()\n", __func__ );
 
-     FindLruRowContext  context;
-     DFBFontCache      *cache;
+     FindLruAtlasContext  context;
+     DFBFontCache        *cache;
+     DFBFontCacheAtlas   *atlas;
 
      DFB_FONT_MANAGER_ASSERT( manager );
 
-     context.lru_stamp = 0;
-     context.lru_row   = NULL;
+     context.manager   = manager;
+     context.lru_atlas = NULL;
 
-     direct_map_iterate( manager->caches, find_lru_row, &context );
+     direct_map_iterate( manager->caches, find_lru_atlas, &context );
 
-     if (!context.lru_row) {
-          D_ERROR( "Core/Font: Could not find any row (LRU)!\n" );
+     atlas = context.lru_atlas;
+     if (!atlas) {
+          D_DEBUG_AT( Font_Manager, "  -> no atlas unused since the lock\n" );
           return DFB_ITEMNOTFOUND;
      }
 
-     D_DEBUG_AT( Font_Manager, "  -> row %p (stamp %llu)\n", context.lru_row, context.lru_row->stamp );
+     D_DEBUG_AT( Font_Manager, "  -> atlas %p (stamp %u)\n", atlas, atlas->stamp );
+
+     cache = atlas->cache;
+     DFB_FONT_CACHE_ASSERT( cache );
+
+     direct_list_remove( &cache->atlases, &atlas->link );
+
+     /* Decrease row counters. */
+     manager->num_rows -= atlas->rows;
+     cache->num_rows   -= atlas->rows;
+
+     dfb_font_cache_atlas_destroy( atlas );
+
+     return DFB_OK;
+}
+
+typedef struct {
+     DFBFontManager      *manager;
+     DFBFontManagerStats *stats;
+} GetStatsContext;
+
+static DirectEnumerationResult
+get_stats( DirectMap *map,
+           void      *object,
+           void      *ctx )
+{
+     GetStatsContext   *context = ctx;
+     DFBFontCache      *cache   = object;
+     DFBFontCacheAtlas *atlas;
 
-     cache = context.lru_row->cache;
      DFB_FONT_CACHE_ASSERT( cache );
 
-     direct_list_remove( &cache->rows, &context.lru_row->link );
+     direct_list_foreach (atlas, cache->atlases) {
+          context->stats->atlases++;
+          context->stats->glyphs += atlas->num_glyphs;
+          context->stats->area   += atlas->width * atlas->height;
+          context->stats->used   += atlas->used;
+     }
+
+     return DENUM_OK;
+}
+
+DFBResult
+dfb_font_manager_get_stats( DFBFontManager      *manager,
+                            DFBFontManagerStats *ret_stats )
+{
+     GetStatsContext context;
+
+     DFB_FONT_MANAGER_ASSERT( manager );
+     D_ASSERT( ret_stats != NULL );
+
+     memset( ret_stats, 0, sizeof(DFBFontManagerStats) );
+
+     context.manager = manager;
+     context.stats   = ret_stats;
+
+     pthread_mutex_lock( &manager->lock );
+
+     direct_map_iterate( manager->caches, get_stats, &context );
 
-     dfb_font_cache_row_destroy( context.lru_row );
+     ret_stats->evictions   = manager->evictions;
+     ret_stats->compactions = manager->compactions;
 
-     /* Decrease row counter. */
-     manager->num_rows--;
+     pthread_mutex_unlock( &manager->lock );
 
      return DFB_OK;
 }
 
+static void
+dump_stats( DFBFontManager *manager )
+{
+     DFBFontManagerStats stats;
+
+     dfb_font_manager_get_stats( manager, &stats );
+
+     D_DEBUG_AT( Font_Manager, "  -> %u glyphs in %u atlases, %llu%% of %llu pixels used, %u evicted, %u compactions\n",
+                 stats.glyphs, stats.atlases, stats.area ? stats.used * 100 / stats.area : 0, stats.area,
+                 stats.evictions, stats.compactions );
+}
+
 /**********************************************************************************************************************/
 /**********************************************************************************************************************/
 
+static inline int
+glyph_slot_width( const DFBFontCache *cache,
+                  int                 width )
+{
+     int align = (8 / (DFB_BYTES_PER_PIXEL( cache->type.pixel_format ) ? : 1)) *
+                 (DFB_PIXELFORMAT_ALIGNMENT( cache->type.pixel_format ) + 1) - 1;
+
+     return (width + align) & ~align;
+}
+
 DFBResult
 dfb_font_cache_create( DFBFontManager          *manager,
                        const DFBFontCacheType  *type,
@@ -458,15 +593,19 @@ dfb_font_cache_init( DFBFontCache           *cache,
      cache->type    = *type;
 
 
-     cache->row_width = 2048 * type->height / 64;
+     cache->atlas_width = 2048 * type->height / 64;
+
+     if (cache->atlas_width > dfb_config->max_font_row_width)
+          cache->atlas_width = dfb_config->max_font_row_width;
 
-     if (cache->row_width > dfb_config->max_font_row_width)
-          cache->row_width = dfb_config->max_font_row_width;
+     if (cache->atlas_width < type->height)
+          cache->atlas_width = type->height;
 
-     if (cache->row_width < type->height)
-          cache->row_width = type->height;
+     cache->atlas_width = glyph_slot_width( cache, (cache->atlas_width + 7) & ~7 );
 
-     cache->row_width = (cache->row_width + 7) & ~7;
+
+     cache->atlas_rows   = MIN( DFB_FONT_ATLAS_ROWS, manager->max_rows );
+     cache->atlas_height = cache->atlas_rows * type->height;
 
 
      D_MAGIC_SET( cache, DFBFontCache );
@@ -474,304 +613,1328 @@ dfb_font_cache_init( DFBFontCache           *cache,
      return DFB_OK;
 }
 
+static void
+evict_glyph( CoreGlyphData *glyph );
+
 DFBResult
 dfb_font_cache_deinit( DFBFontCache *cache )
 {
-     DFBFontCacheRow *row;
+     CoreGlyphData     *glyph, *next_glyph;
+     DFBFontCacheAtlas *atlas, *next;
 
      DFB_FONT_CACHE_ASSERT( cache );
 
-     direct_list_foreach (row, cache->rows)
-          dfb_font_cache_row_destroy( row );
+     /* Kick out all glyphs. */
+     direct_list_foreach_safe (glyph, next_glyph, cache->glyphs)
+          evict_glyph( glyph );
+
+     direct_list_foreach_safe (atlas, next, cache->atlases)
+          dfb_font_cache_atlas_destroy( atlas );
 
-     cache->rows = NULL;
+     cache->atlases = NULL;
 
      D_MAGIC_CLEAR( cache );
 
      return DFB_OK;
 }
 
-DFBResult
-dfb_font_cache_get_row( DFBFontCache     *cache,
-                        unsigned int      width,
-                        DFBFontCacheRow **ret_row )
+/**********************************************************************************************************************/
+
+/*
+ * Checks whether a glyph fits on top of the skyline starting at the given segment,
+ * returning the lowest possible position.
+ */
+static bool
+atlas_skyline_fit( const DFBFontCacheAtlas *atlas,
+                   int                      index,
+                   int                      width,
+                   int                      height,
+                   int                     *ret_y )
 {
-     DFBResult        ret;
-     DFBFontManager  *manager;
-     DFBFontCacheRow *row;
-     DFBFontCacheRow *best_row = NULL;
-     unsigned int     best_val = 0;
+     int i;
+     int y    = 0;
+     int left = width;
 
-     DFB_FONT_CACHE_ASSERT( cache );
-     D_ASSERT( ret_row != NULL );
+     if (atlas->skyline[index].x + width > atlas->width)
+          return false;
 
-     manager = cache->manager;
-     DFB_FONT_MANAGER_ASSERT( manager );
+     for (i=index; left > 0; i++) {
+          D_ASSERT( i < atlas->num_segments );
 
-     /* Try freshest row first. */
-     row = (DFBFontCacheRow*) cache->rows;
-     if (row && row->next_x + width <= cache->row_width) {
-          *ret_row = row;
+          if (y < atlas->skyline[i].y)
+               y = atlas->skyline[i].y;
 
-          return DFB_OK;
+          if (y + height > atlas->height)
+               return false;
+
+          left -= atlas->skyline[i].w;
      }
 
-     /* Check for trailing space in each row. */
-     direct_list_foreach (row, cache->rows) {
-          DFB_FONT_CACHE_ROW_ASSERT( row );
+     *ret_y = y;
 
-          /* If glyph fits... */
-          if (row->next_x + width <= cache->row_width) {
-               /* ...and no row yet or this row fits better... */
-               if (!best_row || best_val < row->next_x) {
-                    /* ...remember row */
-                    best_row = row;
-                    best_val = row->next_x;
+     return true;
+}
+
+static bool
+atlas_allocate_skyline( DFBFontCacheAtlas *atlas,
+                        int                width,
+                        int                height,
+                        DFBPoint          *ret_pos )
+{
+     int           i, y;
+     int           best   = -1;
+     int           best_y = 0;
+     AtlasSegment *skyline = atlas->skyline;
+     AtlasSegment  seg;
+
+     /* Bottom left rule, preferring narrow segments. */
+     for (i=0; i<atlas->num_segments; i++) {
+          if (atlas_skyline_fit( atlas, i, width, height, &y )) {
+               if (best < 0 || y < best_y || (y == best_y && skyline[i].w < skyline[best].w)) {
+                    best   = i;
+                    best_y = y;
                }
           }
      }
 
-     if (best_row) {
-          *ret_row = best_row;
+     if (best < 0)
+          return false;
 
-          return DFB_OK;
-     }
+     seg.x = skyline[best].x;
+     seg.y = best_y + height;
+     seg.w = width;
 
+     /* Insert the new segment... */
+     memmove( &skyline[best+1], &skyline[best], sizeof(AtlasSegment) * (atlas->num_segments - best) );
 
-     /*
-      * Need a new cache row
-      */
+     skyline[best] = seg;
 
-     /* Maximum number of rows reached? */
-     if (manager->num_rows == manager->max_rows) {
-          /* Remove the least recently used row. */
-          ret = dfb_font_manager_remove_lru_row( manager );
-          if (ret)
-               return ret;
-     }
+     atlas->num_segments++;
 
-     D_ASSERT( manager->num_rows < manager->max_rows );
+     /* ...shrinking or removing the segments it covers... */
+     for (i=best+1; i<atlas->num_segments; ) {
+          int shrink = seg.x + seg.w - skyline[i].x;
 
-     /* Create another row. */
-     ret = dfb_font_cache_row_create( cache, &row );
-     if (ret)
-          return ret;
+          if (shrink <= 0)
+               break;
 
-     /* Prepend to list (freshest is first). */
-     direct_list_prepend( &cache->rows, &row->link );
+          if (skyline[i].w > shrink) {
+               skyline[i].x += shrink;
+               skyline[i].w -= shrink;
+               break;
+          }
 
-     /* Increase row counter in manager. */
-     manager->num_rows++;
+          atlas->num_segments--;
 
-     *ret_row = row;
+          memmove( &skyline[i], &skyline[i+1], sizeof(AtlasSegment) * (atlas->num_segments - i) );
+     }
 
-     return DFB_OK;
-}
+     /* ...and merging neighbours of the same height. */
+     for (i=0; i<atlas->num_segments-1; ) {
+          if (skyline[i].y == skyline[i+1].y) {
+               skyline[i].w += skyline[i+1].w;
 
-/**********************************************************************************************************************/
-/**********************************************************************************************************************/
+               atlas->num_segments--;
 
-DFBResult
-dfb_font_cache_row_create( DFBFontCache     *cache,
-                           DFBFontCacheRow **ret_row )
+               memmove( &skyline[i+1], &skyline[i+2], sizeof(AtlasSegment) * (atlas->num_segments - i - 1) );
+          }
+          else
+               i++;
+     }
+
+     ret_pos->x = seg.x;
+     ret_pos->y = best_y;
+
+     return true;
+}
+
+/*
+ * Reuses space of evicted glyphs, splitting the best fitting free rectangle.
+ */
+static bool
+atlas_allocate_free( DFBFontCacheAtlas *atlas,
+                     int                width,
+                     int                height,
+                     DFBPoint          *ret_pos )
 {
-     DFBResult        ret;
-     DFBFontCacheRow *row;
+     int           i;
+     int           best = -1;
+     DFBRectangle  rect;
+     DFBRectangle  right;
+     DFBRectangle  below;
+
+     for (i=0; i<atlas->num_free; i++) {
+          const DFBRectangle *free = &atlas->free[i];
+
+          if (free->w >= width && free->h >= height) {
+               if (best < 0 || free->w * free->h < atlas->free[best].w * atlas->free[best].h)
+                    best = i;
+          }
+     }
 
-     row = D_CALLOC( 1, sizeof(DFBFontCacheRow) );
-     if (!row)
-          return D_OOM();
+     if (best < 0)
+          return false;
 
-     ret = dfb_font_cache_row_init( row, cache );
-     if (ret) {
-          D_FREE( row );
-          return ret;
+     rect = atlas->free[best];
+
+     atlas->free[best] = atlas->free[--atlas->num_free];
+
+     /* Split along the shorter leftover. */
+     if (rect.w - width > rect.h - height) {
+          right = (DFBRectangle) { rect.x + width, rect.y, rect.w - width, rect.h };
+          below = (DFBRectangle) { rect.x, rect.y + height, width, rect.h - height };
+     }
+     else {
+          right = (DFBRectangle) { rect.x + width, rect.y, rect.w - width, height };
+          below = (DFBRectangle) { rect.x, rect.y + height, rect.w, rect.h - height };
      }
 
-     *ret_row = row;
+     if (right.w > 0 && atlas->num_free < DFB_FONT_ATLAS_FREE)
+          atlas->free[atlas->num_free++] = right;
 
-     return DFB_OK;
+     if (below.h > 0 && atlas->num_free < DFB_FONT_ATLAS_FREE)
+          atlas->free[atlas->num_free++] = below;
+
+     ret_pos->x = rect.x;
+     ret_pos->y = rect.y;
+
+     return true;
 }
 
-DFBResult
-dfb_font_cache_row_destroy( DFBFontCacheRow *row )
+static void
+atlas_add_free( DFBFontCacheAtlas  *atlas,
+                const DFBRectangle *rect )
 {
-     DFB_FONT_CACHE_ROW_ASSERT( row );
+     int          i;
+     DFBRectangle add = *rect;
 
-     dfb_font_cache_row_deinit( row );
+     /* Merge with free rectangles sharing a complete edge. */
+     for (i=0; i<atlas->num_free; i++) {
+          const DFBRectangle *free = &atlas->free[i];
 
-     D_FREE( row );
+          if ((free->x == add.x && free->w == add.w && (free->y + free->h == add.y || add.y + add.h == free->y)) ||
+              (free->y == add.y && free->h == add.h && (free->x + free->w == add.x || add.x + add.w == free->x)))
+          {
+               dfb_rectangle_union( &add, free );
 
-     return DFB_OK;
+               atlas->free[i] = atlas->free[--atlas->num_free];
+
+               i = -1;
+          }
+     }
+
+     /* Keep the larger ones if the list is full. */
+     if (atlas->num_free == DFB_FONT_ATLAS_FREE) {
+          int smallest = 0;
+
+          for (i=1; i<atlas->num_free; i++) {
+               if (atlas->free[i].w * atlas->free[i].h < atlas->free[smallest].w * atlas->free[smallest].h)
+                    smallest = i;
+          }
+
+          if (atlas->free[smallest].w * atlas->free[smallest].h >= add.w * add.h)
+               return;
+
+          atlas->free[smallest] = add;
+     }
+     else
+          atlas->free[atlas->num_free++] = add;
 }
 
-DFBResult
-dfb_font_cache_row_init( DFBFontCacheRow *row,
-                         DFBFontCache    *cache )
+static void
+atlas_reset( DFBFontCacheAtlas *atlas )
 {
-     DFBResult       ret;
-     DFBFontManager *manager;
+     atlas->skyline[0].x  = 0;
+     atlas->skyline[0].y  = 0;
+     atlas->skyline[0].w  = atlas->width;
+     atlas->num_segments  = 1;
+     atlas->num_free      = 0;
+     atlas->used          = 0;
+}
+
+/*
+ * Gives back the space of a glyph to its atlas.
+ */
+static void
+release_glyph( CoreGlyphData *glyph )
+{
+     DFBFontCacheAtlas *atlas = glyph->atlas;
+     DFBFontCache      *cache;
+     DFBRectangle       rect;
+
+     DFB_FONT_CACHE_ATLAS_ASSERT( atlas );
 
+     cache = atlas->cache;
      DFB_FONT_CACHE_ASSERT( cache );
 
-     manager = cache->manager;
-     DFB_FONT_MANAGER_ASSERT( manager );
+     direct_list_remove( &cache->glyphs, &glyph->link );
 
-     row->cache = cache;
+     rect = (DFBRectangle) { glyph->start, glyph->start_y, glyph_slot_width( cache, glyph->width ), glyph->height };
 
-     /* Create a new font surface. */
-     ret = dfb_surface_create_simple( manager->core,
-                                      cache->row_width,
-                                      cache->type.height,
-                                      cache->type.pixel_format, DFB_COLORSPACE_DEFAULT(cache->type.pixel_format),
-                                      cache->type.surface_caps,
-                                      CSTF_FONT,
-                                      dfb_config->font_resource_id,
-                                      NULL, &row->surface );
-     if (ret) {
-          D_DERROR( ret, "Core/Font: Could not create font surface!\n" );
-          return ret;
-     }
+     atlas->num_glyphs--;
 
-     D_DEBUG_AT( Core_FontSurfaces, "  -> new row %d - %dx%d %s\n", manager->num_rows,
-                 row->surface->config.size.w, row->surface->config.size.h,
-                 dfb_pixelformat_name(row->surface->config.format) );
+     /* The provider may have cropped the glyph while rendering. */
+     if (atlas->used > rect.w * rect.h)
+          atlas->used -= rect.w * rect.h;
+     else
+          atlas->used = 0;
 
-     D_MAGIC_SET( row, DFBFontCacheRow );
+     if (atlas->num_glyphs)
+          atlas_add_free( atlas, &rect );
+     else
+          atlas_reset( atlas );
 
-     return DFB_OK;
+     glyph->atlas   = NULL;
+     glyph->surface = NULL;
 }
 
-DFBResult
-dfb_font_cache_row_deinit( DFBFontCacheRow *row )
+/*
+ * Glyph lookup table
+ *
+ * Two levels, a page of DFB_FONT_GLYPH_PAGE_SIZE entries being allocated when the first glyph within its range
+ * is inserted. The hash still holds all glyphs and is used for indices beyond the table or if a page is missing.
+ */
+
+static inline CoreGlyphData *
+glyph_table_lookup( CoreFont     *font,
+                    unsigned int  index,
+                    unsigned int  layer )
 {
-     CoreGlyphData *glyph, *next;
+     unsigned int    page_index = index >> DFB_FONT_GLYPH_PAGE_BITS;
+     CoreGlyphData **page;
 
-     DFB_FONT_CACHE_ROW_ASSERT( row );
-
-     /* Kick out all glyphs. */
-     direct_list_foreach_safe (glyph, next, row->glyphs) {
-          CoreFont *font = glyph->font;
+     if (page_index < DFB_FONT_GLYPH_PAGES) {
+          page = font->layers[layer].glyph_pages[page_index];
+          if (page)
+               return page[index & (DFB_FONT_GLYPH_PAGE_SIZE - 1)];
+     }
 
-          D_MAGIC_ASSERT( glyph, CoreGlyphData );
-          D_ASSERT( glyph->layer < D_ARRAY_SIZE(font->layers) );
+     return direct_hash_lookup( font->layers[layer].glyph_hash, index );
+}
 
-          /*ret =*/ direct_hash_remove( font->layers[glyph->layer].glyph_hash, glyph->index );
-          //FIXME: use D_ASSERT( ret == DFB_OK );
+static DFBResult
+glyph_table_insert( CoreFont      *font,
+                    unsigned int   index,
+                    unsigned int   layer,
+                    CoreGlyphData *glyph )
+{
+     DFBResult       ret;
+     unsigned int    i;
+     unsigned int    page_index = index >> DFB_FONT_GLYPH_PAGE_BITS;
+     CoreGlyphData **page;
 
-          if (glyph->index < 128)
-               font->layers[glyph->layer].glyph_data[glyph->index] = NULL;
+     ret = direct_hash_insert( font->layers[layer].glyph_hash, index, glyph );
+     if (ret)
+          return ret;
 
-          D_MAGIC_CLEAR( glyph );
-          D_FREE( glyph );
-     }
+     if (page_index >= DFB_FONT_GLYPH_PAGES)
+          return DFB_OK;
 
+     page = font->layers[layer].glyph_pages[page_index];
+     if (!page) {
+          page = D_CALLOC( DFB_FONT_GLYPH_PAGE_SIZE, sizeof(CoreGlyphData*) );
+          if (!page) {
+               /* Lookups in this range keep using the hash. */
+               D_OOM();
+               return DFB_OK;
+          }
 
-     dfb_surface_unref( row->surface );
+          /* Take over glyphs inserted while a previous allocation failed. */
+          for (i=0; i<DFB_FONT_GLYPH_PAGE_SIZE; i++)
+               page[i] = direct_hash_lookup( font->layers[layer].glyph_hash,
+                                             (page_index << DFB_FONT_GLYPH_PAGE_BITS) + i );
 
-     D_MAGIC_CLEAR( row );
+          font->layers[layer].glyph_pages[page_index] = page;
+     }
+     else
+          page[index & (DFB_FONT_GLYPH_PAGE_SIZE - 1)] = glyph;
 
      return DFB_OK;
 }
 
-/**********************************************************************************************************************/
-/**********************************************************************************************************************/
-
-DFBResult
-dfb_font_create( CoreDFB                   *core,
-                 const DFBFontDescription  *description,
-                 const char                *url,
-                 CoreFont                 **ret_font )
+static void
+glyph_table_remove( CoreFont     *font,
+                    unsigned int  index,
+                    unsigned int  layer )
 {
-     DFBResult  ret;
-     int        i;
-     CoreFont  *font;
+     unsigned int    page_index = index >> DFB_FONT_GLYPH_PAGE_BITS;
+     CoreGlyphData **page;
 
-     D_DEBUG_AT( Core_Font, "%s()\n", __FUNCTION__ );
+     /*ret =*/ direct_hash_remove( font->layers[layer].glyph_hash, index );
+     //FIXME: use D_ASSERT( ret == DFB_OK );
 
-     D_ASSERT( core != NULL );
-     D_ASSERT( ret_font != NULL );
+     if (page_index < DFB_FONT_GLYPH_PAGES) {
+          page = font->layers[layer].glyph_pages[page_index];
+          if (page)
+               page[index & (DFB_FONT_GLYPH_PAGE_SIZE - 1)] = NULL;
+     }
+}
 
-     font = D_CALLOC( 1, sizeof(CoreFont) );
-     if (!font)
-          return D_OOM();
+static void
+glyph_table_clear( CoreFont     *font,
+                   unsigned int  layer )
+{
+     unsigned int i;
 
-     for (i=0; i<DFB_FONT_MAX_LAYERS; i++) {
-          ret = direct_hash_create( 163, &font->layers[i].glyph_hash );
-          if (ret) {
-               while (i--)
-                    direct_hash_destroy( font->layers[i].glyph_hash );
+     for (i=0; i<DFB_FONT_GLYPH_PAGES; i++) {
+          if (font->layers[layer].glyph_pages[i]) {
+               D_FREE( font->layers[layer].glyph_pages[i] );
 
-               D_FREE( font );
-               return ret;
+               font->layers[layer].glyph_pages[i] = NULL;
           }
      }
+}
 
-     font->description = *description;
-     font->url         = D_STRDUP( url );
+static void
+evict_glyph( CoreGlyphData *glyph )
+{
+     CoreFont *font = glyph->font;
 
-     font->core    = core;
-     font->manager = dfb_core_font_manager( core );
+     D_MAGIC_ASSERT( glyph, CoreGlyphData );
+     D_ASSERT( glyph->layer < D_ARRAY_SIZE(font->layers) );
 
-     /* the proposed pixel_format, may be changed by the font provider */
-     font->pixel_format = dfb_config->font_format ? : DSPF_A8;
+     D_DEBUG_AT( Font_Cache, "  -> evicting glyph %u (layer %u) of font %p\n", glyph->index, glyph->layer, font );
 
-     if ((font->pixel_format == DSPF_ARGB ||
-                    font->pixel_format == DSPF_ABGR ||
-                    font->pixel_format == DSPF_ARGB8565 ||
-                    font->pixel_format == DSPF_ARGB4444 ||
-                    font->pixel_format == DSPF_RGBA4444 ||
-                    font->pixel_format == DSPF_ARGB1555 ||
-                    font->pixel_format == DSPF_RGBA5551)
-               && dfb_config->font_premult)
-          font->surface_caps = DSCAPS_PREMULTIPLIED;
+     release_glyph( glyph );
 
-     font->blittingflags = DSBLIT_BLEND_ALPHACHANNEL | DSBLIT_COLORIZE;
+     glyph_table_remove( font, glyph->index, glyph->layer );
 
-     D_MAGIC_SET( font, CoreFont );
+     D_MAGIC_CLEAR( glyph );
+     D_FREE( glyph );
+}
 
-     *ret_font = font;
+static int
+compare_glyph_height( const void *a,
+                      const void *b )
+{
+     const CoreGlyphData *ga = *(const CoreGlyphData **) a;
+     const CoreGlyphData *gb = *(const CoreGlyphData **) b;
 
-     return DFB_OK;
+     return gb->height - ga->height;
 }
 
-void
-dfb_font_destroy( CoreFont *font )
+/*
+ * Repacks the glyphs of an atlas into a new surface, collecting space left by evicted glyphs.
+ * The old surface stays valid as long as it's referenced, e.g. as a blitting source.
+ */
+static DFBResult
+atlas_compact( DFBFontCacheAtlas *atlas )
 {
-     int i;
+     DFBResult              ret;
+     int                    i, n = 0;
+     DFBFontCache          *cache = atlas->cache;
+     CoreGlyphData         *glyph;
+     CoreGlyphData        **glyphs;
+     DFBPoint              *positions;
+     CoreSurface           *surface;
+     CoreSurfaceBufferLock  src, dst;
+     int                    num_segments = atlas->num_segments;
+     unsigned long          used         = atlas->used;
+     AtlasSegment          *skyline;
+
+     D_DEBUG_AT( Font_CacheAtlas, "%s( %p ) <- %u glyphs, %lu/%d pixels used\n", __FUNCTION__,
+                 atlas, atlas->num_glyphs, atlas->used, atlas->width * atlas->height );
+
+     if (!atlas->num_glyphs)
+          return DFB_OK;
 
-     D_DEBUG_AT( Core_Font, "%s()\n", __FUNCTION__ );
+     glyphs    = D_MALLOC( atlas->num_glyphs * (sizeof(CoreGlyphData*) + sizeof(DFBPoint)) );
+     skyline   = D_MALLOC( atlas->width * sizeof(AtlasSegment) );
+     if (!glyphs || !skyline) {
+          if (glyphs)
+               D_FREE( glyphs );
+          if (skyline)
+               D_FREE( skyline );
+          return D_OOM();
+     }
 
-     D_MAGIC_ASSERT( font, CoreFont );
+     positions = (DFBPoint*) (glyphs + atlas->num_glyphs);
 
-     dfb_font_dispose( font );
+     direct_list_foreach (glyph, cache->glyphs) {
+          if (glyph->atlas == atlas)
+               glyphs[n++] = glyph;
+     }
 
-     for (i=0; i<DFB_FONT_MAX_LAYERS; i++)
-          direct_hash_destroy( font->layers[i].glyph_hash );
+     D_ASSERT( n == atlas->num_glyphs );
 
-     D_ASSERT( font->encodings != NULL || !font->last_encoding );
+     qsort( glyphs, n, sizeof(CoreGlyphData*), compare_glyph_height );
 
-     for (i=DTEID_OTHER; i<=font->last_encoding; i++) {
-          CoreFontEncoding *encoding = font->encodings[i];
+     /* Place all glyphs, keeping the current layout in case they don't fit anymore. */
+     direct_memcpy( skyline, atlas->skyline, num_segments * sizeof(AtlasSegment) );
 
-          D_ASSERT( encoding != NULL );
-          D_ASSERT( encoding->name != NULL );
+     atlas_reset( atlas );
 
-          D_MAGIC_CLEAR( encoding );
+     for (i=0; i<n; i++) {
+          int width = glyph_slot_width( cache, glyphs[i]->width );
 
-          D_FREE( encoding->name );
-          D_FREE( encoding );
+          if (!atlas_allocate_skyline( atlas, width, glyphs[i]->height, &positions[i] ))
+               break;
+
+          atlas->used += width * glyphs[i]->height;
      }
 
-     if (font->encodings)
-          D_FREE( font->encodings );
+     if (i < n) {
+          ret = DFB_LIMITEXCEEDED;
+          goto restore;
+     }
 
-     D_FREE( font->url );
+     ret = dfb_surface_create_simple( cache->manager->core, atlas->width, atlas->height,
+                                      cache->type.pixel_format, DFB_COLORSPACE_DEFAULT(cache->type.pixel_format),
+                                      cache->type.surface_caps, CSTF_FONT, dfb_config->font_resource_id,
+                                      NULL, &surface );
+     if (ret)
+          goto restore;
 
-     D_MAGIC_CLEAR( font );
+     ret = dfb_surface_lock_buffer( atlas->surface, CSBR_BACK, CSAID_CPU, CSAF_READ, &src );
+     if (ret) {
+          dfb_surface_unref( surface );
+          goto restore;
+     }
 
-     D_FREE( font );
-}
+     ret = dfb_surface_lock_buffer( surface, CSBR_BACK, CSAID_CPU, CSAF_WRITE, &dst );
+     if (ret) {
+          dfb_surface_unlock_buffer( atlas->surface, &src );
+          dfb_surface_unref( surface );
+          goto restore;
+     }
+
+     for (i=0; i<n; i++) {
+          int  y;
+          int  bytes = DFB_BYTES_PER_LINE( cache->type.pixel_format, glyphs[i]->width );
+          u8  *from  = src.addr + glyphs[i]->start_y * src.pitch +
+                       DFB_BYTES_PER_LINE( cache->type.pixel_format, glyphs[i]->start );
+          u8  *to    = dst.addr + positions[i].y * dst.pitch +
+                       DFB_BYTES_PER_LINE( cache->type.pixel_format, positions[i].x );
+
+          for (y=0; y<glyphs[i]->height; y++) {
+               direct_memcpy( to, from, bytes );
+
+               from += src.pitch;
+               to   += dst.pitch;
+          }
+
+          glyphs[i]->surface = surface;
+          glyphs[i]->start   = positions[i].x;
+          glyphs[i]->start_y = positions[i].y;
+     }
+
+     dfb_surface_unlock_buffer( surface, &dst );
+     dfb_surface_unlock_buffer( atlas->surface, &src );
+
+     dfb_surface_unref( atlas->surface );
+
+     atlas->surface = surface;
+
+     cache->manager->compactions++;
+
+     D_FREE( skyline );
+     D_FREE( glyphs );
+
+     dfb_gfxcard_flush_texture_cache();
+
+     return DFB_OK;
+
+
+restore:
+     direct_memcpy( atlas->skyline, skyline, num_segments * sizeof(AtlasSegment) );
+
+     atlas->num_segments = num_segments;
+     atlas->used         = used;
+
+     D_FREE( skyline );
+     D_FREE( glyphs );
+
+     return ret;
+}
+
+static bool
+atlas_allocate( DFBFontCacheAtlas *atlas,
+                int                width,
+                int                height,
+                DFBPoint          *ret_pos )
+{
+     return atlas_allocate_free( atlas, width, height, ret_pos ) ||
+            atlas_allocate_skyline( atlas, width, height, ret_pos );
+}
+
+static void
+atlas_place_glyph( DFBFontCacheAtlas *atlas,
+                   CoreGlyphData     *glyph,
+                   int                width,
+                   const DFBPoint    *pos )
+{
+     DFBFontCache *cache = atlas->cache;
+
+     glyph->atlas   = atlas;
+     glyph->surface = atlas->surface;
+     glyph->start   = pos->x;
+     glyph->start_y = pos->y;
+     glyph->stamp   = cache->manager->stamp;
+
+     atlas->stamp = cache->manager->stamp;
+     atlas->num_glyphs++;
+     atlas->used += width * glyph->height;
+
+     direct_list_prepend( &cache->glyphs, &glyph->link );
+}
+
+DFBResult
+dfb_font_cache_allocate( DFBFontCache  *cache,
+                         CoreGlyphData *glyph )
+{
+     DFBResult          ret;
+     DFBFontManager    *manager;
+     DFBFontCacheAtlas *atlas;
+     DFBPoint           pos;
+     int                width;
+     unsigned int       rows;
+     unsigned int       grant;
+     bool               compacted = false;
+
+     DFB_FONT_CACHE_ASSERT( cache );
+     D_MAGIC_ASSERT( glyph, CoreGlyphData );
+     D_ASSERT( glyph->atlas == NULL );
+
+     manager = cache->manager;
+     DFB_FONT_MANAGER_ASSERT( manager );
+
+     width = glyph_slot_width( cache, glyph->width );
+
+     D_ASSERT( width <= cache->atlas_width );
+     D_ASSERT( glyph->height <= cache->atlas_height );
+
+     /* Try existing atlases, freshest first. */
+     direct_list_foreach (atlas, cache->atlases) {
+          DFB_FONT_CACHE_ATLAS_ASSERT( atlas );
+
+          if (atlas_allocate( atlas, width, glyph->height, &pos )) {
+               atlas_place_glyph( atlas, glyph, width, &pos );
+               return DFB_OK;
+          }
+     }
+
+     /* Grant small atlases to small caches, growing with the cache up to the maximum. */
+     grant = MAX( DFB_FONT_ATLAS_MIN_ROWS, cache->num_rows );
+     grant = MIN( grant, cache->atlas_rows );
+
+     /* Evict least recently used glyphs of this cache, unless there's room for another atlas. */
+     while (manager->num_rows + grant > manager->max_rows) {
+          CoreGlyphData *lru = direct_list_get_last( cache->glyphs );
+
+          /* All remaining glyphs have been used since the lock? */
+          if (!lru || lru->stamp == manager->stamp)
+               break;
+
+          atlas = lru->atlas;
+
+          evict_glyph( lru );
+
+          manager->evictions++;
+
+          if (atlas_allocate( atlas, width, glyph->height, &pos )) {
+               atlas_place_glyph( atlas, glyph, width, &pos );
+               return DFB_OK;
+          }
+
+          /* At least a quarter of the atlas is free, but too fragmented? */
+          if (!compacted && (atlas->width * atlas->height - atlas->used) * 4 >= atlas->width * atlas->height) {
+               compacted = true;
+
+               if (atlas_compact( atlas ) == DFB_OK && atlas_allocate( atlas, width, glyph->height, &pos )) {
+                    atlas_place_glyph( atlas, glyph, width, &pos );
+                    return DFB_OK;
+               }
+          }
+     }
+
+     /* Make room for another atlas by removing the least recently used ones of any cache... */
+     while (manager->num_rows + grant > manager->max_rows) {
+          if (dfb_font_manager_remove_lru_atlas( manager ))
+               break;
+     }
+
+     /* ...or make do with a smaller one, failing if all rows are in use since the lock. */
+     rows = MIN( grant, manager->max_rows - manager->num_rows );
+     if (!rows) {
+          D_ERROR( "Core/Font: All %u font cache rows are in use!\n", manager->max_rows );
+          return DFB_NOVIDEOMEMORY;
+     }
+
+     ret = dfb_font_cache_atlas_create( cache, rows, &atlas );
+     if (ret)
+          return ret;
+
+     /* Prepend to list (freshest is first). */
+     direct_list_prepend( &cache->atlases, &atlas->link );
+
+     /* Increase row counters. */
+     manager->num_rows += rows;
+     cache->num_rows   += rows;
+
+     if (!atlas_allocate( atlas, width, glyph->height, &pos )) {
+          D_BUG( "glyph %dx%d does not fit into empty %dx%d atlas", width, glyph->height, atlas->width, atlas->height );
+          return DFB_BUG;
+     }
+
+     atlas_place_glyph( atlas, glyph, width, &pos );
+
+     if (D_DEBUG_CHECK( Font_Manager ))
+          dump_stats( manager );
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+/**********************************************************************************************************************/
+
+DFBResult
+dfb_font_cache_atlas_create( DFBFontCache       *cache,
+                             unsigned int        rows,
+                             DFBFontCacheAtlas **ret_atlas )
+{
+     DFBResult          ret;
+     DFBFontCacheAtlas *atlas;
+
+     atlas = D_CALLOC( 1, sizeof(DFBFontCacheAtlas) );
+     if (!atlas)
+          return D_OOM();
+
+     ret = dfb_font_cache_atlas_init( atlas, cache, rows );
+     if (ret) {
+          D_FREE( atlas );
+          return ret;
+     }
+
+     *ret_atlas = atlas;
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_font_cache_atlas_destroy( DFBFontCacheAtlas *atlas )
+{
+     DFB_FONT_CACHE_ATLAS_ASSERT( atlas );
+
+     dfb_font_cache_atlas_deinit( atlas );
+
+     D_FREE( atlas );
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_font_cache_atlas_init( DFBFontCacheAtlas *atlas,
+                           DFBFontCache      *cache,
+                           unsigned int       rows )
+{
+     DFBResult       ret;
+     DFBFontManager *manager;
+
+     DFB_FONT_CACHE_ASSERT( cache );
+     D_ASSERT( rows > 0 );
+     D_ASSERT( rows <= cache->atlas_rows );
+
+     manager = cache->manager;
+     DFB_FONT_MANAGER_ASSERT( manager );
+
+     atlas->cache  = cache;
+     atlas->width  = cache->atlas_width;
+     atlas->height = rows * cache->type.height;
+     atlas->rows   = rows;
+     atlas->stamp  = manager->stamp;
+
+     /* The skyline has at most one segment per pixel column. */
+     atlas->skyline = D_MALLOC( atlas->width * sizeof(AtlasSegment) );
+     if (!atlas->skyline)
+          return D_OOM();
+
+     atlas_reset( atlas );
+
+     /* Create a new font surface. */
+     ret = dfb_surface_create_simple( manager->core,
+                                      atlas->width,
+                                      atlas->height,
+                                      cache->type.pixel_format, DFB_COLORSPACE_DEFAULT(cache->type.pixel_format),
+                                      cache->type.surface_caps,
+                                      CSTF_FONT,
+                                      dfb_config->font_resource_id,
+                                      NULL, &atlas->surface );
+     if (ret) {
+          D_DERROR( ret, "Core/Font: Could not create font surface!\n" );
+          D_FREE( atlas->skyline );
+          return ret;
+     }
+
+     D_DEBUG_AT( Font_CacheAtlas, "  -> new atlas (%d rows used) - %dx%d %s\n", manager->num_rows,
+                 atlas->surface->config.size.w, atlas->surface->config.size.h,
+                 dfb_pixelformat_name(atlas->surface->config.format) );
+
+     D_MAGIC_SET( atlas, DFBFontCacheAtlas );
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_font_cache_atlas_deinit( DFBFontCacheAtlas *atlas )
+{
+     CoreGlyphData *glyph, *next;
+     DFBFontCache  *cache;
+
+     DFB_FONT_CACHE_ATLAS_ASSERT( atlas );
+
+     cache = atlas->cache;
+     DFB_FONT_CACHE_ASSERT( cache );
+
+     /* Kick out all glyphs. */
+     direct_list_foreach_safe (glyph, next, cache->glyphs) {
+          if (glyph->atlas == atlas)
+               evict_glyph( glyph );
+     }
+
+     D_ASSERT( atlas->num_glyphs == 0 );
+
+     dfb_surface_unref( atlas->surface );
+
+     D_FREE( atlas->skyline );
+
+     D_MAGIC_CLEAR( atlas );
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+/**********************************************************************************************************************/
+
+#define DFB_FONT_GLYPH_FILE_MAGIC    0x47464244    /* "DBFG" */
+#define DFB_FONT_GLYPH_FILE_VERSION  1
+
+typedef struct {
+     u32                 magic;
+     u32                 version;
+     u64                 key;
+     u32                 pixel_format;
+     u32                 surface_caps;
+} GlyphFileHeader;
+
+typedef struct {
+     u32                 index;
+     u32                 layer;
+     s32                 width;
+     s32                 height;
+     s32                 left;
+     s32                 top;
+     s32                 xadvance;
+     s32                 yadvance;
+     u32                 pitch;         /* bytes per line of the bitmap following the record */
+} GlyphFileRecord;
+
+/* Records (including the bitmap) are padded to keep the next one aligned. */
+#define GLYPH_FILE_RECORD_SIZE(r)   ((sizeof(GlyphFileRecord) + (r)->pitch * (r)->height + 3) & ~3)
+
+struct __DFB_DFBFontGlyphFile {
+     int                 magic;
+
+     DirectFile          file;
+     bool                writable;      /* file is ours to append to */
+
+     void               *map;           /* read-only view of records written before opening */
+     size_t              map_size;
+
+     DirectHash         *records[DFB_FONT_MAX_LAYERS];
+};
+
+static u64
+glyph_file_hash( u64         hash,
+                 const void *data,
+                 size_t      size )
+{
+     const u8 *bytes = data;
+
+     /* FNV-1a */
+     while (size--) {
+          hash ^= *bytes++;
+          hash *= 0x100000001b3ULL;
+     }
+
+     return hash;
+}
+
+static u64
+glyph_file_key( const CoreFont *font,
+                const void     *content,
+                unsigned int    content_size )
+{
+     const DFBFontDescription *desc = &font->description;
+     u64                       hash = 0xcbf29ce484222325ULL;
+     s32                       values[13];
+     int                       n    = 0;
+
+     hash = glyph_file_hash( hash, content, content_size );
+
+     /* Only fields which are set, others might not be initialized. */
+     values[n++] = desc->flags;
+
+     if (desc->flags & DFDESC_ATTRIBUTES)
+          values[n++] = desc->attributes;
+     if (desc->flags & DFDESC_HEIGHT)
+          values[n++] = desc->height;
+     if (desc->flags & DFDESC_WIDTH)
+          values[n++] = desc->width;
+     if (desc->flags & DFDESC_INDEX)
+          values[n++] = desc->index;
+     if (desc->flags & DFDESC_FIXEDADVANCE)
+          values[n++] = desc->fixed_advance;
+     if (desc->flags & DFDESC_FRACT_HEIGHT)
+          values[n++] = desc->fract_height;
+     if (desc->flags & DFDESC_FRACT_WIDTH)
+          values[n++] = desc->fract_width;
+     if (desc->flags & DFDESC_OUTLINE_WIDTH)
+          values[n++] = desc->outline_width;
+     if (desc->flags & DFDESC_OUTLINE_OPACITY)
+          values[n++] = desc->outline_opacity;
+     if (desc->flags & DFDESC_ROTATION)
+          values[n++] = desc->rotation;
+
+     values[n++] = font->pixel_format;
+     values[n++] = font->surface_caps;
+
+     return glyph_file_hash( hash, values, n * sizeof(s32) );
+}
+
+/*
+ * Indexes all records of the mapped file. Broken records let the whole file be rejected,
+ * while a truncated record at the end is still being written by another process.
+ */
+static DFBResult
+glyph_file_scan( DFBFontGlyphFile *file )
+{
+     const GlyphFileHeader *header = file->map;
+     size_t                 offset = sizeof(GlyphFileHeader);
+
+     while (offset + sizeof(GlyphFileRecord) <= file->map_size) {
+          const GlyphFileRecord *record = file->map + offset;
+
+          /* Bitmaps have to be packed lines of the font format fitting into an atlas. */
+          if (record->layer >= DFB_FONT_MAX_LAYERS ||
+              record->width < 0 || record->width > dfb_config->max_font_row_width ||
+              record->height < 0 || record->height > dfb_config->max_font_row_width ||
+              record->pitch != DFB_BYTES_PER_LINE( header->pixel_format, record->width ) ||
+              (!record->width != !record->height))
+          {
+               D_ERROR( "Core/Font: Broken glyph record at offset %zu (index %u, %dx%d, pitch %u)!\n",
+                        offset, record->index, record->width, record->height, record->pitch );
+               return DFB_INVAREA;
+          }
+
+          if (offset + GLYPH_FILE_RECORD_SIZE( record ) > file->map_size)
+               break;
+
+          if (!direct_hash_lookup( file->records[record->layer], record->index ))
+               direct_hash_insert( file->records[record->layer], record->index, (void*) record );
+
+          offset += GLYPH_FILE_RECORD_SIZE( record );
+     }
+
+     D_DEBUG_AT( Core_Font, "  -> %zu of %zu bytes valid\n", offset, file->map_size );
+
+     return DFB_OK;
+}
+
+static void
+glyph_file_close( DFBFontGlyphFile *file )
+{
+     int i;
+
+     D_MAGIC_ASSERT( file, DFBFontGlyphFile );
+
+     for (i=0; i<DFB_FONT_MAX_LAYERS; i++) {
+          if (file->records[i])
+               direct_hash_destroy( file->records[i] );
+     }
+
+     if (file->map)
+          direct_file_unmap( &file->file, file->map, file->map_size );
+
+     direct_file_close( &file->file );
+
+     D_MAGIC_CLEAR( file );
+
+     D_FREE( file );
+}
+
+DFBResult
+dfb_font_open_glyph_file( CoreFont     *font,
+                          const void   *content,
+                          unsigned int  content_size )
+{
+     DFBResult          ret;
+     int                i;
+     u64                key;
+     char              *path;
+     int                length;
+     DirectFileInfo     info;
+     DFBFontGlyphFile  *file;
+     GlyphFileHeader    header;
+
+     D_MAGIC_ASSERT( font, CoreFont );
+     D_ASSERT( font->glyph_file == NULL );
+
+     if (!dfb_config->font_cache_dir || !content)
+          return DFB_OK;
+
+     key = glyph_file_key( font, content, content_size );
+
+     D_DEBUG_AT( Core_Font, "%s( '%s' ) <- key 0x%016llx\n", __FUNCTION__, font->url, (unsigned long long) key );
+
+     length = strlen( dfb_config->font_cache_dir ) + 32;
+
+     path = alloca( length );
+
+     snprintf( path, length, "%s/%016llx.glyphs", dfb_config->font_cache_dir, (unsigned long long) key );
+
+     file = D_CALLOC( 1, sizeof(DFBFontGlyphFile) );
+     if (!file)
+          return D_OOM();
+
+     D_MAGIC_SET( file, DFBFontGlyphFile );
+
+     for (i=0; i<DFB_FONT_MAX_LAYERS; i++) {
+          ret = direct_hash_create( 163, &file->records[i] );
+          if (ret)
+               goto error;
+     }
+
+     header.magic        = DFB_FONT_GLYPH_FILE_MAGIC;
+     header.version      = DFB_FONT_GLYPH_FILE_VERSION;
+     header.key          = key;
+     header.pixel_format = font->pixel_format;
+     header.surface_caps = font->surface_caps;
+
+     /* Create a new file... */
+     if (direct_file_open( &file->file, path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644 ) == DR_OK) {
+          size_t written;
+
+          ret = direct_file_write( &file->file, &header, sizeof(header), &written );
+          if (ret == DFB_OK && written == sizeof(header))
+               file->writable = true;
+
+          D_DEBUG_AT( Core_Font, "  -> created '%s'\n", path );
+
+          font->glyph_file = file;
+
+          return DFB_OK;
+     }
+
+     /* ...or use the existing one, read only if it's not ours to write. */
+     if (direct_file_open( &file->file, path, O_WRONLY | O_APPEND, 0 ) == DR_OK)
+          file->writable = true;
+     else {
+          ret = direct_file_open( &file->file, path, O_RDONLY, 0 );
+          if (ret) {
+               D_DERROR( ret, "Core/Font: Could not open glyph cache file '%s'!\n", path );
+               goto error;
+          }
+     }
+
+     ret = direct_file_get_info( &file->file, &info );
+     if (ret)
+          goto error_close;
+
+     /* Still being created by another process? */
+     if (info.size < sizeof(GlyphFileHeader)) {
+          file->writable   = false;
+          font->glyph_file = file;
+
+          return DFB_OK;
+     }
+
+     /* Writable files still need a separate read only descriptor for mapping. */
+     if (file->writable) {
+          DirectFile map_file;
+
+          ret = direct_file_open( &map_file, path, O_RDONLY, 0 );
+          if (ret == DFB_OK) {
+               ret = direct_file_map( &map_file, NULL, 0, info.size, DFP_READ, &file->map );
+
+               direct_file_close( &map_file );
+          }
+     }
+     else
+          ret = direct_file_map( &file->file, NULL, 0, info.size, DFP_READ, &file->map );
+
+     if (ret) {
+          D_DERROR( ret, "Core/Font: Could not map glyph cache file '%s'!\n", path );
+          file->map = NULL;
+          goto error_close;
+     }
+
+     file->map_size = info.size;
+
+     if (memcmp( file->map, &header, sizeof(header) )) {
+          D_DEBUG_AT( Core_Font, "  -> header mismatch, not using '%s'\n", path );
+          ret = DFB_VERSIONMISMATCH;
+          goto error_close;
+     }
+
+     ret = glyph_file_scan( file );
+     if (ret) {
+          D_ERROR( "Core/Font: Not using glyph cache file '%s'!\n", path );
+          goto error_close;
+     }
+
+     font->glyph_file = file;
+
+     return DFB_OK;
+
+
+error_close:
+     if (file->map)
+          direct_file_unmap( &file->file, file->map, file->map_size );
+
+     direct_file_close( &file->file );
+
+error:
+     for (i=0; i<DFB_FONT_MAX_LAYERS; i++) {
+          if (file->records[i])
+               direct_hash_destroy( file->records[i] );
+     }
+
+     D_MAGIC_CLEAR( file );
+
+     D_FREE( file );
+
+     return ret;
+}
+
+static inline const GlyphFileRecord *
+glyph_file_lookup( const CoreFont *font,
+                   unsigned int    layer,
+                   unsigned int    index )
+{
+     if (!font->glyph_file)
+          return NULL;
+
+     D_MAGIC_ASSERT( font->glyph_file, DFBFontGlyphFile );
+
+     return direct_hash_lookup( font->glyph_file->records[layer], index );
+}
+
+/*
+ * Copies the bitmap of a glyph from the file into its place in the cache.
+ */
+static DFBResult
+glyph_file_load( const CoreGlyphData   *data,
+                 const GlyphFileRecord *record )
+{
+     DFBResult              ret;
+     int                    y;
+     CoreSurfaceBufferLock  lock;
+     const u8              *src = (const u8*) (record + 1);
+     u8                    *dst;
+
+     /* Checked by glyph_file_scan(). */
+     D_ASSERT( record->pitch == DFB_BYTES_PER_LINE( data->surface->config.format, record->width ) );
+     D_ASSERT( record->height == data->height );
+
+     ret = dfb_surface_lock_buffer( data->surface, CSBR_BACK, CSAID_CPU, CSAF_WRITE, &lock );
+     if (ret)
+          return ret;
+
+     dst = lock.addr + data->start_y * lock.pitch + DFB_BYTES_PER_LINE( data->surface->config.format, data->start );
+
+     for (y=0; y<record->height; y++) {
+          direct_memcpy( dst, src, record->pitch );
+
+          src += record->pitch;
+          dst += lock.pitch;
+     }
+
+     dfb_surface_unlock_buffer( data->surface, &lock );
+
+     return DFB_OK;
+}
+
+/*
+ * Appends a glyph to the file, reading back its bitmap from the cache if it has one.
+ */
+static void
+glyph_file_store( DFBFontGlyphFile    *file,
+                  const CoreGlyphData *data )
+{
+     DFBResult              ret;
+     int                    y;
+     int                    width  = 0;
+     int                    height = 0;
+     unsigned int           pitch  = 0;
+     size_t                 size;
+     GlyphFileRecord       *record;
+     CoreSurfaceBufferLock  lock;
+
+     D_MAGIC_ASSERT( file, DFBFontGlyphFile );
+
+     if (!file->writable)
+          return;
+
+     /* Glyphs without a bitmap are stored as well, just to skip loading them next time. */
+     if (data->surface) {
+          width  = data->width;
+          height = data->height;
+          pitch  = DFB_BYTES_PER_LINE( data->surface->config.format, width );
+     }
+
+     size = (sizeof(GlyphFileRecord) + pitch * height + 3) & ~3;
+
+     record = D_CALLOC( 1, size );
+     if (!record) {
+          D_OOM();
+          return;
+     }
+
+     record->index    = data->index;
+     record->layer    = data->layer;
+     record->width    = width;
+     record->height   = height;
+     record->left     = data->left;
+     record->top      = data->top;
+     record->xadvance = data->xadvance;
+     record->yadvance = data->yadvance;
+     record->pitch    = pitch;
+
+     if (record->height) {
+          const u8 *src;
+          u8       *dst = (u8*) (record + 1);
+
+          ret = dfb_surface_lock_buffer( data->surface, CSBR_BACK, CSAID_CPU, CSAF_READ, &lock );
+          if (ret) {
+               D_FREE( record );
+               return;
+          }
+
+          src = lock.addr + data->start_y * lock.pitch + DFB_BYTES_PER_LINE( data->surface->config.format, data->start );
+
+          for (y=0; y<record->height; y++) {
+               direct_memcpy( dst, src, record->pitch );
+
+               src += lock.pitch;
+               dst += record->pitch;
+          }
+
+          dfb_surface_unlock_buffer( data->surface, &lock );
+     }
+
+     /* A single write, so records of concurrent processes don't interleave. */
+     ret = direct_file_write( &file->file, record, size, NULL );
+     if (ret) {
+          D_DERROR( ret, "Core/Font: Could not write to glyph cache file, disabling it!\n" );
+          file->writable = false;
+     }
+
+     D_FREE( record );
+}
+
+/**********************************************************************************************************************/
+/**********************************************************************************************************************/
+
+DFBResult
+dfb_font_create( CoreDFB                   *core,
+                 const DFBFontDescription  *description,
+                 const char                *url,
+                 CoreFont                 **ret_font )
+{
+     DFBResult  ret;
+     int        i;
+     CoreFont  *font;
+
+     D_DEBUG_AT( Core_Font, "%s()\n", __FUNCTION__ );
+
+     D_ASSERT( core != NULL );
+     D_ASSERT( ret_font != NULL );
+
+     font = D_CALLOC( 1, sizeof(CoreFont) );
+     if (!font)
+          return D_OOM();
+
+     for (i=0; i<DFB_FONT_MAX_LAYERS; i++) {
+          ret = direct_hash_create( 163, &font->layers[i].glyph_hash );
+          if (ret) {
+               while (i--)
+                    direct_hash_destroy( font->layers[i].glyph_hash );
+
+               D_FREE( font );
+               return ret;
+          }
+     }
+
+     font->description = *description;
+     font->url         = D_STRDUP( url );
+
+     font->core    = core;
+     font->manager = dfb_core_font_manager( core );
+
+     /* the proposed pixel_format, may be changed by the font provider */
+     font->pixel_format = dfb_config->font_format ? : DSPF_A8;
+
+     if ((font->pixel_format == DSPF_ARGB ||
+                    font->pixel_format == DSPF_ABGR ||
+                    font->pixel_format == DSPF_ARGB8565 ||
+                    font->pixel_format == DSPF_ARGB4444 ||
+                    font->pixel_format == DSPF_RGBA4444 ||
+                    font->pixel_format == DSPF_ARGB1555 ||
+                    font->pixel_format == DSPF_RGBA5551)
+               && dfb_config->font_premult)
+          font->surface_caps = DSCAPS_PREMULTIPLIED;
+
+     font->blittingflags = DSBLIT_BLEND_ALPHACHANNEL | DSBLIT_COLORIZE;
+
+     D_MAGIC_SET( font, CoreFont );
+
+     *ret_font = font;
+
+     return DFB_OK;
+}
+
+void
+dfb_font_destroy( CoreFont *font )
+{
+     int i;
+
+     D_DEBUG_AT( Core_Font, "%s()\n", __FUNCTION__ );
+
+     D_MAGIC_ASSERT( font, CoreFont );
+
+     dfb_font_dispose( font );
+
+     for (i=0; i<DFB_FONT_MAX_LAYERS; i++)
+          direct_hash_destroy( font->layers[i].glyph_hash );
+
+     if (font->glyph_file)
+          glyph_file_close( font->glyph_file );
+
+     text_runs_clear( font );
+
+     D_ASSERT( font->encodings != NULL || !font->last_encoding );
+
+     for (i=DTEID_OTHER; i<=font->last_encoding; i++) {
+          CoreFontEncoding *encoding = font->encodings[i];
+
+          D_ASSERT( encoding != NULL );
+          D_ASSERT( encoding->name != NULL );
+
+          D_MAGIC_CLEAR( encoding );
+
+          D_FREE( encoding->name );
+          D_FREE( encoding );
+     }
+
+     if (font->encodings)
+          D_FREE( font->encodings );
+
+     D_FREE( font->url );
+
+     D_MAGIC_CLEAR( font );
+
+     D_FREE( font );
+}
 
 DFBResult
 dfb_font_dispose( CoreFont *font )
@@ -787,7 +1950,7 @@ dfb_font_dispose( CoreFont *font )
      for (i=0; i<DFB_FONT_MAX_LAYERS; i++) {
           direct_hash_iterate( font->layers[i].glyph_hash, free_glyphs, NULL );
 
-          memset( font->layers[i].glyph_data, 0, sizeof(font->layers[i].glyph_data) );
+          glyph_table_clear( font, i );
      }
 
      dfb_font_manager_unlock( font->manager );
@@ -797,18 +1960,163 @@ dfb_font_dispose( CoreFont *font )
 
 /**********************************************************************************************************************/
 
+/* Minimum number of missing glyphs worth rasterizing in parallel. */
+#define DFB_FONT_PREFETCH_MIN  4
+
+static int
+compare_index( const void *a,
+               const void *b )
+{
+     unsigned int ia = *(const unsigned int *) a;
+     unsigned int ib = *(const unsigned int *) b;
+
+     return (ia > ib) - (ia < ib);
+}
+
+DFBResult
+dfb_font_prefetch_glyphs( CoreFont           *font,
+                          const unsigned int *indices,
+                          unsigned int        num_indices )
+{
+     DFBResult      ret;
+     unsigned int   i;
+     unsigned int   num = 0;
+     unsigned int  *missing;
+     CoreGlyphData *glyph;
+
+     D_DEBUG_AT( Core_Font, "%s( %u indices )\n", __FUNCTION__, num_indices );
+
+     D_MAGIC_ASSERT( font, CoreFont );
+     D_ASSERT( indices != NULL || num_indices == 0 );
+
+     if (!font->PrefetchGlyphs || num_indices < DFB_FONT_PREFETCH_MIN)
+          return DFB_OK;
+
+     missing = D_MALLOC( num_indices * sizeof(unsigned int) );
+     if (!missing)
+          return D_OOM();
+
+     /* Collect glyphs not loaded yet... */
+     dfb_font_manager_lock( font->manager );
+
+     /* The lock is recursive, rasterizing while the caller holds it would block everyone else. */
+     D_ASSUME( font->manager->lock_count == 1 );
+
+     if (font->manager->lock_count > 1) {
+          dfb_font_manager_unlock( font->manager );
+          D_FREE( missing );
+          return DFB_OK;
+     }
+
+     for (i=0; i<num_indices; i++) {
+          unsigned int index = indices[i];
+
+          if (glyph_table_lookup( font, index, 0 ))
+               continue;
+
+          if (glyph_file_lookup( font, 0, index ))
+               continue;
+
+          missing[num++] = index;
+     }
+
+     dfb_font_manager_unlock( font->manager );
+
+     if (num > 1) {
+          unsigned int unique = 1;
+
+          qsort( missing, num, sizeof(unsigned int), compare_index );
+
+          for (i=1; i<num; i++) {
+               if (missing[i] != missing[unique-1])
+                    missing[unique++] = missing[i];
+          }
+
+          num = unique;
+     }
+
+     D_DEBUG_AT( Core_Font, "  -> %u missing\n", num );
+
+     if (num < DFB_FONT_PREFETCH_MIN) {
+          D_FREE( missing );
+          return DFB_OK;
+     }
+
+     /* ...rasterize them without holding the manager lock... */
+     ret = font->PrefetchGlyphs( font, missing, num );
+     if (ret == DFB_OK) {
+          /* ...and put them into the cache. */
+          dfb_font_manager_lock( font->manager );
+
+          for (i=0; i<num; i++)
+               dfb_font_get_glyph_data( font, missing[i], 0, &glyph );
+
+          dfb_font_manager_unlock( font->manager );
+     }
+
+     D_FREE( missing );
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_font_prefetch_text( CoreFont          *font,
+                        DFBTextEncodingID  encoding,
+                        const void        *text,
+                        int                bytes )
+{
+     DFBResult    ret;
+     int          num;
+     unsigned int indices[bytes ? : 1];
+
+     D_DEBUG_AT( Core_Font, "%s( %p [%d], %d )\n", __FUNCTION__, text, bytes, encoding );
+
+     D_MAGIC_ASSERT( font, CoreFont );
+     D_ASSERT( text != NULL );
+     D_ASSERT( bytes >= 0 );
+
+     /* There can't be more glyphs than bytes. */
+     if (!font->PrefetchGlyphs || bytes < DFB_FONT_PREFETCH_MIN)
+          return DFB_OK;
+
+     ret = dfb_font_decode_text( font, encoding, text, bytes, indices, &num );
+     if (ret)
+          return ret;
+
+     return dfb_font_prefetch_glyphs( font, indices, num );
+}
+
+/*
+ * Keeps the glyph until the manager is unlocked and marks it most recently used.
+ * The atlas and list are only touched by the first use after locking.
+ */
+static inline void
+glyph_touch( DFBFontManager *manager,
+             CoreGlyphData  *glyph )
+{
+     DFBFontCacheAtlas *atlas = glyph->atlas;
+
+     if (atlas && glyph->stamp != manager->stamp) {
+          DFB_FONT_CACHE_ATLAS_ASSERT( atlas );
+
+          glyph->stamp = manager->stamp;
+          atlas->stamp = manager->stamp;
+
+          direct_list_move_to_front( &atlas->cache->glyphs, &glyph->link );
+     }
+}
+
 DFBResult
 dfb_font_get_glyph_data( CoreFont       *font,
                          unsigned int    index,
                          unsigned int    layer,
                          CoreGlyphData **ret_data )
 {
-     DFBResult        ret;
-     CoreGlyphData   *data;
-     int              align;
-     DFBFontManager  *manager;
-     DFBFontCache    *cache;
-     DFBFontCacheRow *row = NULL;
+     DFBResult          ret;
+     CoreGlyphData     *data;
+     DFBFontManager    *manager;
+     DFBFontCache      *cache;
+     const GlyphFileRecord *record;
 
      D_DEBUG_AT( Core_Font, "%s( index %u, layer %u )\n", __FUNCTION__, index, layer );
 
@@ -820,29 +2128,13 @@ dfb_font_get_glyph_data( CoreFont       *font,
      manager = font->manager;
      DFB_FONT_MANAGER_ASSERT( manager );
 
-     /* Quick Lookup in array */
-     if (index < 128 && font->layers[layer].glyph_data[index]) {
-          data = font->layers[layer].glyph_data[index];
-          if (data->retry)
-               goto retry;
-
-          *ret_data = font->layers[layer].glyph_data[index];
-          return DFB_OK;
-     }
-
-     /* Standard lookup in hash */
-     data = direct_hash_lookup( font->layers[layer].glyph_hash, index );
+     data = glyph_table_lookup( font, index, layer );
      if (data) {
           D_MAGIC_ASSERT( data, CoreGlyphData );
 
           D_DEBUG_AT( Core_Font, "  -> already in cache (%p)\n", data );
 
-          row = data->row;
-          if (row) {
-               DFB_FONT_CACHE_ROW_ASSERT( row );
-
-               row->stamp = manager->row_stamp++;
-          }
+          glyph_touch( manager, data );
 
           if (data->retry)
                goto retry;
@@ -873,27 +2165,49 @@ dfb_font_get_glyph_data( CoreFont       *font,
 retry:
      data->retry = false;
 
-     /* Get glyph data from font implementation */
-     ret = font->GetGlyphData( font, index, data );
-     if (ret) {
-          D_DERROR( ret, "Core/Font: Could not get glyph info for index %d!\n", index );
-          data->start = data->width = data->height = 0;
+     /* Give back the space of a previous attempt. */
+     if (data->atlas)
+          release_glyph( data );
+
+     /* Use the glyph from the persistent cache if available... */
+     record = glyph_file_lookup( font, layer, index );
+     if (record) {
+          D_DEBUG_AT( Core_Font, "  -> found in glyph file\n" );
+
+          data->width    = record->width;
+          data->height   = record->height;
+          data->left     = record->left;
+          data->top      = record->top;
+          data->xadvance = record->xadvance;
+          data->yadvance = record->yadvance;
+     }
+     else {
+          /* ...or get glyph data from font implementation */
+          ret = font->GetGlyphData( font, index, data );
+          if (ret) {
+               D_DERROR( ret, "Core/Font: Could not get glyph info for index %d!\n", index );
+               data->start = data->width = data->height = 0;
 
-          /* If the font module returned BUFFEREMPTY we will retry loading next time */
-          if (ret == DFB_BUFFEREMPTY)
-               data->retry = true;
+               /* If the font module returned BUFFEREMPTY we will retry loading next time */
+               if (ret == DFB_BUFFEREMPTY)
+                    data->retry = true;
 
-          goto out;
-     }
+               goto out;
+          }
 
-     if (!(font->flags & CFF_SUBPIXEL_ADVANCE)) {
-          data->xadvance <<= 8;
-          data->yadvance <<= 8;
+          if (!(font->flags & CFF_SUBPIXEL_ADVANCE)) {
+               data->xadvance <<= 8;
+               data->yadvance <<= 8;
+          }
      }
 
      if (data->width < 1 || data->height < 1) {
           D_DEBUG_AT( Core_Font, "  -> zero size glyph bitmap!\n" );
           data->start = data->width = data->height = 0;
+
+          if (!record && font->glyph_file)
+               glyph_file_store( font->glyph_file, data );
+
           goto out;
      }
 
@@ -914,36 +2228,28 @@ retry:
           goto error;
      }
 
-     /* Check for a cache row (surface) to use */
-     ret = dfb_font_cache_get_row( cache, data->width, &row );
+     /* Find a place in one of the cache's atlases (surfaces) */
+     ret = dfb_font_cache_allocate( cache, data );
      if (ret) {
-          D_DEBUG_AT( Core_Font, "  -> could not get row from cache!\n" );
+          D_DEBUG_AT( Core_Font, "  -> could not allocate space in cache!\n" );
           goto error;
      }
 
-     /*
-      * Add the glyph to the cache row
-      */
-
-     D_DEBUG_AT( Core_FontSurfaces, "  -> render %2d - %2dx%2d at %03d font <%p>\n",
-                 index, data->width, data->height, row->next_x, font );
-
-     data->row     = row;
-     data->start   = row->next_x;
-     data->surface = row->surface;
-
-     align = (8 / (DFB_BYTES_PER_PIXEL( font->pixel_format ) ? : 1)) *
-                  (DFB_PIXELFORMAT_ALIGNMENT( font->pixel_format ) + 1) - 1;
-
-     row->next_x  += (data->width + align) & ~align;
-
-     row->stamp = manager->row_stamp++;
+     D_DEBUG_AT( Core_FontSurfaces, "  -> render %2d - %2dx%2d at %03d,%03d font <%p>\n",
+                 index, data->width, data->height, data->start, data->start_y, font );
 
      /* Render the glyph data into the surface. */
-     ret = font->RenderGlyph( font, index, data );
+     if (record)
+          ret = glyph_file_load( data, record );
+     else
+          ret = font->RenderGlyph( font, index, data );
+
      if (ret) {
           D_DEBUG_AT( Core_Font, "  -> rendering glyph failed!\n" );
-          data->start = data->width = data->height = 0;
+
+          release_glyph( data );
+
+          data->start = data->start_y = data->width = data->height = 0;
 
           /* If the font module returned BUFFEREMPTY we will retry loading next time */
           if (ret == DFB_BUFFEREMPTY)
@@ -954,18 +2260,15 @@ retry:
 
      dfb_gfxcard_flush_texture_cache();
 
+     if (!record && font->glyph_file)
+          glyph_file_store( font->glyph_file, data );
+
      CORE_GLYPH_DATA_DEBUG_AT( Core_Font, data );
 
 
 out:
      if (!data->inserted) {
-          if (row)
-               direct_list_append( &row->glyphs, &data->link );
-
-          direct_hash_insert( font->layers[layer].glyph_hash, index, data );
-
-          if (index < 128)
-               font->layers[layer].glyph_data[index] = data;
+          glyph_table_insert( font, index, layer, data );
 
           data->inserted = true;
      }
@@ -976,12 +2279,297 @@ out:
 
 
 error:
+     if (data->inserted) {
+          data->start = data->start_y = data->width = data->height = 0;
+
+          *ret_data = data;
+
+          return DFB_OK;
+     }
+
      D_MAGIC_CLEAR( data );
      D_FREE( data );
 
      return ret;
 }
 
+DFBResult
+dfb_font_get_glyphs( CoreFont           *font,
+                     const unsigned int *indices,
+                     unsigned int        num_indices,
+                     unsigned int        layer,
+                     CoreGlyphData     **ret_glyphs )
+{
+     unsigned int    i;
+     CoreGlyphData  *data;
+     DFBFontManager *manager;
+
+     D_DEBUG_AT( Core_Font, "%s( %u indices, layer %u )\n", __FUNCTION__, num_indices, layer );
+
+     D_MAGIC_ASSERT( font, CoreFont );
+     D_ASSERT( indices != NULL || num_indices == 0 );
+     D_ASSERT( ret_glyphs != NULL || num_indices == 0 );
+
+     D_ASSERT( layer < D_ARRAY_SIZE(font->layers) );
+
+     manager = font->manager;
+     DFB_FONT_MANAGER_ASSERT( manager );
+
+     for (i=0; i<num_indices; i++) {
+          /* Resolve glyphs in cache right here, going the long way for new ones only. */
+          data = glyph_table_lookup( font, indices[i], layer );
+          if (data && !data->retry) {
+               D_MAGIC_ASSERT( data, CoreGlyphData );
+
+               glyph_touch( manager, data );
+          }
+          else if (dfb_font_get_glyph_data( font, indices[i], layer, &data ))
+               data = NULL;
+
+          ret_glyphs[i] = data;
+     }
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+
+/* Number of laid out strings cached per font. */
+#define DFB_FONT_TEXT_RUNS      512
+
+/* Longer strings are laid out for each call. */
+#define DFB_FONT_TEXT_RUN_BYTES 256
+
+static void
+text_run_remove( CoreFont        *font,
+                 CoreFontTextRun *run )
+{
+     D_MAGIC_ASSERT( run, CoreFontTextRun );
+
+     direct_hash_remove( font->text_runs, run->key );
+     direct_list_remove( &font->text_run_lru, &run->link );
+
+     font->num_text_runs--;
+
+     D_MAGIC_CLEAR( run );
+     D_FREE( run );
+}
+
+static void
+text_runs_clear( CoreFont *font )
+{
+     while (font->text_run_lru)
+          text_run_remove( font, (CoreFontTextRun*) font->text_run_lru );
+
+     if (font->text_runs) {
+          direct_hash_destroy( font->text_runs );
+
+          font->text_runs = NULL;
+     }
+
+     if (font->text_run) {
+          D_MAGIC_CLEAR( font->text_run );
+          D_FREE( font->text_run );
+
+          font->text_run = NULL;
+     }
+}
+
+static CoreFontTextRun *
+text_run_layout( CoreFont           *font,
+                 const unsigned int *indices,
+                 int                 num,
+                 const void         *text,
+                 int                 bytes,
+                 bool               *ret_complete )
+{
+     int              i;
+     int              kx, ky;
+     int              x        = 0;
+     int              y        = 0;
+     unsigned int     prev     = 0;
+     bool             complete = true;
+     CoreGlyphData   *glyphs[num ? : 1];
+     CoreFontTextRun *run;
+
+     run = D_CALLOC( 1, sizeof(CoreFontTextRun) + num * (sizeof(DFBPoint) + sizeof(unsigned int)) + bytes );
+     if (!run) {
+          D_OOM();
+          return NULL;
+     }
+
+     run->positions = (DFBPoint*) (run + 1);
+     run->indices   = (unsigned int*) (run->positions + num);
+     run->text      = (const u8*) (run->indices + num);
+     run->bytes     = bytes;
+     run->num       = num;
+
+     direct_memcpy( run->indices, indices, num * sizeof(unsigned int) );
+     direct_memcpy( (u8*) run->text, text, bytes );
+
+     dfb_font_get_glyphs( font, indices, num, 0, glyphs );
+
+     for (i=0; i<num; i++) {
+          CoreGlyphData *glyph   = glyphs[i];
+          unsigned int   current = indices[i];
+
+          if (glyph) {
+               if (prev && font->GetKerning && font->GetKerning( font, prev, current, &kx, &ky ) == DFB_OK) {
+                    x += kx << 8;
+                    y += ky << 8;
+               }
+
+               /* Metrics may still change if loading is retried. */
+               if (glyph->retry)
+                    complete = false;
+          }
+          else
+               complete = false;
+
+          run->positions[i].x = x;
+          run->positions[i].y = y;
+
+          if (glyph) {
+               DFBRectangle rect = { x + (glyph->left << 8), y + (glyph->top << 8),
+                                     glyph->width << 8, glyph->height << 8 };
+
+               dfb_rectangle_union( &run->ink, &rect );
+
+               x += glyph->xadvance;
+               y += glyph->yadvance;
+          }
+
+          prev = current;
+     }
+
+     run->advance_x = x;
+     run->advance_y = y;
+
+     D_MAGIC_SET( run, CoreFontTextRun );
+
+     *ret_complete = complete;
+
+     return run;
+}
+
+DFBResult
+dfb_font_get_text_run( CoreFont               *font,
+                       DFBTextEncodingID       encoding,
+                       const void             *text,
+                       int                     bytes,
+                       const CoreFontTextRun **ret_run )
+{
+     DFBResult        ret;
+     int              num;
+     unsigned long    key   = 0;
+     bool             cache = false;
+     bool             complete;
+     CoreFontTextRun *run;
+     unsigned int     indices[bytes ? : 1];
+
+     D_DEBUG_AT( Core_Font, "%s( %p [%d], %d )\n", __FUNCTION__, text, bytes, encoding );
+
+     D_MAGIC_ASSERT( font, CoreFont );
+     D_ASSERT( text != NULL );
+     D_ASSERT( bytes >= 0 );
+     D_ASSERT( ret_run != NULL );
+
+     if (bytes <= DFB_FONT_TEXT_RUN_BYTES) {
+          key = glyph_file_hash( glyph_file_hash( 0xcbf29ce484222325ULL, &encoding, sizeof(encoding) ), text, bytes );
+
+          if (!font->text_runs)
+               direct_hash_create( 163, &font->text_runs );
+
+          cache = font->text_runs != NULL;
+     }
+
+     if (cache) {
+          run = direct_hash_lookup( font->text_runs, key );
+          if (run) {
+               D_MAGIC_ASSERT( run, CoreFontTextRun );
+
+               if (run->encoding == encoding && run->bytes == bytes && !memcmp( run->text, text, bytes )) {
+                    D_DEBUG_AT( Core_Font, "  -> cached (%d glyphs)\n", run->num );
+
+                    direct_list_move_to_front( &font->text_run_lru, &run->link );
+
+                    *ret_run = run;
+
+                    return DFB_OK;
+               }
+
+               /* Another text with the same key. */
+               text_run_remove( font, run );
+          }
+     }
+
+     /* Decode string to character indices. */
+     ret = dfb_font_decode_text( font, encoding, text, bytes, indices, &num );
+     if (ret)
+          return ret;
+
+     run = text_run_layout( font, indices, num, text, bytes, &complete );
+     if (!run)
+          return DFB_NOSYSTEMMEMORY;
+
+     run->key      = key;
+     run->encoding = encoding;
+
+     D_DEBUG_AT( Core_Font, "  -> laid out %d glyphs%s\n", num, complete ? "" : " (incomplete)" );
+
+     if (cache && complete) {
+          if (font->num_text_runs == DFB_FONT_TEXT_RUNS)
+               text_run_remove( font, (CoreFontTextRun*) font->text_run_lru->prev );
+
+          ret = direct_hash_insert( font->text_runs, key, run );
+          if (ret == DFB_OK) {
+               direct_list_prepend( &font->text_run_lru, &run->link );
+
+               font->num_text_runs++;
+
+               *ret_run = run;
+
+               return DFB_OK;
+          }
+     }
+
+     /* Keep the run until the next call. */
+     if (font->text_run) {
+          D_MAGIC_CLEAR( font->text_run );
+          D_FREE( font->text_run );
+     }
+
+     font->text_run = run;
+
+     *ret_run = run;
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_font_insert_glyph( CoreFont      *font,
+                       unsigned int   index,
+                       unsigned int   layer,
+                       CoreGlyphData *data )
+{
+     DFBResult ret;
+
+     D_DEBUG_AT( Core_Font, "%s( index %u, layer %u )\n", __FUNCTION__, index, layer );
+
+     D_MAGIC_ASSERT( font, CoreFont );
+     D_MAGIC_ASSERT( data, CoreGlyphData );
+
+     D_ASSERT( layer < D_ARRAY_SIZE(font->layers) );
+
+     ret = glyph_table_insert( font, index, layer, data );
+     if (ret)
+          return ret;
+
+     data->inserted = true;
+
+     return DFB_OK;
+}
+
 /**********************************************************************************************************************/
 
 DFBResult
@@ -1161,8 +2749,8 @@ free_glyphs( DirectHash    *hash,
 {
      D_DEBUG_AT( Core_Font, "%s( %lu )\n", __FUNCTION__, key );
 
-     CoreGlyphData   *data = value;
-     DFBFontCacheRow *row;
+     CoreGlyphData     *data = value;
+     DFBFontCacheAtlas *atlas;
 
      D_MAGIC_ASSERT( data, CoreGlyphData );
 
@@ -1172,31 +2760,30 @@ free_glyphs( DirectHash    *hash,
      direct_hash_remove( hash, key );
 
 
-     row = data->row;
-     if (row) {
-          DFB_FONT_CACHE_ROW_ASSERT( row );
-
-          /* Remove glyph from cache row. */
-          direct_list_remove( &row->glyphs, &data->link );
+     atlas = data->atlas;
+     if (atlas) {
+          DFBFontManager *manager;
+          DFBFontCache   *cache = atlas->cache;
 
-          /* If cache row got empty, destroy it. */
-          if (!row->glyphs) {
-               DFBFontManager *manager;
-               DFBFontCache   *cache = row->cache;
+          DFB_FONT_CACHE_ASSERT( cache );
 
-               DFB_FONT_CACHE_ASSERT( cache );
+          manager = cache->manager;
+          DFB_FONT_MANAGER_ASSERT( manager );
 
-               manager = cache->manager;
-               DFB_FONT_MANAGER_ASSERT( manager );
+          /* Give back the glyph's space in the atlas. */
+          release_glyph( data );
 
-               /* Remove row from cache. */
-               direct_list_remove( &cache->rows, &row->link );
+          /* If cache atlas got empty, destroy it. */
+          if (!atlas->num_glyphs) {
+               /* Remove atlas from cache. */
+               direct_list_remove( &cache->atlases, &atlas->link );
 
-               /* Destroy row. */
-               dfb_font_cache_row_destroy( row );
+               /* Decrease row counters. */
+               manager->num_rows -= atlas->rows;
+               cache->num_rows   -= atlas->rows;
 
-               /* Decrease row counter in manager. */
-               manager->num_rows--;
+               /* Destroy atlas. */
+               dfb_font_cache_atlas_destroy( atlas );
           }
      }
 
@@ -47,6 +47,15 @@ typedef struct {
      DFBSurfaceCapabilities   surface_caps;
 } DFBFontCacheType;
 
+typedef struct {
+     unsigned int             atlases;       /* number of atlases (surfaces) in all caches */
+     unsigned int             glyphs;        /* number of glyphs in all atlases */
+     unsigned long long       area;          /* pixels of all atlases */
+     unsigned long long       used;          /* pixels occupied by glyphs */
+     unsigned int             evictions;     /* glyphs evicted to make room for others */
+     unsigned int             compactions;   /* atlases repacked to collect fragmented space */
+} DFBFontManagerStats;
+
 
 DFBResult dfb_font_manager_create        ( CoreDFB                 *core,
                                            DFBFontManager         **ret_manager );
@@ -62,7 +71,10 @@ DFBResult dfb_font_manager_get_cache     ( DFBFontManager          *manager,
                                            const DFBFontCacheType  *type,
                                            DFBFontCache           **ret_cache );
 
-DFBResult dfb_font_manager_remove_lru_row( DFBFontManager          *manager );
+DFBResult dfb_font_manager_remove_lru_atlas( DFBFontManager        *manager );
+
+DFBResult dfb_font_manager_get_stats     ( DFBFontManager          *manager,
+                                           DFBFontManagerStats     *ret_stats );
 
 DFBResult dfb_font_cache_create          ( DFBFontManager          *manager,
                                            const DFBFontCacheType  *type,
@@ -72,16 +84,17 @@ DFBResult dfb_font_cache_init            ( DFBFontCache            *cache,
                                            DFBFontManager          *manager,
                                            const DFBFontCacheType  *type );
 DFBResult dfb_font_cache_deinit          ( DFBFontCache            *cache );
-DFBResult dfb_font_cache_get_row         ( DFBFontCache            *cache,
-                                           unsigned int             width,
-                                           DFBFontCacheRow        **ret_row );
+DFBResult dfb_font_cache_allocate        ( DFBFontCache            *cache,
+                                           CoreGlyphData           *glyph );
 
-DFBResult dfb_font_cache_row_create      ( DFBFontCache            *cache,
-                                           DFBFontCacheRow        **ret_row );
-DFBResult dfb_font_cache_row_destroy     ( DFBFontCacheRow         *row );
-DFBResult dfb_font_cache_row_init        ( DFBFontCacheRow         *row,
-                                           DFBFontCache            *cache );
-DFBResult dfb_font_cache_row_deinit      ( DFBFontCacheRow         *row );
+DFBResult dfb_font_cache_atlas_create    ( DFBFontCache            *cache,
+                                           unsigned int             rows,
+                                           DFBFontCacheAtlas      **ret_atlas );
+DFBResult dfb_font_cache_atlas_destroy   ( DFBFontCacheAtlas       *atlas );
+DFBResult dfb_font_cache_atlas_init      ( DFBFontCacheAtlas       *atlas,
+                                           DFBFontCache            *cache,
+                                           unsigned int             rows );
+DFBResult dfb_font_cache_atlas_deinit    ( DFBFontCacheAtlas       *atlas );
 
 
 
@@ -91,37 +104,39 @@ DFBResult dfb_font_cache_row_deinit      ( DFBFontCacheRow         *row );
  * glyph struct
  */
 struct _CoreGlyphData {
-     DirectLink       link;
+     DirectLink         link;               /* in the cache's LRU list          */
 
-     CoreFont        *font;
+     CoreFont          *font;
 
-     unsigned int     index;
-     unsigned int     layer;
+     unsigned int       index;
+     unsigned int       layer;
 
-     CoreSurface     *surface;              /* contains bitmap of glyph         */
-     int              start;                /* x offset of glyph in surface     */
-     int              width;                /* width of the glyphs bitmap       */
-     int              height;               /* height of the glyphs bitmap      */
-     int              left;                 /* x offset of the glyph            */
-     int              top;                  /* y offset of the glyph            */
-     int              xadvance;             /* placement of next glyph          */
-     int              yadvance;
+     CoreSurface       *surface;            /* contains bitmap of glyph         */
+     int                start;              /* x offset of glyph in surface     */
+     int                start_y;            /* y offset of glyph in surface     */
+     int                width;              /* width of the glyphs bitmap       */
+     int                height;             /* height of the glyphs bitmap      */
+     int                left;               /* x offset of the glyph            */
+     int                top;                /* y offset of the glyph            */
+     int                xadvance;           /* placement of next glyph          */
+     int                yadvance;
 
-     int              magic;
+     int                magic;
 
-     DFBFontCacheRow *row;
+     DFBFontCacheAtlas *atlas;
+     unsigned int       stamp;              /* manager stamp of last use        */
 
-     bool             inserted;
-     bool             retry;
+     bool               inserted;
+     bool               retry;
 };
 
 #define CORE_GLYPH_DATA_DEBUG_AT(Domain, data)                                       \
      do {                                                                            \
           D_DEBUG_AT( Domain, "  -> index    %d\n", (data)->index );                 \
           D_DEBUG_AT( Domain, "  -> layer    %d\n", (data)->layer );                 \
-          D_DEBUG_AT( Domain, "  -> row      %p\n", (data)->row );                   \
+          D_DEBUG_AT( Domain, "  -> atlas    %p\n", (data)->atlas );                 \
           D_DEBUG_AT( Domain, "  -> surface  %p\n", (data)->surface );               \
-          D_DEBUG_AT( Domain, "  -> start    %d\n", (data)->start );                 \
+          D_DEBUG_AT( Domain, "  -> start    %d,%d\n", (data)->start, (data)->start_y ); \
           D_DEBUG_AT( Domain, "  -> width    %d\n", (data)->width );                 \
           D_DEBUG_AT( Domain, "  -> height   %d\n", (data)->height );                \
           D_DEBUG_AT( Domain, "  -> left     %d\n", (data)->left );                  \
@@ -130,6 +145,28 @@ struct _CoreGlyphData {
           D_DEBUG_AT( Domain, "  -> yadvance %d\n", (data)->yadvance );              \
      } while (0)
 
+/*
+ * laid out string, positions and extents in 1/256 pixels relative to the origin of the baseline
+ */
+struct _CoreFontTextRun {
+     DirectLink         link;               /* in the font's LRU list           */
+
+     unsigned long      key;                /* hash of encoding and text        */
+     DFBTextEncodingID  encoding;
+     const u8          *text;               /* copy of the text                 */
+     int                bytes;
+
+     int                num;                /* number of glyphs                 */
+     unsigned int      *indices;            /* glyph index per glyph            */
+     DFBPoint          *positions;          /* pen position per glyph, kerned   */
+
+     int                advance_x;          /* pen movement of the whole run    */
+     int                advance_y;
+     DFBRectangle       ink;                /* union of glyph bitmaps (layer 0) */
+
+     int                magic;
+};
+
 typedef struct {
      DFBResult   (* GetCharacterIndex) ( CoreFont       *thiz,
                                          unsigned int    character,
@@ -164,6 +201,10 @@ typedef enum {
 
 #define DFB_FONT_MAX_LAYERS 2
 
+#define DFB_FONT_GLYPH_PAGE_BITS  8
+#define DFB_FONT_GLYPH_PAGE_SIZE  (1 << DFB_FONT_GLYPH_PAGE_BITS)
+#define DFB_FONT_GLYPH_PAGES      256    /* lookup table covers indices below 65536 */
+
 /*
  * font struct
  */
@@ -182,10 +223,17 @@ struct _CoreFont {
 
      DFBFontAttributes             attributes;
 
+     DFBFontGlyphFile             *glyph_file;    /* persistent glyph cache, if enabled */
+
+     DirectHash                   *text_runs;     /* laid out strings by key          */
+     DirectLink                   *text_run_lru;  /* most recently used run first     */
+     unsigned int                  num_text_runs;
+     CoreFontTextRun              *text_run;      /* last run not kept in the cache   */
 
      struct {
           DirectHash              *glyph_hash;    /* infos about loaded glyphs        */
-          CoreGlyphData           *glyph_data[128];
+          CoreGlyphData          **glyph_pages[DFB_FONT_GLYPH_PAGES]; /* lookup table, pages
+                                                                     allocated on demand */
      } layers[DFB_FONT_MAX_LAYERS];
 
      int                           height;        /* font height                      */
@@ -219,6 +267,10 @@ struct _CoreFont {
                                                    int           *ret_x,
                                                    int           *ret_y );
 
+     DFBResult                  (* PrefetchGlyphs)( CoreFont           *thiz,
+                                                    const unsigned int *indices,
+                                                    unsigned int        num_indices );
+
 
      int                           magic;
 
@@ -275,6 +327,29 @@ dfb_font_unlock( CoreFont *font )
      dfb_font_manager_unlock( font->manager );
 }
 
+/*
+ * opens the persistent glyph cache file of the font, keyed by the font data and its description
+ */
+DFBResult dfb_font_open_glyph_file( CoreFont           *font,
+                                    const void         *content,
+                                    unsigned int        content_size );
+
+/*
+ * loads all glyphs of a string not cached yet, rasterizing them in parallel if supported by the font,
+ * the font must not be locked by the caller
+ */
+DFBResult dfb_font_prefetch_glyphs( CoreFont           *font,
+                                    const unsigned int *indices,
+                                    unsigned int        num_indices );
+
+/*
+ * decodes the text and prefetches its glyphs, to be called before locking the font for dfb_font_get_text_run()
+ */
+DFBResult dfb_font_prefetch_text  ( CoreFont           *font,
+                                    DFBTextEncodingID   encoding,
+                                    const void         *text,
+                                    int                 bytes );
+
 /*
  * loads glyph data from font
  */
@@ -283,6 +358,34 @@ DFBResult dfb_font_get_glyph_data( CoreFont        *font,
                                    unsigned int     layer,
                                    CoreGlyphData  **glyph_data );
 
+/*
+ * loads glyph data of all indices of a string, failed ones are returned as NULL
+ */
+DFBResult dfb_font_get_glyphs    ( CoreFont           *font,
+                                   const unsigned int *indices,
+                                   unsigned int        num_indices,
+                                   unsigned int        layer,
+                                   CoreGlyphData     **ret_glyphs );
+
+/*
+ * returns the laid out string from the font's cache, decoding it and loading its glyphs if not cached yet,
+ * the font must be locked and the run is valid until the next call or unlocking,
+ * see dfb_font_prefetch_text() for loading the glyphs in advance
+ */
+DFBResult dfb_font_get_text_run  ( CoreFont               *font,
+                                   DFBTextEncodingID       encoding,
+                                   const void             *text,
+                                   int                     bytes,
+                                   const CoreFontTextRun **ret_run );
+
+/*
+ * adds glyph data provided by the font implementation, e.g. preloaded glyphs
+ */
+DFBResult dfb_font_insert_glyph  ( CoreFont           *font,
+                                   unsigned int        index,
+                                   unsigned int        layer,
+                                   CoreGlyphData      *glyph_data );
+
 
 /*
  * Called by font module to register encoding implementations.
@@ -3531,20 +3531,18 @@ dfb_gfxcard_drawstring( const u8 *text, int bytes,
                         DFBTextEncodingID encoding, int x, int y,
                         CoreFont *font, unsigned int layers, CoreGraphicsStateClient *client )
 {
-     DFBResult     ret;
-     unsigned int  prev = 0;
-     unsigned int  indices[bytes];
-     int           i, l, num;
-     int           kern_x;
-     int           kern_y;
-     CoreSurface  *surface;
-     CardState     state_backup;
-     DFBPoint      points[50];
-     DFBRectangle  rects[50];
-     int           num_blits = 0;
-     int           ox = x;
-     int           oy = y;
-     CardState    *state;
+     DFBResult              ret;
+     const CoreFontTextRun *run;
+     CoreGlyphData         *glyphs[bytes];
+     int                    i, l;
+     CoreSurface           *surface;
+     CardState              state_backup;
+     DFBPoint               points[50];
+     DFBRectangle           rects[50];
+     int                    num_blits = 0;
+     int                    ox = x;
+     int                    oy = y;
+     CardState             *state;
 
      if (encoding == DTEID_UTF8)
           D_DEBUG_AT( Core_GraphicsOps, "%s( '%s' [%d], %d,%d, %p, %p )\n",
@@ -3576,15 +3574,20 @@ dfb_gfxcard_drawstring( const u8 *text, int bytes,
           }
      }
 
-     /* Decode string to character indices. */
-     ret = dfb_font_decode_text( font, encoding, text, bytes, indices, &num );
-     if (ret)
+     /* Load missing glyphs at once, possibly in parallel, before locking the font. */
+     dfb_font_prefetch_text( font, encoding, text, bytes );
+
+     dfb_font_lock( font );
+
+     /* Get the laid out string, decoding it and loading missing glyphs if not cached. */
+     ret = dfb_font_get_text_run( font, encoding, text, bytes, &run );
+     if (ret) {
+          dfb_font_unlock( font );
           return;
+     }
 
      font_state_prepare( state, &state_backup, font, surface );
 
-     dfb_font_lock( font );
-
      for (l=layers-1; l>=0; l--) {
           x = ox << 8;
           y = oy << 8;
@@ -3592,25 +3595,22 @@ dfb_gfxcard_drawstring( const u8 *text, int bytes,
           if (layers > 1)
                dfb_state_set_color( state, &state->colors[l] );
 
+          /* Look up all glyphs of the layer at once. */
+          dfb_font_get_glyphs( font, run->indices, run->num, l, glyphs );
+
           /* blit glyphs */
-          for (i=0; i<num; i++) {
-               DFBResult      ret;
-               CoreGlyphData *glyph;
-               unsigned int   current = indices[i];
+          for (i=0; i<run->num; i++) {
+               CoreGlyphData *glyph = glyphs[i];
 
-               ret = dfb_font_get_glyph_data( font, current, l, &glyph );
-               if (ret) {
-                    D_DEBUG_AT( Core_GraphicsOps, "  -> dfb_font_get_glyph_data() failed! [%s]\n", DirectFBErrorString( ret ) );
-                    prev = current;
+               if (!glyph) {
+                    D_DEBUG_AT( Core_GraphicsOps, "  -> no glyph data for index %u!\n", run->indices[i] );
                     continue;
                }
 
-               if (prev && font->GetKerning && font->GetKerning( font, prev, current, &kern_x, &kern_y) == DFB_OK) {
-                    x += kern_x << 8;
-                    y += kern_y << 8;
-               }
-
                if (glyph->width) {
+                    int gx = (x + run->positions[i].x) >> 8;
+                    int gy = (y + run->positions[i].y) >> 8;
+
                     if (glyph->surface != state->source || num_blits == D_ARRAY_SIZE(rects)) {
                          if (num_blits) {
                               CoreGraphicsStateClient_Blit( client, rects, points, num_blits );
@@ -3621,15 +3621,11 @@ dfb_gfxcard_drawstring( const u8 *text, int bytes,
                               dfb_state_set_source( state, glyph->surface );
                     }
 
-                    points[num_blits] = (DFBPoint){ (x >> 8) + glyph->left, (y >> 8) + glyph->top };
-                    rects[num_blits]  = (DFBRectangle){ glyph->start, 0, glyph->width, glyph->height };
+                    points[num_blits] = (DFBPoint){ gx + glyph->left, gy + glyph->top };
+                    rects[num_blits]  = (DFBRectangle){ glyph->start, glyph->start_y, glyph->width, glyph->height };
 
                     num_blits++;
                }
-
-               x   += glyph->xadvance;
-               y   += glyph->yadvance;
-               prev = current;
           }
 
           if (num_blits) {
@@ -3674,7 +3670,7 @@ void dfb_gfxcard_drawglyph( CoreGlyphData **glyph, int x, int y,
 
           /* blit glyph */
           if (glyph[l]->width) {
-               DFBRectangle rect  = { glyph[l]->start, 0, glyph[l]->width, glyph[l]->height };
+               DFBRectangle rect  = { glyph[l]->start, glyph[l]->start_y, glyph[l]->width, glyph[l]->height };
                DFBPoint     point = { x + glyph[l]->left, y + glyph[l]->top };
 
                dfb_state_set_source( state, glyph[l]->surface );
@@ -0,0 +1,408 @@
+/*
+   (c) Copyright 2001-2009  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <directfb.h>
+#include <directfb_util.h>
+
+#include <direct/debug.h>
+#include <direct/list.h>
+#include <direct/memcpy.h>
+#include <direct/messages.h>
+
+#include <fusion/conf.h>
+#include <fusion/shmalloc.h>
+
+#include <core/core.h>
+#include <core/core_parts.h>
+#include <core/imagecache.h>
+#include <core/surface.h>
+
+#include <misc/conf.h>
+
+
+D_DEBUG_DOMAIN( Core_ImageCache, "Core/ImageCache", "DirectFB Image Cache Core" );
+
+/**********************************************************************************************************************/
+
+typedef struct {
+     DirectLink              link;
+
+     int                     magic;
+
+     DFBImageCacheKey        key;
+     void                   *data;      /* copy of the encoded data, key.length bytes */
+
+     CoreSurface            *surface;   /* global reference */
+     unsigned int            size;      /* bytes accounted for the surface and the encoded data */
+} DFBImageCacheEntry;
+
+typedef struct {
+     int                     magic;
+
+     FusionSkirmish          lock;
+
+     DirectLink             *entries;   /* most recently used first */
+     unsigned int            num;
+     unsigned int            size;      /* total bytes of all entries */
+     unsigned int            budget;    /* limit of the total size, from the master's configuration */
+
+     FusionSHMPoolShared    *shmpool;
+} DFBImageCacheCoreShared;
+
+struct __DFB_DFBImageCacheCore {
+     int                      magic;
+
+     CoreDFB                 *core;
+
+     DFBImageCacheCoreShared *shared;
+};
+
+
+DFB_CORE_PART( image_cache_core, ImageCacheCore );
+
+/**********************************************************************************************************************/
+
+static void
+entry_remove( DFBImageCacheCoreShared *shared,
+              DFBImageCacheEntry      *entry )
+{
+     D_MAGIC_ASSERT( shared, DFBImageCacheCoreShared );
+     D_MAGIC_ASSERT( entry, DFBImageCacheEntry );
+
+     D_DEBUG_AT( Core_ImageCache, "  -> removing %dx%d %s (%u bytes)\n", entry->key.width, entry->key.height,
+                 dfb_pixelformat_name( entry->key.format ), entry->size );
+
+     D_ASSERT( shared->num > 0 );
+     D_ASSERT( shared->size >= entry->size );
+
+     direct_list_remove( &shared->entries, &entry->link );
+
+     shared->num--;
+     shared->size -= entry->size;
+
+     dfb_surface_unlink( &entry->surface );
+
+     SHFREE( shared->shmpool, entry->data );
+
+     D_MAGIC_CLEAR( entry );
+
+     SHFREE( shared->shmpool, entry );
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+dfb_image_cache_core_initialize( CoreDFB                 *core,
+                                 DFBImageCacheCore       *data,
+                                 DFBImageCacheCoreShared *shared )
+{
+     D_DEBUG_AT( Core_ImageCache, "dfb_image_cache_core_initialize( %p, %p, %p )\n", core, data, shared );
+
+     D_ASSERT( data != NULL );
+     D_ASSERT( shared != NULL );
+
+     data->core   = core;
+     data->shared = shared;
+
+     shared->shmpool = dfb_core_shmpool( core );
+     shared->budget  = dfb_config->image_cache_size;
+
+     fusion_skirmish_init2( &shared->lock, "Image Cache Core", dfb_core_world(core), fusion_config->secure_fusion );
+
+     D_MAGIC_SET( data, DFBImageCacheCore );
+     D_MAGIC_SET( shared, DFBImageCacheCoreShared );
+
+     return DFB_OK;
+}
+
+static DFBResult
+dfb_image_cache_core_join( CoreDFB                 *core,
+                           DFBImageCacheCore       *data,
+                           DFBImageCacheCoreShared *shared )
+{
+     D_DEBUG_AT( Core_ImageCache, "dfb_image_cache_core_join( %p, %p, %p )\n", core, data, shared );
+
+     D_ASSERT( data != NULL );
+     D_MAGIC_ASSERT( shared, DFBImageCacheCoreShared );
+
+     data->core   = core;
+     data->shared = shared;
+
+     D_MAGIC_SET( data, DFBImageCacheCore );
+
+     return DFB_OK;
+}
+
+static DFBResult
+dfb_image_cache_core_shutdown( DFBImageCacheCore *data,
+                               bool               emergency )
+{
+     DFBImageCacheCoreShared *shared;
+     DFBImageCacheEntry      *entry, *next;
+
+     D_DEBUG_AT( Core_ImageCache, "dfb_image_cache_core_shutdown( %p, %semergency )\n", data, emergency ? "" : "no " );
+
+     D_MAGIC_ASSERT( data, DFBImageCacheCore );
+
+     shared = data->shared;
+
+     D_MAGIC_ASSERT( shared, DFBImageCacheCoreShared );
+
+     direct_list_foreach_safe (entry, next, shared->entries)
+          entry_remove( shared, entry );
+
+     D_ASSERT( shared->num == 0 );
+     D_ASSERT( shared->size == 0 );
+
+     fusion_skirmish_destroy( &shared->lock );
+
+     D_MAGIC_CLEAR( data );
+     D_MAGIC_CLEAR( shared );
+
+     return DFB_OK;
+}
+
+static DFBResult
+dfb_image_cache_core_leave( DFBImageCacheCore *data,
+                            bool               emergency )
+{
+     D_DEBUG_AT( Core_ImageCache, "dfb_image_cache_core_leave( %p, %semergency )\n", data, emergency ? "" : "no " );
+
+     D_MAGIC_ASSERT( data, DFBImageCacheCore );
+     D_MAGIC_ASSERT( data->shared, DFBImageCacheCoreShared );
+
+     D_MAGIC_CLEAR( data );
+
+     return DFB_OK;
+}
+
+static DFBResult
+dfb_image_cache_core_suspend( DFBImageCacheCore *data )
+{
+     D_DEBUG_AT( Core_ImageCache, "dfb_image_cache_core_suspend( %p )\n", data );
+
+     D_MAGIC_ASSERT( data, DFBImageCacheCore );
+     D_MAGIC_ASSERT( data->shared, DFBImageCacheCoreShared );
+
+     return DFB_OK;
+}
+
+static DFBResult
+dfb_image_cache_core_resume( DFBImageCacheCore *data )
+{
+     D_DEBUG_AT( Core_ImageCache, "dfb_image_cache_core_resume( %p )\n", data );
+
+     D_MAGIC_ASSERT( data, DFBImageCacheCore );
+     D_MAGIC_ASSERT( data->shared, DFBImageCacheCoreShared );
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+
+u64
+dfb_image_cache_hash( const void   *data,
+                      unsigned int  length )
+{
+     const u8 *bytes = data;
+     u64       hash  = 0xcbf29ce484222325ULL;
+
+     D_ASSERT( data != NULL || length == 0 );
+
+     /* FNV-1a */
+     while (length--) {
+          hash ^= *bytes++;
+          hash *= 0x100000001b3ULL;
+     }
+
+     return hash;
+}
+
+static DFBImageCacheEntry *
+entry_find( DFBImageCacheCoreShared *shared,
+            const DFBImageCacheKey  *key,
+            const void              *data )
+{
+     DFBImageCacheEntry *entry;
+
+     /* Entries are limited by the budget, a linear search is fine. */
+     direct_list_foreach (entry, shared->entries) {
+          D_MAGIC_ASSERT( entry, DFBImageCacheEntry );
+
+          /* The hash only rules out most entries, never trust it for a match. */
+          if (!memcmp( &entry->key, key, sizeof(DFBImageCacheKey) ) && !memcmp( entry->data, data, key->length ))
+               return entry;
+     }
+
+     return NULL;
+}
+
+DFBResult
+dfb_image_cache_lookup( DFBImageCacheCore       *cache,
+                        const DFBImageCacheKey  *key,
+                        const void              *data,
+                        CoreSurface            **ret_surface )
+{
+     DFBResult                ret;
+     DFBImageCacheCoreShared *shared;
+     DFBImageCacheEntry      *entry;
+
+     D_MAGIC_ASSERT( cache, DFBImageCacheCore );
+     D_ASSERT( key != NULL );
+     D_ASSERT( data != NULL );
+     D_ASSERT( ret_surface != NULL );
+
+     D_DEBUG_AT( Core_ImageCache, "%s( %dx%d %s, source 0x%016llx )\n", __FUNCTION__, key->width, key->height,
+                 dfb_pixelformat_name( key->format ), (unsigned long long) key->source );
+
+     shared = cache->shared;
+
+     D_MAGIC_ASSERT( shared, DFBImageCacheCoreShared );
+
+     if (fusion_skirmish_prevail( &shared->lock ))
+          return DFB_FUSION;
+
+     entry = entry_find( shared, key, data );
+     if (!entry) {
+          fusion_skirmish_dismiss( &shared->lock );
+          return DFB_ITEMNOTFOUND;
+     }
+
+     /* The caller's reference keeps the surface while the entry might be evicted. */
+     ret = dfb_surface_ref( entry->surface );
+     if (ret) {
+          fusion_skirmish_dismiss( &shared->lock );
+          return ret;
+     }
+
+     direct_list_move_to_front( &shared->entries, &entry->link );
+
+     *ret_surface = entry->surface;
+
+     fusion_skirmish_dismiss( &shared->lock );
+
+     D_DEBUG_AT( Core_ImageCache, "  -> hit (%p)\n", *ret_surface );
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_image_cache_insert( DFBImageCacheCore      *cache,
+                        const DFBImageCacheKey *key,
+                        const void             *data,
+                        CoreSurface            *surface )
+{
+     DFBResult                ret;
+     DFBImageCacheCoreShared *shared;
+     DFBImageCacheEntry      *entry;
+     unsigned int             size;
+
+     D_MAGIC_ASSERT( cache, DFBImageCacheCore );
+     D_ASSERT( key != NULL );
+     D_ASSERT( data != NULL );
+     D_MAGIC_ASSERT( surface, CoreSurface );
+
+     D_DEBUG_AT( Core_ImageCache, "%s( %dx%d %s, source 0x%016llx )\n", __FUNCTION__, key->width, key->height,
+                 dfb_pixelformat_name( key->format ), (unsigned long long) key->source );
+
+     shared = cache->shared;
+
+     D_MAGIC_ASSERT( shared, DFBImageCacheCoreShared );
+
+     size = DFB_BYTES_PER_LINE( surface->config.format, surface->config.size.w ) *
+            DFB_PLANE_MULTIPLY( surface->config.format, surface->config.size.h ) + key->length;
+
+     if (size > shared->budget) {
+          D_DEBUG_AT( Core_ImageCache, "  -> %u bytes exceed budget of %u\n", size, shared->budget );
+          return DFB_LIMITEXCEEDED;
+     }
+
+     if (fusion_skirmish_prevail( &shared->lock ))
+          return DFB_FUSION;
+
+     /* Another process may have decoded the same image meanwhile. */
+     if (entry_find( shared, key, data )) {
+          D_DEBUG_AT( Core_ImageCache, "  -> already cached\n" );
+
+          fusion_skirmish_dismiss( &shared->lock );
+          return DFB_OK;
+     }
+
+     /* Evict least recently used images until the new one fits. */
+     while (shared->size + size > shared->budget) {
+          entry = (DFBImageCacheEntry*) direct_list_get_last( shared->entries );
+
+          D_ASSERT( entry != NULL );
+
+          entry_remove( shared, entry );
+     }
+
+     entry = SHCALLOC( shared->shmpool, 1, sizeof(DFBImageCacheEntry) );
+     if (!entry) {
+          fusion_skirmish_dismiss( &shared->lock );
+          return D_OOSHM();
+     }
+
+     entry->data = SHMALLOC( shared->shmpool, key->length ?: 1 );
+     if (!entry->data) {
+          SHFREE( shared->shmpool, entry );
+          fusion_skirmish_dismiss( &shared->lock );
+          return D_OOSHM();
+     }
+
+     direct_memcpy( entry->data, data, key->length );
+
+     ret = dfb_surface_link( &entry->surface, surface );
+     if (ret) {
+          SHFREE( shared->shmpool, entry->data );
+          SHFREE( shared->shmpool, entry );
+          fusion_skirmish_dismiss( &shared->lock );
+          return ret;
+     }
+
+     entry->key  = *key;
+     entry->size = size;
+
+     D_MAGIC_SET( entry, DFBImageCacheEntry );
+
+     direct_list_prepend( &shared->entries, &entry->link );
+
+     shared->num++;
+     shared->size += size;
+
+     D_DEBUG_AT( Core_ImageCache, "  -> %u images, %u bytes\n", shared->num, shared->size );
+
+     fusion_skirmish_dismiss( &shared->lock );
+
+     return DFB_OK;
+}
+
@@ -0,0 +1,80 @@
+/*
+   (c) Copyright 2001-2009  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef __CORE__IMAGECACHE_H__
+#define __CORE__IMAGECACHE_H__
+
+#include <directfb.h>
+
+#include <core/coretypes.h>
+
+
+/*
+ * Identifies a decoded image: the encoded data and everything the decoder output depends on.
+ *
+ * Clear the whole key before filling it in, keys are compared bytewise.
+ * Entries with a matching key are only used if the encoded data is equal, too.
+ */
+typedef struct {
+     u64                      source;        /* hash of the encoded data */
+     unsigned int             length;        /* length of the encoded data */
+
+     int                      width;         /* size the image has been rendered at */
+     int                      height;
+     DFBSurfacePixelFormat    format;        /* format and color space of the destination */
+     DFBSurfaceColorSpace     colorspace;
+     DFBSurfaceCapabilities   caps;          /* only DSCAPS_PREMULTIPLIED is relevant */
+     DIRenderFlags            flags;         /* render flags set on the provider */
+} DFBImageCacheKey;
+
+
+u64       dfb_image_cache_hash  ( const void             *data,
+                                  unsigned int            length );
+
+/*
+ * Returns a surface with a local reference holding the decoded image of the encoded data (key->length bytes),
+ * or DFB_ITEMNOTFOUND if there's no such image in the cache.
+ */
+DFBResult dfb_image_cache_lookup( DFBImageCacheCore      *cache,
+                                  const DFBImageCacheKey *key,
+                                  const void             *data,
+                                  CoreSurface           **ret_surface );
+
+/*
+ * Adds the surface holding the decoded image along with a copy of the encoded data,
+ * evicting least recently used images to stay within the budget.
+ *
+ * Returns DFB_LIMITEXCEEDED if the image alone is larger than the budget.
+ */
+DFBResult dfb_image_cache_insert( DFBImageCacheCore      *cache,
+                                  const DFBImageCacheKey *key,
+                                  const void             *data,
+                                  CoreSurface            *surface );
+
+#endif
+
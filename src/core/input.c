@@ -44,6 +44,7 @@
 #include <direct/list.h>
 #include <direct/memcpy.h>
 #include <direct/messages.h>
+#include <direct/thread.h>
 
 
 #include <fusion/conf.h>
@@ -68,6 +69,7 @@
 #include <core/layers.h>
 #include <core/input.h>
 #include <core/input_hub.h>
+#include <core/input_loop.h>
 #include <core/windows.h>
 #include <core/windows_internal.h>
 
@@ -160,6 +162,8 @@ struct __DFB_CoreInputDevice {
      void               *driver_data;
 
      CoreDFB            *core;
+
+     DFBInputLatencyStats latency;        /* protected by latency_lock */
 };
 
 /**********************************************************************************************************************/
@@ -352,6 +356,10 @@ static void flush_keys       ( CoreInputDevice    *device );
 static bool core_input_filter( CoreInputDevice    *device,
                                DFBInputEvent      *event );
 
+static void record_latency   ( CoreInputDevice      *device,
+                               const DFBInputEvent  *event,
+                               DFBInputLatencyStage  stage );
+
 /**********************************************************************************************************************/
 
 static DFBInputDeviceKeyIdentifier symbol_to_id( DFBInputDeviceKeySymbol     symbol );
@@ -419,6 +427,8 @@ dfb_input_set_global( ReactionFunc func,
 static DFBInputCore       *core_local; /* FIXME */
 static DFBInputCoreShared *core_input; /* FIXME */
 
+static DirectMutex         latency_lock = DIRECT_MUTEX_INITIALIZER( latency_lock );
+
 #if FUSION_BUILD_MULTI
 static Reaction            local_processing_react; /* Local reaction to hot-plug event */
 #endif
@@ -650,6 +660,8 @@ dfb_input_core_shutdown( DFBInputCore *data,
           D_FREE( device );
      }
 
+     dfb_input_loop_shutdown();
+
      if (data->hub)
           CoreInputHub_Destroy( data->hub );
 
@@ -1008,6 +1020,8 @@ dfb_input_dispatch( CoreInputDevice *device, DFBInputEvent *event )
           gettimeofday( &event->timestamp, NULL );
           event->flags |= DIEF_TIMESTAMP;
      }
+     else if (dfb_config->input_latency_stats)
+          record_latency( device, event, DILST_DRIVER );
 
      switch (event->type) {
           case DIET_BUTTONPRESS:
@@ -1078,8 +1092,12 @@ dfb_input_dispatch( CoreInputDevice *device, DFBInputEvent *event )
 
      if (core_input_filter( device, event ))
           D_DEBUG_AT( Core_InputEvt, "  ****>> FILTERED\n" );
-     else
+     else {
+          if (dfb_config->input_latency_stats)
+               record_latency( device, event, DILST_DISPATCH );
+
           fusion_reactor_dispatch( device->shared->reactor, event, true, dfb_input_globals );
+     }
 }
 
 DFBInputDeviceID
@@ -1237,8 +1255,99 @@ dfb_input_device_set_configuration( CoreInputDevice            *device,
      return driver->funcs->SetConfiguration( device, device->driver_data, config );
 }
 
+DFBResult
+dfb_input_device_get_latency( CoreInputDevice      *device,
+                              DFBInputLatencyStats *ret_stats )
+{
+     D_MAGIC_ASSERT( device, CoreInputDevice );
+     D_ASSERT( ret_stats != NULL );
+
+     direct_mutex_lock( &latency_lock );
+
+     *ret_stats = device->latency;
+
+     direct_mutex_unlock( &latency_lock );
+
+     return DFB_OK;
+}
+
+DFBResult
+dfb_input_device_reset_latency( CoreInputDevice *device )
+{
+     D_MAGIC_ASSERT( device, CoreInputDevice );
+
+     direct_mutex_lock( &latency_lock );
+
+     memset( &device->latency, 0, sizeof(device->latency) );
+
+     direct_mutex_unlock( &latency_lock );
+
+     return DFB_OK;
+}
+
+void
+dfb_input_record_latency( const DFBInputEvent  *event,
+                          DFBInputLatencyStage  stage )
+{
+     CoreInputDevice *device;
+
+     D_ASSERT( event != NULL );
+     D_ASSERT( stage < DILST_NUM );
+
+     if (!dfb_config->input_latency_stats || !core_input || event->clazz != DFEC_INPUT)
+          return;
+
+     device = dfb_input_device_at( event->device_id );
+     if (device)
+          record_latency( device, event, stage );
+}
+
 /** internal **/
 
+static void
+record_latency( CoreInputDevice      *device,
+                const DFBInputEvent  *event,
+                DFBInputLatencyStage  stage )
+{
+     struct timeval            now;
+     long long                 micros;
+     unsigned int              bucket;
+     DFBInputLatencyHistogram *histogram;
+
+     D_MAGIC_ASSERT( device, CoreInputDevice );
+
+     if (!(event->flags & DIEF_TIMESTAMP))
+          return;
+
+     gettimeofday( &now, NULL );
+
+     micros = (now.tv_sec - event->timestamp.tv_sec) * 1000000LL + (now.tv_usec - event->timestamp.tv_usec);
+
+     /* Clock adjustments or timestamps from a different clock. */
+     if (micros < 0)
+          micros = 0;
+     else if (micros > 0xffffffffLL)
+          micros = 0xffffffffLL;
+
+     for (bucket = 0; bucket < DFB_INPUT_LATENCY_BUCKETS - 1; bucket++) {
+          if (micros < (32LL << bucket))
+               break;
+     }
+
+     histogram = &device->latency.stages[stage];
+
+     direct_mutex_lock( &latency_lock );
+
+     histogram->num++;
+     histogram->buckets[bucket]++;
+     histogram->total += micros;
+
+     if (histogram->max < micros)
+          histogram->max = micros;
+
+     direct_mutex_unlock( &latency_lock );
+}
+
 static void
 input_add_device( CoreInputDevice *device )
 {
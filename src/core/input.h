@@ -201,6 +201,21 @@ DFBResult         dfb_input_device_get_state( CoreInputDevice      *device,
                                               CoreInputDeviceState *ret_state );
 
 
+/*
+ * Latency statistics, only recorded with the "input-latency-stats" option.
+ */
+DFBResult         dfb_input_device_get_latency  ( CoreInputDevice      *device,
+                                                  DFBInputLatencyStats *ret_stats );
+
+DFBResult         dfb_input_device_reset_latency( CoreInputDevice      *device );
+
+/*
+ * Records the latency of an event reaching a stage, looking up the device by the event's id.
+ */
+void              dfb_input_record_latency      ( const DFBInputEvent  *event,
+                                                  DFBInputLatencyStage  stage );
+
+
 
 void              containers_attach_device( CoreInputDevice *device );
 
@@ -0,0 +1,544 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#include <directfb.h>
+
+#include <direct/debug.h>
+#include <direct/list.h>
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/thread.h>
+#include <direct/util.h>
+
+#include <core/input_loop.h>
+
+#include <misc/conf.h>
+
+
+D_DEBUG_DOMAIN( Core_InputLoop, "Core/InputLoop", "DirectFB Input Event Loop" );
+
+/**********************************************************************************************************************/
+
+#ifdef __linux__
+
+#define MAX_EVENTS   32
+
+typedef struct __DFB_InputLoop InputLoop;
+
+typedef struct {
+     InputLoopWatch   *watch;
+     InputLoopEvents   events;       /* passed to the handler when the fd is ready */
+} InputLoopSource;
+
+struct __DFB_InputLoopWatch {
+     DirectLink        link;
+
+     int               magic;
+
+     InputLoop        *loop;
+
+     int               fd;
+     int               timer_fd;     /* created with the first timeout, -1 before */
+
+     InputLoopSource   fd_source;
+     InputLoopSource   timer_source;
+
+     InputLoopHandler  handler;
+     void             *ctx;
+
+     bool              active;       /* false after the handler returned false */
+};
+
+struct __DFB_InputLoop {
+     int               magic;
+
+     int               epoll_fd;
+     int               wakeup_fds[2];
+
+     DirectThread     *thread;
+
+     DirectLink       *watches;
+     DirectLink       *removed;      /* freed by the loop thread after processing events */
+
+     bool              stop;
+};
+
+/*
+ * Protects everything, held by the loop thread while calling handlers.
+ *
+ * Recursive for handlers adding or removing watches, e.g. by dispatching events that lead to closing a device.
+ */
+static DirectMutex  loop_lock = DIRECT_RECURSIVE_MUTEX_INITIALIZER( loop_lock );
+static InputLoop   *loop_current;
+static InputLoop   *loop_stopped;  /* stopped by itself after a handler removed the last watch, not joined yet */
+
+/**********************************************************************************************************************/
+
+static void
+loop_free_removed( InputLoop *loop )
+{
+     InputLoopWatch *watch;
+     DirectLink     *next;
+
+     direct_list_foreach_safe (watch, next, loop->removed) {
+          D_MAGIC_CLEAR( watch );
+
+          D_FREE( watch );
+     }
+
+     loop->removed = NULL;
+}
+
+static void
+loop_deactivate( InputLoopWatch *watch )
+{
+     D_DEBUG_AT( Core_InputLoop, "  -> deactivating fd %d\n", watch->fd );
+
+     epoll_ctl( watch->loop->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL );
+
+     if (watch->timer_fd >= 0)
+          epoll_ctl( watch->loop->epoll_fd, EPOLL_CTL_DEL, watch->timer_fd, NULL );
+
+     watch->active = false;
+}
+
+static void *
+input_loop_thread( DirectThread *thread, void *arg )
+{
+     InputLoop          *loop = arg;
+     struct epoll_event  events[MAX_EVENTS];
+
+     D_DEBUG_AT( Core_InputLoop, "%s()\n", __FUNCTION__ );
+
+     D_MAGIC_ASSERT( loop, InputLoop );
+
+     while (true) {
+          int i, num;
+
+          num = epoll_wait( loop->epoll_fd, events, MAX_EVENTS, -1 );
+          if (num < 0) {
+               if (errno == EINTR)
+                    continue;
+
+               D_PERROR( "Core/InputLoop: epoll_wait() failed!\n" );
+               break;
+          }
+
+          direct_mutex_lock( &loop_lock );
+
+          if (loop->stop) {
+               direct_mutex_unlock( &loop_lock );
+               break;
+          }
+
+          for (i=0; i<num; i++) {
+               InputLoopSource *source = events[i].data.ptr;
+               InputLoopWatch  *watch;
+
+               /* Wake up from the pipe. */
+               if (!source) {
+                    char buf[16];
+
+                    if (read( loop->wakeup_fds[0], buf, sizeof(buf) ) < 0)
+                         D_DEBUG_AT( Core_InputLoop, "  -> reading wake up pipe failed (%s)\n", strerror(errno) );
+
+                    continue;
+               }
+
+               watch = source->watch;
+
+               D_MAGIC_ASSERT( watch, InputLoopWatch );
+
+               /* Removed since epoll_wait() returned, still on the 'removed' list. */
+               if (!watch->handler || !watch->active)
+                    continue;
+
+               if (source == &watch->timer_source) {
+                    u64 expirations;
+
+                    /* Nonblocking, the timeout may have been cancelled or changed meanwhile. */
+                    if (read( watch->timer_fd, &expirations, sizeof(expirations) ) != sizeof(expirations))
+                         continue;
+               }
+
+               if (!watch->handler( watch, source->events, watch->ctx ) && watch->handler && watch->active)
+                    loop_deactivate( watch );
+          }
+
+          loop_free_removed( loop );
+
+          /* A handler removed the last watch, the thread cannot join itself, see loop_reap(). */
+          if (!loop->watches) {
+               D_DEBUG_AT( Core_InputLoop, "  -> last watch removed by handler, stopping\n" );
+
+               D_ASSERT( loop_stopped == NULL );
+
+               loop->stop = true;
+
+               if (loop_current == loop)
+                    loop_current = NULL;
+
+               loop_stopped = loop;
+
+               direct_mutex_unlock( &loop_lock );
+               break;
+          }
+
+          direct_mutex_unlock( &loop_lock );
+     }
+
+     return NULL;
+}
+
+static DFBResult
+loop_create( InputLoop **ret_loop )
+{
+     InputLoop          *loop;
+     struct epoll_event  event = { .events = EPOLLIN, .data.ptr = NULL };
+
+     D_DEBUG_AT( Core_InputLoop, "%s()\n", __FUNCTION__ );
+
+     loop = D_CALLOC( 1, sizeof(InputLoop) );
+     if (!loop)
+          return D_OOM();
+
+     loop->epoll_fd = epoll_create( MAX_EVENTS );
+     if (loop->epoll_fd < 0) {
+          D_PERROR( "Core/InputLoop: epoll_create() failed!\n" );
+          D_FREE( loop );
+          return DFB_UNSUPPORTED;
+     }
+
+     if (pipe( loop->wakeup_fds )) {
+          D_PERROR( "Core/InputLoop: pipe() failed!\n" );
+          close( loop->epoll_fd );
+          D_FREE( loop );
+          return DFB_INIT;
+     }
+
+     epoll_ctl( loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fds[0], &event );
+
+     D_MAGIC_SET( loop, InputLoop );
+
+     loop->thread = direct_thread_create( DTT_INPUT, input_loop_thread, loop, "Input Loop" );
+     if (!loop->thread) {
+          D_MAGIC_CLEAR( loop );
+          close( loop->wakeup_fds[0] );
+          close( loop->wakeup_fds[1] );
+          close( loop->epoll_fd );
+          D_FREE( loop );
+          return DFB_INIT;
+     }
+
+     *ret_loop = loop;
+
+     return DFB_OK;
+}
+
+/*
+ * Called without the lock, after the loop has been unlinked and marked to stop.
+ */
+static void
+loop_destroy( InputLoop *loop )
+{
+     D_DEBUG_AT( Core_InputLoop, "%s()\n", __FUNCTION__ );
+
+     D_MAGIC_ASSERT( loop, InputLoop );
+     D_ASSERT( loop->stop );
+     D_ASSERT( loop->watches == NULL );
+
+     if (write( loop->wakeup_fds[1], "", 1 ) < 0)
+          D_PERROR( "Core/InputLoop: Could not wake up loop thread!\n" );
+
+     direct_thread_join( loop->thread );
+     direct_thread_destroy( loop->thread );
+
+     loop_free_removed( loop );
+
+     close( loop->wakeup_fds[0] );
+     close( loop->wakeup_fds[1] );
+     close( loop->epoll_fd );
+
+     D_MAGIC_CLEAR( loop );
+
+     D_FREE( loop );
+}
+
+/*
+ * Joins and destroys a loop that has stopped itself, called without the lock.
+ */
+static void
+loop_reap( void )
+{
+     InputLoop *loop;
+
+     direct_mutex_lock( &loop_lock );
+
+     loop         = loop_stopped;
+     loop_stopped = NULL;
+
+     direct_mutex_unlock( &loop_lock );
+
+     if (loop)
+          loop_destroy( loop );
+}
+
+/**********************************************************************************************************************/
+
+DFBResult
+dfb_input_loop_add( int                fd,
+                    InputLoopHandler   handler,
+                    void              *ctx,
+                    InputLoopWatch   **ret_watch )
+{
+     DFBResult           ret;
+     InputLoopWatch     *watch;
+     struct epoll_event  event;
+
+     D_DEBUG_AT( Core_InputLoop, "%s( %d, %p, %p )\n", __FUNCTION__, fd, handler, ctx );
+
+     D_ASSERT( fd >= 0 );
+     D_ASSERT( handler != NULL );
+     D_ASSERT( ret_watch != NULL );
+
+     if (!dfb_config->input_event_loop)
+          return DFB_UNSUPPORTED;
+
+     loop_reap();
+
+     watch = D_CALLOC( 1, sizeof(InputLoopWatch) );
+     if (!watch)
+          return D_OOM();
+
+     watch->fd       = fd;
+     watch->timer_fd = -1;
+     watch->handler  = handler;
+     watch->ctx      = ctx;
+     watch->active   = true;
+
+     watch->fd_source.watch     = watch;
+     watch->fd_source.events    = ILEV_READ;
+     watch->timer_source.watch  = watch;
+     watch->timer_source.events = ILEV_TIMEOUT;
+
+     D_MAGIC_SET( watch, InputLoopWatch );
+
+     direct_mutex_lock( &loop_lock );
+
+     if (!loop_current) {
+          ret = loop_create( &loop_current );
+          if (ret)
+               goto error;
+     }
+
+     watch->loop = loop_current;
+
+     event.events   = EPOLLIN;
+     event.data.ptr = &watch->fd_source;
+
+     if (epoll_ctl( loop_current->epoll_fd, EPOLL_CTL_ADD, fd, &event )) {
+          D_PERROR( "Core/InputLoop: Could not add fd %d!\n", fd );
+          ret = errno2result( errno );
+
+          /* Don't leave an empty loop behind. */
+          if (!loop_current->watches) {
+               InputLoop *loop = loop_current;
+
+               loop->stop   = true;
+               loop_current = NULL;
+
+               direct_mutex_unlock( &loop_lock );
+
+               loop_destroy( loop );
+
+               D_MAGIC_CLEAR( watch );
+               D_FREE( watch );
+
+               return ret;
+          }
+
+          goto error;
+     }
+
+     direct_list_append( &loop_current->watches, &watch->link );
+
+     /* Before the handler may run. */
+     *ret_watch = watch;
+
+     direct_mutex_unlock( &loop_lock );
+
+     return DFB_OK;
+
+error:
+     direct_mutex_unlock( &loop_lock );
+
+     D_MAGIC_CLEAR( watch );
+     D_FREE( watch );
+
+     return ret;
+}
+
+void
+dfb_input_loop_remove( InputLoopWatch *watch )
+{
+     InputLoop *loop;
+
+     D_DEBUG_AT( Core_InputLoop, "%s( %p )\n", __FUNCTION__, watch );
+
+     D_MAGIC_ASSERT( watch, InputLoopWatch );
+
+     direct_mutex_lock( &loop_lock );
+
+     loop = watch->loop;
+
+     D_MAGIC_ASSERT( loop, InputLoop );
+
+     if (watch->active)
+          loop_deactivate( watch );
+
+     if (watch->timer_fd >= 0)
+          close( watch->timer_fd );
+
+     /* The loop thread may still have the watch in its list of events, it frees the watch afterwards. */
+     watch->handler = NULL;
+
+     direct_list_remove( &loop->watches, &watch->link );
+     direct_list_append( &loop->removed, &watch->link );
+
+     /* Stop the thread with the last watch, if removed by a handler the thread stops itself after it returned. */
+     if (!loop->watches && direct_thread_self() != loop->thread) {
+          loop->stop = true;
+
+          if (loop_current == loop)
+               loop_current = NULL;
+
+          direct_mutex_unlock( &loop_lock );
+
+          loop_destroy( loop );
+
+          return;
+     }
+
+     direct_mutex_unlock( &loop_lock );
+}
+
+DFBResult
+dfb_input_loop_set_timeout( InputLoopWatch *watch,
+                            long long       micros )
+{
+     struct itimerspec spec = { .it_interval = { 0, 0 } };
+
+     D_DEBUG_AT( Core_InputLoop, "%s( %p, %lld )\n", __FUNCTION__, watch, micros );
+
+     D_MAGIC_ASSERT( watch, InputLoopWatch );
+     D_ASSERT( micros >= 0 );
+
+     direct_mutex_lock( &loop_lock );
+
+     if (watch->timer_fd < 0) {
+          struct epoll_event event;
+
+          if (!micros) {
+               direct_mutex_unlock( &loop_lock );
+               return DFB_OK;
+          }
+
+          watch->timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+          if (watch->timer_fd < 0) {
+               D_PERROR( "Core/InputLoop: timerfd_create() failed!\n" );
+               direct_mutex_unlock( &loop_lock );
+               return DFB_UNSUPPORTED;
+          }
+
+          event.events   = EPOLLIN;
+          event.data.ptr = &watch->timer_source;
+
+          if (watch->active)
+               epoll_ctl( watch->loop->epoll_fd, EPOLL_CTL_ADD, watch->timer_fd, &event );
+     }
+
+     spec.it_value.tv_sec  = micros / 1000000;
+     spec.it_value.tv_nsec = (micros % 1000000) * 1000;
+
+     timerfd_settime( watch->timer_fd, 0, &spec, NULL );
+
+     direct_mutex_unlock( &loop_lock );
+
+     return DFB_OK;
+}
+
+void
+dfb_input_loop_shutdown( void )
+{
+     D_DEBUG_AT( Core_InputLoop, "%s()\n", __FUNCTION__ );
+
+     loop_reap();
+}
+
+#else
+
+DFBResult
+dfb_input_loop_add( int                fd,
+                    InputLoopHandler   handler,
+                    void              *ctx,
+                    InputLoopWatch   **ret_watch )
+{
+     return DFB_UNSUPPORTED;
+}
+
+void
+dfb_input_loop_remove( InputLoopWatch *watch )
+{
+     D_BUG( "no input loop" );
+}
+
+DFBResult
+dfb_input_loop_set_timeout( InputLoopWatch *watch,
+                            long long       micros )
+{
+     return DFB_UNSUPPORTED;
+}
+
+void
+dfb_input_loop_shutdown( void )
+{
+}
+
+#endif
+
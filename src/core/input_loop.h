@@ -0,0 +1,89 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef __CORE__INPUT_LOOP_H__
+#define __CORE__INPUT_LOOP_H__
+
+#include <directfb.h>
+
+
+/*
+ * Single thread servicing the file descriptors of all input devices,
+ * instead of one thread per device blocking in select().
+ */
+
+typedef struct __DFB_InputLoopWatch InputLoopWatch;
+
+typedef enum {
+     ILEV_NONE     = 0x00000000,
+
+     ILEV_READ     = 0x00000001,  /* file descriptor is readable, hung up or has an error */
+     ILEV_TIMEOUT  = 0x00000002   /* timeout set via dfb_input_loop_set_timeout() has expired */
+} InputLoopEvents;
+
+/*
+ * Called from the loop thread, return false to stop watching the file descriptor.
+ *
+ * The watch still has to be removed by its owner.
+ */
+typedef bool (*InputLoopHandler)( InputLoopWatch  *watch,
+                                  InputLoopEvents  events,
+                                  void            *ctx );
+
+
+/*
+ * Starts watching the file descriptor, the loop thread is started with the first watch.
+ *
+ * Returns DFB_UNSUPPORTED if there's no event loop on this platform
+ * or if it has been disabled via "no-input-event-loop".
+ */
+DFBResult dfb_input_loop_add        ( int                fd,
+                                      InputLoopHandler   handler,
+                                      void              *ctx,
+                                      InputLoopWatch   **ret_watch );
+
+/*
+ * Stops watching and frees the watch, the handler is not running and won't be called after return.
+ *
+ * The loop thread is stopped with the last watch.
+ */
+void      dfb_input_loop_remove     ( InputLoopWatch    *watch );
+
+/*
+ * Calls the handler with ILEV_TIMEOUT once after 'micros', zero cancels a pending timeout.
+ */
+DFBResult dfb_input_loop_set_timeout( InputLoopWatch    *watch,
+                                      long long          micros );
+
+/*
+ * Joins a loop thread that has stopped after its last watch was removed by a handler.
+ */
+void      dfb_input_loop_shutdown   ( void );
+
+#endif
+
@@ -28,13 +28,18 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include <directfb.h>
 
 #include <core/coredefs.h>
 #include <core/coretypes.h>
 
 #include <direct/debug.h>
+#include <direct/hash.h>
+#include <direct/mem.h>
 #include <direct/messages.h>
+#include <direct/thread.h>
 #include <direct/util.h>
 
 #include <fusion/conf.h>
@@ -52,6 +57,8 @@
 
 #include <gfx/util.h>
 
+#include <misc/conf.h>
+
 
 D_DEBUG_DOMAIN( Core_Layers, "Core/Layers", "DirectFB Display Layer Core" );
 D_DEBUG_DOMAIN( Core_LayersLock, "Core/Layers/Lock", "DirectFB Display Layer Core locks" );
@@ -77,6 +84,37 @@ static DFBResult realize_region  ( CoreLayerRegion            *region );
 
 static DFBResult unrealize_region( CoreLayerRegion            *region );
 
+static DFBResult flip_update     ( CoreLayerRegion            *region,
+                                   const DFBRegion            *update,
+                                   const DFBRegion            *damage,
+                                   unsigned int                num_damage,
+                                   DFBSurfaceFlipFlags         flags );
+
+typedef struct __DFB_CoreLayerRegionFlips CoreLayerRegionFlips;
+
+static CoreLayerRegionFlips *flip_queue_get( CoreLayerRegion *region,
+                                             bool             create );
+
+static void      flip_queue_destroy  ( CoreLayerRegion *region );
+
+static void      flip_queue_wait     ( CoreLayerRegionFlips *flips,
+                                       int                   max );
+
+static void      flip_queue_push     ( CoreLayerRegionFlips *flips,
+                                       u32                   flip_count,
+                                       int                   index );
+
+static void      flip_queue_drop     ( CoreLayerRegionFlips *flips,
+                                       u32                   flip_count );
+
+static void      flip_queue_done     ( CoreLayerRegion *region,
+                                       u32              flip_count );
+
+static void      flip_queue_displayed( CoreLayerRegion *region,
+                                       int              index );
+
+static void      flip_queue_reset    ( CoreLayerRegion *region );
+
 /******************************************************************************/
 
 static void
@@ -104,6 +142,9 @@ region_destructor( FusionObject *object, bool zombie, void *ctx )
      if (D_FLAGS_IS_SET( region->state, CLRSF_ENABLED ))
           dfb_layer_region_disable( region );
 
+     /* Stop the flip queue thread after the last flips have been completed by disabling. */
+     flip_queue_destroy( region );
+
      /* Remove the region from the context. */
      dfb_layer_context_remove_region( region->context, region );
 
@@ -368,6 +409,9 @@ dfb_layer_region_set_surface( CoreLayerRegion *region,
                }
           }
 
+          /* Flips of the old surface will not be acked. */
+          flip_queue_reset( region );
+
           /* Throw away the old surface. */
           if (region->surface) {
                /* Detach the global listener. */
@@ -438,6 +482,27 @@ DFBResult
 dfb_layer_region_flip_update( CoreLayerRegion     *region,
                               const DFBRegion     *update,
                               DFBSurfaceFlipFlags  flags )
+{
+     return flip_update( region, update, NULL, 0, flags );
+}
+
+DFBResult
+dfb_layer_region_flip_damage( CoreLayerRegion     *region,
+                              const DFBRegion     *damage,
+                              unsigned int         num_damage,
+                              DFBSurfaceFlipFlags  flags )
+{
+     D_ASSERT( damage != NULL || num_damage == 0 );
+
+     return flip_update( region, NULL, damage, num_damage, flags );
+}
+
+static DFBResult
+flip_update( CoreLayerRegion     *region,
+             const DFBRegion     *update,
+             const DFBRegion     *damage,
+             unsigned int         num_damage,
+             DFBSurfaceFlipFlags  flags )
 {
      DFBResult                ret = DFB_OK;
      DFBRegion                unrotated;
@@ -525,19 +590,52 @@ dfb_layer_region_flip_update( CoreLayerRegion     *region,
 
                     /* Use the driver's routine if the region is realized. */
                     if (D_FLAGS_IS_SET( region->state, CLRSF_REALIZED )) {
-                         CoreSurfaceBufferLock left;
+                         CoreSurfaceBufferLock  left;
+                         CoreLayerRegionFlips  *flips      = NULL;
+                         bool                   queue      = false;
+                         u32                    flip_count = 0;
 
                          D_ASSUME( funcs->FlipRegion != NULL );
 
+                         /*
+                          * Queue flips on sync of triple buffered regions instead of waiting for them,
+                          * but not before the buffer becoming the next back buffer has left the screen.
+                          */
+                         if (dfb_config->flip_queue && region->config.buffermode == DLBM_TRIPLE &&
+                             (flags & DSFLIP_ONSYNC) && surface->num_buffers > 2)
+                              flips = flip_queue_get( region, true );
+
+                         if (flips) {
+                              flip_queue_wait( flips, surface->num_buffers - 2 );
+
+                              flags &= ~DSFLIP_WAIT;
+                              queue  = true;
+                         }
+
                          ret = region_buffer_lock( region, surface, CSBR_BACK, &left, NULL );
                          if (ret) {
                               dfb_layer_region_unlock( region );
                               return ret;
                          }
 
+                         if (queue) {
+                              flip_count = surface->flips + 1;
+
+                              flip_queue_push( flips, flip_count, left.allocation->index );
+                         }
+
                          D_DEBUG_AT( Core_Layers, "  -> Flipping region using driver...\n" );
 
-                         if (funcs->FlipRegion)
+                         /* Let the driver know which parts actually changed if possible. */
+                         if (num_damage && funcs->FlipUpdate)
+                              ret = funcs->FlipUpdate( layer,
+                                                       layer->driver_data,
+                                                       layer->layer_data,
+                                                       region->region_data,
+                                                       surface, flags,
+                                                       damage, num_damage,
+                                                       &left );
+                         else if (funcs->FlipRegion)
                               ret = funcs->FlipRegion( layer,
                                                        layer->driver_data,
                                                        layer->layer_data,
@@ -546,8 +644,20 @@ dfb_layer_region_flip_update( CoreLayerRegion     *region,
                                                        &left,
                                                        NULL );
 
+                         if (queue && (ret || surface->flips != flip_count)) {
+                              flip_queue_drop( flips, flip_count );
+
+                              queue = false;
+                         }
+
                          /* Unlock region buffer since the lock is no longer needed. */
                          region_buffer_unlock(region, true, &left, NULL);
+
+                         /* The flip is pending, do not ack it below. */
+                         if (queue) {
+                              dfb_layer_region_unlock( region );
+                              return DFB_OK;
+                         }
                     }
                     else {
                          D_DEBUG_AT( Core_Layers, "  -> Flipping region not using driver...\n" );
@@ -645,6 +755,10 @@ dfb_layer_region_flip_update( CoreLayerRegion     *region,
                ret = DFB_BUG;
      }
 
+     /* Ack flips that have been displayed already. */
+     if (dfb_config->flip_queue)
+          flip_queue_done( region, surface->flips );
+
      D_DEBUG_AT( Core_Layers, "  -> done.\n" );
 
      /* Unlock the region. */
@@ -894,6 +1008,10 @@ dfb_layer_region_flip_update_stereo( CoreLayerRegion     *region,
                ret = DFB_BUG;
      }
 
+     /* Ack flips that have been displayed already. */
+     if (dfb_config->flip_queue)
+          flip_queue_done( region, surface->flips );
+
      D_DEBUG_AT( Core_Layers, "  -> done.\n" );
 
      /* Unlock the region. */
@@ -1118,7 +1236,15 @@ _dfb_layer_region_surface_listener( const void *msg_data, void *ctx )
           return RS_REMOVE;
      }
 
-     if (flags & CSNF_DISPLAY)
+     if (flags & CSNF_DISPLAY) {
+          if (dfb_config->flip_queue)
+               flip_queue_displayed( region, notification->index );
+
+          return RS_OK;
+     }
+
+     /* Frame acks are sent by the flip queue thread holding the surface lock. */
+     if (flags & CSNF_FRAME)
           return RS_OK;
 
      if (dfb_layer_region_lock( region ))
@@ -1517,6 +1643,10 @@ unrealize_region( CoreLayerRegion *region )
      /* Remove the region from the 'added' list. */
      fusion_vector_remove( &shared->added_regions, index );
 
+     /* Queued flips will never be displayed. */
+     if (dfb_config->flip_queue && region->surface)
+          flip_queue_done( region, region->surface->flips );
+
      /* Deallocate the driver's region data. */
      if (region->region_data) {
           SHFREE( shared->shmpool, region->region_data );
@@ -1534,3 +1664,384 @@ unrealize_region( CoreLayerRegion *region )
      return DFB_OK;
 }
 
+
+/******************************************************************************/
+
+/*
+ * A flip submitted to the driver that has not been displayed yet.
+ */
+typedef struct {
+     u32                    flip_count;    /* surface flip count after this flip */
+     int                    index;         /* index of the buffer being displayed by this flip */
+} CoreLayerRegionFlip;
+
+/*
+ * Flip queue of a region, see "flip-queue" option.
+ *
+ * Process local, only the master queues flips as it executes them.
+ */
+struct __DFB_CoreLayerRegionFlips {
+     CoreLayerRegion       *region;
+
+     DirectMutex            lock;
+     DirectWaitQueue        wq;
+
+     DirectThread          *thread;        /* delivers frame acks, waits for vsync if not notified */
+     bool                   stop;
+     bool                   notified;      /* driver reports displayed buffers via CSNF_DISPLAY */
+
+     CoreLayerRegionFlip    queue[MAX_SURFACE_BUFFERS];
+     int                    num;
+
+     u32                    completed;     /* flip count of the last displayed flip */
+     u32                    acked;         /* flip count last sent to clients via CSNF_FRAME */
+};
+
+/* Flip queues by region object id. */
+static DirectMutex  flip_queues_lock = DIRECT_MUTEX_INITIALIZER( flip_queues_lock );
+static DirectHash  *flip_queues;
+
+static void *flip_queue_loop( DirectThread *thread, void *arg );
+
+/*
+ * Returns the flip queue of the region, creating it if requested, or NULL if not running in the master
+ * or without "flip-queue".
+ */
+static CoreLayerRegionFlips *
+flip_queue_get( CoreLayerRegion *region,
+                bool             create )
+{
+     CoreLayerRegionFlips *flips;
+     CoreLayer            *layer = dfb_layer_at( region->context->layer_id );
+
+     if (!dfb_config->flip_queue || !dfb_core_is_master( layer->core ))
+          return NULL;
+
+     direct_mutex_lock( &flip_queues_lock );
+
+     if (!flip_queues && (!create || direct_hash_create( 7, &flip_queues ))) {
+          direct_mutex_unlock( &flip_queues_lock );
+          return NULL;
+     }
+
+     flips = direct_hash_lookup( flip_queues, region->object.id );
+     if (!flips && create) {
+          flips = D_CALLOC( 1, sizeof(CoreLayerRegionFlips) );
+          if (!flips) {
+               D_OOM();
+               direct_mutex_unlock( &flip_queues_lock );
+               return NULL;
+          }
+
+          flips->region = region;
+
+          direct_mutex_init( &flips->lock );
+          direct_waitqueue_init( &flips->wq );
+
+          if (direct_hash_insert( flip_queues, region->object.id, flips )) {
+               direct_waitqueue_deinit( &flips->wq );
+               direct_mutex_deinit( &flips->lock );
+               D_FREE( flips );
+               flips = NULL;
+          }
+     }
+
+     direct_mutex_unlock( &flip_queues_lock );
+
+     return flips;
+}
+
+/*
+ * Stops the thread and frees the flip queue of a region being destroyed.
+ */
+static void
+flip_queue_destroy( CoreLayerRegion *region )
+{
+     CoreLayerRegionFlips *flips = NULL;
+
+     direct_mutex_lock( &flip_queues_lock );
+
+     if (flip_queues) {
+          flips = direct_hash_lookup( flip_queues, region->object.id );
+          if (flips)
+               direct_hash_remove( flip_queues, region->object.id );
+
+          if (!direct_hash_count( flip_queues )) {
+               direct_hash_destroy( flip_queues );
+               flip_queues = NULL;
+          }
+     }
+
+     direct_mutex_unlock( &flip_queues_lock );
+
+     if (!flips)
+          return;
+
+     direct_mutex_lock( &flips->lock );
+     flips->stop = true;
+     direct_waitqueue_broadcast( &flips->wq );
+     direct_mutex_unlock( &flips->lock );
+
+     if (flips->thread) {
+          direct_thread_join( flips->thread );
+          direct_thread_destroy( flips->thread );
+     }
+
+     direct_waitqueue_deinit( &flips->wq );
+     direct_mutex_deinit( &flips->lock );
+
+     D_FREE( flips );
+}
+
+/*
+ * Removes all queued flips up to the given flip count which is the last one displayed.
+ *
+ * Called with the flip queue lock held.
+ */
+static void
+flip_queue_complete( CoreLayerRegionFlips *flips,
+                     u32                   flip_count )
+{
+     int i;
+
+     D_DEBUG_AT( Core_Layers, "%s( %p, %u )\n", __FUNCTION__, flips->region, flip_count );
+
+     for (i=0; i<flips->num; i++) {
+          if ((s32)(flips->queue[i].flip_count - flip_count) > 0)
+               break;
+     }
+
+     if (i) {
+          flips->num -= i;
+
+          memmove( &flips->queue[0], &flips->queue[i], flips->num * sizeof(CoreLayerRegionFlip) );
+     }
+
+     if ((s32)(flip_count - flips->completed) > 0)
+          flips->completed = flip_count;
+
+     /* Start the thread delivering frame acks to the clients. */
+     if (!flips->thread && !flips->stop && flips->completed != flips->acked)
+          flips->thread = direct_thread_create( DTT_OUTPUT, flip_queue_loop, flips, "Layer Flips" );
+
+     direct_waitqueue_broadcast( &flips->wq );
+}
+
+/*
+ * Waits until less than 'max' flips are queued. A flip not displayed within
+ * "flip-notify-max-latency" is considered displayed anyway.
+ */
+static void
+flip_queue_wait( CoreLayerRegionFlips *flips,
+                 int                   max )
+{
+     DirectResult ret;
+
+     direct_mutex_lock( &flips->lock );
+
+     while (flips->num >= max) {
+          D_DEBUG_AT( Core_Layers, "  -> waiting for queued flip %u...\n", flips->queue[0].flip_count );
+
+          if (!dfb_config->flip_notify_max_latency) {
+               direct_waitqueue_wait( &flips->wq, &flips->lock );
+               continue;
+          }
+
+          ret = direct_waitqueue_wait_timeout( &flips->wq, &flips->lock,
+                                               dfb_config->flip_notify_max_latency * 1000 );
+          if (ret == DR_TIMEOUT && flips->num >= max) {
+               D_WARN( "flip %u not displayed within %u ms", flips->queue[0].flip_count,
+                       dfb_config->flip_notify_max_latency );
+
+               flip_queue_complete( flips, flips->queue[0].flip_count );
+          }
+     }
+
+     direct_mutex_unlock( &flips->lock );
+}
+
+/*
+ * Adds a flip that is about to be submitted to the driver.
+ */
+static void
+flip_queue_push( CoreLayerRegionFlips *flips,
+                 u32                   flip_count,
+                 int                   index )
+{
+     direct_mutex_lock( &flips->lock );
+
+     D_ASSERT( flips->num < MAX_SURFACE_BUFFERS );
+
+     flips->queue[flips->num].flip_count = flip_count;
+     flips->queue[flips->num].index      = index;
+
+     flips->num++;
+
+     /* Start the thread waiting for the vsync if the driver does not notify. */
+     if (!flips->thread && !flips->stop)
+          flips->thread = direct_thread_create( DTT_OUTPUT, flip_queue_loop, flips, "Layer Flips" );
+
+     direct_waitqueue_broadcast( &flips->wq );
+
+     direct_mutex_unlock( &flips->lock );
+}
+
+/*
+ * Removes a flip that the driver did not do.
+ */
+static void
+flip_queue_drop( CoreLayerRegionFlips *flips,
+                 u32                   flip_count )
+{
+     int i;
+
+     direct_mutex_lock( &flips->lock );
+
+     for (i=0; i<flips->num; i++) {
+          if (flips->queue[i].flip_count == flip_count) {
+               flips->num--;
+
+               memmove( &flips->queue[i], &flips->queue[i+1],
+                        (flips->num - i) * sizeof(CoreLayerRegionFlip) );
+
+               direct_waitqueue_broadcast( &flips->wq );
+               break;
+          }
+     }
+
+     direct_mutex_unlock( &flips->lock );
+}
+
+/*
+ * Completes flips that have been displayed synchronously.
+ */
+static void
+flip_queue_done( CoreLayerRegion *region,
+                 u32              flip_count )
+{
+     CoreLayerRegionFlips *flips = flip_queue_get( region, true );
+
+     if (!flips)
+          return;
+
+     direct_mutex_lock( &flips->lock );
+
+     flip_queue_complete( flips, flip_count );
+
+     direct_mutex_unlock( &flips->lock );
+}
+
+/*
+ * Completes the queued flip of the buffer reported by the driver via dfb_surface_notify_display().
+ */
+static void
+flip_queue_displayed( CoreLayerRegion *region,
+                      int              index )
+{
+     int                   i;
+     CoreLayerRegionFlips *flips = flip_queue_get( region, false );
+
+     if (!flips)
+          return;
+
+     direct_mutex_lock( &flips->lock );
+
+     flips->notified = true;
+
+     for (i=0; i<flips->num; i++) {
+          if (flips->queue[i].index == index) {
+               flip_queue_complete( flips, flips->queue[i].flip_count );
+               break;
+          }
+     }
+
+     direct_mutex_unlock( &flips->lock );
+}
+
+/*
+ * Forgets about queued flips, e.g. when the region gets a new surface.
+ */
+static void
+flip_queue_reset( CoreLayerRegion *region )
+{
+     CoreLayerRegionFlips *flips = flip_queue_get( region, false );
+
+     if (!flips)
+          return;
+
+     direct_mutex_lock( &flips->lock );
+
+     flips->num       = 0;
+     flips->completed = 0;
+     flips->acked     = 0;
+
+     direct_waitqueue_broadcast( &flips->wq );
+
+     direct_mutex_unlock( &flips->lock );
+}
+
+/*
+ * Delivers frame acks to clients and completes flips at the vsync if the driver does not notify.
+ */
+static void *
+flip_queue_loop( DirectThread *thread, void *arg )
+{
+     CoreLayerRegionFlips *flips  = arg;
+     CoreLayerRegion      *region = flips->region;
+     CoreLayer            *layer  = dfb_layer_at( region->context->layer_id );
+
+     direct_mutex_lock( &flips->lock );
+
+     while (!flips->stop) {
+          if (flips->acked != flips->completed) {
+               u32          flip_count = flips->completed;
+               CoreSurface *surface    = region->surface;
+
+               flips->acked = flip_count;
+
+               if (!surface || dfb_surface_ref( surface ))
+                    continue;
+
+               direct_mutex_unlock( &flips->lock );
+
+               D_DEBUG_AT( Core_Layers, "  -> frame ack %u\n", flip_count );
+
+               /* Let clients waiting for a back buffer continue, accounted like acks of surface clients. */
+               dfb_surface_lock( surface );
+
+               if ((s32)(flip_count - surface->flips_acked) > 0) {
+                    surface->flips_acked = flip_count;
+
+                    dfb_surface_notify_frame( surface, surface->flips_acked );
+               }
+
+               dfb_surface_unlock( surface );
+
+               dfb_surface_unref( surface );
+
+               direct_mutex_lock( &flips->lock );
+               continue;
+          }
+
+          if (flips->num && !flips->notified) {
+               u32 flip_count = flips->queue[flips->num-1].flip_count;
+
+               direct_mutex_unlock( &flips->lock );
+
+               /* Without notifications from the driver, flips are displayed at the next vsync. */
+               dfb_layer_wait_vsync( layer );
+
+               direct_mutex_lock( &flips->lock );
+
+               if (!flips->notified)
+                    flip_queue_complete( flips, flip_count );
+               continue;
+          }
+
+          direct_waitqueue_wait( &flips->wq, &flips->lock );
+     }
+
+     direct_mutex_unlock( &flips->lock );
+
+     return NULL;
+}
@@ -78,6 +78,15 @@ DFBResult dfb_layer_region_flip_update  ( CoreLayerRegion      *region,
                                           const DFBRegion      *update,
                                           DFBSurfaceFlipFlags   flags );
 
+/*
+ * Flips the whole region like dfb_layer_region_flip_update() without an update,
+ * passing the regions changed since the previous flip on to the driver.
+ */
+DFBResult dfb_layer_region_flip_damage  ( CoreLayerRegion      *region,
+                                          const DFBRegion      *damage,
+                                          unsigned int          num_damage,
+                                          DFBSurfaceFlipFlags   flags );
+
 DFBResult
 dfb_layer_region_flip_update_stereo     ( CoreLayerRegion      *region,
                                           const DFBRegion      *left_update,
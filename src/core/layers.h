@@ -322,6 +322,22 @@ typedef struct {
                                      void                   *layer_data,
                                      void                   *region_data,
                                      CoreSurface            *surface );
+
+     /*
+      * Flip the surface of the region, only the damaged regions changed since the previous flip.
+      *
+      * Optional, FlipRegion() is used if damage is unknown.
+      * Appended to keep the layout of the table for existing drivers.
+      */
+     DFBResult (*FlipUpdate)       ( CoreLayer              *layer,
+                                     void                   *driver_data,
+                                     void                   *layer_data,
+                                     void                   *region_data,
+                                     CoreSurface            *surface,
+                                     DFBSurfaceFlipFlags     flags,
+                                     const DFBRegion        *damage,
+                                     unsigned int            num_damage,
+                                     CoreSurfaceBufferLock  *left_lock );
 } DisplayLayerFuncs;
 
 
@@ -616,6 +616,9 @@ dfb_surface_flip( CoreSurface *surface, bool swap )
          surface->buffers[surface->buffer_indices[front]]->policy || (surface->config.caps & DSCAPS_ROTATED))
           return DFB_UNSUPPORTED;
 
+     /* Remember when the back buffer became the front buffer. */
+     surface->buffers[surface->buffer_indices[back]]->frame = ++surface->frames;
+
      if (swap) {
           int tmp = surface->buffer_indices[back];
           surface->buffer_indices[back] = surface->buffer_indices[front];
@@ -631,6 +634,26 @@ dfb_surface_flip( CoreSurface *surface, bool swap )
      return DFB_OK;
 }
 
+int
+dfb_surface_buffer_age( CoreSurface           *surface,
+                        CoreSurfaceBufferRole  role )
+{
+     CoreSurfaceBuffer *buffer;
+
+     D_MAGIC_ASSERT( surface, CoreSurface );
+
+     if (surface->num_buffers == 0)
+          return 0;
+
+     buffer = dfb_surface_get_buffer( surface, role );
+     CORE_SURFACE_BUFFER_ASSERT( buffer );
+
+     if (!buffer->frame)
+          return 0;
+
+     return surface->frames - buffer->frame + 1;
+}
+
 DFBResult
 dfb_surface_dispatch_event( CoreSurface         *surface,
                             DFBSurfaceEventType  type )
@@ -239,6 +239,7 @@ struct __DFB_CoreSurface
      int                      buffer_indices[MAX_SURFACE_BUFFERS];
 
      u32                      flips;
+     u32                      frames;        /* Number of buffers made the front buffer by dfb_surface_flip(). */
 
      CorePalette             *palette;
      GlobalReaction           palette_reaction;
@@ -318,6 +319,16 @@ DFBResult dfb_surface_pool_notify   ( CoreSurface                  *surface,
 DFBResult dfb_surface_flip          ( CoreSurface                  *surface,
                                       bool                          swap );
 
+/*
+     Returns the age of the buffer with the given role, i.e. the number of frames
+     its content is behind the next frame: 1 if it holds the current front buffer
+     content, 2 if it was shown one frame earlier, and so on.
+
+     Returns 0 if the buffer has not been shown by dfb_surface_flip(), yet.
+*/
+int       dfb_surface_buffer_age    ( CoreSurface                  *surface,
+                                      CoreSurfaceBufferRole         role );
+
 DFBResult dfb_surface_dispatch_event( CoreSurface                  *surface,
                                       DFBSurfaceEventType           type );
 
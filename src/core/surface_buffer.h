@@ -162,6 +162,8 @@ struct __DFB_CoreSurfaceBuffer {
      unsigned long            resource_id;   /* layer id, window id, or user specified */
      
      int                      index;
+
+     u32                      frame;         /* Value of surface->frames when this buffer was shown last, 0 if never. */
 };
 
 #define CORE_SURFACE_BUFFER_ASSERT(buffer)                                                     \
@@ -51,7 +51,9 @@ typedef enum {
      CORE_PVR2D,
      CORE_CARE1,
      CORE_ANDROID,
-     CORE_EGL
+     CORE_EGL,
+     CORE_HEADLESS,
+     CORE_DRMKMS
 } CoreSystemType;
 
 typedef enum {
@@ -133,12 +133,13 @@ static void
 stack_containers_remove(CoreWindowStack *p)
 {
      Stack_Container    *stack_cntr = NULL;
+     Stack_Container    *next;
 
      D_DEBUG_AT( Core_WindowStack, "Enter:%s()\n", __FUNCTION__);
 
      pthread_mutex_lock( &stack_containers_lock );
 
-     direct_list_foreach(stack_cntr, stack_containers) {
+     direct_list_foreach_safe(stack_cntr, next, stack_containers) {
           if((void *)p == stack_cntr->ctx) {
                direct_list_remove(&stack_containers, &stack_cntr->link);
                D_FREE(stack_cntr);
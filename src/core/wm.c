@@ -45,6 +45,7 @@
 #include <core/coredefs.h>
 #include <core/coretypes.h>
 #include <core/core_parts.h>
+#include <core/input.h>
 #include <core/layer_context.h>
 #include <core/layers_internal.h>
 #include <core/windowstack.h>
@@ -880,6 +881,8 @@ DFBResult
 dfb_wm_process_input( CoreWindowStack     *stack,
                       const DFBInputEvent *event )
 {
+     DFBResult ret;
+
      D_DEBUG_AT( Core_WM, "%s( %p, %p )\n", __FUNCTION__, stack, event );
 
      D_ASSERT( wm_local != NULL );
@@ -895,7 +898,11 @@ dfb_wm_process_input( CoreWindowStack     *stack,
      D_ASSERT( event != NULL );
 
      /* Dispatch input event via window manager. */
-     return wm_local->funcs->ProcessInput( stack, wm_local->data, stack->stack_data, event );
+     ret = wm_local->funcs->ProcessInput( stack, wm_local->data, stack->stack_data, event );
+
+     dfb_input_record_latency( event, DILST_WM );
+
+     return ret;
 }
 
 DFBResult
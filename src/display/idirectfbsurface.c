@@ -2527,40 +2527,23 @@ IDirectFBSurface_DrawString( IDirectFBSurface *thiz,
      }
 
      if (flags & (DSTF_RIGHT | DSTF_CENTER)) {
-          int          i, num, kx, ky;
-          int          xsize = 0;
-          int          ysize = 0;
-          unsigned int prev = 0;
-          unsigned int indices[bytes];
+          int                    xsize;
+          int                    ysize;
+          const CoreFontTextRun *run;
 
-          /* FIXME: Avoid double locking and decoding. */
+          dfb_font_prefetch_text( core_font, data->encoding, text, bytes );
+
+          /* The laid out string is cached for drawing it below. */
           dfb_font_lock( core_font );
 
-          /* Decode string to character indices. */
-          ret = dfb_font_decode_text( core_font, data->encoding, text, bytes, indices, &num );
+          ret = dfb_font_get_text_run( core_font, data->encoding, text, bytes, &run );
           if (ret) {
                dfb_font_unlock( core_font );
                return ret;
           }
 
-          /* Calculate string width. */
-          for (i=0; i<num; i++) {
-               unsigned int   current = indices[i];
-               CoreGlyphData *glyph;
-
-               if (dfb_font_get_glyph_data( core_font, current, 0, &glyph ) == DFB_OK) {
-                    xsize += glyph->xadvance;
-                    ysize += glyph->yadvance;
-
-                    if (prev && core_font->GetKerning &&
-                        core_font->GetKerning( core_font, prev, current, &kx, &ky ) == DFB_OK) {
-                         xsize += kx << 8;
-                         ysize += ky << 8;
-                    }
-               }
-
-               prev = current;
-          }
+          xsize = run->advance_x;
+          ysize = run->advance_y;
 
           dfb_font_unlock( core_font );
 
@@ -32,6 +32,7 @@
 #include <directfb_util.h>
 
 #include "convert.h"
+#include "convert_simd.h"
 
 /* lookup tables for 2/3bit to 8bit color conversion */
 static const u8 lookup3to8[] = { 0x00, 0x24, 0x49, 0x6d, 0x92, 0xb6, 0xdb, 0xff};
@@ -388,6 +389,55 @@ dfb_pixel_to_components( DFBSurfacePixelFormat  format,
      }
 }
 
+/*
+ * Converts part of a line of a YUV format converted by the SIMD line converters,
+ * 'src' being the first line of the surface (chroma is located via 'surface_height').
+ */
+static void
+yuv_line_to_argb( DFBSurfacePixelFormat  format,
+                  const void            *src,
+                  int                    spitch,
+                  int                    surface_height,
+                  int                    line,
+                  int                    offset,
+                  u32                   *dst,
+                  int                    width )
+{
+     const u8 *src8 = src;
+     const u8 *y    = src8 + line * spitch + offset;
+     const u8 *c0, *c1;
+
+     D_ASSERT( !(offset & 1) );
+
+     switch (format) {
+          case DSPF_YUY2:
+          case DSPF_UYVY:
+               dfb_convert_line_yuv422_to_argb( src8 + line * spitch + offset * 2, dst, width, format == DSPF_UYVY );
+               break;
+
+          case DSPF_NV12:
+          case DSPF_NV21:
+               c0 = src8 + (surface_height + line / 2) * spitch + offset;
+
+               dfb_convert_line_nv12_to_argb( y, c0, dst, width, format == DSPF_NV21 );
+               break;
+
+          case DSPF_I420:
+          case DSPF_YV12:
+               c0 = src8 + surface_height * spitch + (line / 2) * (spitch / 2) + offset / 2;
+               c1 = c0 + (surface_height / 2) * (spitch / 2);
+
+               if (format == DSPF_I420)
+                    dfb_convert_line_i420_to_argb( y, c0, c1, dst, width );
+               else
+                    dfb_convert_line_i420_to_argb( y, c1, c0, dst, width );
+               break;
+
+          default:
+               D_BUG( "unexpected format" );
+     }
+}
+
 void
 dfb_convert_to_rgb16( DFBSurfacePixelFormat  format,
                       const void            *src,
@@ -399,7 +449,7 @@ dfb_convert_to_rgb16( DFBSurfacePixelFormat  format,
                       int                    height )
 {
      const int dp2 = dpitch / 2;
-     int       x;
+     int       x, y;
 
      switch (format) {
           case DSPF_RGB16:
@@ -433,27 +483,23 @@ dfb_convert_to_rgb16( DFBSurfacePixelFormat  format,
                }
                break;
 
+          case DSPF_YUY2:
           case DSPF_UYVY:
-               while (height--) {
-                    const u32 *src32 = src;
-     
-                    for (x=0; x<width; x+=2) {
-                         int r,g,b;
-                         int y0, y1, cb, cr;
+          case DSPF_NV12:
+          case DSPF_NV21:
+          case DSPF_I420:
+          case DSPF_YV12:
+               for (y=0; y<height; y++) {
+                    u32 line[256];
 
-                         y1 = (src32[x/2] >> 24);
-                         cr = (src32[x/2] >> 16) & 0xff;
-                         y0 = (src32[x/2] >>  8) & 0xff;
-                         cb = (src32[x/2]      ) & 0xff;
+                    for (x=0; x<width; x+=256) {
+                         int num = MIN( width - x, 256 );
 
-                         YCBCR_TO_RGB( y0, cb, cr, r, g, b );
-                         dst[x] = PIXEL_RGB16( r, g, b );
+                         yuv_line_to_argb( format, src, spitch, surface_height, y, x, line, num );
 
-                         YCBCR_TO_RGB( y1, cb, cr, r, g, b );
-                         dst[x+1] = PIXEL_RGB16( r, g, b );
+                         dfb_convert_line_argb_to_rgb16( line, dst + x, num );
                     }
 
-                    src += spitch;
                     dst += dp2;
                }
                break;
@@ -517,12 +563,7 @@ dfb_convert_to_rgb16( DFBSurfacePixelFormat  format,
           case DSPF_RGB32:
           case DSPF_ARGB:
                while (height--) {
-                    const u32 *src32 = src;
-
-                    for (x=0; x<width; x++)
-                         dst[x] = PIXEL_RGB16( (src32[x] & 0xff0000) >> 16,
-                                               (src32[x] & 0x00ff00) >>  8,
-                                               (src32[x] & 0x0000ff) );
+                    dfb_convert_line_argb_to_rgb16( src, dst, width );
 
                     src += spitch;
                     dst += dp2;
@@ -982,7 +1023,7 @@ dfb_convert_to_rgb32( DFBSurfacePixelFormat  format,
                       int                    height )
 {
      const int dp4 = dpitch / 4;
-     int       x;
+     int       x, y;
 
      switch (format) {
           case DSPF_RGB32:
@@ -1046,6 +1087,19 @@ dfb_convert_to_rgb32( DFBSurfacePixelFormat  format,
                }
                break;
 
+          case DSPF_YUY2:
+          case DSPF_UYVY:
+          case DSPF_NV12:
+          case DSPF_NV21:
+          case DSPF_I420:
+          case DSPF_YV12:
+               for (y=0; y<height; y++) {
+                    yuv_line_to_argb( format, src, spitch, surface_height, y, 0, dst, width );
+
+                    dst += dp4;
+               }
+               break;
+
           case DSPF_NV16:
                while (height--) {
                     const u8  *src8  = src;
@@ -1285,7 +1339,7 @@ dfb_convert_to_argb( DFBSurfacePixelFormat  format,
                      int                    height )
 {
      const int dp4 = dpitch / 4;
-     int       x;
+     int       x, y;
 
      switch (format) {
           case DSPF_ARGB:
@@ -1361,6 +1415,19 @@ dfb_convert_to_argb( DFBSurfacePixelFormat  format,
                }
                break;
 
+          case DSPF_YUY2:
+          case DSPF_UYVY:
+          case DSPF_NV12:
+          case DSPF_NV21:
+          case DSPF_I420:
+          case DSPF_YV12:
+               for (y=0; y<height; y++) {
+                    yuv_line_to_argb( format, src, spitch, surface_height, y, 0, dst, width );
+
+                    dst += dp4;
+               }
+               break;
+
           case DSPF_NV16:
                while (height--) {
                     const u8  *src8  = src;
@@ -2422,6 +2489,25 @@ dfb_convert_to_yuy2( DFBSurfacePixelFormat  format,
                }
                break;
 
+          case DSPF_UYVY:
+               while (height--) {
+                    dfb_convert_line_swap_yuv422( src, (u8*) dst, width );
+
+                    src += spitch;
+                    dst += dp4;
+               }
+               break;
+
+          case DSPF_RGB32:
+          case DSPF_ARGB:
+               while (height--) {
+                    dfb_convert_line_argb_to_yuv422( src, (u8*) dst, width, false );
+
+                    src += spitch;
+                    dst += dp4;
+               }
+               break;
+
           default:
                D_ONCE( "unsupported format" );
      }
@@ -2449,6 +2535,25 @@ dfb_convert_to_uyvy( DFBSurfacePixelFormat  format,
                }
                break;
 
+          case DSPF_YUY2:
+               while (height--) {
+                    dfb_convert_line_swap_yuv422( src, (u8*) dst, width );
+
+                    src += spitch;
+                    dst += dp4;
+               }
+               break;
+
+          case DSPF_RGB32:
+          case DSPF_ARGB:
+               while (height--) {
+                    dfb_convert_line_argb_to_yuv422( src, (u8*) dst, width, true );
+
+                    src += spitch;
+                    dst += dp4;
+               }
+               break;
+
           default:
                D_ONCE( "unsupported format" );
      }
@@ -0,0 +1,382 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <directfb.h>
+#include <directfb_util.h>
+
+#include "convert.h"
+#include "convert_simd.h"
+
+/*
+ * SSE2 is part of every x86-64 CPU, 32 bit builds get it with -msse2.
+ */
+#if defined(USE_SSE) && defined(__SSE2__)
+#define USE_SSE2_CONVERT
+#include <emmintrin.h>
+#endif
+
+
+#ifdef USE_SSE2_CONVERT
+
+/* Coefficient pairs for _mm_madd_epi16(), applied to interleaved 16 bit values (a,b). */
+#define PAIR(a,b)   _mm_setr_epi16( (a), (b), (a), (b), (a), (b), (a), (b) )
+
+/*
+ * Converts eight pixels, y, cb and cr are signed 16 bit values with offsets already removed.
+ *
+ * Products are summed in 32 bits like YCBCR_TO_RGB() does, packing to bytes does the clamping.
+ */
+static __inline__ void
+sse2_ycbcr_to_argb( __m128i y, __m128i cb, __m128i cr, u32 *dst )
+{
+     const __m128i round = _mm_set1_epi32( 128 );
+     const __m128i one   = _mm_set1_epi16( 1 );
+
+     __m128i ycb_lo = _mm_unpacklo_epi16( y, cb );
+     __m128i ycb_hi = _mm_unpackhi_epi16( y, cb );
+     __m128i ycr_lo = _mm_unpacklo_epi16( y, cr );
+     __m128i ycr_hi = _mm_unpackhi_epi16( y, cr );
+     __m128i cr1_lo = _mm_unpacklo_epi16( cr, one );
+     __m128i cr1_hi = _mm_unpackhi_epi16( cr, one );
+
+     __m128i r_lo, r_hi, g_lo, g_hi, b_lo, b_hi;
+     __m128i r, g, b, bg, ra;
+
+     r_lo = _mm_add_epi32( _mm_madd_epi16( ycr_lo, PAIR( 298, 409 ) ), round );
+     r_hi = _mm_add_epi32( _mm_madd_epi16( ycr_hi, PAIR( 298, 409 ) ), round );
+
+     g_lo = _mm_add_epi32( _mm_madd_epi16( ycb_lo, PAIR( 298, -100 ) ), _mm_madd_epi16( cr1_lo, PAIR( -208, 128 ) ) );
+     g_hi = _mm_add_epi32( _mm_madd_epi16( ycb_hi, PAIR( 298, -100 ) ), _mm_madd_epi16( cr1_hi, PAIR( -208, 128 ) ) );
+
+     b_lo = _mm_add_epi32( _mm_madd_epi16( ycb_lo, PAIR( 298, 516 ) ), round );
+     b_hi = _mm_add_epi32( _mm_madd_epi16( ycb_hi, PAIR( 298, 516 ) ), round );
+
+     r = _mm_packs_epi32( _mm_srai_epi32( r_lo, 8 ), _mm_srai_epi32( r_hi, 8 ) );
+     g = _mm_packs_epi32( _mm_srai_epi32( g_lo, 8 ), _mm_srai_epi32( g_hi, 8 ) );
+     b = _mm_packs_epi32( _mm_srai_epi32( b_lo, 8 ), _mm_srai_epi32( b_hi, 8 ) );
+
+     r = _mm_packus_epi16( r, r );
+     g = _mm_packus_epi16( g, g );
+     b = _mm_packus_epi16( b, b );
+
+     bg = _mm_unpacklo_epi8( b, g );
+     ra = _mm_unpacklo_epi8( r, _mm_set1_epi8( (char) 0xff ) );
+
+     _mm_storeu_si128( (__m128i*) dst,       _mm_unpacklo_epi16( bg, ra ) );
+     _mm_storeu_si128( (__m128i*) (dst + 4), _mm_unpackhi_epi16( bg, ra ) );
+}
+
+/* Splits interleaved 16 bit chroma (c0,c1,c0,c1,...) into one value per pixel each. */
+static __inline__ void
+sse2_split_chroma( __m128i c, __m128i *c0, __m128i *c1 )
+{
+     c = _mm_sub_epi16( c, _mm_set1_epi16( 128 ) );
+
+     *c0 = _mm_shufflehi_epi16( _mm_shufflelo_epi16( c, _MM_SHUFFLE(2,2,0,0) ), _MM_SHUFFLE(2,2,0,0) );
+     *c1 = _mm_shufflehi_epi16( _mm_shufflelo_epi16( c, _MM_SHUFFLE(3,3,1,1) ), _MM_SHUFFLE(3,3,1,1) );
+}
+
+/* Narrows four 32 bit values below 0x10000 each in two vectors to eight 16 bit values. */
+static __inline__ __m128i
+sse2_pack_u32( __m128i a, __m128i b )
+{
+     a = _mm_srai_epi32( _mm_slli_epi32( a, 16 ), 16 );
+     b = _mm_srai_epi32( _mm_slli_epi32( b, 16 ), 16 );
+
+     return _mm_packs_epi32( a, b );
+}
+
+/* Four pixels to YUY2 (or UYVY) words, i.e. two macro pixels as 32 bit values below 0x10000. */
+static __inline__ __m128i
+sse2_argb_to_yuv422( __m128i p, bool uyvy )
+{
+     const __m128i mask = _mm_set1_epi32( 0xff );
+     const __m128i even = _mm_setr_epi32( -1, 0, -1, 0 );
+
+     __m128i r  = _mm_and_si128( _mm_srli_epi32( p, 16 ), mask );
+     __m128i g  = _mm_and_si128( _mm_srli_epi32( p,  8 ), mask );
+     __m128i b  = _mm_and_si128( p, mask );
+     __m128i rg = _mm_or_si128( r, _mm_slli_epi32( g, 16 ) );
+     __m128i b1 = _mm_or_si128( b, _mm_set1_epi32( 1 << 16 ) );
+     __m128i b2 = _mm_or_si128( b, _mm_set1_epi32( 2 << 16 ) );
+     __m128i y, cb, cr, c;
+
+     /* RGB_TO_YCBCR() with the constant offsets split to fit into 16 bits */
+     y  = _mm_add_epi32( _mm_madd_epi16( rg, PAIR(  66, 129 ) ), _mm_madd_epi16( b1, PAIR(  25, 16*256 + 128 ) ) );
+     cb = _mm_add_epi32( _mm_madd_epi16( rg, PAIR( -38, -74 ) ), _mm_madd_epi16( b2, PAIR( 112, (128*256 + 128)/2 ) ) );
+     cr = _mm_add_epi32( _mm_madd_epi16( rg, PAIR( 112, -94 ) ), _mm_madd_epi16( b2, PAIR( -18, (128*256 + 128)/2 ) ) );
+
+     y  = _mm_srli_epi32( y,  8 );
+     cb = _mm_srli_epi32( cb, 8 );
+     cr = _mm_srli_epi32( cr, 8 );
+
+     /* average chroma of both pixels */
+     cb = _mm_srli_epi32( _mm_add_epi32( cb, _mm_shuffle_epi32( cb, _MM_SHUFFLE(2,3,0,1) ) ), 1 );
+     cr = _mm_srli_epi32( _mm_add_epi32( cr, _mm_shuffle_epi32( cr, _MM_SHUFFLE(2,3,0,1) ) ), 1 );
+
+     c = _mm_or_si128( _mm_and_si128( even, cb ), _mm_andnot_si128( even, cr ) );
+
+     if (uyvy)
+          return _mm_or_si128( c, _mm_slli_epi32( y, 8 ) );
+
+     return _mm_or_si128( y, _mm_slli_epi32( c, 8 ) );
+}
+
+static __inline__ __m128i
+sse2_load_u32( const u8 *src )
+{
+     int v;
+
+     memcpy( &v, src, 4 );
+
+     return _mm_cvtsi32_si128( v );
+}
+
+#endif
+
+/**********************************************************************************************************************/
+
+void
+dfb_convert_line_yuv422_to_argb( const u8 *src,
+                                 u32      *dst,
+                                 int       width,
+                                 bool      uyvy )
+{
+     int x  = 0;
+     int yo = uyvy ? 1 : 0;
+     int co = uyvy ? 0 : 1;
+
+#ifdef USE_SSE2_CONVERT
+     const __m128i mask = _mm_set1_epi16( 0xff );
+
+     for (; x + 8 <= width; x += 8) {
+          __m128i p = _mm_loadu_si128( (const __m128i*) (src + x * 2) );
+          __m128i y, c, cb, cr;
+
+          if (uyvy) {
+               y = _mm_srli_epi16( p, 8 );
+               c = _mm_and_si128( p, mask );
+          }
+          else {
+               y = _mm_and_si128( p, mask );
+               c = _mm_srli_epi16( p, 8 );
+          }
+
+          sse2_split_chroma( c, &cb, &cr );
+
+          sse2_ycbcr_to_argb( _mm_sub_epi16( y, _mm_set1_epi16( 16 ) ), cb, cr, dst + x );
+     }
+#endif
+
+     for (; x < width; x++) {
+          const u8 *p = src + (x & ~1) * 2;
+          int       r, g, b;
+
+          YCBCR_TO_RGB( p[(x & 1) * 2 + yo], p[co], p[co + 2], r, g, b );
+
+          dst[x] = PIXEL_ARGB( 0xff, r, g, b );
+     }
+}
+
+void
+dfb_convert_line_nv12_to_argb( const u8 *y,
+                               const u8 *cbcr,
+                               u32      *dst,
+                               int       width,
+                               bool      nv21 )
+{
+     int x = 0;
+
+#ifdef USE_SSE2_CONVERT
+     const __m128i zero = _mm_setzero_si128();
+
+     for (; x + 8 <= width; x += 8) {
+          __m128i l = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) (y + x) ), zero );
+          __m128i c = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) (cbcr + x) ), zero );
+          __m128i cb, cr;
+
+          if (nv21)
+               sse2_split_chroma( c, &cr, &cb );
+          else
+               sse2_split_chroma( c, &cb, &cr );
+
+          sse2_ycbcr_to_argb( _mm_sub_epi16( l, _mm_set1_epi16( 16 ) ), cb, cr, dst + x );
+     }
+#endif
+
+     for (; x < width; x++) {
+          const u8 *c = cbcr + (x & ~1);
+          int       r, g, b;
+
+          if (nv21)
+               YCBCR_TO_RGB( y[x], c[1], c[0], r, g, b );
+          else
+               YCBCR_TO_RGB( y[x], c[0], c[1], r, g, b );
+
+          dst[x] = PIXEL_ARGB( 0xff, r, g, b );
+     }
+}
+
+void
+dfb_convert_line_i420_to_argb( const u8 *y,
+                               const u8 *cb,
+                               const u8 *cr,
+                               u32      *dst,
+                               int       width )
+{
+     int x = 0;
+
+#ifdef USE_SSE2_CONVERT
+     const __m128i zero = _mm_setzero_si128();
+     const __m128i half = _mm_set1_epi16( 128 );
+
+     for (; x + 8 <= width; x += 8) {
+          __m128i l = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) (y + x) ), zero );
+          __m128i u = _mm_unpacklo_epi8( sse2_load_u32( cb + x / 2 ), zero );
+          __m128i v = _mm_unpacklo_epi8( sse2_load_u32( cr + x / 2 ), zero );
+
+          u = _mm_sub_epi16( _mm_unpacklo_epi16( u, u ), half );
+          v = _mm_sub_epi16( _mm_unpacklo_epi16( v, v ), half );
+
+          sse2_ycbcr_to_argb( _mm_sub_epi16( l, _mm_set1_epi16( 16 ) ), u, v, dst + x );
+     }
+#endif
+
+     for (; x < width; x++) {
+          int r, g, b;
+
+          YCBCR_TO_RGB( y[x], cb[x>>1], cr[x>>1], r, g, b );
+
+          dst[x] = PIXEL_ARGB( 0xff, r, g, b );
+     }
+}
+
+void
+dfb_convert_line_argb_to_rgb16( const u32 *src,
+                                u16       *dst,
+                                int        width )
+{
+     int x = 0;
+
+#ifdef USE_SSE2_CONVERT
+     const __m128i mask_r = _mm_set1_epi32( 0xf800 );
+     const __m128i mask_g = _mm_set1_epi32( 0x07e0 );
+     const __m128i mask_b = _mm_set1_epi32( 0x001f );
+
+     for (; x + 8 <= width; x += 8) {
+          __m128i p0 = _mm_loadu_si128( (const __m128i*) (src + x) );
+          __m128i p1 = _mm_loadu_si128( (const __m128i*) (src + x + 4) );
+
+          p0 = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p0, 8 ), mask_r ),
+                                           _mm_and_si128( _mm_srli_epi32( p0, 5 ), mask_g ) ),
+                             _mm_and_si128( _mm_srli_epi32( p0, 3 ), mask_b ) );
+
+          p1 = _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p1, 8 ), mask_r ),
+                                           _mm_and_si128( _mm_srli_epi32( p1, 5 ), mask_g ) ),
+                             _mm_and_si128( _mm_srli_epi32( p1, 3 ), mask_b ) );
+
+          _mm_storeu_si128( (__m128i*) (dst + x), sse2_pack_u32( p0, p1 ) );
+     }
+#endif
+
+     for (; x < width; x++)
+          dst[x] = PIXEL_RGB16( (src[x] & 0xff0000) >> 16,
+                                (src[x] & 0x00ff00) >>  8,
+                                (src[x] & 0x0000ff) );
+}
+
+void
+dfb_convert_line_argb_to_yuv422( const u32 *src,
+                                 u8        *dst,
+                                 int        width,
+                                 bool       uyvy )
+{
+     int x = 0;
+
+#ifdef USE_SSE2_CONVERT
+     for (; x + 8 <= width; x += 8) {
+          __m128i p0 = _mm_loadu_si128( (const __m128i*) (src + x) );
+          __m128i p1 = _mm_loadu_si128( (const __m128i*) (src + x + 4) );
+
+          _mm_storeu_si128( (__m128i*) (dst + x * 2),
+                            sse2_pack_u32( sse2_argb_to_yuv422( p0, uyvy ), sse2_argb_to_yuv422( p1, uyvy ) ) );
+     }
+#endif
+
+     for (; x < width; x += 2) {
+          u32 p0 = src[x];
+          u32 p1 = (x + 1 < width) ? src[x+1] : p0;
+          int y0, cb0, cr0;
+          int y1, cb1, cr1;
+          u8 *d  = dst + x * 2;
+
+          RGB_TO_YCBCR( (p0 >> 16) & 0xff, (p0 >> 8) & 0xff, p0 & 0xff, y0, cb0, cr0 );
+          RGB_TO_YCBCR( (p1 >> 16) & 0xff, (p1 >> 8) & 0xff, p1 & 0xff, y1, cb1, cr1 );
+
+          if (uyvy) {
+               d[0] = (cb0 + cb1) >> 1;
+               d[1] = y0;
+               d[2] = (cr0 + cr1) >> 1;
+               d[3] = y1;
+          }
+          else {
+               d[0] = y0;
+               d[1] = (cb0 + cb1) >> 1;
+               d[2] = y1;
+               d[3] = (cr0 + cr1) >> 1;
+          }
+     }
+}
+
+void
+dfb_convert_line_swap_yuv422( const u8 *src,
+                              u8       *dst,
+                              int       width )
+{
+     int x = 0;
+     int n = (width + 1) & ~1;
+
+#ifdef USE_SSE2_CONVERT
+     for (; x + 8 <= n; x += 8) {
+          __m128i p = _mm_loadu_si128( (const __m128i*) (src + x * 2) );
+
+          _mm_storeu_si128( (__m128i*) (dst + x * 2), _mm_or_si128( _mm_slli_epi16( p, 8 ), _mm_srli_epi16( p, 8 ) ) );
+     }
+#endif
+
+     for (; x < n; x++) {
+          u8 a = src[x*2];
+
+          dst[x*2]   = src[x*2+1];
+          dst[x*2+1] = a;
+     }
+}
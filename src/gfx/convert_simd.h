@@ -0,0 +1,80 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef __GFX__CONVERT_SIMD_H__
+#define __GFX__CONVERT_SIMD_H__
+
+#include <directfb.h>
+
+
+/*
+ * Line converters used by dfb_convert_to_*() for the formats converted every frame.
+ *
+ * Each one converts a single line of 'width' pixels, using SSE2 where available
+ * and plain C for the remaining pixels, with results identical to YCBCR_TO_RGB(),
+ * RGB_TO_YCBCR() and PIXEL_RGB16(). Chroma is shared by two horizontally adjacent
+ * pixels, an odd width is completed by repeating the last pixel.
+ */
+
+/* YUY2 or UYVY to ARGB with full alpha */
+void dfb_convert_line_yuv422_to_argb( const u8  *src,
+                                      u32       *dst,
+                                      int        width,
+                                      bool       uyvy );
+
+/* NV12 or NV21 (interleaved chroma line) to ARGB with full alpha */
+void dfb_convert_line_nv12_to_argb  ( const u8  *y,
+                                      const u8  *cbcr,
+                                      u32       *dst,
+                                      int        width,
+                                      bool       nv21 );
+
+/* I420 or YV12 (separate chroma lines) to ARGB with full alpha */
+void dfb_convert_line_i420_to_argb  ( const u8  *y,
+                                      const u8  *cb,
+                                      const u8  *cr,
+                                      u32       *dst,
+                                      int        width );
+
+/* ARGB or RGB32 to RGB16 */
+void dfb_convert_line_argb_to_rgb16 ( const u32 *src,
+                                      u16       *dst,
+                                      int        width );
+
+/* ARGB or RGB32 to YUY2 or UYVY, chroma of two pixels is averaged */
+void dfb_convert_line_argb_to_yuv422( const u32 *src,
+                                      u8        *dst,
+                                      int        width,
+                                      bool       uyvy );
+
+/* YUY2 to UYVY and vice versa */
+void dfb_convert_line_swap_yuv422   ( const u8  *src,
+                                      u8        *dst,
+                                      int        width );
+
+#endif
@@ -281,6 +281,9 @@ IDirectFB_Destruct( IDirectFB *thiz )
 
      D_DEBUG_AT( IDFB, "%s( %p )\n", __FUNCTION__, thiz );
 
+     /* Renderings still running may use surfaces and the core. */
+     IDirectFBImageProvider_ShutdownAsync();
+
      drop_window( data, false );
 
      if (data->primary.context)
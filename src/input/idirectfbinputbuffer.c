@@ -62,6 +62,8 @@
 #include <core/windows_internal.h>
 #endif
 
+#include <media/idirectfbimageprovider.h>
+
 #include <misc/conf.h>
 #include <misc/util.h>
 
@@ -74,11 +76,6 @@ D_DEBUG_DOMAIN( IDFBEvBuf,         "IDFBEventBuffer",         "IDirectFBEventBuf
 D_DEBUG_DOMAIN( IDFBEvBuf_Surface, "IDFBEventBuffer/Surface", "IDirectFBEventBuffer Interface Surface" );
 
 
-typedef struct {
-     DirectLink   link;
-     DFBEvent     evt;
-} EventBufferItem;
-
 #if !DIRECTFB_BUILD_PURE_VOODOO
 typedef struct {
      DirectLink       link;
@@ -118,11 +115,16 @@ typedef struct {
      DirectLink                   *windows;        /* attached windows */
      DirectLink                   *surfaces;       /* attached surfaces */
 
-     DirectLink                   *events;         /* linked list containing events */
+     DFBEvent                     *events;         /* ring buffer containing events */
+     unsigned int                  events_size;    /* number of slots in the ring, power of two */
+     unsigned int                  events_first;   /* slot of the oldest event */
+     unsigned int                  events_count;   /* number of events in the ring */
+     unsigned int                  events_dropped; /* number of events dropped due to the limit */
 
      DirectMutex                   events_mutex;   /* mutex lock for accessing the event queue */
 
      DirectWaitQueue               wait_condition; /* condition for idle wait in WaitForEvent() */
+     int                           waiting;        /* number of threads waiting for events */
 
      bool                          pipe;           /* file descriptor mode? */
      int                           pipe_fds[2];    /* read & write file descriptor */
@@ -137,7 +139,7 @@ typedef struct {
  * adds an event to the event queue
  */
 static void IDirectFBEventBuffer_AddItem( IDirectFBEventBuffer_data *data,
-                                          EventBufferItem           *item );
+                                          DFBEvent                  *event );
 
 #if !DIRECTFB_BUILD_PURE_VOODOO
 static ReactionResult IDirectFBEventBuffer_InputReact( const void *msg_data,
@@ -158,6 +160,256 @@ static void CollectEventStatistics( DFBEventBufferStats *stats,
                                     const DFBEvent      *event,
                                     int                  incdec );
 
+/**********************************************************************************************************************/
+
+/*
+ * Copies the part of the event that is valid for its class,
+ * the application may pass pointers to the class specific structs only.
+ */
+static inline void
+CopyEvent( DFBEvent       *dst,
+           const DFBEvent *src )
+{
+     switch (src->clazz) {
+          case DFEC_INPUT:
+               dst->input = src->input;
+               break;
+
+          case DFEC_WINDOW:
+               dst->window = src->window;
+               break;
+
+          case DFEC_USER:
+               dst->user = src->user;
+               break;
+
+          case DFEC_VIDEOPROVIDER:
+               dst->videoprovider = src->videoprovider;
+               break;
+
+          case DFEC_UNIVERSAL:
+               direct_memcpy( dst, src, src->universal.size );
+               break;
+
+          case DFEC_SURFACE:
+               dst->surface = src->surface;
+               break;
+
+          case DFEC_IMAGEPROVIDER:
+               dst->imageprovider = src->imageprovider;
+               break;
+
+          default:
+               D_BUG("unknown event class");
+     }
+}
+
+/*
+ * Removes the oldest event from the ring, called with events_mutex locked.
+ */
+static inline void
+RemoveFirst( IDirectFBEventBuffer_data *data )
+{
+     D_ASSERT( data->events_count > 0 );
+
+     if (data->stats_enabled)
+          CollectEventStatistics( &data->stats, &data->events[data->events_first], -1 );
+
+     data->events_first = (data->events_first + 1) & (data->events_size - 1);
+     data->events_count--;
+}
+
+/*
+ * Copies up to 'max' events out of the ring and removes them, called with events_mutex locked.
+ */
+static unsigned int
+FetchEvents( IDirectFBEventBuffer_data *data,
+             DFBEvent                  *events,
+             unsigned int               max )
+{
+     unsigned int num = MIN( max, data->events_count );
+     unsigned int part;
+
+     if (data->stats_enabled) {
+          unsigned int i;
+
+          for (i=0; i<num; i++)
+               CollectEventStatistics( &data->stats,
+                                       &data->events[(data->events_first + i) & (data->events_size - 1)], -1 );
+     }
+
+     /* Copy in at most two chunks, before and after the wrap around. */
+     part = MIN( num, data->events_size - data->events_first );
+
+     direct_memcpy( events, &data->events[data->events_first], part * sizeof(DFBEvent) );
+
+     if (part < num)
+          direct_memcpy( events + part, data->events, (num - part) * sizeof(DFBEvent) );
+
+     data->events_first  = (data->events_first + num) & (data->events_size - 1);
+     data->events_count -= num;
+
+     return num;
+}
+
+/*
+ * Records the input latency of events handed to the application.
+ */
+static void
+RecordClientLatency( const DFBEvent *events,
+                     unsigned int    num )
+{
+#if !DIRECTFB_BUILD_PURE_VOODOO
+     unsigned int i;
+
+     if (!dfb_config->input_latency_stats)
+          return;
+
+     for (i=0; i<num; i++) {
+          if (events[i].clazz == DFEC_INPUT)
+               dfb_input_record_latency( &events[i].input, DILST_CLIENT );
+     }
+#endif
+}
+
+/*
+ * Lets asynchronous image renderings release their references once their final event is handed to the application.
+ */
+static void
+NotifyEventsFetched( const DFBEvent *events,
+                     unsigned int    num )
+{
+     unsigned int i;
+
+     for (i=0; i<num; i++) {
+          if (events[i].clazz == DFEC_IMAGEPROVIDER)
+               IDirectFBImageProvider_AsyncEventFetched( &events[i].imageprovider );
+     }
+}
+
+/*
+ * Returns a free slot at the end of the ring, called with events_mutex locked.
+ *
+ * A full ring is doubled in size unless the "event-buffer-limit" is reached,
+ * in which case the oldest event is dropped to make room for the new one.
+ */
+static DFBEvent *
+AllocateSlot( IDirectFBEventBuffer_data *data )
+{
+     if (data->events_count == data->events_size) {
+          DFBEvent *events = NULL;
+
+          if (!dfb_config->event_buffer_limit || data->events_size * 2 <= dfb_config->event_buffer_limit)
+               events = D_MALLOC( data->events_size * 2 * sizeof(DFBEvent) );
+
+          if (events) {
+               unsigned int part = data->events_size - data->events_first;
+
+               D_DEBUG_AT( IDFBEvBuf, "  -> growing ring to %u events\n", data->events_size * 2 );
+
+               direct_memcpy( events, &data->events[data->events_first], part * sizeof(DFBEvent) );
+               direct_memcpy( events + part, data->events, data->events_first * sizeof(DFBEvent) );
+
+               D_FREE( data->events );
+
+               data->events       = events;
+               data->events_size *= 2;
+               data->events_first = 0;
+          }
+          else {
+               if (!data->events_dropped++)
+                    D_WARN( "event buffer overflow (%u events), dropping oldest events", data->events_count );
+
+               RemoveFirst( data );
+          }
+     }
+
+     return &data->events[(data->events_first + data->events_count++) & (data->events_size - 1)];
+}
+
+/*
+ * Merges a motion event into a queued one of the same device/window, called with events_mutex locked.
+ *
+ * Input motion is only merged into the trailing run of motion events of the same device and only if the
+ * last queued event completes its group, so that events with DIEF_FOLLOW are always followed by another.
+ */
+static bool
+CoalesceEvent( IDirectFBEventBuffer_data *data,
+               const DFBEvent            *event )
+{
+     unsigned int i;
+
+     if (!data->events_count)
+          return false;
+
+     switch (event->clazz) {
+          case DFEC_INPUT:
+               if (event->input.type != DIET_AXISMOTION)
+                    return false;
+
+               for (i=data->events_count; i>0; i--) {
+                    DFBInputEvent *queued = &data->events[(data->events_first + i - 1) & (data->events_size - 1)].input;
+                    int            follow = queued->flags & DIEF_FOLLOW;
+                    int            axisrel;
+
+                    if (queued->clazz != DFEC_INPUT || queued->type != DIET_AXISMOTION ||
+                        queued->device_id != event->input.device_id)
+                         return false;
+
+                    if (i == data->events_count && follow)
+                         return false;
+
+                    if (queued->axis != event->input.axis)
+                         continue;
+
+                    if ((queued->flags & ~DIEF_FOLLOW) != (event->input.flags & ~DIEF_FOLLOW) ||
+                        queued->buttons   != event->input.buttons   ||
+                        queued->modifiers != event->input.modifiers ||
+                        queued->locks     != event->input.locks)
+                         return false;
+
+                    axisrel = queued->axisrel + event->input.axisrel;
+
+                    *queued = event->input;
+
+                    queued->flags = (queued->flags & ~DIEF_FOLLOW) | follow;
+
+                    if (queued->flags & DIEF_AXISREL)
+                         queued->axisrel = axisrel;
+
+                    return true;
+               }
+               break;
+
+          case DFEC_WINDOW:
+               if (event->window.type == DWET_MOTION) {
+                    DFBWindowEvent *queued = &data->events[(data->events_first + data->events_count - 1) &
+                                                           (data->events_size - 1)].window;
+
+                    if (queued->clazz     == DFEC_WINDOW               &&
+                        queued->type      == DWET_MOTION               &&
+                        queued->window_id == event->window.window_id   &&
+                        queued->flags     == event->window.flags       &&
+                        queued->buttons   == event->window.buttons     &&
+                        queued->modifiers == event->window.modifiers   &&
+                        queued->locks     == event->window.locks)
+                    {
+                         *queued = event->window;
+
+                         return true;
+                    }
+               }
+               break;
+
+          default:
+               break;
+     }
+
+     return false;
+}
+
+/**********************************************************************************************************************/
+
 
 static void
 IDirectFBEventBuffer_Destruct( IDirectFBEventBuffer *thiz )
@@ -166,9 +418,8 @@ IDirectFBEventBuffer_Destruct( IDirectFBEventBuffer *thiz )
 #if !DIRECTFB_BUILD_PURE_VOODOO
      AttachedDevice            *device;
      AttachedWindow            *window;
-#endif
-     EventBufferItem           *item;
      DirectLink                *n;
+#endif
 
      D_DEBUG_AT( IDFBEvBuf, "%s( %p )\n", __FUNCTION__, thiz );
 
@@ -217,8 +468,10 @@ IDirectFBEventBuffer_Destruct( IDirectFBEventBuffer *thiz )
      }
 #endif
 
-     direct_list_foreach_safe (item, n, data->events)
-          D_FREE( item );
+     if (data->events_dropped)
+          D_DEBUG_AT( IDFBEvBuf, "  -> dropped %u events\n", data->events_dropped );
+
+     D_FREE( data->events );
 
      direct_waitqueue_deinit( &data->wait_condition );
      direct_mutex_deinit( &data->events_mutex );
@@ -254,9 +507,6 @@ IDirectFBEventBuffer_Release( IDirectFBEventBuffer *thiz )
 static DFBResult
 IDirectFBEventBuffer_Reset( IDirectFBEventBuffer *thiz )
 {
-     EventBufferItem *item;
-     DirectLink      *n;
-
      DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer)
 
      D_DEBUG_AT( IDFBEvBuf, "%s( %p )\n", __FUNCTION__, thiz );
@@ -266,10 +516,8 @@ IDirectFBEventBuffer_Reset( IDirectFBEventBuffer *thiz )
 
      direct_mutex_lock( &data->events_mutex );
 
-     direct_list_foreach_safe (item, n, data->events)
-          D_FREE( item );
-
-     data->events = NULL;
+     data->events_first = 0;
+     data->events_count = 0;
 
      direct_mutex_unlock( &data->events_mutex );
 
@@ -290,9 +538,12 @@ IDirectFBEventBuffer_WaitForEvent( IDirectFBEventBuffer *thiz )
 
      direct_mutex_lock( &data->events_mutex );
 
-     if (!data->events)
+     if (!data->events_count) {
+          data->waiting++;
           direct_waitqueue_wait( &data->wait_condition, &data->events_mutex );
-     if (!data->events)
+          data->waiting--;
+     }
+     if (!data->events_count)
           ret = DFB_INTERRUPTED;
 
      direct_mutex_unlock( &data->events_mutex );
@@ -316,7 +567,7 @@ IDirectFBEventBuffer_WaitForEventWithTimeout( IDirectFBEventBuffer *thiz,
           return DFB_UNSUPPORTED;
 
      if (direct_mutex_trylock( &data->events_mutex ) == 0) {
-          if (data->events) {
+          if (data->events_count) {
                direct_mutex_unlock ( &data->events_mutex );
                return ret;
           }
@@ -326,11 +577,13 @@ IDirectFBEventBuffer_WaitForEventWithTimeout( IDirectFBEventBuffer *thiz,
      if (!locked)
           direct_mutex_lock( &data->events_mutex );
 
-     if (!data->events) {
+     if (!data->events_count) {
+          data->waiting++;
           ret = direct_waitqueue_wait_timeout( &data->wait_condition,
                                                &data->events_mutex,
                                                seconds * 1000000 + milli_seconds * 1000 );
-          if (ret != DR_TIMEOUT && !data->events)
+          data->waiting--;
+          if (ret != DR_TIMEOUT && !data->events_count)
                ret = DFB_INTERRUPTED;
      }
 
@@ -358,8 +611,6 @@ static DFBResult
 IDirectFBEventBuffer_GetEvent( IDirectFBEventBuffer *thiz,
                                DFBEvent             *event )
 {
-     EventBufferItem *item;
-
      DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer)
 
      D_DEBUG_AT( IDFBEvBuf, "%s( %p, %p )\n", __FUNCTION__, thiz, event );
@@ -369,50 +620,20 @@ IDirectFBEventBuffer_GetEvent( IDirectFBEventBuffer *thiz,
 
      direct_mutex_lock( &data->events_mutex );
 
-     if (!data->events) {
+     if (!data->events_count) {
           direct_mutex_unlock( &data->events_mutex );
           return DFB_BUFFEREMPTY;
      }
 
-     item = (EventBufferItem*) data->events;
+     CopyEvent( event, &data->events[data->events_first] );
 
-     switch (item->evt.clazz) {
-          case DFEC_INPUT:
-               event->input = item->evt.input;
-               break;
-
-          case DFEC_WINDOW:
-               event->window = item->evt.window;
-               break;
-
-          case DFEC_USER:
-               event->user = item->evt.user;
-               break;
-
-          case DFEC_VIDEOPROVIDER:
-               event->videoprovider = item->evt.videoprovider;
-               break;
-
-          case DFEC_UNIVERSAL:
-               direct_memcpy( event, &item->evt, item->evt.universal.size );
-               break;
-
-          case DFEC_SURFACE:
-               event->surface = item->evt.surface;
-               break;
-
-          default:
-               D_BUG("unknown event class");
-     }
-
-     if (data->stats_enabled)
-          CollectEventStatistics( &data->stats, &item->evt, -1 );
+     RemoveFirst( data );
 
-     direct_list_remove( &data->events, &item->link );
+     direct_mutex_unlock( &data->events_mutex );
 
-     D_FREE( item );
+     RecordClientLatency( event, 1 );
 
-     direct_mutex_unlock( &data->events_mutex );
+     NotifyEventsFetched( event, 1 );
 
      D_DEBUG_AT( IDFBEvBuf, "  -> class %d, type/size %d, data/id %p\n", event->clazz, event->user.type, event->user.data );
 
@@ -423,8 +644,6 @@ static DFBResult
 IDirectFBEventBuffer_PeekEvent( IDirectFBEventBuffer *thiz,
                                 DFBEvent             *event )
 {
-     EventBufferItem *item;
-
      DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer)
 
      D_DEBUG_AT( IDFBEvBuf, "%s( %p, %p )\n", __FUNCTION__, thiz, event );
@@ -434,47 +653,53 @@ IDirectFBEventBuffer_PeekEvent( IDirectFBEventBuffer *thiz,
 
      direct_mutex_lock( &data->events_mutex );
 
-     if (!data->events) {
+     if (!data->events_count) {
           direct_mutex_unlock( &data->events_mutex );
           return DFB_BUFFEREMPTY;
      }
 
-     item = (EventBufferItem*) data->events;
+     CopyEvent( event, &data->events[data->events_first] );
 
-     switch (item->evt.clazz) {
-          case DFEC_INPUT:
-               event->input = item->evt.input;
-               break;
+     direct_mutex_unlock( &data->events_mutex );
 
-          case DFEC_WINDOW:
-               event->window = item->evt.window;
-               break;
+     D_DEBUG_AT( IDFBEvBuf, "  -> class %d, type/size %d, data/id %p\n", event->clazz, event->user.type, event->user.data );
 
-          case DFEC_USER:
-               event->user = item->evt.user;
-               break;
+     return DFB_OK;
+}
 
-          case DFEC_VIDEOPROVIDER:
-               event->videoprovider = item->evt.videoprovider;
-               break;
+static DFBResult
+IDirectFBEventBuffer_GetEvents( IDirectFBEventBuffer *thiz,
+                                DFBEvent             *ret_events,
+                                unsigned int          max,
+                                unsigned int         *ret_num )
+{
+     unsigned int num;
 
-          case DFEC_UNIVERSAL:
-               direct_memcpy( event, &item->evt, item->evt.universal.size );
-               break;
+     DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer)
 
-          case DFEC_SURFACE:
-               event->surface = item->evt.surface;
-               break;
+     D_DEBUG_AT( IDFBEvBuf, "%s( %p, %p, %u )\n", __FUNCTION__, thiz, ret_events, max );
 
-          default:
-               D_BUG("unknown event class");
-     }
+     if (!ret_events || !max || !ret_num)
+          return DFB_INVARG;
+
+     if (data->pipe)
+          return DFB_UNSUPPORTED;
+
+     direct_mutex_lock( &data->events_mutex );
+
+     num = FetchEvents( data, ret_events, max );
 
      direct_mutex_unlock( &data->events_mutex );
 
-     D_DEBUG_AT( IDFBEvBuf, "  -> class %d, type/size %d, data/id %p\n", event->clazz, event->user.type, event->user.data );
+     RecordClientLatency( ret_events, num );
 
-     return DFB_OK;
+     NotifyEventsFetched( ret_events, num );
+
+     D_DEBUG_AT( IDFBEvBuf, "  -> %u events\n", num );
+
+     *ret_num = num;
+
+     return num ? DFB_OK : DFB_BUFFEREMPTY;
 }
 
 static DFBResult
@@ -482,20 +707,19 @@ IDirectFBEventBuffer_HasEvent( IDirectFBEventBuffer *thiz )
 {
      DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer)
 
-     D_DEBUG_AT( IDFBEvBuf, "%s( %p ) <- events: %p, pipe: %d\n", __FUNCTION__, thiz, data->events, data->pipe );
+     D_DEBUG_AT( IDFBEvBuf, "%s( %p ) <- events: %u, pipe: %d\n", __FUNCTION__, thiz, data->events_count, data->pipe );
 
      if (data->pipe)
           return DFB_UNSUPPORTED;
 
-     return (data->events ? DFB_OK : DFB_BUFFEREMPTY);
+     return (data->events_count ? DFB_OK : DFB_BUFFEREMPTY);
 }
 
 static DFBResult
 IDirectFBEventBuffer_PostEvent( IDirectFBEventBuffer *thiz,
                                 const DFBEvent       *event )
 {
-     EventBufferItem *item;
-     int              size;
+     DFBEvent evt;
 
      DIRECT_INTERFACE_GET_DATA(IDirectFBEventBuffer)
 
@@ -508,58 +732,25 @@ IDirectFBEventBuffer_PostEvent( IDirectFBEventBuffer *thiz,
           case DFEC_USER:
           case DFEC_VIDEOPROVIDER:
           case DFEC_SURFACE:
-               size = sizeof(EventBufferItem);
+          case DFEC_IMAGEPROVIDER:
                break;
 
           case DFEC_UNIVERSAL:
-               size = event->universal.size;
-               if (size < sizeof(DFBUniversalEvent))
+               if (event->universal.size < sizeof(DFBUniversalEvent))
                     return DFB_INVARG;
                /* We must not exceed the union to avoid crashes in generic code (reading DFBEvents)
                 * and to support pipe mode where each written block has to have a fixed size. */
-               if (size > sizeof(DFBEvent))
+               if (event->universal.size > sizeof(DFBEvent))
                     return DFB_INVARG;
-               size += sizeof(DirectLink);
                break;
 
           default:
                return DFB_INVARG;
      }
 
-     item = D_CALLOC( 1, size );
-     if (!item)
-          return D_OOM();
-
-     switch (event->clazz) {
-          case DFEC_INPUT:
-               item->evt.input = event->input;
-               break;
+     CopyEvent( &evt, event );
 
-          case DFEC_WINDOW:
-               item->evt.window = event->window;
-               break;
-
-          case DFEC_USER:
-               item->evt.user = event->user;
-               break;
-
-          case DFEC_VIDEOPROVIDER:
-               item->evt.videoprovider = event->videoprovider;
-               break;
-
-          case DFEC_UNIVERSAL:
-               direct_memcpy( &item->evt, event, event->universal.size );
-               break;
-
-          case DFEC_SURFACE:
-               item->evt.surface = event->surface;
-               break;
-
-          default:
-               D_BUG("unexpected event class");
-     }
-
-     IDirectFBEventBuffer_AddItem( data, item );
+     IDirectFBEventBuffer_AddItem( data, &evt );
 
      return DFB_OK;
 }
@@ -642,11 +833,12 @@ IDirectFBEventBuffer_EnableStatistics( IDirectFBEventBuffer *thiz,
      }
 
      if (enable) {
-          EventBufferItem *item;
+          unsigned int i;
 
           /* Collect statistics for events already in the queue. */
-          direct_list_foreach (item, data->events)
-               CollectEventStatistics( &data->stats, &item->evt, 1 );
+          for (i=0; i<data->events_count; i++)
+               CollectEventStatistics( &data->stats,
+                                       &data->events[(data->events_first + i) & (data->events_size - 1)], 1 );
      }
      else {
           /* Clear statistics. */
@@ -704,6 +896,18 @@ IDirectFBEventBuffer_Construct( IDirectFBEventBuffer      *thiz,
      data->filter     = filter;
      data->filter_ctx = filter_ctx;
 
+     /* Preallocate the ring, rounding the configured size up to a power of two. */
+     data->events_size = 1;
+
+     while (data->events_size < dfb_config->event_buffer_size)
+          data->events_size <<= 1;
+
+     data->events = D_MALLOC( data->events_size * sizeof(DFBEvent) );
+     if (!data->events) {
+          DIRECT_DEALLOCATE_INTERFACE( thiz );
+          return D_OOM();
+     }
+
      direct_mutex_init( &data->events_mutex );
      direct_waitqueue_init( &data->wait_condition );
 
@@ -713,6 +917,7 @@ IDirectFBEventBuffer_Construct( IDirectFBEventBuffer      *thiz,
      thiz->WaitForEvent            = IDirectFBEventBuffer_WaitForEvent;
      thiz->WaitForEventWithTimeout = IDirectFBEventBuffer_WaitForEventWithTimeout;
      thiz->GetEvent                = IDirectFBEventBuffer_GetEvent;
+     thiz->GetEvents               = IDirectFBEventBuffer_GetEvents;
      thiz->PeekEvent               = IDirectFBEventBuffer_PeekEvent;
      thiz->HasEvent                = IDirectFBEventBuffer_HasEvent;
      thiz->PostEvent               = IDirectFBEventBuffer_PostEvent;
@@ -867,25 +1072,20 @@ DFBResult IDirectFBEventBuffer_AttachSurface( IDirectFBEventBuffer *thiz,
      D_DEBUG_AT( IDFBEvBuf, "  -> flip count %u\n", surface->flips );
 
      if (surface->flips > 0 || !(surface->config.caps & DSCAPS_FLIPPING)) {
-          EventBufferItem *item;
-
-          item = D_CALLOC( 1, sizeof(EventBufferItem) );
-          if (!item)
-               D_OOM();
-          else {
-               item->evt.surface.clazz        = DFEC_SURFACE;
-               item->evt.surface.type         = DSEVT_UPDATE;
-               item->evt.surface.surface_id   = surface->object.id;
-               item->evt.surface.update.x1    = 0;
-               item->evt.surface.update.y1    = 0;
-               item->evt.surface.update.x2    = surface->config.size.w - 1;
-               item->evt.surface.update.y2    = surface->config.size.h - 1;
-               item->evt.surface.update_right = item->evt.surface.update;
-               item->evt.surface.flip_count   = surface->flips;
-               item->evt.surface.time_stamp   = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
-
-               IDirectFBEventBuffer_AddItem( data, item );
-          }
+          DFBEvent evt;
+
+          evt.surface.clazz        = DFEC_SURFACE;
+          evt.surface.type         = DSEVT_UPDATE;
+          evt.surface.surface_id   = surface->object.id;
+          evt.surface.update.x1    = 0;
+          evt.surface.update.y1    = 0;
+          evt.surface.update.x2    = surface->config.size.w - 1;
+          evt.surface.update.y2    = surface->config.size.h - 1;
+          evt.surface.update_right = evt.surface.update;
+          evt.surface.flip_count   = surface->flips;
+          evt.surface.time_stamp   = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+
+          IDirectFBEventBuffer_AddItem( data, &evt );
      }
 
      return DFB_OK;
@@ -924,21 +1124,36 @@ DFBResult IDirectFBEventBuffer_DetachSurface( IDirectFBEventBuffer *thiz,
 /* file internals */
 
 static void IDirectFBEventBuffer_AddItem( IDirectFBEventBuffer_data *data,
-                                          EventBufferItem           *item )
+                                          DFBEvent                  *event )
 {
-     if (data->filter && data->filter( &item->evt, data->filter_ctx )) {
-          D_FREE( item );
+     DFBEvent *slot;
+
+     if (data->filter && data->filter( event, data->filter_ctx ))
           return;
-     }
 
      direct_mutex_lock( &data->events_mutex );
 
-     if (data->stats_enabled)
-          CollectEventStatistics( &data->stats, &item->evt, 1 );
+     /* Merge stale motion while the application is behind. */
+     if (dfb_config->event_buffer_coalescing && CoalesceEvent( data, event )) {
+          D_DEBUG_AT( IDFBEvBuf, "  -> coalesced motion event\n" );
 
-     direct_list_append( &data->events, &item->link );
+          if (data->stats_enabled)
+               data->stats.num_coalesced++;
 
-     direct_waitqueue_broadcast( &data->wait_condition );
+          direct_mutex_unlock( &data->events_mutex );
+          return;
+     }
+
+     slot = AllocateSlot( data );
+
+     CopyEvent( slot, event );
+
+     if (data->stats_enabled)
+          CollectEventStatistics( &data->stats, slot, 1 );
+
+     /* Only wake up if somebody is actually waiting. */
+     if (data->waiting)
+          direct_waitqueue_broadcast( &data->wait_condition );
 
      direct_mutex_unlock( &data->events_mutex );
 }
@@ -949,7 +1164,7 @@ static ReactionResult IDirectFBEventBuffer_InputReact( const void *msg_data,
 {
      const DFBInputEvent       *evt  = msg_data;
      IDirectFBEventBuffer_data *data = ctx;
-     EventBufferItem           *item;
+     DFBEvent                   event;
 
      D_DEBUG_AT( IDFBEvBuf, "%s( %p, %p ) <- type %06x\n", __FUNCTION__, evt, data, evt->type );
 
@@ -958,12 +1173,12 @@ static ReactionResult IDirectFBEventBuffer_InputReact( const void *msg_data,
           return DFB_OK;
      }
 
-     item = D_CALLOC( 1, sizeof(EventBufferItem) );
+     event.input = *evt;
+     event.clazz = DFEC_INPUT;
 
-     item->evt.input = *evt;
-     item->evt.clazz = DFEC_INPUT;
+     IDirectFBEventBuffer_AddItem( data, &event );
 
-     IDirectFBEventBuffer_AddItem( data, item );
+     dfb_input_record_latency( evt, DILST_BUFFER );
 
      return RS_OK;
 }
@@ -973,7 +1188,7 @@ static ReactionResult IDirectFBEventBuffer_WindowReact( const void *msg_data,
 {
      const DFBWindowEvent      *evt  = msg_data;
      IDirectFBEventBuffer_data *data = ctx;
-     EventBufferItem           *item;
+     DFBEvent                   event;
 
      D_DEBUG_AT( IDFBEvBuf, "%s( %p, %p ) <- type %06x\n", __FUNCTION__, evt, data, evt->type );
 
@@ -982,12 +1197,10 @@ static ReactionResult IDirectFBEventBuffer_WindowReact( const void *msg_data,
           return DFB_OK;
      }
 
-     item = D_CALLOC( 1, sizeof(EventBufferItem) );
+     event.window = *evt;
+     event.clazz  = DFEC_WINDOW;
 
-     item->evt.window = *evt;
-     item->evt.clazz  = DFEC_WINDOW;
-
-     IDirectFBEventBuffer_AddItem( data, item );
+     IDirectFBEventBuffer_AddItem( data, &event );
 
      if (evt->type == DWET_DESTROYED) {
           AttachedWindow *window;
@@ -1015,7 +1228,7 @@ static ReactionResult IDirectFBEventBuffer_SurfaceReact( const void *msg_data,
 {
      const DFBSurfaceEvent     *evt  = msg_data;
      IDirectFBEventBuffer_data *data = ctx;
-     EventBufferItem           *item;
+     DFBEvent                   event;
 
      D_DEBUG_AT( IDFBEvBuf_Surface, "%s( %p, %p ) <- type %06x\n", __FUNCTION__, evt, data, evt->type );
      D_DEBUG_AT( IDFBEvBuf_Surface, "  -> surface id %u\n", evt->surface_id );
@@ -1028,12 +1241,10 @@ static ReactionResult IDirectFBEventBuffer_SurfaceReact( const void *msg_data,
           D_DEBUG_AT( IDFBEvBuf_Surface, "  -> flip count %u\n", evt->flip_count );
      }
 
-     item = D_CALLOC( 1, sizeof(EventBufferItem) );
-
-     item->evt.surface = *evt;
-     item->evt.clazz   = DFEC_SURFACE;
+     event.surface = *evt;
+     event.clazz   = DFEC_SURFACE;
 
-     IDirectFBEventBuffer_AddItem( data, item );
+     IDirectFBEventBuffer_AddItem( data, &event );
 
      if (evt->type == DSEVT_DESTROYED) {
           AttachedSurface *surface;
@@ -1062,43 +1273,56 @@ static void *
 IDirectFBEventBuffer_Feed( DirectThread *thread, void *arg )
 {
      IDirectFBEventBuffer_data *data = arg;
+     DFBEvent                   events[16];
 
      direct_mutex_lock( &data->events_mutex );
 
      while (data->pipe) {
-          while (data->events && data->pipe) {
-               int              ret;
-               EventBufferItem *item = (EventBufferItem*) data->events;
+          while (data->events_count && data->pipe) {
+               int          ret;
+               unsigned int i, num;
+               unsigned int written = 0;
 
-               if (data->stats_enabled)
-                    CollectEventStatistics( &data->stats, &item->evt, -1 );
+               num = FetchEvents( data, events, D_ARRAY_SIZE(events) );
 
-               direct_list_remove( &data->events, &item->link );
+               /* Pack the events that can be written, dropping universal ones. */
+               for (i=0; i<num; i++) {
+                    if (events[i].clazz == DFEC_UNIVERSAL) {
+                         D_WARN( "universal events not supported in pipe mode" );
+                         continue;
+                    }
 
-               if (item->evt.clazz == DFEC_UNIVERSAL) {
-                    D_WARN( "universal events not supported in pipe mode" );
-                    continue;
+                    if (i != written)
+                         events[written] = events[i];
+
+                    written++;
                }
 
+               if (!written)
+                    continue;
+
                direct_mutex_unlock( &data->events_mutex );
 
                D_DEBUG_AT( IDFBEvBuf, "Going to write %zu bytes to file descriptor %d...\n",
-                           sizeof(DFBEvent), data->pipe_fds[1] );
+                           written * sizeof(DFBEvent), data->pipe_fds[1] );
 
-               ret = write( data->pipe_fds[1], &item->evt, sizeof(DFBEvent) );
+               ret = write( data->pipe_fds[1], events, written * sizeof(DFBEvent) );
 
                (void)ret;
 
                D_DEBUG_AT( IDFBEvBuf, "...wrote %d bytes to file descriptor %d.\n",
                            ret, data->pipe_fds[1] );
 
-               D_FREE( item );
+               RecordClientLatency( events, written );
 
                direct_mutex_lock( &data->events_mutex );
           }
 
-          if (data->pipe)
+          if (data->pipe) {
+               data->waiting++;
                direct_waitqueue_wait( &data->wait_condition, &data->events_mutex );
+               data->waiting--;
+          }
      }
 
      direct_mutex_unlock( &data->events_mutex );
@@ -1290,6 +1514,10 @@ CollectEventStatistics( DFBEventBufferStats *stats,
                stats->DFEC_UNIVERSAL += incdec;
                break;
 
+          case DFEC_IMAGEPROVIDER:
+               stats->DFEC_IMAGEPROVIDER += incdec;
+               break;
+
           default:
                D_BUG( "unknown event class 0x%08x\n", event->clazz );
      }
@@ -379,6 +379,26 @@ IDirectFBInputDevice_SetConfiguration( IDirectFBInputDevice       *thiz,
      return CoreInputDevice_SetConfiguration( data->device, config );
 }
 
+static DFBResult
+IDirectFBInputDevice_GetLatencyStatistics( IDirectFBInputDevice *thiz,
+                                           DFBInputLatencyStats *ret_stats )
+{
+     DIRECT_INTERFACE_GET_DATA(IDirectFBInputDevice)
+
+     if (!ret_stats)
+          return DFB_INVARG;
+
+     return dfb_input_device_get_latency( data->device, ret_stats );
+}
+
+static DFBResult
+IDirectFBInputDevice_ResetLatencyStatistics( IDirectFBInputDevice *thiz )
+{
+     DIRECT_INTERFACE_GET_DATA(IDirectFBInputDevice)
+
+     return dfb_input_device_reset_latency( data->device );
+}
+
 DFBResult
 IDirectFBInputDevice_Construct( IDirectFBInputDevice *thiz,
                                 CoreInputDevice      *device )
@@ -411,6 +431,8 @@ IDirectFBInputDevice_Construct( IDirectFBInputDevice *thiz,
      thiz->GetAxis = IDirectFBInputDevice_GetAxis;
      thiz->GetXY = IDirectFBInputDevice_GetXY;
      thiz->SetConfiguration = IDirectFBInputDevice_SetConfiguration;
+     thiz->GetLatencyStatistics = IDirectFBInputDevice_GetLatencyStatistics;
+     thiz->ResetLatencyStatistics = IDirectFBInputDevice_ResetLatencyStatistics;
 
      return DFB_OK;
 }
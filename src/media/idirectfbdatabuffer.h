@@ -45,6 +45,9 @@ typedef struct {
 
      bool         is_memory;
 
+     const void  *content;        /* whole data if in memory or a mapped file, */
+     unsigned int content_length; /* can be read without copying */
+
      FusionCall   call;       /* for remote access */
 } IDirectFBDataBuffer_data;
 
@@ -275,6 +275,9 @@ IDirectFBDataBuffer_File_Construct( IDirectFBDataBuffer *thiz,
 
      direct_mutex_init( &data->mutex );
 
+     /* Regular files are mapped, allowing providers to decode without reading. */
+     direct_stream_memory( data->stream, &data->base.content, &data->base.content_length );
+
      thiz->Release                = IDirectFBDataBuffer_File_Release;
      thiz->Flush                  = IDirectFBDataBuffer_File_Flush;
      thiz->Finish                 = IDirectFBDataBuffer_File_Finish;
@@ -236,7 +236,9 @@ IDirectFBDataBuffer_Memory_Construct( IDirectFBDataBuffer *thiz,
      data->buffer = data_buffer;
      data->length = length;
 
-     data->base.is_memory = true;
+     data->base.is_memory      = true;
+     data->base.content        = data_buffer;
+     data->base.content_length = length;
 
      thiz->Release                = IDirectFBDataBuffer_Memory_Release;
      thiz->Flush                  = IDirectFBDataBuffer_Memory_Flush;
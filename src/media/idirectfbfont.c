@@ -298,46 +298,26 @@ IDirectFBFont_GetStringExtents( IDirectFBFont *thiz,
 
      font = data->font;
 
+     if (bytes > 0)
+          dfb_font_prefetch_text( font, data->encoding, text, bytes );
+
      dfb_font_lock( font );
 
      if (bytes > 0) {
-          int          i, num;
-          unsigned int prev  = 0;
-          unsigned int indices[bytes];
+          const CoreFontTextRun *run;
 
-          /* Decode string to character indices. */
-          ret = dfb_font_decode_text( font, data->encoding, text, bytes, indices, &num );
+          /* Get the laid out string, shared with drawing. */
+          ret = dfb_font_get_text_run( font, data->encoding, text, bytes, &run );
           if (ret) {
                dfb_font_unlock( font );
                return ret;
           }
 
-          for (i=0; i<num; i++) {
-               unsigned int   current = indices[i];
-               CoreGlyphData *glyph;
-
-               if (dfb_font_get_glyph_data( font, current, 0, &glyph ) == DFB_OK) {  // FIXME: support font layers
-                    int kx, ky = 0;
+          xbaseline = run->advance_x;
+          ybaseline = run->advance_y;
 
-                    if (prev && font->GetKerning &&
-                        font->GetKerning( font, prev, current, &kx, &ky ) == DFB_OK) {
-                         xbaseline += kx << 8;
-                         ybaseline += ky << 8;
-                    }
-
-                    if (ink_rect) {
-                         DFBRectangle glyph_rect = { xbaseline + (glyph->left << 8),
-                              ybaseline + (glyph->top << 8),
-                              glyph->width << 8, glyph->height << 8};
-                         dfb_rectangle_union (ink_rect, &glyph_rect);
-                    }
-
-                    xbaseline += glyph->xadvance;
-                    ybaseline += glyph->yadvance;
-               }
-
-               prev = current;
-          }
+          if (ink_rect)
+               *ink_rect = run->ink;
      }
 
      if (logical_rect) {
@@ -410,38 +390,22 @@ IDirectFBFont_GetStringWidth( IDirectFBFont *thiz,
           bytes = strlen (text);
 
      if (bytes > 0) {
-          int           i, num, kx, ky;
-          unsigned int  prev = 0;
-          unsigned int  indices[bytes];
-          CoreFont     *font = data->font;
+          const CoreFontTextRun *run;
+          CoreFont              *font = data->font;
+
+          dfb_font_prefetch_text( font, data->encoding, text, bytes );
 
           dfb_font_lock( font );
 
-          /* Decode string to character indices. */
-          ret = dfb_font_decode_text( font, data->encoding, text, bytes, indices, &num );
+          /* Get the laid out string, shared with drawing. */
+          ret = dfb_font_get_text_run( font, data->encoding, text, bytes, &run );
           if (ret) {
                dfb_font_unlock( font );
                return ret;
           }
 
-          /* Calculate string width. */
-          for (i=0; i<num; i++) {
-               unsigned int   current = indices[i];
-               CoreGlyphData *glyph;
-
-               if (dfb_font_get_glyph_data( font, current, 0, &glyph ) == DFB_OK) {  // FIXME: support font layers
-                    xsize += glyph->xadvance;
-                    ysize += glyph->yadvance;
-
-                    if (prev && font->GetKerning &&
-                        font->GetKerning( font, prev, current, &kx, &ky ) == DFB_OK) {
-                         xsize += kx << 8;
-                         ysize += ky << 8;
-                    }
-               }
-
-               prev = current;
-          }
+          xsize = run->advance_x;
+          ysize = run->advance_y;
 
           dfb_font_unlock( font );
      }
@@ -1025,6 +989,9 @@ IDirectFBFont_CreateFromBuffer( IDirectFBDataBuffer       *buffer,
           data->content = ctx.content;
           data->content_size = ctx.content_size;
           data->content_type = ctx.content_type;
+
+          /* Reuse glyphs rendered before, also by other processes. */
+          dfb_font_open_glyph_file( data->font, ctx.content, ctx.content_size );
      }
 
      *interface = ifont;
@@ -34,16 +34,32 @@
 #include <directfb.h>
 
 #include <core/core.h>
+#include <core/imagecache.h>
+#include <core/surface.h>
 
+#include <direct/clock.h>
+#include <direct/debug.h>
 #include <direct/interface.h>
+#include <direct/list.h>
 #include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/thread.h>
+#include <direct/util.h>
+
+#include <display/idirectfbsurface.h>
 
 #include <fusion/conf.h>
 
+#include <gfx/util.h>
+
 #include <media/idirectfbimageprovider.h>
 #include <media/idirectfbimageprovider_client.h>
 #include <media/idirectfbdatabuffer.h>
 
+#include <misc/conf.h>
+
+
+D_DEBUG_DOMAIN( ImageProvider_Async, "ImageProvider/Async", "Asynchronous image rendering" );
 
 static DirectResult
 IDirectFBImageProvider_AddRef( IDirectFBImageProvider *thiz )
@@ -55,11 +71,16 @@ IDirectFBImageProvider_AddRef( IDirectFBImageProvider *thiz )
      return DFB_OK;
 }
 
+static void async_render_reap( void );
+
 static DirectResult
 IDirectFBImageProvider_Release( IDirectFBImageProvider *thiz )
 {
      DIRECT_INTERFACE_GET_DATA( IDirectFBImageProvider )
 
+     /* Finished renderings might hold the last references of the application. */
+     async_render_reap();
+
      if (--data->ref == 0) {
           if (data->Destruct)
                data->Destruct( thiz );
@@ -68,6 +89,9 @@ IDirectFBImageProvider_Release( IDirectFBImageProvider *thiz )
           if (data->buffer)
                data->buffer->Release( data->buffer );
 
+          if (data->cache.buffer)
+               data->cache.buffer->Release( data->cache.buffer );
+
           DIRECT_DEALLOCATE_INTERFACE( thiz );
      }
 
@@ -135,6 +159,573 @@ IDirectFBImageProvider_WriteBack( IDirectFBImageProvider *thiz,
      return DFB_UNIMPLEMENTED;
 }
 
+/**********************************************************************************************************************/
+
+#define ASYNC_MAX_THREADS     8
+#define ASYNC_PROGRESS_MS    20      /* minimum interval of DIPET_PROGRESS events */
+
+typedef struct {
+     DirectLink               link;
+
+     int                      magic;
+
+     unsigned int             id;
+     int                      priority;
+
+     IDirectFBImageProvider  *provider;
+     IDirectFBSurface        *destination;
+     DFBRectangle             rect;
+     bool                     has_rect;
+     IDirectFBEventBuffer    *buffer;
+
+     bool                     canceled;
+
+     DFBRegion                progress;     /* rendered since the last DIPET_PROGRESS event */
+     bool                     has_progress;
+     long long                progress_time;
+} AsyncRender;
+
+static DirectMutex      async_lock = DIRECT_MUTEX_INITIALIZER( async_lock );
+static DirectWaitQueue  async_wq   = DIRECT_WAITQUEUE_INITIALIZER( async_wq );
+
+static DirectLink      *async_queue;      /* highest priority first */
+static DirectLink      *async_done;       /* ended renderings holding references, see async_render_reap() */
+static unsigned int     async_ids;
+static DirectThread    *async_threads[ASYNC_MAX_THREADS];
+static int              async_num_threads;
+static int              async_idle_threads;
+static bool             async_shutdown;
+
+static void
+async_render_post( AsyncRender               *render,
+                   DFBImageProviderEventType  type,
+                   const DFBRegion           *region,
+                   DFBResult                  result )
+{
+     DFBImageProviderEvent event;
+
+     D_MAGIC_ASSERT( render, AsyncRender );
+
+     memset( &event, 0, sizeof(event) );
+
+     event.clazz     = DFEC_IMAGEPROVIDER;
+     event.type      = type;
+     event.render_id = render->id;
+     event.result    = result;
+
+     if (region)
+          event.rect = DFB_RECTANGLE_INIT_FROM_REGION( region );
+
+     render->buffer->PostEvent( render->buffer, DFB_EVENT(&event) );
+}
+
+static void
+async_render_flush( AsyncRender *render )
+{
+     D_MAGIC_ASSERT( render, AsyncRender );
+
+     if (render->has_progress) {
+          async_render_post( render, DIPET_PROGRESS, &render->progress, DFB_OK );
+
+          render->has_progress = false;
+     }
+
+     render->progress_time = direct_clock_get_millis();
+}
+
+/*
+ * Installed as the provider's render callback, reporting progress of asynchronous renderings and
+ * passing on to the application's callback.
+ */
+static DIRenderCallbackResult
+async_render_callback( DFBRectangle *rect,
+                       void         *ctx )
+{
+     IDirectFBImageProvider      *thiz = ctx;
+     IDirectFBImageProvider_data *data = thiz->priv;
+     AsyncRender                 *render;
+
+     D_ASSERT( rect != NULL );
+     D_ASSERT( data != NULL );
+
+     render = data->async.render;
+     if (render) {
+          DFBRegion region = DFB_REGION_INIT_FROM_RECTANGLE( rect );
+
+          D_MAGIC_ASSERT( render, AsyncRender );
+
+          if (render->has_progress)
+               dfb_region_region_union( &render->progress, &region );
+          else
+               render->progress = region;
+
+          render->has_progress = true;
+
+          if (direct_clock_get_millis() - render->progress_time >= ASYNC_PROGRESS_MS)
+               async_render_flush( render );
+
+          /* Read without lock, aborting one part later doesn't matter. */
+          if (render->canceled)
+               return DIRCR_ABORT;
+     }
+
+     if (data->async.callback)
+          return data->async.callback( rect, data->async.callback_context );
+
+     return DIRCR_OK;
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Looks up the decoded image in the image cache, keyed by the encoded data and the target size, format and flags.
+ *
+ * Only renderings that are not clipped and not watched by the application's render callback are cached.
+ */
+static DFBResult
+IDirectFBImageProvider_Cached_RenderTo( IDirectFBImageProvider *thiz,
+                                        IDirectFBSurface       *destination,
+                                        const DFBRectangle     *destination_rect )
+{
+     DFBResult                 ret;
+     IDirectFBSurface_data    *dst_data;
+     CoreSurface              *dst_surface;
+     CoreSurface              *surface;
+     DFBImageCacheCore        *cache;
+     DFBImageCacheKey          key;
+     DFBRegion                 clip;
+     DFBRectangle              rect;
+     DFBRectangle              clipped;
+
+     DIRECT_INTERFACE_GET_DATA( IDirectFBImageProvider )
+
+     D_ASSERT( data->cache.RenderTo != NULL );
+
+     if (!destination || data->async.callback)
+          return data->cache.RenderTo( thiz, destination, destination_rect );
+
+     dst_data = destination->priv;
+     if (!dst_data || !dst_data->surface)
+          return data->cache.RenderTo( thiz, destination, destination_rect );
+
+     dst_surface = dst_data->surface;
+
+     if (DFB_PIXELFORMAT_IS_INDEXED( dst_surface->config.format ) || (dst_surface->config.caps & DSCAPS_STEREO))
+          return data->cache.RenderTo( thiz, destination, destination_rect );
+
+     dfb_region_from_rectangle( &clip, &dst_data->area.current );
+
+     if (destination_rect) {
+          if (destination_rect->w < 1 || destination_rect->h < 1)
+               return data->cache.RenderTo( thiz, destination, destination_rect );
+
+          rect = *destination_rect;
+          rect.x += dst_data->area.wanted.x;
+          rect.y += dst_data->area.wanted.y;
+     }
+     else
+          rect = dst_data->area.wanted;
+
+     clipped = rect;
+
+     if (!dfb_rectangle_intersect_by_region( &clipped, &clip ) || !DFB_RECTANGLE_EQUAL( clipped, rect ))
+          return data->cache.RenderTo( thiz, destination, destination_rect );
+
+     memset( &key, 0, sizeof(key) );
+
+     key.source     = data->cache.source;
+     key.length     = data->cache.length;
+     key.width      = rect.w;
+     key.height     = rect.h;
+     key.format     = dst_surface->config.format;
+     key.colorspace = dst_surface->config.colorspace;
+     key.caps       = dst_surface->config.caps & DSCAPS_PREMULTIPLIED;
+     key.flags      = data->render_flags;
+
+     cache = DFB_CORE( data->cache.core, IMAGECACHE );
+
+     if (dfb_image_cache_lookup( cache, &key, data->cache.content, &surface ) == DFB_OK) {
+          dfb_gfx_copy_to( surface, dst_surface, NULL, rect.x, rect.y, true );
+
+          dfb_surface_unref( surface );
+
+          if (data->async.render) {
+               DFBRectangle whole = { 0, 0, rect.w, rect.h };
+
+               async_render_callback( &whole, thiz );
+          }
+
+          return DFB_OK;
+     }
+
+     ret = data->cache.RenderTo( thiz, destination, destination_rect );
+     if (ret)
+          return ret;
+
+     /* An aborted rendering might have returned early with a partial image. */
+     if (data->async.render && ((AsyncRender*) data->async.render)->canceled)
+          return DFB_OK;
+
+     /* Keep a copy of the decoded image, failing to do so is not an error. */
+     if (dfb_surface_create_simple( data->cache.core, rect.w, rect.h, key.format, key.colorspace, key.caps,
+                                    CSTF_SHARED, 0, NULL, &surface ))
+          return DFB_OK;
+
+     dfb_gfx_copy_to( dst_surface, surface, &rect, 0, 0, true );
+
+     dfb_image_cache_insert( cache, &key, data->cache.content, surface );
+
+     dfb_surface_unref( surface );
+
+     return DFB_OK;
+}
+
+static DFBResult
+IDirectFBImageProvider_Cached_SetRenderFlags( IDirectFBImageProvider *thiz,
+                                              DIRenderFlags           flags )
+{
+     DFBResult ret;
+
+     DIRECT_INTERFACE_GET_DATA( IDirectFBImageProvider )
+
+     D_ASSERT( data->cache.SetRenderFlags != NULL );
+
+     ret = data->cache.SetRenderFlags( thiz, flags );
+
+     /* Flags are only part of the key if the provider knows about them. */
+     if (ret == DFB_OK)
+          data->render_flags = flags;
+
+     return ret;
+}
+
+/**********************************************************************************************************************/
+
+static void
+async_render_destroy( AsyncRender *render )
+{
+     D_MAGIC_ASSERT( render, AsyncRender );
+
+     D_DEBUG_AT( ImageProvider_Async, "%s( %u )\n", __FUNCTION__, render->id );
+
+     render->buffer->Release( render->buffer );
+     render->destination->Release( render->destination );
+     render->provider->Release( render->provider );
+
+     D_MAGIC_CLEAR( render );
+
+     D_FREE( render );
+}
+
+/*
+ * Releases the references of ended renderings. Reference counting of the interfaces is not thread safe,
+ * so it's done by the application's thread fetching the final event or calling into a provider
+ * instead of the decoder thread.
+ */
+static void
+async_render_reap( void )
+{
+     AsyncRender *render, *next;
+     DirectLink  *done;
+
+     direct_mutex_lock( &async_lock );
+
+     done       = async_done;
+     async_done = NULL;
+
+     direct_mutex_unlock( &async_lock );
+     direct_list_foreach_safe (render, next, done)
+          async_render_destroy( render );
+}
+
+/*
+ * Takes the next rendering from the queue, skipping those of providers that are busy with another one.
+ */
+static AsyncRender *
+async_render_next( void )
+{
+     AsyncRender *render = NULL;
+
+     direct_mutex_lock( &async_lock );
+
+     while (!async_shutdown) {
+          direct_list_foreach (render, async_queue) {
+               IDirectFBImageProvider_data *data = render->provider->priv;
+
+               D_MAGIC_ASSERT( render, AsyncRender );
+
+               if (!data->async.render)
+                    break;
+          }
+
+          if (render) {
+               IDirectFBImageProvider_data *data = render->provider->priv;
+
+               direct_list_remove( &async_queue, &render->link );
+
+               data->async.render = render;
+               break;
+          }
+
+          async_idle_threads++;
+
+          direct_waitqueue_wait( &async_wq, &async_lock );
+
+          async_idle_threads--;
+     }
+
+     direct_mutex_unlock( &async_lock );
+
+     return render;
+}
+
+static void
+async_render_run( AsyncRender *render )
+{
+     DFBResult                    ret;
+     IDirectFBImageProvider      *thiz = render->provider;
+     IDirectFBImageProvider_data *data = thiz->priv;
+     bool                         canceled;
+
+     D_MAGIC_ASSERT( render, AsyncRender );
+     D_ASSERT( data->async.render == render );
+
+     D_DEBUG_AT( ImageProvider_Async, "%s( %u, priority %d )\n", __FUNCTION__, render->id, render->priority );
+
+     render->progress_time = direct_clock_get_millis();
+
+     data->async.SetRenderCallback( thiz, async_render_callback, thiz );
+
+     ret = thiz->RenderTo( thiz, render->destination, render->has_rect ? &render->rect : NULL );
+
+     data->async.SetRenderCallback( thiz, data->async.callback ? async_render_callback : NULL, thiz );
+
+     async_render_flush( render );
+
+     direct_mutex_lock( &async_lock );
+
+     data->async.render = NULL;
+
+     canceled = render->canceled;
+
+     /* Another rendering of this provider may be waiting. */
+     if (async_queue)
+          direct_waitqueue_broadcast( &async_wq );
+
+     direct_mutex_unlock( &async_lock );
+
+     D_DEBUG_AT( ImageProvider_Async, "  -> %s (%s)\n", canceled ? "canceled" : "finished", DirectFBErrorString( ret ) );
+
+     /* Leave the references to the application's thread, which can't reap it before the final event is posted. */
+     direct_mutex_lock( &async_lock );
+
+     direct_list_append( &async_done, &render->link );
+
+     if (canceled)
+          async_render_post( render, DIPET_CANCELED, NULL, DFB_OK );
+     else
+          async_render_post( render, DIPET_FINISHED, NULL, ret );
+
+     direct_mutex_unlock( &async_lock );
+}
+
+static void *
+async_render_thread( DirectThread *thread,
+                     void         *arg )
+{
+     AsyncRender *render;
+
+     while ((render = async_render_next()) != NULL)
+          async_render_run( render );
+
+     return NULL;
+}
+
+static DFBResult
+IDirectFBImageProvider_RenderToAsync( IDirectFBImageProvider *thiz,
+                                      IDirectFBSurface       *destination,
+                                      const DFBRectangle     *destination_rect,
+                                      IDirectFBEventBuffer   *buffer,
+                                      int                     priority,
+                                      unsigned int           *ret_render_id )
+{
+     AsyncRender *render;
+     AsyncRender *before;
+
+     DIRECT_INTERFACE_GET_DATA( IDirectFBImageProvider )
+
+     D_DEBUG_AT( ImageProvider_Async, "%s( %p, priority %d )\n", __FUNCTION__, thiz, priority );
+
+     async_render_reap();
+
+     if (!destination || !buffer)
+          return DFB_INVARG;
+
+     if (!data->async.SetRenderCallback)
+          return DFB_UNSUPPORTED;
+
+     render = D_CALLOC( 1, sizeof(AsyncRender) );
+     if (!render)
+          return D_OOM();
+
+     render->priority    = priority;
+     render->provider    = thiz;
+     render->destination = destination;
+     render->buffer      = buffer;
+
+     if (destination_rect) {
+          render->rect     = *destination_rect;
+          render->has_rect = true;
+     }
+
+     thiz->AddRef( thiz );
+     destination->AddRef( destination );
+     buffer->AddRef( buffer );
+
+     D_MAGIC_SET( render, AsyncRender );
+
+     direct_mutex_lock( &async_lock );
+
+     render->id = ++async_ids;
+
+     /* Keep the order of calls within the same priority. */
+     direct_list_foreach (before, async_queue) {
+          if (before->priority < priority)
+               break;
+     }
+
+     direct_list_insert( &async_queue, &render->link, before ? &before->link : NULL );
+
+     if (!async_idle_threads && async_num_threads < MIN( dfb_config->image_decode_threads, ASYNC_MAX_THREADS )) {
+          async_threads[async_num_threads] = direct_thread_create( DTT_DEFAULT, async_render_thread, NULL, "Image Decoder" );
+          if (async_threads[async_num_threads])
+               async_num_threads++;
+     }
+
+     direct_waitqueue_signal( &async_wq );
+
+     if (ret_render_id)
+          *ret_render_id = render->id;
+
+     direct_mutex_unlock( &async_lock );
+
+     return DFB_OK;
+}
+
+static DFBResult
+IDirectFBImageProvider_CancelRender( IDirectFBImageProvider *thiz,
+                                     unsigned int            render_id )
+{
+     AsyncRender *render;
+
+     DIRECT_INTERFACE_GET_DATA( IDirectFBImageProvider )
+
+     D_DEBUG_AT( ImageProvider_Async, "%s( %p, %u )\n", __FUNCTION__, thiz, render_id );
+
+     async_render_reap();
+
+     direct_mutex_lock( &async_lock );
+
+     render = data->async.render;
+     if (render && render->id == render_id) {
+          render->canceled = true;
+
+          direct_mutex_unlock( &async_lock );
+
+          return DFB_OK;
+     }
+
+     direct_list_foreach (render, async_queue) {
+          D_MAGIC_ASSERT( render, AsyncRender );
+
+          if (render->id == render_id && render->provider == thiz)
+               break;
+     }
+
+     if (!render) {
+          direct_mutex_unlock( &async_lock );
+
+          return DFB_IDNOTFOUND;
+     }
+
+     direct_list_remove( &async_queue, &render->link );
+
+     direct_mutex_unlock( &async_lock );
+
+     async_render_post( render, DIPET_CANCELED, NULL, DFB_OK );
+
+     async_render_destroy( render );
+
+     return DFB_OK;
+}
+
+static DFBResult
+IDirectFBImageProvider_Async_SetRenderCallback( IDirectFBImageProvider *thiz,
+                                                DIRenderCallback        callback,
+                                                void                   *callback_data )
+{
+     DIRECT_INTERFACE_GET_DATA( IDirectFBImageProvider )
+
+     D_ASSERT( data->async.SetRenderCallback != NULL );
+
+     data->async.callback         = callback;
+     data->async.callback_context = callback_data;
+
+     return data->async.SetRenderCallback( thiz, callback ? async_render_callback : NULL, thiz );
+}
+
+void
+IDirectFBImageProvider_AsyncEventFetched( const DFBImageProviderEvent *event )
+{
+     D_ASSERT( event != NULL );
+     D_ASSERT( event->clazz == DFEC_IMAGEPROVIDER );
+
+     if (event->type & (DIPET_FINISHED | DIPET_CANCELED))
+          async_render_reap();
+}
+
+void
+IDirectFBImageProvider_ShutdownAsync( void )
+{
+     int          i;
+     AsyncRender *render, *next;
+     DirectLink  *queue;
+
+     D_DEBUG_AT( ImageProvider_Async, "%s()\n", __FUNCTION__ );
+
+     direct_mutex_lock( &async_lock );
+
+     queue       = async_queue;
+     async_queue = NULL;
+
+     async_shutdown = true;
+
+     direct_waitqueue_broadcast( &async_wq );
+
+     direct_mutex_unlock( &async_lock );
+
+     direct_list_foreach_safe (render, next, queue) {
+          async_render_post( render, DIPET_CANCELED, NULL, DFB_OK );
+
+          async_render_destroy( render );
+     }
+
+     /* Running renderings are finished. */
+     for (i=0; i<async_num_threads; i++) {
+          direct_thread_join( async_threads[i] );
+          direct_thread_destroy( async_threads[i] );
+
+          async_threads[i] = NULL;
+     }
+
+     async_num_threads = 0;
+     async_shutdown    = false;
+
+     async_render_reap();
+}
+
+/**********************************************************************************************************************/
+
 static void
 IDirectFBImageProvider_Construct( IDirectFBImageProvider *thiz )
 {
@@ -146,6 +737,8 @@ IDirectFBImageProvider_Construct( IDirectFBImageProvider *thiz )
      thiz->SetRenderCallback     = IDirectFBImageProvider_SetRenderCallback;
      thiz->SetRenderFlags        = IDirectFBImageProvider_SetRenderFlags;
      thiz->WriteBack             = IDirectFBImageProvider_WriteBack;
+     thiz->RenderToAsync         = IDirectFBImageProvider_RenderToAsync;
+     thiz->CancelRender          = IDirectFBImageProvider_CancelRender;
 }
      
 DFBResult
@@ -220,6 +813,29 @@ IDirectFBImageProvider_CreateFromBuffer( IDirectFBDataBuffer     *buffer,
 
      data->idirectfb = idirectfb;
 
+     /* Report progress of asynchronous renderings via the render callback. */
+     data->async.SetRenderCallback = imageprovider->SetRenderCallback;
+
+     imageprovider->SetRenderCallback = IDirectFBImageProvider_Async_SetRenderCallback;
+
+     /* Decoded images can be reused if the encoded data is fully available, i.e. in memory or mapped.
+        Keep a reference to the buffer as providers may release it after decoding. */
+     if (dfb_config->image_cache_size && buffer_data->content) {
+          buffer->AddRef( buffer );
+
+          data->cache.core    = core;
+          data->cache.buffer  = buffer;
+          data->cache.content = buffer_data->content;
+          data->cache.source  = dfb_image_cache_hash( buffer_data->content, buffer_data->content_length );
+          data->cache.length  = buffer_data->content_length;
+
+          data->cache.RenderTo       = imageprovider->RenderTo;
+          data->cache.SetRenderFlags = imageprovider->SetRenderFlags;
+
+          imageprovider->RenderTo       = IDirectFBImageProvider_Cached_RenderTo;
+          imageprovider->SetRenderFlags = IDirectFBImageProvider_Cached_SetRenderFlags;
+     }
+
      *interface = imageprovider;
 
      return DFB_OK;
@@ -46,6 +46,19 @@ IDirectFBImageProvider_CreateFromBuffer( IDirectFBDataBuffer     *buffer,
                                          IDirectFB               *idirectfb,
                                          IDirectFBImageProvider **interface_ptr );
 
+/*
+ * Called by the event buffer in the application's thread for each image provider event fetched,
+ * releasing the references of renderings that have ended.
+ */
+void
+IDirectFBImageProvider_AsyncEventFetched( const DFBImageProviderEvent *event );
+
+/*
+ * Cancels pending asynchronous renderings and stops the decoder threads.
+ */
+void
+IDirectFBImageProvider_ShutdownAsync( void );
+
 /**********************************************************************************************************************/
 
 /*
@@ -64,6 +77,35 @@ typedef struct {
      void                *render_callback_context;
 
      void (*Destruct)( IDirectFBImageProvider *thiz );
+
+     DIRenderFlags        render_flags;
+
+     /* decoded image cache, see image-cache-size option */
+     struct {
+          CoreDFB             *core;
+          IDirectFBDataBuffer *buffer;    /* reference keeping the encoded data */
+          const void          *content;   /* encoded data */
+          u64                  source;    /* hash of the encoded data */
+          unsigned int         length;    /* length of the encoded data */
+
+          DFBResult     (*RenderTo)      ( IDirectFBImageProvider *thiz,
+                                           IDirectFBSurface       *destination,
+                                           const DFBRectangle     *destination_rect );
+          DFBResult     (*SetRenderFlags)( IDirectFBImageProvider *thiz,
+                                           DIRenderFlags           flags );
+     } cache;
+
+     /* asynchronous rendering, see RenderToAsync() */
+     struct {
+          void           *render;    /* running rendering, protected by the decoder lock */
+
+          DIRenderCallback callback; /* set by the application */
+          void           *callback_context;
+
+          DFBResult     (*SetRenderCallback)( IDirectFBImageProvider *thiz,
+                                              DIRenderCallback        callback,
+                                              void                   *callback_data );
+     } async;
 } IDirectFBImageProvider_data;
 
 
@@ -131,6 +131,24 @@ IDirectFBImageProvider_Client_WriteBack( IDirectFBImageProvider *thiz,
      return DFB_UNIMPLEMENTED;
 }
 
+static DFBResult
+IDirectFBImageProvider_Client_RenderToAsync( IDirectFBImageProvider *thiz,
+                                             IDirectFBSurface       *destination,
+                                             const DFBRectangle     *destination_rect,
+                                             IDirectFBEventBuffer   *buffer,
+                                             int                     priority,
+                                             unsigned int           *ret_render_id )
+{
+     return DFB_UNIMPLEMENTED;
+}
+
+static DFBResult
+IDirectFBImageProvider_Client_CancelRender( IDirectFBImageProvider *thiz,
+                                            unsigned int            render_id )
+{
+     return DFB_UNIMPLEMENTED;
+}
+
 DFBResult
 IDirectFBImageProvider_Client_Construct( IDirectFBImageProvider *thiz,
                                          IDirectFBDataBuffer    *buffer,
@@ -170,6 +188,8 @@ IDirectFBImageProvider_Client_Construct( IDirectFBImageProvider *thiz,
      thiz->RenderTo              = IDirectFBImageProvider_Client_RenderTo;
      thiz->SetRenderCallback     = IDirectFBImageProvider_Client_SetRenderCallback;
      thiz->WriteBack             = IDirectFBImageProvider_Client_WriteBack;
+     thiz->RenderToAsync         = IDirectFBImageProvider_Client_RenderToAsync;
+     thiz->CancelRender          = IDirectFBImageProvider_Client_CancelRender;
 
      return DFB_OK;
 }
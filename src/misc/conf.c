@@ -126,13 +126,15 @@ static const char *config_usage_strings[]  = {
      "  [no-]vt                        Use VT handling code at all?\n"
      "  mouse-source=<device>          Mouse device for serial mouse\n"
      "  [no-]mouse-gpm-source          Enable mouse input repeated by GPM\n"
-     "  [no-]motion-compression        Mouse motion event compression\n"
+     "  [no-]motion-compression        Merge mouse and touch motion events read at once\n"
      "  mouse-protocol=<protocol>      Mouse protocol\n"
      "  [no-]lefty                     Swap left and right mouse buttons\n"
      "  [no-]capslock-meta             Map the CapsLock key to Meta\n"
      "  linux-input-ir-only            Ignore all non-IR Linux Input devices\n"
      "  [no-]linux-input-grab          Grab Linux Input devices?\n"
      "  [no-]linux-input-force         Force using linux-input with all system modules\n"
+     "  [no-]input-event-loop          Service input devices from a single thread (default on)\n"
+     "  [no-]input-latency-stats       Record latency histograms of input events (default off)\n"
      "  [no-]cursor                    Never create a cursor or handle it\n"
      "  [no-]cursor-automation         Automated cursor show/hide for windowed primary surfaces\n"
      "  [no-]cursor-updates            Never show a cursor, but still handle it\n"
@@ -154,6 +156,10 @@ static const char *config_usage_strings[]  = {
      "  layer-palette-<index>=AARRGGBB Set palette entry at index (hex)\n"
      "  layer-rotate=<degree>          Set the layer rotation for double buffer mode (0,90,180,270)\n"
      "  [no-]wm-fullscreen-updates     Force fullscreen updates in window manager\n"
+     "  [no-]wm-compositor-thread      Composite window stack once per vsync in a separate thread\n"
+     "  [no-]wm-compositor-stats       Print latency, composition time and frame interval of the compositor thread\n"
+     "  [no-]wm-window-cache           Cache rotated, scaled or converted window content between repaints\n"
+     "  [no-]wm-overlay-promotion      Show the topmost opaque window on an unused layer instead of compositing it\n"
      "  [no-]smooth-upscale            Enable/disable smooth upscaling per default\n"
      "  [no-]smooth-downscale          Enable/disable smooth downscaling per default\n"
      "  [no-]translucent-windows       Allow translucent windows\n"
@@ -161,8 +167,12 @@ static const char *config_usage_strings[]  = {
      "  [no-]startstop                 Issue StartDrawing/StopDrawing to driver\n"
      "  [no-]autoflip-window           Auto flip non-flipping windowed primary surfaces\n"
      "  [no-]discard-repeat-events     Discard repeat events (option per application)\n"
+     "  event-buffer-size=<events>     Number of events preallocated per event buffer (default 64)\n"
+     "  event-buffer-limit=<events>    Do not grow event buffers beyond this, drop oldest events (default 0, no limit)\n"
+     "  [no-]event-buffer-coalescing   Merge motion events queued in event buffers while the application is behind\n"
      "  [no-]flip-notify               Use FlipNotify for remote display\n"
      "  flip-notify-max-latency=<ms>   Set maximum FlipNotify latency (ms from Flip to Notify, default 200)\n"
+     "  [no-]flip-queue                Queue flips of triple buffered layers and complete them asynchronously\n"
      "  videoram-limit=<amount>        Limit amount of Video RAM in kb\n"
      "  agpmem-limit=<amount>          Limit amount of AGP memory in kb\n"
      "  screenshot-dir=<directory>     Dump screen content on <Print> key presses\n"
@@ -175,6 +185,10 @@ static const char *config_usage_strings[]  = {
      "  resource-manager=<impl>        Use this resource manager implementation\n"
      "\n",
      "  x11-borderless[=<x>.<y>]       Disable X11 window borders, optionally position window\n"
+     "  [no-]vnc-tile-hashing          Only send VNC tiles whose content has changed (default off)\n"
+     "  headless-refresh=<hz>          Simulated refresh rate of the headless system, 0 for no vsync (default 60)\n"
+     "  headless-dump=<directory>      Dump every frame displayed by the headless system\n"
+     "  drmkms-device=<device>         DRM device used by the drmkms system (default /dev/dri/card0)\n"
      "  [no-]matrox-sgram              Use Matrox SGRAM features\n"
      "  [no-]matrox-crtc2              Experimental Matrox CRTC2 support\n"
      "  matrox-tv-standard=(pal|ntsc|pal-60)\n"
@@ -196,6 +210,10 @@ static const char *config_usage_strings[]  = {
      "\n"
      "  max-font-rows=<number>         Maximum number of glyph cache rows (total for all fonts)\n"
      "  max-font-row-width=<pixels>    Maximum width of glyph cache row surface\n"
+     "  font-cache-dir=<directory>     Store rendered glyphs in files, reused by other processes and after restart\n"
+     "  image-cache-size=<kbytes>      Keep decoded images up to this size for reuse by all processes (0 disables)\n"
+     "  image-decode-threads=<number>  Number of threads for asynchronous image rendering (default 2)\n"
+     "  jpeg-decode-threads=<number>   Number of threads decoding a single JPEG image (default 1, at most 16)\n"
      "  graphics-state-call-limit=<n>  Set FusionCall quota for graphics state object\n"
      "\n",
      " Window surface swapping policy:\n"
@@ -482,6 +500,9 @@ static void config_allocate( void )
      dfb_config->cursor_automation        = true;
      dfb_config->layers_clear             = true;
      dfb_config->wm_fullscreen_updates    = false;
+     dfb_config->wm_compositor_thread     = false;
+     dfb_config->wm_window_cache          = false;
+     dfb_config->wm_overlay_promotion     = false;
 
      /* default to fbdev */
      dfb_config->system = D_STRDUP( "FBDev" );
@@ -497,9 +518,18 @@ static void config_allocate( void )
      dfb_config->max_font_rows      = 99;
      dfb_config->max_font_row_width = 2048;
 
+     dfb_config->image_decode_threads = 2;
+     dfb_config->jpeg_decode_threads  = 1;
+
+     dfb_config->event_buffer_size  = 64;
+
+     dfb_config->input_event_loop   = true;
+
      dfb_config->core_sighandler    = true;
 
      dfb_config->flip_notify_max_latency = 200;
+
+     dfb_config->headless_refresh   = 60;
 }
 
 const char *dfb_config_usage( void )
@@ -1001,6 +1031,30 @@ DFBResult dfb_config_set( const char *name, const char *value )
      if (strcmp (name, "no-wm-fullscreen-updates" ) == 0) {
           dfb_config->wm_fullscreen_updates = false;
      } else
+     if (strcmp (name, "wm-compositor-thread" ) == 0) {
+          dfb_config->wm_compositor_thread = true;
+     } else
+     if (strcmp (name, "no-wm-compositor-thread" ) == 0) {
+          dfb_config->wm_compositor_thread = false;
+     } else
+     if (strcmp (name, "wm-compositor-stats" ) == 0) {
+          dfb_config->wm_compositor_stats = true;
+     } else
+     if (strcmp (name, "no-wm-compositor-stats" ) == 0) {
+          dfb_config->wm_compositor_stats = false;
+     } else
+     if (strcmp (name, "wm-window-cache" ) == 0) {
+          dfb_config->wm_window_cache = true;
+     } else
+     if (strcmp (name, "no-wm-window-cache" ) == 0) {
+          dfb_config->wm_window_cache = false;
+     } else
+     if (strcmp (name, "wm-overlay-promotion" ) == 0) {
+          dfb_config->wm_overlay_promotion = true;
+     } else
+     if (strcmp (name, "no-wm-overlay-promotion" ) == 0) {
+          dfb_config->wm_overlay_promotion = false;
+     } else
      if (strcmp (name, "cursor-updates" ) == 0) {
           dfb_config->no_cursor_updates = false;
      } else
@@ -1022,6 +1076,18 @@ DFBResult dfb_config_set( const char *name, const char *value )
      if (strcmp (name, "no-linux-input-force" ) == 0) {
           dfb_config->linux_input_force = false;
      } else
+     if (strcmp (name, "input-event-loop" ) == 0) {
+          dfb_config->input_event_loop = true;
+     } else
+     if (strcmp (name, "no-input-event-loop" ) == 0) {
+          dfb_config->input_event_loop = false;
+     } else
+     if (strcmp (name, "input-latency-stats" ) == 0) {
+          dfb_config->input_latency_stats = true;
+     } else
+     if (strcmp (name, "no-input-latency-stats" ) == 0) {
+          dfb_config->input_latency_stats = false;
+     } else
      if (strcmp (name, "motion-compression" ) == 0) {
           dfb_config->mouse_motion_compression = true;
      } else
@@ -1118,12 +1184,61 @@ DFBResult dfb_config_set( const char *name, const char *value )
                return DFB_INVARG;
           }
      } else
+     if (strcmp (name, "flip-queue" ) == 0) {
+          dfb_config->flip_queue = true;
+     } else
+     if (strcmp (name, "no-flip-queue" ) == 0) {
+          dfb_config->flip_queue = false;
+     } else
      if (strcmp (name, "discard-repeat-events" ) == 0) {
           dfb_config->discard_repeat_events = true;
      } else
      if (strcmp (name, "no-discard-repeat-events" ) == 0) {
           dfb_config->discard_repeat_events = false;
      } else
+     if (strcmp (name, "event-buffer-size" ) == 0) {
+          if (value) {
+               unsigned int size;
+
+               if (direct_sscanf( value, "%u", &size ) < 1) {
+                    D_ERROR("DirectFB/Config '%s': Could not parse value!\n", name);
+                    return DFB_INVARG;
+               }
+
+               if (size < 1) {
+                    D_ERROR("DirectFB/Config '%s': At least one event is required!\n", name);
+                    return DFB_INVARG;
+               }
+
+               dfb_config->event_buffer_size = size;
+          }
+          else {
+               D_ERROR("DirectFB/Config '%s': No value specified!\n", name);
+               return DFB_INVARG;
+          }
+     } else
+     if (strcmp (name, "event-buffer-coalescing" ) == 0) {
+          dfb_config->event_buffer_coalescing = true;
+     } else
+     if (strcmp (name, "no-event-buffer-coalescing" ) == 0) {
+          dfb_config->event_buffer_coalescing = false;
+     } else
+     if (strcmp (name, "event-buffer-limit" ) == 0) {
+          if (value) {
+               unsigned int limit;
+
+               if (direct_sscanf( value, "%u", &limit ) < 1) {
+                    D_ERROR("DirectFB/Config '%s': Could not parse value!\n", name);
+                    return DFB_INVARG;
+               }
+
+               dfb_config->event_buffer_limit = limit;
+          }
+          else {
+               D_ERROR("DirectFB/Config '%s': No value specified!\n", name);
+               return DFB_INVARG;
+          }
+     } else
      if (strcmp (name, "vsync-none" ) == 0) {
           dfb_config->pollvsync_none = true;
      } else
@@ -1773,6 +1888,89 @@ DFBResult dfb_config_set( const char *name, const char *value )
                return DFB_INVARG;
           }
      } else
+     if (strcmp (name, "font-cache-dir" ) == 0) {
+          if (value) {
+               if (dfb_config->font_cache_dir)
+                    D_FREE( dfb_config->font_cache_dir );
+               dfb_config->font_cache_dir = D_STRDUP( value );
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No directory name specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
+     if (strcmp (name, "image-cache-size" ) == 0) {
+          if (value) {
+               char *error;
+               unsigned long size;
+
+               size = strtoul( value, &error, 10 );
+
+               if (*error) {
+                    D_ERROR( "DirectFB/Config '%s': Error in value '%s'!\n", name, error );
+                    return DFB_INVARG;
+               }
+
+               dfb_config->image_cache_size = size * 1024;
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No value specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
+     if (strcmp (name, "image-decode-threads" ) == 0) {
+          if (value) {
+               char *error;
+               long  num;
+
+               num = strtol( value, &error, 10 );
+
+               if (*error) {
+                    D_ERROR( "DirectFB/Config '%s': Error in value '%s'!\n", name, error );
+                    return DFB_INVARG;
+               }
+
+               if (num < 1) {
+                    D_ERROR( "DirectFB/Config '%s': At least one thread is required!\n", name );
+                    return DFB_INVARG;
+               }
+
+               dfb_config->image_decode_threads = num;
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No value specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
+     if (strcmp (name, "jpeg-decode-threads" ) == 0) {
+          if (value) {
+               char *error;
+               long  num;
+
+               num = strtol( value, &error, 10 );
+
+               if (*error) {
+                    D_ERROR( "DirectFB/Config '%s': Error in value '%s'!\n", name, error );
+                    return DFB_INVARG;
+               }
+
+               if (num < 1) {
+                    D_ERROR( "DirectFB/Config '%s': At least one thread is required!\n", name );
+                    return DFB_INVARG;
+               }
+
+               if (num > DFB_JPEG_DECODE_THREADS_MAX) {
+                    D_WARN( "DirectFB/Config '%s': limited to %d threads", name, DFB_JPEG_DECODE_THREADS_MAX );
+                    num = DFB_JPEG_DECODE_THREADS_MAX;
+               }
+
+               dfb_config->jpeg_decode_threads = num;
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No value specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
      if (strcmp (name, "graphics-state-call-limit" ) == 0) {
           if (value) {
                char *error;
@@ -1844,6 +2042,53 @@ DFBResult dfb_config_set( const char *name, const char *value )
                return DFB_INVARG;
           }
      } else
+     if (strcmp (name, "vnc-tile-hashing" ) == 0) {
+          dfb_config->vnc_tile_hashing = true;
+     } else
+     if (strcmp (name, "no-vnc-tile-hashing" ) == 0) {
+          dfb_config->vnc_tile_hashing = false;
+     } else
+     if (strcmp (name, "headless-refresh" ) == 0) {
+          if (value) {
+               char          *error;
+               unsigned long  hz;
+
+               hz = strtoul( value, &error, 10 );
+
+               if (*error) {
+                    D_ERROR( "DirectFB/Config '%s': Error in value '%s'!\n", name, error );
+                    return DFB_INVARG;
+               }
+
+               dfb_config->headless_refresh = hz;
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No value specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
+     if (strcmp (name, "headless-dump" ) == 0) {
+          if (value) {
+               if (dfb_config->headless_dump)
+                    D_FREE( dfb_config->headless_dump );
+               dfb_config->headless_dump = D_STRDUP( value );
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No directory name specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
+     if (strcmp (name, "drmkms-device" ) == 0) {
+          if (value) {
+               if (dfb_config->drmkms_device)
+                    D_FREE( dfb_config->drmkms_device );
+               dfb_config->drmkms_device = D_STRDUP( value );
+          }
+          else {
+               D_ERROR( "DirectFB/Config '%s': No device name specified!\n", name );
+               return DFB_INVARG;
+          }
+     } else
      if (strcmp (name, "matrox-sgram" ) == 0) {
           dfb_config->matrox_sgram = true;
      } else
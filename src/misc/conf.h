@@ -38,6 +38,10 @@
 #include <core/coredefs.h>
 
 
+/* Upper limit of the jpeg-decode-threads option. */
+#define DFB_JPEG_DECODE_THREADS_MAX  16
+
+
 typedef struct {
      bool                                init;
 
@@ -73,7 +77,8 @@ typedef enum {
 
 typedef struct
 {
-     bool      mouse_motion_compression;          /* use motion compression? */
+     bool      mouse_motion_compression;          /* merge relative and absolute
+                                                     motion read at once? */
      char     *mouse_protocol;                    /* mouse protocol */
      char     *mouse_source;                      /* mouse source device name */
      bool      mouse_gpm_source;                  /* mouse source is gpm? */
@@ -256,13 +261,24 @@ typedef struct
      bool          cursor_automation;
 
      bool          wm_fullscreen_updates;
+     bool          wm_compositor_thread;           /* composite window stack once per vsync in a separate thread */
+     bool          wm_compositor_stats;            /* print statistics of the compositor thread */
+     bool          wm_window_cache;                /* keep rotated/scaled/converted window content cached */
+     bool          wm_overlay_promotion;           /* scan out the topmost opaque window on an unused layer */
 
      int           max_font_rows;
      int           max_font_row_width;
+     char         *font_cache_dir;                 /* keep rendered glyphs in files for reuse by other processes */
+
+     unsigned int  image_cache_size;               /* byte budget for decoded images shared by all processes, 0 disables */
+     int           image_decode_threads;           /* number of threads for IDirectFBImageProvider::RenderToAsync() */
+     int           jpeg_decode_threads;            /* number of threads decoding a single JPEG image, 1 decodes serially */
 
      bool          core_sighandler;
 
      bool          linux_input_force;              /* use linux-input with all system modules */
+     bool          input_event_loop;               /* service input devices from a single thread */
+     bool          input_latency_stats;            /* record latency histograms of input events */
 
      u64           resource_id;
 
@@ -271,6 +287,15 @@ typedef struct
      bool          x11_borderless;
      DFBPoint      x11_position;
 
+     bool          vnc_tile_hashing;               /* only mark VNC tiles whose content hash changed */
+
+     unsigned int  headless_refresh;               /* simulated refresh rate of the headless system, 0 = no vsync */
+     char         *headless_dump;                  /* dump displayed frames of the headless system into this directory */
+
+     char         *drmkms_device;                  /* DRM device node of the drmkms system, default /dev/dri/card0 */
+
+     bool          flip_queue;                     /* queue flips of triple buffered regions instead of waiting */
+
      bool          flip_notify;
 
      char         *resource_manager;
@@ -285,6 +310,10 @@ typedef struct
 
      bool                 discard_repeat_events;
 
+     unsigned int         event_buffer_size;       /* number of events preallocated per event buffer */
+     unsigned int         event_buffer_limit;      /* do not grow event buffers beyond, drop oldest events (0 = unlimited) */
+     bool                 event_buffer_coalescing; /* merge motion events queued in event buffers */
+
      bool                 accel1;
 
      DFBSurfaceID         primary_id;              /* id for primary surface */
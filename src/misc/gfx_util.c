@@ -33,6 +33,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <pthread.h>
 
@@ -1142,3 +1143,139 @@ void dfb_scale_linear_32( u32 *src, int sw, int sh,
      D_FREE(filter.weights);
 }
 
+
+/**********************************************************************************************************************/
+
+static void row_scaler_flush( DFBRowScaler *scaler )
+{
+     int          x;
+     DFBRectangle rect;
+
+     for (x = 0; x < scaler->drect.w; x++) {
+          const u64 *acc = scaler->accum + x * 4;
+          u32        n   = scaler->cols[x] * scaler->rows;
+          u32        a, r = 0, g = 0, b = 0;
+
+          a = (acc[0] + n / 2) / n;
+
+          if (acc[0]) {
+               r = (acc[1] + acc[0] / 2) / acc[0];
+               g = (acc[2] + acc[0] / 2) / acc[0];
+               b = (acc[3] + acc[0] / 2) / acc[0];
+          }
+
+          scaler->line[x] = (a << 24) | (r << 16) | (g << 8) | b;
+     }
+
+     rect.x = scaler->drect.x;
+     rect.y = scaler->drect.y + scaler->dy;
+     rect.w = scaler->drect.w;
+     rect.h = 1;
+
+     dfb_copy_buffer_32( scaler->line, scaler->dst, scaler->dpitch, &rect,
+                         scaler->dst_surface, scaler->clipped ? &scaler->clip : NULL );
+
+     memset( scaler->accum, 0, sizeof(u64) * 4 * scaler->drect.w );
+
+     scaler->rows = 0;
+}
+
+DFBResult dfb_row_scaler_init( DFBRowScaler *scaler,
+                               int sw, int sh,
+                               void *dst, int dpitch, const DFBRectangle *drect,
+                               CoreSurface *dst_surface, const DFBRegion *dst_clip )
+{
+     int  x;
+     u8  *mem;
+
+     D_ASSERT( scaler != NULL );
+     D_ASSERT( drect != NULL );
+     D_ASSERT( drect->w > 0 && drect->w <= sw );
+     D_ASSERT( drect->h > 0 && drect->h <= sh );
+
+     memset( scaler, 0, sizeof(DFBRowScaler) );
+
+     mem = D_CALLOC( 1, sizeof(u64) * 4 * drect->w + sizeof(u32) * drect->w +
+                        sizeof(int) * drect->w + sizeof(int) * sw );
+     if (!mem)
+          return D_OOM();
+
+     scaler->accum = (u64*) mem;
+     scaler->line  = (u32*) (scaler->accum + 4 * drect->w);
+     scaler->cols  = (int*) (scaler->line + drect->w);
+     scaler->xmap  = scaler->cols + drect->w;
+
+     scaler->sw          = sw;
+     scaler->sh          = sh;
+     scaler->dst         = dst;
+     scaler->dpitch      = dpitch;
+     scaler->drect       = *drect;
+     scaler->dst_surface = dst_surface;
+
+     if (dst_clip) {
+          scaler->clip    = *dst_clip;
+          scaler->clipped = true;
+     }
+
+     for (x = 0; x < sw; x++) {
+          scaler->xmap[x] = (u64) x * drect->w / sw;
+
+          scaler->cols[scaler->xmap[x]]++;
+     }
+
+     return DFB_OK;
+}
+
+void dfb_row_scaler_push( DFBRowScaler *scaler, const u32 *row )
+{
+     int  x;
+     int  dy;
+     u64 *accum;
+
+     D_ASSERT( scaler != NULL );
+     D_ASSERT( row != NULL );
+
+     if (scaler->sy >= scaler->sh)
+          return;
+
+     dy = (u64) scaler->sy * scaler->drect.h / scaler->sh;
+     if (dy != scaler->dy) {
+          if (scaler->rows)
+               row_scaler_flush( scaler );
+
+          scaler->dy = dy;
+     }
+
+     accum = scaler->accum;
+
+     for (x = 0; x < scaler->sw; x++) {
+          u32  p   = row[x];
+          u32  a   = p >> 24;
+          u64 *acc = accum + scaler->xmap[x] * 4;
+
+          acc[0] += a;
+          acc[1] += ((p >> 16) & 0xff) * a;
+          acc[2] += ((p >>  8) & 0xff) * a;
+          acc[3] += ((p      ) & 0xff) * a;
+     }
+
+     scaler->rows++;
+
+     if (++scaler->sy == scaler->sh)
+          row_scaler_flush( scaler );
+}
+
+void dfb_row_scaler_deinit( DFBRowScaler *scaler )
+{
+     D_ASSERT( scaler != NULL );
+
+     if (!scaler->accum)
+          return;
+
+     if (scaler->rows)
+          row_scaler_flush( scaler );
+
+     D_FREE( scaler->accum );
+
+     scaler->accum = NULL;
+}
@@ -45,4 +45,46 @@ void dfb_scale_linear_32( u32 *src, int sw, int sh,
                           CoreSurface *dst_surface, const DFBRegion *dst_clip );
 
 
+/*
+ * Downscales an image while it is being decoded, one source row at a time.
+ *
+ * Source rows are box filtered into the destination rectangle, which must not be
+ * larger than the source in either dimension. Each finished destination row is
+ * written to the locked destination right away, so the decoder does not need to
+ * keep the full resolution image.
+ */
+typedef struct {
+     int           sw;
+     int           sh;
+
+     void         *dst;
+     int           dpitch;
+     DFBRectangle  drect;
+     CoreSurface  *dst_surface;
+     DFBRegion     clip;
+     bool          clipped;
+
+     int          *xmap;         /* destination column of each source column */
+     int          *cols;         /* number of source columns per destination column */
+     u64          *accum;        /* alpha and alpha weighted color sums per destination column */
+     u32          *line;         /* finished destination row */
+
+     int           sy;           /* next source row */
+     int           dy;           /* destination row being accumulated */
+     int           rows;         /* number of source rows accumulated */
+} DFBRowScaler;
+
+DFBResult dfb_row_scaler_init  ( DFBRowScaler *scaler,
+                                 int sw, int sh,
+                                 void *dst, int dpitch, const DFBRectangle *drect,
+                                 CoreSurface *dst_surface, const DFBRegion *dst_clip );
+
+void      dfb_row_scaler_push  ( DFBRowScaler *scaler, const u32 *row );
+
+/*
+ * Writes out a partially accumulated row, e.g. after an aborted decode, and frees the buffers.
+ */
+void      dfb_row_scaler_deinit( DFBRowScaler *scaler );
+
+
 #endif
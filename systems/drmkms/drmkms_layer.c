@@ -0,0 +1,519 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+
+#include <config.h>
+
+#include <directfb.h>
+#include <directfb_util.h>
+
+#include <direct/messages.h>
+#include <direct/thread.h>
+
+#include <core/layers.h>
+#include <core/screens.h>
+#include <core/surface.h>
+#include <core/surface_buffer.h>
+
+#include <misc/conf.h>
+
+#include "drmkms_system.h"
+
+
+D_DEBUG_DOMAIN( DRMKMS_Layer, "DRMKMS/Layer", "DRM/KMS Layers" );
+
+/**********************************************************************************************************************/
+
+typedef struct {
+     int                 index;      /* index into the usable planes of the system */
+     drmModePlane       *plane;
+
+     DFBRectangle        source;
+     DFBRectangle        dest;
+} DRMKMSPlaneLayerData;
+
+/**********************************************************************************************************************/
+
+/*
+ * Waits until the kernel signalled completion of the pending page flip, if any.
+ */
+static void
+wait_flip_done( DRMKMSData *drmkms )
+{
+     direct_mutex_lock( &drmkms->lock );
+
+     while (drmkms->flip_pending) {
+          D_DEBUG_AT( DRMKMS_Layer, "  -> waiting for pending flip\n" );
+
+          direct_waitqueue_wait( &drmkms->wq_event, &drmkms->lock );
+     }
+
+     direct_mutex_unlock( &drmkms->lock );
+}
+
+static const drmModeModeInfo *
+find_mode( const DRMKMSData *drmkms,
+           int               width,
+           int               height )
+{
+     const drmModeConnector *connector = drmkms->connector;
+     int                     i;
+
+     for (i=0; i<connector->count_modes; i++) {
+          if (connector->modes[i].hdisplay == width && connector->modes[i].vdisplay == height)
+               return &connector->modes[i];
+     }
+
+     return NULL;
+}
+
+static bool
+plane_supports_format( const drmModePlane    *plane,
+                       DFBSurfacePixelFormat  format )
+{
+     uint32_t     fourcc = drmkms_format_to_drm( format );
+     unsigned int i;
+
+     for (i=0; fourcc && i<plane->count_formats; i++) {
+          if (plane->formats[i] == fourcc)
+               return true;
+     }
+
+     return false;
+}
+
+static DFBResult
+test_buffermode( DFBDisplayLayerBufferMode buffermode )
+{
+     switch (buffermode) {
+          case DLBM_FRONTONLY:
+          case DLBM_BACKVIDEO:
+          case DLBM_TRIPLE:
+               return DFB_OK;
+
+          default:
+               break;
+     }
+
+     return DFB_UNSUPPORTED;
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+primaryInitLayer( CoreLayer                  *layer,
+                  void                       *driver_data,
+                  void                       *layer_data,
+                  DFBDisplayLayerDescription *description,
+                  DFBDisplayLayerConfig      *config,
+                  DFBColorAdjustment         *adjustment )
+{
+     DRMKMSData *drmkms = driver_data;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s()\n", __FUNCTION__ );
+
+     /* set capabilities and type */
+     description->caps             = DLCAPS_SURFACE;
+     description->type             = DLTF_GRAPHICS;
+     description->surface_caps     = DSCAPS_NONE;
+     description->surface_accessor = CSAID_LAYER0;
+
+     /* set name */
+     direct_snputs( description->name, "DRM/KMS Primary Layer", DFB_DISPLAY_LAYER_DESC_NAME_LENGTH );
+
+     /* fill out the default configuration, triple buffering lets rendering overlap a pending flip */
+     config->flags       = DLCONF_WIDTH       | DLCONF_HEIGHT |
+                           DLCONF_PIXELFORMAT | DLCONF_BUFFERMODE;
+     config->buffermode  = DLBM_TRIPLE;
+     config->width       = dfb_config->mode.width  ?: drmkms->shared->mode.hdisplay;
+     config->height      = dfb_config->mode.height ?: drmkms->shared->mode.vdisplay;
+
+     /* The legacy primary plane is guaranteed to scan out XRGB8888 only. */
+     if (dfb_config->mode.format != DSPF_UNKNOWN)
+          config->pixelformat = dfb_config->mode.format;
+     else
+          config->pixelformat = DSPF_RGB32;
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryTestRegion( CoreLayer                  *layer,
+                   void                       *driver_data,
+                   void                       *layer_data,
+                   CoreLayerRegionConfig      *config,
+                   CoreLayerRegionConfigFlags *failed )
+{
+     DRMKMSData                 *drmkms = driver_data;
+     CoreLayerRegionConfigFlags  fail   = CLRCF_NONE;
+
+     if (test_buffermode( config->buffermode ))
+          fail |= CLRCF_BUFFERMODE;
+
+     if (!drmkms_format_to_drm( config->format ))
+          fail |= CLRCF_FORMAT;
+
+     if (!find_mode( drmkms, config->width, config->height ))
+          fail |= CLRCF_WIDTH | CLRCF_HEIGHT;
+
+     if (config->options)
+          fail |= CLRCF_OPTIONS;
+
+     if (failed)
+          *failed = fail;
+
+     if (fail)
+          return DFB_UNSUPPORTED;
+
+     return DFB_OK;
+}
+
+static DFBResult
+primarySetRegion( CoreLayer                  *layer,
+                  void                       *driver_data,
+                  void                       *layer_data,
+                  void                       *region_data,
+                  CoreLayerRegionConfig      *config,
+                  CoreLayerRegionConfigFlags  updated,
+                  CoreSurface                *surface,
+                  CorePalette                *palette,
+                  CoreSurfaceBufferLock      *left_lock,
+                  CoreSurfaceBufferLock      *right_lock )
+{
+     DRMKMSData            *drmkms = driver_data;
+     const drmModeModeInfo *mode;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s( %dx%d %s, buffermode %d )\n", __FUNCTION__, config->width, config->height,
+                 dfb_pixelformat_name( config->format ), config->buffermode );
+
+     if (!(updated & (CLRCF_WIDTH | CLRCF_HEIGHT | CLRCF_FORMAT | CLRCF_SOURCE | CLRCF_BUFFERMODE | CLRCF_SURFACE)))
+          return DFB_OK;
+
+     mode = find_mode( drmkms, config->width, config->height );
+     if (!mode)
+          return DFB_UNSUPPORTED;
+
+     /* The CRTC must not switch buffers while a flip to another one is still in flight. */
+     wait_flip_done( drmkms );
+
+     if (drmModeSetCrtc( drmkms->fd, drmkms->crtc_id, (u32)(long) left_lock->handle,
+                         config->source.x, config->source.y,
+                         &drmkms->connector->connector_id, 1, (drmModeModeInfo*) mode ))
+     {
+          D_PERROR( "DirectFB/DRMKMS: drmModeSetCrtc() failed!\n" );
+          return DFB_FAILURE;
+     }
+
+     drmkms->shared->mode = *mode;
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryFlipRegion( CoreLayer             *layer,
+                   void                  *driver_data,
+                   void                  *layer_data,
+                   void                  *region_data,
+                   CoreSurface           *surface,
+                   DFBSurfaceFlipFlags    flags,
+                   CoreSurfaceBufferLock *left_lock,
+                   CoreSurfaceBufferLock *right_lock )
+{
+     DRMKMSData *drmkms = driver_data;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s( 0x%08x )\n", __FUNCTION__, flags );
+
+     /* Only one page flip per CRTC can be queued in the kernel. */
+     wait_flip_done( drmkms );
+
+     D_ASSERT( drmkms->flip_buffer == NULL );
+
+     drmkms->flip_buffer = left_lock->buffer;
+     dfb_surface_buffer_ref( drmkms->flip_buffer );
+
+     if (drmModePageFlip( drmkms->fd, drmkms->crtc_id, (u32)(long) left_lock->handle,
+                          DRM_MODE_PAGE_FLIP_EVENT, drmkms ))
+     {
+          D_PERROR( "DirectFB/DRMKMS: drmModePageFlip() failed!\n" );
+
+          dfb_surface_buffer_unref( drmkms->flip_buffer );
+          drmkms->flip_buffer = NULL;
+
+          return DFB_FAILURE;
+     }
+
+     dfb_surface_flip( surface, false );
+
+     direct_mutex_lock( &drmkms->lock );
+
+     drmkms->flip_pending = true;
+
+     direct_waitqueue_broadcast( &drmkms->wq_flip );
+
+     /*
+      * With less than three buffers the new back buffer is still being scanned out until the flip completed,
+      * so rendering into it right away would tear.
+      */
+     if ((flags & DSFLIP_WAITFORSYNC) == DSFLIP_WAITFORSYNC || !(surface->config.caps & DSCAPS_TRIPLE)) {
+          while (drmkms->flip_pending) {
+               D_DEBUG_AT( DRMKMS_Layer, "  -> waiting for flip to complete\n" );
+
+               direct_waitqueue_wait( &drmkms->wq_event, &drmkms->lock );
+          }
+
+          D_DEBUG_AT( DRMKMS_Layer, "  -> flip completed at vblank %u, %lld us\n",
+                      drmkms->flip_sequence, drmkms->flip_time );
+     }
+
+     direct_mutex_unlock( &drmkms->lock );
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryUpdateRegion( CoreLayer             *layer,
+                     void                  *driver_data,
+                     void                  *layer_data,
+                     void                  *region_data,
+                     CoreSurface           *surface,
+                     const DFBRegion       *left_update,
+                     CoreSurfaceBufferLock *left_lock,
+                     const DFBRegion       *right_update,
+                     CoreSurfaceBufferLock *right_lock )
+{
+     DRMKMSData   *drmkms = driver_data;
+     drmModeClip   clip;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s()\n", __FUNCTION__ );
+
+     if (left_update) {
+          clip.x1 = left_update->x1;
+          clip.y1 = left_update->y1;
+          clip.x2 = left_update->x2 + 1;
+          clip.y2 = left_update->y2 + 1;
+     }
+     else {
+          clip.x1 = 0;
+          clip.y1 = 0;
+          clip.x2 = surface->config.size.w;
+          clip.y2 = surface->config.size.h;
+     }
+
+     /* Front buffer rendering, drivers with shadow buffers (e.g. USB displays) need to know what changed. */
+     drmModeDirtyFB( drmkms->fd, (u32)(long) left_lock->handle, &clip, 1 );
+
+     return DFB_OK;
+}
+
+static const DisplayLayerFuncs _drmkmsPrimaryLayerFuncs = {
+     .InitLayer      = primaryInitLayer,
+     .TestRegion     = primaryTestRegion,
+     .SetRegion      = primarySetRegion,
+     .FlipRegion     = primaryFlipRegion,
+     .UpdateRegion   = primaryUpdateRegion,
+};
+
+const DisplayLayerFuncs *drmkmsPrimaryLayerFuncs = &_drmkmsPrimaryLayerFuncs;
+
+/**********************************************************************************************************************/
+
+static int
+planeLayerDataSize( void )
+{
+     return sizeof(DRMKMSPlaneLayerData);
+}
+
+static DFBResult
+planeInitLayer( CoreLayer                  *layer,
+                void                       *driver_data,
+                void                       *layer_data,
+                DFBDisplayLayerDescription *description,
+                DFBDisplayLayerConfig      *config,
+                DFBColorAdjustment         *adjustment )
+{
+     DRMKMSData           *drmkms = driver_data;
+     DRMKMSPlaneLayerData *data   = layer_data;
+
+     D_ASSERT( drmkms->plane_count < drmkms->num_planes );
+
+     data->index = drmkms->plane_count++;
+     data->plane = drmkms->planes[data->index];
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s( plane %u )\n", __FUNCTION__, data->plane->plane_id );
+
+     /* set capabilities and type */
+     description->caps             = DLCAPS_SURFACE | DLCAPS_SCREEN_LOCATION |
+                                     DLCAPS_SCREEN_POSITION | DLCAPS_SCREEN_SIZE;
+     description->type             = DLTF_GRAPHICS | DLTF_VIDEO | DLTF_STILL_PICTURE;
+     description->surface_caps     = DSCAPS_NONE;
+     description->surface_accessor = CSAID_LAYER0 + dfb_layer_id( layer );
+
+     /* set name */
+     snprintf( description->name, DFB_DISPLAY_LAYER_DESC_NAME_LENGTH, "DRM/KMS Plane %u", data->plane->plane_id );
+
+     /* fill out the default configuration */
+     config->flags       = DLCONF_WIDTH       | DLCONF_HEIGHT |
+                           DLCONF_PIXELFORMAT | DLCONF_BUFFERMODE;
+     config->buffermode  = DLBM_BACKVIDEO;
+     config->width       = drmkms->shared->mode.hdisplay;
+     config->height      = drmkms->shared->mode.vdisplay;
+
+     if (plane_supports_format( data->plane, DSPF_ARGB ))
+          config->pixelformat = DSPF_ARGB;
+     else if (plane_supports_format( data->plane, DSPF_YUY2 ))
+          config->pixelformat = DSPF_YUY2;
+     else
+          config->pixelformat = DSPF_RGB32;
+
+     return DFB_OK;
+}
+
+static DFBResult
+planeTestRegion( CoreLayer                  *layer,
+                 void                       *driver_data,
+                 void                       *layer_data,
+                 CoreLayerRegionConfig      *config,
+                 CoreLayerRegionConfigFlags *failed )
+{
+     DRMKMSPlaneLayerData       *data = layer_data;
+     CoreLayerRegionConfigFlags  fail = CLRCF_NONE;
+
+     if (test_buffermode( config->buffermode ))
+          fail |= CLRCF_BUFFERMODE;
+
+     if (!plane_supports_format( data->plane, config->format ))
+          fail |= CLRCF_FORMAT;
+
+     if (config->options)
+          fail |= CLRCF_OPTIONS;
+
+     if (failed)
+          *failed = fail;
+
+     if (fail)
+          return DFB_UNSUPPORTED;
+
+     return DFB_OK;
+}
+
+/*
+ * Shows the framebuffer on the plane, the legacy call takes effect at the next vertical retrace.
+ */
+static DFBResult
+plane_show( DRMKMSData           *drmkms,
+            DRMKMSPlaneLayerData *data,
+            uint32_t              fb_id )
+{
+     if (drmModeSetPlane( drmkms->fd, data->plane->plane_id, drmkms->crtc_id, fb_id, 0,
+                          data->dest.x, data->dest.y, data->dest.w, data->dest.h,
+                          data->source.x << 16, data->source.y << 16, data->source.w << 16, data->source.h << 16 ))
+     {
+          D_PERROR( "DirectFB/DRMKMS: drmModeSetPlane( %u ) failed!\n", data->plane->plane_id );
+          return DFB_FAILURE;
+     }
+
+     return DFB_OK;
+}
+
+static DFBResult
+planeSetRegion( CoreLayer                  *layer,
+                void                       *driver_data,
+                void                       *layer_data,
+                void                       *region_data,
+                CoreLayerRegionConfig      *config,
+                CoreLayerRegionConfigFlags  updated,
+                CoreSurface                *surface,
+                CorePalette                *palette,
+                CoreSurfaceBufferLock      *left_lock,
+                CoreSurfaceBufferLock      *right_lock )
+{
+     DRMKMSData           *drmkms = driver_data;
+     DRMKMSPlaneLayerData *data   = layer_data;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s( plane %u, %d,%d-%dx%d )\n", __FUNCTION__, data->plane->plane_id,
+                 DFB_RECTANGLE_VALS( &config->dest ) );
+
+     data->source = config->source;
+     data->dest   = config->dest;
+
+     return plane_show( drmkms, data, (u32)(long) left_lock->handle );
+}
+
+static DFBResult
+planeRemoveRegion( CoreLayer *layer,
+                   void      *driver_data,
+                   void      *layer_data,
+                   void      *region_data )
+{
+     DRMKMSData           *drmkms = driver_data;
+     DRMKMSPlaneLayerData *data   = layer_data;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s( plane %u )\n", __FUNCTION__, data->plane->plane_id );
+
+     drmModeSetPlane( drmkms->fd, data->plane->plane_id, drmkms->crtc_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+
+     return DFB_OK;
+}
+
+static DFBResult
+planeFlipRegion( CoreLayer             *layer,
+                 void                  *driver_data,
+                 void                  *layer_data,
+                 void                  *region_data,
+                 CoreSurface           *surface,
+                 DFBSurfaceFlipFlags    flags,
+                 CoreSurfaceBufferLock *left_lock,
+                 CoreSurfaceBufferLock *right_lock )
+{
+     DFBResult             ret;
+     DRMKMSData           *drmkms = driver_data;
+     DRMKMSPlaneLayerData *data   = layer_data;
+
+     D_DEBUG_AT( DRMKMS_Layer, "%s( plane %u, 0x%08x )\n", __FUNCTION__, data->plane->plane_id, flags );
+
+     ret = plane_show( drmkms, data, (u32)(long) left_lock->handle );
+     if (ret)
+          return ret;
+
+     dfb_surface_flip( surface, false );
+
+     dfb_surface_notify_display( surface, left_lock->buffer );
+
+     return DFB_OK;
+}
+
+static const DisplayLayerFuncs _drmkmsPlaneLayerFuncs = {
+     .LayerDataSize  = planeLayerDataSize,
+     .InitLayer      = planeInitLayer,
+     .TestRegion     = planeTestRegion,
+     .SetRegion      = planeSetRegion,
+     .RemoveRegion   = planeRemoveRegion,
+     .FlipRegion     = planeFlipRegion,
+};
+
+const DisplayLayerFuncs *drmkmsPlaneLayerFuncs = &_drmkmsPlaneLayerFuncs;
@@ -0,0 +1,149 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+
+#include <config.h>
+
+#include <directfb.h>
+
+#include <direct/messages.h>
+
+#include <core/screens.h>
+
+#include "drmkms_system.h"
+
+
+D_DEBUG_DOMAIN( DRMKMS_Screen, "DRMKMS/Screen", "DRM/KMS Screen" );
+
+/**********************************************************************************************************************/
+
+/*
+ * Waits for the given number of vertical retraces on our CRTC, zero just queries the counter.
+ */
+static DFBResult
+wait_vblank( DRMKMSData   *drmkms,
+             unsigned int  count,
+             unsigned int *ret_sequence )
+{
+     drmVBlank    vbl;
+     unsigned int type = DRM_VBLANK_RELATIVE;
+
+     if (drmkms->crtc_index == 1)
+          type |= DRM_VBLANK_SECONDARY;
+     else if (drmkms->crtc_index > 1)
+          type |= (drmkms->crtc_index << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+
+     vbl.request.type     = type;
+     vbl.request.sequence = count;
+     vbl.request.signal   = 0;
+
+     if (drmWaitVBlank( drmkms->fd, &vbl )) {
+          D_PERROR( "DirectFB/DRMKMS: drmWaitVBlank() failed!\n" );
+          return DFB_FAILURE;
+     }
+
+     if (ret_sequence)
+          *ret_sequence = vbl.reply.sequence;
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+drmkmsInitScreen( CoreScreen           *screen,
+                  CoreGraphicsDevice   *device,
+                  void                 *driver_data,
+                  void                 *screen_data,
+                  DFBScreenDescription *description )
+{
+     D_DEBUG_AT( DRMKMS_Screen, "%s()\n", __FUNCTION__ );
+
+     /* Set the screen capabilities. */
+     description->caps = DSCCAPS_VSYNC;
+
+     /* Set the screen name. */
+     direct_snputs( description->name, "DRM/KMS Screen", DFB_SCREEN_DESC_NAME_LENGTH );
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsWaitVSync( CoreScreen *screen,
+                 void       *driver_data,
+                 void       *screen_data )
+{
+     DRMKMSData *drmkms = driver_data;
+
+     D_DEBUG_AT( DRMKMS_Screen, "%s()\n", __FUNCTION__ );
+
+     return wait_vblank( drmkms, 1, NULL );
+}
+
+static DFBResult
+drmkmsGetVSyncCount( CoreScreen    *screen,
+                     void          *driver_data,
+                     void          *screen_data,
+                     unsigned long *ret_count )
+{
+     DFBResult     ret;
+     DRMKMSData   *drmkms = driver_data;
+     unsigned int  sequence;
+
+     ret = wait_vblank( drmkms, 0, &sequence );
+     if (ret)
+          return ret;
+
+     *ret_count = sequence;
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsGetScreenSize( CoreScreen *screen,
+                     void       *driver_data,
+                     void       *screen_data,
+                     int        *ret_width,
+                     int        *ret_height )
+{
+     DRMKMSData *drmkms = driver_data;
+
+     *ret_width  = drmkms->shared->mode.hdisplay;
+     *ret_height = drmkms->shared->mode.vdisplay;
+
+     return DFB_OK;
+}
+
+static const ScreenFuncs _drmkmsScreenFuncs = {
+     .InitScreen     = drmkmsInitScreen,
+     .WaitVSync      = drmkmsWaitVSync,
+     .GetVSyncCount  = drmkmsGetVSyncCount,
+     .GetScreenSize  = drmkmsGetScreenSize,
+};
+
+const ScreenFuncs *drmkmsScreenFuncs = &_drmkmsScreenFuncs;
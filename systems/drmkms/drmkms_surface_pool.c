@@ -0,0 +1,421 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <drm_fourcc.h>
+
+#include <direct/debug.h>
+#include <direct/mem.h>
+#include <direct/messages.h>
+
+#include <core/surface_pool.h>
+
+#include <misc/conf.h>
+
+#include "drmkms_system.h"
+
+D_DEBUG_DOMAIN( DRMKMS_Surfaces, "DRMKMS/Surfaces", "DRM/KMS Dumb Buffer Surface Pool" );
+D_DEBUG_DOMAIN( DRMKMS_SurfLock, "DRMKMS/SurfLock", "DRM/KMS Dumb Buffer Surface Pool Locks" );
+
+/**********************************************************************************************************************/
+
+typedef struct {
+     int             magic;
+} DRMKMSPoolData;
+
+typedef struct {
+     int             magic;
+
+     DRMKMSData     *drmkms;
+} DRMKMSPoolLocalData;
+
+typedef struct {
+     int             magic;
+
+     uint32_t        handle;     /* dumb buffer handle */
+     int             pitch;
+     int             size;
+
+     uint32_t        fb_id;      /* framebuffer for scanout on the CRTC or a plane */
+
+     void           *addr;       /* mapping of the dumb buffer in the master */
+} DRMKMSAllocationData;
+
+/**********************************************************************************************************************/
+
+uint32_t
+drmkms_format_to_drm( DFBSurfacePixelFormat format )
+{
+     switch (format) {
+          case DSPF_ARGB:
+               return DRM_FORMAT_ARGB8888;
+
+          case DSPF_RGB32:
+               return DRM_FORMAT_XRGB8888;
+
+          case DSPF_ABGR:
+               return DRM_FORMAT_ABGR8888;
+
+          case DSPF_RGB24:
+               return DRM_FORMAT_RGB888;
+
+          case DSPF_RGB16:
+               return DRM_FORMAT_RGB565;
+
+          case DSPF_ARGB1555:
+               return DRM_FORMAT_ARGB1555;
+
+          case DSPF_RGB555:
+               return DRM_FORMAT_XRGB1555;
+
+          case DSPF_ARGB4444:
+               return DRM_FORMAT_ARGB4444;
+
+          case DSPF_YUY2:
+               return DRM_FORMAT_YUYV;
+
+          case DSPF_UYVY:
+               return DRM_FORMAT_UYVY;
+
+          default:
+               break;
+     }
+
+     return 0;
+}
+
+/**********************************************************************************************************************/
+
+static int
+drmkmsPoolDataSize( void )
+{
+     return sizeof(DRMKMSPoolData);
+}
+
+static int
+drmkmsPoolLocalDataSize( void )
+{
+     return sizeof(DRMKMSPoolLocalData);
+}
+
+static int
+drmkmsAllocationDataSize( void )
+{
+     return sizeof(DRMKMSAllocationData);
+}
+
+static DFBResult
+drmkmsInitPool( CoreDFB                    *core,
+                CoreSurfacePool            *pool,
+                void                       *pool_data,
+                void                       *pool_local,
+                void                       *system_data,
+                CoreSurfacePoolDescription *ret_desc )
+{
+     DRMKMSPoolData      *data   = pool_data;
+     DRMKMSPoolLocalData *local  = pool_local;
+     DRMKMSData          *drmkms = system_data;
+     int                  i;
+
+     D_DEBUG_AT( DRMKMS_Surfaces, "%s()\n", __FUNCTION__ );
+
+     D_ASSERT( core != NULL );
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_ASSERT( data != NULL );
+     D_ASSERT( local != NULL );
+     D_ASSERT( drmkms != NULL );
+     D_ASSERT( ret_desc != NULL );
+
+     /* Dumb buffers are meant for scanout only, everything else stays in system memory. */
+     ret_desc->caps              = CSPCAPS_VIRTUAL;
+     ret_desc->access[CSAID_CPU] = CSAF_READ | CSAF_WRITE;
+     ret_desc->types             = CSTF_LAYER | CSTF_SHARED | CSTF_EXTERNAL;
+     ret_desc->priority          = CSPP_DEFAULT;
+
+     /* For the primary layer and the plane layers */
+     for (i=CSAID_LAYER0; i<=CSAID_LAYER15; i++)
+          ret_desc->access[i] = CSAF_READ;
+
+     snprintf( ret_desc->name, DFB_SURFACE_POOL_DESC_NAME_LENGTH, "DRM/KMS Dumb Buffers" );
+
+     local->drmkms = drmkms;
+
+     D_MAGIC_SET( data, DRMKMSPoolData );
+     D_MAGIC_SET( local, DRMKMSPoolLocalData );
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsDestroyPool( CoreSurfacePool *pool,
+                   void            *pool_data,
+                   void            *pool_local )
+{
+     DRMKMSPoolData      *data  = pool_data;
+     DRMKMSPoolLocalData *local = pool_local;
+
+     D_DEBUG_AT( DRMKMS_Surfaces, "%s()\n", __FUNCTION__ );
+
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_MAGIC_ASSERT( data, DRMKMSPoolData );
+     D_MAGIC_ASSERT( local, DRMKMSPoolLocalData );
+
+     D_MAGIC_CLEAR( data );
+     D_MAGIC_CLEAR( local );
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsTestConfig( CoreSurfacePool         *pool,
+                  void                    *pool_data,
+                  void                    *pool_local,
+                  CoreSurfaceBuffer       *buffer,
+                  const CoreSurfaceConfig *config )
+{
+     D_DEBUG_AT( DRMKMS_Surfaces, "%s( %p )\n", __FUNCTION__, buffer );
+
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_MAGIC_ASSERT( buffer, CoreSurfaceBuffer );
+
+     if (!drmkms_format_to_drm( config->format ))
+          return DFB_UNSUPPORTED;
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsAllocateBuffer( CoreSurfacePool       *pool,
+                      void                  *pool_data,
+                      void                  *pool_local,
+                      CoreSurfaceBuffer     *buffer,
+                      CoreSurfaceAllocation *allocation,
+                      void                  *alloc_data )
+{
+     DFBResult                  ret;
+     CoreSurface               *surface;
+     DRMKMSPoolLocalData       *local = pool_local;
+     DRMKMSAllocationData      *alloc = alloc_data;
+     DRMKMSData                *drmkms;
+     struct drm_mode_create_dumb  creq;
+     struct drm_mode_map_dumb     mreq;
+     struct drm_mode_destroy_dumb dreq;
+     uint32_t                   handles[4] = { 0 };
+     uint32_t                   pitches[4] = { 0 };
+     uint32_t                   offsets[4] = { 0 };
+
+     D_DEBUG_AT( DRMKMS_Surfaces, "%s( %p )\n", __FUNCTION__, buffer );
+
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_MAGIC_ASSERT( local, DRMKMSPoolLocalData );
+     D_MAGIC_ASSERT( buffer, CoreSurfaceBuffer );
+
+     drmkms = local->drmkms;
+     D_ASSERT( drmkms != NULL );
+
+     surface = buffer->surface;
+     D_MAGIC_ASSERT( surface, CoreSurface );
+
+     memset( &creq, 0, sizeof(creq) );
+
+     creq.width  = surface->config.size.w;
+     creq.height = surface->config.size.h;
+     creq.bpp    = DFB_BITS_PER_PIXEL( buffer->format );
+
+     if (drmIoctl( drmkms->fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq )) {
+          ret = errno2result( errno );
+          D_PERROR( "DirectFB/DRMKMS: Creating %dx%d dumb buffer failed!\n", creq.width, creq.height );
+          return ret;
+     }
+
+     alloc->handle = creq.handle;
+     alloc->pitch  = creq.pitch;
+     alloc->size   = creq.size;
+
+     handles[0] = alloc->handle;
+     pitches[0] = alloc->pitch;
+
+     if (drmModeAddFB2( drmkms->fd, creq.width, creq.height, drmkms_format_to_drm( buffer->format ),
+                        handles, pitches, offsets, &alloc->fb_id, 0 ))
+     {
+          ret = errno2result( errno );
+          D_PERROR( "DirectFB/DRMKMS: drmModeAddFB2() failed!\n" );
+          goto error;
+     }
+
+     memset( &mreq, 0, sizeof(mreq) );
+
+     mreq.handle = alloc->handle;
+
+     if (drmIoctl( drmkms->fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq )) {
+          ret = errno2result( errno );
+          D_PERROR( "DirectFB/DRMKMS: Mapping dumb buffer failed!\n" );
+          drmModeRmFB( drmkms->fd, alloc->fb_id );
+          goto error;
+     }
+
+     alloc->addr = mmap( NULL, alloc->size, PROT_READ | PROT_WRITE, MAP_SHARED, drmkms->fd, mreq.offset );
+     if (alloc->addr == MAP_FAILED) {
+          ret = errno2result( errno );
+          D_PERROR( "DirectFB/DRMKMS: mmap() of dumb buffer failed!\n" );
+          drmModeRmFB( drmkms->fd, alloc->fb_id );
+          goto error;
+     }
+
+     D_DEBUG_AT( DRMKMS_Surfaces, "  -> handle %u, fb %u, pitch %d, size %d\n",
+                 alloc->handle, alloc->fb_id, alloc->pitch, alloc->size );
+
+     allocation->size = alloc->size;
+
+     D_MAGIC_SET( alloc, DRMKMSAllocationData );
+
+     return DFB_OK;
+
+
+error:
+     memset( &dreq, 0, sizeof(dreq) );
+
+     dreq.handle = alloc->handle;
+
+     drmIoctl( drmkms->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq );
+
+     return ret;
+}
+
+static DFBResult
+drmkmsDeallocateBuffer( CoreSurfacePool       *pool,
+                        void                  *pool_data,
+                        void                  *pool_local,
+                        CoreSurfaceBuffer     *buffer,
+                        CoreSurfaceAllocation *allocation,
+                        void                  *alloc_data )
+{
+     DRMKMSPoolLocalData          *local = pool_local;
+     DRMKMSAllocationData         *alloc = alloc_data;
+     DRMKMSData                   *drmkms;
+     struct drm_mode_destroy_dumb  dreq;
+
+     D_DEBUG_AT( DRMKMS_Surfaces, "%s( %p )\n", __FUNCTION__, buffer );
+
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_MAGIC_ASSERT( local, DRMKMSPoolLocalData );
+     D_MAGIC_ASSERT( alloc, DRMKMSAllocationData );
+
+     drmkms = local->drmkms;
+     D_ASSERT( drmkms != NULL );
+
+     munmap( alloc->addr, alloc->size );
+
+     drmModeRmFB( drmkms->fd, alloc->fb_id );
+
+     memset( &dreq, 0, sizeof(dreq) );
+
+     dreq.handle = alloc->handle;
+
+     drmIoctl( drmkms->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq );
+
+     D_MAGIC_CLEAR( alloc );
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsLock( CoreSurfacePool       *pool,
+            void                  *pool_data,
+            void                  *pool_local,
+            CoreSurfaceAllocation *allocation,
+            void                  *alloc_data,
+            CoreSurfaceBufferLock *lock )
+{
+     DRMKMSAllocationData *alloc = alloc_data;
+
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_MAGIC_ASSERT( allocation, CoreSurfaceAllocation );
+     D_MAGIC_ASSERT( alloc, DRMKMSAllocationData );
+     D_MAGIC_ASSERT( lock, CoreSurfaceBufferLock );
+
+     D_DEBUG_AT( DRMKMS_SurfLock, "%s( %p )\n", __FUNCTION__, lock->buffer );
+
+     lock->pitch  = alloc->pitch;
+     lock->offset = 0;
+     lock->addr   = alloc->addr;
+     lock->phys   = 0;
+
+     /* Layers get the framebuffer id to pass to page flips and plane updates. */
+     if (lock->accessor >= CSAID_LAYER0 && lock->accessor <= CSAID_LAYER15)
+          lock->handle = (void*) (long) alloc->fb_id;
+
+     D_DEBUG_AT( DRMKMS_SurfLock, "  -> offset %lu, pitch %d, addr %p, fb %u\n",
+                 lock->offset, lock->pitch, lock->addr, alloc->fb_id );
+
+     return DFB_OK;
+}
+
+static DFBResult
+drmkmsUnlock( CoreSurfacePool       *pool,
+              void                  *pool_data,
+              void                  *pool_local,
+              CoreSurfaceAllocation *allocation,
+              void                  *alloc_data,
+              CoreSurfaceBufferLock *lock )
+{
+     DRMKMSAllocationData *alloc = alloc_data;
+
+     D_MAGIC_ASSERT( pool, CoreSurfacePool );
+     D_MAGIC_ASSERT( allocation, CoreSurfaceAllocation );
+     D_MAGIC_ASSERT( alloc, DRMKMSAllocationData );
+     D_MAGIC_ASSERT( lock, CoreSurfaceBufferLock );
+
+     D_DEBUG_AT( DRMKMS_SurfLock, "%s( %p )\n", __FUNCTION__, lock->buffer );
+
+     (void) alloc;
+
+     return DFB_OK;
+}
+
+const SurfacePoolFuncs drmkmsSurfacePoolFuncs = {
+     .PoolDataSize       = drmkmsPoolDataSize,
+     .PoolLocalDataSize  = drmkmsPoolLocalDataSize,
+     .AllocationDataSize = drmkmsAllocationDataSize,
+
+     .InitPool           = drmkmsInitPool,
+     .DestroyPool        = drmkmsDestroyPool,
+
+     .TestConfig         = drmkmsTestConfig,
+     .AllocateBuffer     = drmkmsAllocateBuffer,
+     .DeallocateBuffer   = drmkmsDeallocateBuffer,
+
+     .Lock               = drmkmsLock,
+     .Unlock             = drmkmsUnlock,
+};
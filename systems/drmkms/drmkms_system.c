@@ -0,0 +1,557 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <directfb.h>
+
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/thread.h>
+#include <direct/util.h>
+
+#include <fusion/shmalloc.h>
+
+#include <core/core.h>
+#include <core/surface_buffer.h>
+#include <core/surface_pool.h>
+
+#include <misc/conf.h>
+
+#include "drmkms_system.h"
+
+#include <core/core_system.h>
+
+
+D_DEBUG_DOMAIN( DRMKMS_System, "DRMKMS/System", "DRM/KMS System" );
+
+DFB_CORE_SYSTEM( drmkms )
+
+
+static DRMKMSData *dfb_drmkms;
+
+/**********************************************************************************************************************/
+
+/*
+ * Called by drmHandleEvent() in the event thread when the kernel completed a page flip on our CRTC.
+ */
+static void
+page_flip_handler( int           fd,
+                   unsigned int  frame,
+                   unsigned int  sec,
+                   unsigned int  usec,
+                   void         *user_data )
+{
+     DRMKMSData        *drmkms = user_data;
+     CoreSurfaceBuffer *buffer = drmkms->flip_buffer;
+
+     D_DEBUG_AT( DRMKMS_System, "%s( frame %u, %u.%06u )\n", __FUNCTION__, frame, sec, usec );
+
+     D_ASSERT( buffer != NULL );
+
+     dfb_surface_notify_display( buffer->surface, buffer );
+
+     direct_mutex_lock( &drmkms->lock );
+
+     drmkms->flip_pending  = false;
+     drmkms->flip_buffer   = NULL;
+     drmkms->flip_sequence = frame;
+     drmkms->flip_time     = sec * 1000000LL + usec;
+
+     direct_waitqueue_broadcast( &drmkms->wq_event );
+
+     direct_mutex_unlock( &drmkms->lock );
+
+     dfb_surface_buffer_unref( buffer );
+}
+
+static void *
+DRMKMS_EventThread_Main( DirectThread *thread, void *arg )
+{
+     DRMKMSData *drmkms = arg;
+
+     D_DEBUG_AT( DRMKMS_System, "%s()\n", __FUNCTION__ );
+
+     while (true) {
+          direct_mutex_lock( &drmkms->lock );
+
+          while (!drmkms->flip_pending && !drmkms->quit) {
+               D_DEBUG_AT( DRMKMS_System, "  -> waiting for flip to be issued\n" );
+
+               direct_waitqueue_wait( &drmkms->wq_flip, &drmkms->lock );
+          }
+
+          if (!drmkms->flip_pending) {
+               direct_mutex_unlock( &drmkms->lock );
+               break;
+          }
+
+          direct_mutex_unlock( &drmkms->lock );
+
+
+          D_DEBUG_AT( DRMKMS_System, "  -> waiting for flip to be done\n" );
+
+          /* Blocks reading the event, the page flip handler is called from here. */
+          if (drmHandleEvent( drmkms->fd, &drmkms->event_context ) < 0 && errno != EINTR) {
+               D_PERROR( "DirectFB/DRMKMS: drmHandleEvent() failed!\n" );
+               break;
+          }
+     }
+
+     return NULL;
+}
+
+/**********************************************************************************************************************/
+
+static const drmModeModeInfo *
+find_preferred_mode( const drmModeConnector *connector )
+{
+     int i;
+
+     for (i=0; i<connector->count_modes; i++) {
+          if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+               return &connector->modes[i];
+     }
+
+     return &connector->modes[0];
+}
+
+static DFBResult
+find_crtc( DRMKMSData *drmkms )
+{
+     drmModeRes       *resources = drmkms->resources;
+     drmModeConnector *connector = drmkms->connector;
+     drmModeEncoder   *encoder;
+     int               i, n;
+
+     /* Prefer the CRTC already driving the connector, then any CRTC one of its encoders can use. */
+     for (i=-1; i<connector->count_encoders; i++) {
+          encoder = drmModeGetEncoder( drmkms->fd, i < 0 ? connector->encoder_id : connector->encoders[i] );
+          if (!encoder)
+               continue;
+
+          for (n=0; n<resources->count_crtcs; n++) {
+               if (i < 0 ? resources->crtcs[n] == encoder->crtc_id : encoder->possible_crtcs & (1 << n)) {
+                    drmkms->crtc_id    = resources->crtcs[n];
+                    drmkms->crtc_index = n;
+
+                    drmModeFreeEncoder( encoder );
+
+                    return DFB_OK;
+               }
+          }
+
+          drmModeFreeEncoder( encoder );
+     }
+
+     return DFB_UNSUPPORTED;
+}
+
+static void
+find_planes( DRMKMSData *drmkms )
+{
+     drmModePlaneRes *plane_resources;
+     drmModePlane    *plane;
+     unsigned int     i;
+
+     /* Without DRM_CLIENT_CAP_UNIVERSAL_PLANES only overlay planes are listed. */
+     plane_resources = drmModeGetPlaneResources( drmkms->fd );
+     if (!plane_resources)
+          return;
+
+     for (i=0; i<plane_resources->count_planes && drmkms->num_planes < DRMKMS_MAX_PLANES; i++) {
+          plane = drmModeGetPlane( drmkms->fd, plane_resources->planes[i] );
+          if (!plane)
+               continue;
+
+          if (!(plane->possible_crtcs & (1 << drmkms->crtc_index))) {
+               drmModeFreePlane( plane );
+               continue;
+          }
+
+          D_INFO( "DirectFB/DRMKMS: Using plane %u with %u formats as layer\n", plane->plane_id, plane->count_formats );
+
+          drmkms->planes[drmkms->num_planes++] = plane;
+     }
+
+     drmModeFreePlaneResources( plane_resources );
+}
+
+static DFBResult
+InitLocal( DRMKMSData *drmkms )
+{
+     DFBResult         ret;
+     int               i;
+     uint64_t          dumb = 0;
+     const char       *device_name = dfb_config->drmkms_device ?: DRMKMS_DEFAULT_DEVICE;
+     drmModeConnector *connector   = NULL;
+
+     drmkms->fd = open( device_name, O_RDWR | O_CLOEXEC );
+     if (drmkms->fd < 0) {
+          ret = errno2result( errno );
+          D_PERROR( "DirectFB/DRMKMS: Failed to open '%s'!\n", device_name );
+          return ret;
+     }
+
+     if (drmGetCap( drmkms->fd, DRM_CAP_DUMB_BUFFER, &dumb ) || !dumb) {
+          D_ERROR( "DirectFB/DRMKMS: '%s' does not support dumb buffers!\n", device_name );
+          ret = DFB_UNSUPPORTED;
+          goto error;
+     }
+
+     drmkms->resources = drmModeGetResources( drmkms->fd );
+     if (!drmkms->resources) {
+          D_ERROR( "DirectFB/DRMKMS: drmModeGetResources() failed!\n" );
+          ret = DFB_INIT;
+          goto error;
+     }
+
+     for (i=0; i<drmkms->resources->count_connectors; i++) {
+          connector = drmModeGetConnector( drmkms->fd, drmkms->resources->connectors[i] );
+          if (!connector)
+               continue;
+
+          if (connector->connection == DRM_MODE_CONNECTED && connector->count_modes > 0)
+               break;
+
+          drmModeFreeConnector( connector );
+          connector = NULL;
+     }
+
+     if (!connector) {
+          D_ERROR( "DirectFB/DRMKMS: No connected connector found!\n" );
+          ret = DFB_INIT;
+          goto error;
+     }
+
+     drmkms->connector = connector;
+
+     ret = find_crtc( drmkms );
+     if (ret) {
+          D_ERROR( "DirectFB/DRMKMS: No CRTC found for connector %u!\n", connector->connector_id );
+          goto error;
+     }
+
+     D_INFO( "DirectFB/DRMKMS: Using connector %u, crtc %u on '%s'\n",
+             connector->connector_id, drmkms->crtc_id, device_name );
+
+     find_planes( drmkms );
+
+     drmkms->event_context.version           = DRM_EVENT_CONTEXT_VERSION;
+     drmkms->event_context.page_flip_handler = page_flip_handler;
+
+     direct_mutex_init( &drmkms->lock );
+     direct_waitqueue_init( &drmkms->wq_event );
+     direct_waitqueue_init( &drmkms->wq_flip );
+
+     drmkms->thread = direct_thread_create( DTT_CRITICAL, DRMKMS_EventThread_Main, drmkms, "DRMKMS/Event" );
+
+     return DFB_OK;
+
+
+error:
+     if (drmkms->connector)
+          drmModeFreeConnector( drmkms->connector );
+
+     if (drmkms->resources)
+          drmModeFreeResources( drmkms->resources );
+
+     close( drmkms->fd );
+
+     return ret;
+}
+
+static void
+DeinitLocal( DRMKMSData *drmkms )
+{
+     int i;
+
+     direct_mutex_lock( &drmkms->lock );
+
+     drmkms->quit = true;
+
+     direct_waitqueue_broadcast( &drmkms->wq_flip );
+
+     direct_mutex_unlock( &drmkms->lock );
+
+     /* A pending flip completes within a frame, the thread exits right after. */
+     direct_thread_join( drmkms->thread );
+     direct_thread_destroy( drmkms->thread );
+
+     direct_waitqueue_deinit( &drmkms->wq_flip );
+     direct_waitqueue_deinit( &drmkms->wq_event );
+     direct_mutex_deinit( &drmkms->lock );
+
+     for (i=0; i<drmkms->num_planes; i++)
+          drmModeFreePlane( drmkms->planes[i] );
+
+     drmModeFreeConnector( drmkms->connector );
+     drmModeFreeResources( drmkms->resources );
+
+     close( drmkms->fd );
+}
+
+/**********************************************************************************************************************/
+
+static void
+system_get_info( CoreSystemInfo *info )
+{
+     info->type = CORE_DRMKMS;
+     info->caps = CSCAPS_NONE;
+
+     direct_snputs( info->name, "DRM/KMS", DFB_CORE_SYSTEM_INFO_NAME_LENGTH );
+}
+
+static DFBResult
+system_initialize( CoreDFB *core, void **data )
+{
+     DFBResult         ret;
+     DRMKMSData       *drmkms;
+     DRMKMSDataShared *shared;
+     int               i;
+
+     D_ASSERT( dfb_drmkms == NULL );
+
+     drmkms = D_CALLOC( 1, sizeof(DRMKMSData) );
+     if (!drmkms)
+          return D_OOM();
+
+     drmkms->core = core;
+
+     shared = SHCALLOC( dfb_core_shmpool( core ), 1, sizeof(DRMKMSDataShared) );
+     if (!shared) {
+          D_FREE( drmkms );
+          return D_OOSHM();
+     }
+
+     shared->shmpool = dfb_core_shmpool( core );
+
+     drmkms->shared = shared;
+
+     ret = InitLocal( drmkms );
+     if (ret) {
+          SHFREE( shared->shmpool, shared );
+          D_FREE( drmkms );
+          return ret;
+     }
+
+     drmkms->saved_crtc = drmModeGetCrtc( drmkms->fd, drmkms->crtc_id );
+
+     shared->mode = *find_preferred_mode( drmkms->connector );
+
+     D_INFO( "DirectFB/DRMKMS: Default mode is %dx%d@%d\n",
+             shared->mode.hdisplay, shared->mode.vdisplay, shared->mode.vrefresh );
+
+     dfb_drmkms = drmkms;
+
+     dfb_surface_pool_initialize( core, &drmkmsSurfacePoolFuncs, &shared->pool );
+
+     drmkms->screen = dfb_screens_register( NULL, drmkms, drmkmsScreenFuncs );
+     drmkms->layer  = dfb_layers_register( drmkms->screen, drmkms, drmkmsPrimaryLayerFuncs );
+
+     for (i=0; i<drmkms->num_planes; i++)
+          dfb_layers_register( drmkms->screen, drmkms, drmkmsPlaneLayerFuncs );
+
+     core_arena_add_shared_field( core, "drmkms", shared );
+
+     *data = drmkms;
+
+     return DFB_OK;
+}
+
+static DFBResult
+system_join( CoreDFB *core, void **data )
+{
+     /* Dumb buffer handles and framebuffer ids belong to the file descriptor of the master. */
+     D_ERROR( "DirectFB/DRMKMS: Multi application slaves are not supported!\n" );
+
+     return DFB_UNSUPPORTED;
+}
+
+static DFBResult
+system_shutdown( bool emergency )
+{
+     DRMKMSData       *drmkms = dfb_drmkms;
+     DRMKMSDataShared *shared;
+     drmModeCrtc      *saved;
+
+     D_ASSERT( drmkms != NULL );
+
+     shared = drmkms->shared;
+     D_ASSERT( shared != NULL );
+
+     /* Restore the previous scanout before our framebuffers are removed with the pool. */
+     saved = drmkms->saved_crtc;
+     if (saved) {
+          drmModeSetCrtc( drmkms->fd, saved->crtc_id, saved->buffer_id, saved->x, saved->y,
+                          &drmkms->connector->connector_id, 1, &saved->mode );
+
+          drmModeFreeCrtc( saved );
+     }
+
+     dfb_surface_pool_destroy( shared->pool );
+
+     DeinitLocal( drmkms );
+
+     SHFREE( shared->shmpool, shared );
+
+     D_FREE( drmkms );
+     dfb_drmkms = NULL;
+
+     return DFB_OK;
+}
+
+static DFBResult
+system_leave( bool emergency )
+{
+     return DFB_OK;
+}
+
+static DFBResult
+system_suspend( void )
+{
+     return DFB_OK;
+}
+
+static DFBResult
+system_resume( void )
+{
+     return DFB_OK;
+}
+
+static volatile void *
+system_map_mmio( unsigned int    offset,
+                 int             length )
+{
+     return NULL;
+}
+
+static void
+system_unmap_mmio( volatile void  *addr,
+                   int             length )
+{
+}
+
+static int
+system_get_accelerator( void )
+{
+     return -1;
+}
+
+static VideoMode *
+system_get_modes( void )
+{
+     return NULL;
+}
+
+static VideoMode *
+system_get_current_mode( void )
+{
+     return NULL;
+}
+
+static DFBResult
+system_thread_init( void )
+{
+     return DFB_OK;
+}
+
+static bool
+system_input_filter( CoreInputDevice *device,
+                     DFBInputEvent   *event )
+{
+     return false;
+}
+
+static unsigned long
+system_video_memory_physical( unsigned int offset )
+{
+     return 0;
+}
+
+static void *
+system_video_memory_virtual( unsigned int offset )
+{
+     return NULL;
+}
+
+static unsigned int
+system_videoram_length( void )
+{
+     return 0;
+}
+
+static unsigned long
+system_aux_memory_physical( unsigned int offset )
+{
+     return 0;
+}
+
+static void *
+system_aux_memory_virtual( unsigned int offset )
+{
+     return NULL;
+}
+
+static unsigned int
+system_auxram_length( void )
+{
+     return 0;
+}
+
+static void
+system_get_busid( int *ret_bus, int *ret_dev, int *ret_func )
+{
+}
+
+static int
+system_surface_data_size( void )
+{
+     return 0;
+}
+
+static void
+system_surface_data_init( CoreSurface *surface, void *data )
+{
+}
+
+static void
+system_surface_data_destroy( CoreSurface *surface, void *data )
+{
+}
+
+static void
+system_get_deviceid( unsigned int *ret_vendor_id,
+                     unsigned int *ret_device_id )
+{
+}
@@ -0,0 +1,106 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+
+#ifndef __DRMKMS__DRMKMS_SYSTEM_H__
+#define __DRMKMS__DRMKMS_SYSTEM_H__
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <direct/thread.h>
+
+#include <fusion/shmalloc.h>
+
+#include <core/surface_pool.h>
+
+#include <core/layers.h>
+#include <core/screens.h>
+
+
+#define DRMKMS_DEFAULT_DEVICE "/dev/dri/card0"
+
+#define DRMKMS_MAX_PLANES     8
+
+
+extern const SurfacePoolFuncs   drmkmsSurfacePoolFuncs;
+
+extern const ScreenFuncs       *drmkmsScreenFuncs;
+extern const DisplayLayerFuncs *drmkmsPrimaryLayerFuncs;
+extern const DisplayLayerFuncs *drmkmsPlaneLayerFuncs;
+
+
+typedef struct {
+     FusionSHMPoolShared *shmpool;
+
+     CoreSurfacePool     *pool;
+
+     drmModeModeInfo      mode;             /* mode currently set on the CRTC */
+} DRMKMSDataShared;
+
+typedef struct {
+     DRMKMSDataShared    *shared;
+
+     CoreDFB             *core;
+     CoreScreen          *screen;
+     CoreLayer           *layer;
+
+     int                  fd;               /* DRM file descriptor */
+
+     drmModeRes          *resources;
+     drmModeConnector    *connector;
+     drmModeCrtc         *saved_crtc;
+
+     uint32_t             crtc_id;
+     int                  crtc_index;       /* index of the CRTC within the resources, for vblank requests */
+
+     drmModePlane        *planes[DRMKMS_MAX_PLANES];   /* overlay planes usable on our CRTC */
+     int                  num_planes;
+     int                  plane_count;      /* number of plane layers initialized so far */
+
+     drmEventContext      event_context;
+
+     DirectThread        *thread;
+     DirectMutex          lock;
+     DirectWaitQueue      wq_event;         /* signalled when a page flip completed */
+     DirectWaitQueue      wq_flip;          /* signalled when a page flip has been issued */
+
+     bool                 flip_pending;
+     CoreSurfaceBuffer   *flip_buffer;      /* buffer shown by the pending page flip */
+     unsigned int         flip_sequence;    /* vblank counter at completion of the last page flip */
+     long long            flip_time;        /* completion time of the last page flip as reported by the kernel */
+
+     bool                 quit;
+} DRMKMSData;
+
+
+uint32_t drmkms_format_to_drm( DFBSurfacePixelFormat format );
+
+#endif
@@ -0,0 +1,294 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+
+#include <directfb.h>
+
+#include <direct/clock.h>
+#include <direct/messages.h>
+
+#include <fusion/shmalloc.h>
+
+#include <core/core.h>
+#include <core/coredefs.h>
+#include <core/coretypes.h>
+#include <core/layers.h>
+#include <core/screens.h>
+#include <core/system.h>
+
+#include <misc/conf.h>
+
+#include "headless.h"
+
+#include <core/core_system.h>
+
+
+DFB_CORE_SYSTEM( headless )
+
+
+static DFBHeadless *dfb_headless;
+
+/**********************************************************************************************************************/
+
+static void
+system_get_info( CoreSystemInfo *info )
+{
+     info->type = CORE_HEADLESS;
+     info->caps = CSCAPS_NONE;
+
+     direct_snputs( info->name, "Headless", DFB_CORE_SYSTEM_INFO_NAME_LENGTH );
+}
+
+static DFBResult
+system_initialize( CoreDFB *core, void **data )
+{
+     DFBHeadlessShared *shared;
+
+     D_ASSERT( dfb_headless == NULL );
+
+     dfb_headless = (DFBHeadless*) D_CALLOC( 1, sizeof(DFBHeadless) );
+     if (!dfb_headless)
+          return D_OOM();
+
+     dfb_headless->core = core;
+
+     shared = (DFBHeadlessShared*) SHCALLOC( dfb_core_shmpool(core), 1, sizeof(DFBHeadlessShared) );
+     if (!shared) {
+          D_FREE( dfb_headless );
+          dfb_headless = NULL;
+          return D_OOSHM();
+     }
+
+     shared->screen_size.w = dfb_config->mode.width  ?: HEADLESS_WIDTH;
+     shared->screen_size.h = dfb_config->mode.height ?: HEADLESS_HEIGHT;
+
+     shared->vsync_start   = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+
+     if (dfb_config->headless_refresh)
+          shared->vsync_period = 1000000LL / dfb_config->headless_refresh;
+
+     D_INFO( "DirectFB/Headless: %dx%d, %u Hz\n", shared->screen_size.w, shared->screen_size.h,
+             dfb_config->headless_refresh );
+
+     dfb_headless->shared = shared;
+
+     dfb_headless->screen = dfb_screens_register( NULL, dfb_headless, headlessPrimaryScreenFuncs );
+
+     dfb_headless->layer = dfb_layers_register( dfb_headless->screen, dfb_headless, headlessPrimaryLayerFuncs );
+
+     core_arena_add_shared_field( core, "headless", shared );
+
+     *data = dfb_headless;
+
+     return DFB_OK;
+}
+
+static DFBResult
+system_join( CoreDFB *core, void **data )
+{
+     DFBResult  ret;
+     void      *shared;
+
+     D_ASSERT( dfb_headless == NULL );
+
+     ret = core_arena_get_shared_field( core, "headless", &shared );
+     if (ret)
+          return ret;
+
+     dfb_headless = (DFBHeadless*) D_CALLOC( 1, sizeof(DFBHeadless) );
+     if (!dfb_headless)
+          return D_OOM();
+
+     dfb_headless->core   = core;
+     dfb_headless->shared = shared;
+
+     dfb_headless->screen = dfb_screens_register( NULL, dfb_headless, headlessPrimaryScreenFuncs );
+
+     dfb_headless->layer = dfb_layers_register( dfb_headless->screen, dfb_headless, headlessPrimaryLayerFuncs );
+
+     *data = dfb_headless;
+
+     return DFB_OK;
+}
+
+static DFBResult
+system_shutdown( bool emergency )
+{
+     DFBHeadlessShared *shared;
+
+     D_ASSERT( dfb_headless != NULL );
+
+     shared = dfb_headless->shared;
+
+     /* Frame times between displayed frames, e.g. for comparing runs in CI. */
+     if (shared->stats.frames > 1)
+          D_INFO( "DirectFB/Headless: %u frames, frame time %lld.%03lld ms average, %lld.%03lld min, %lld.%03lld max\n",
+                  shared->stats.frames,
+                  shared->stats.total / (shared->stats.frames - 1) / 1000,
+                  shared->stats.total / (shared->stats.frames - 1) % 1000,
+                  shared->stats.min / 1000, shared->stats.min % 1000,
+                  shared->stats.max / 1000, shared->stats.max % 1000 );
+
+     SHFREE( dfb_core_shmpool(dfb_headless->core), shared );
+
+     D_FREE( dfb_headless );
+     dfb_headless = NULL;
+
+     return DFB_OK;
+}
+
+static DFBResult
+system_leave( bool emergency )
+{
+     D_ASSERT( dfb_headless != NULL );
+
+     D_FREE( dfb_headless );
+     dfb_headless = NULL;
+
+     return DFB_OK;
+}
+
+static DFBResult
+system_suspend( void )
+{
+     return DFB_OK;
+}
+
+static DFBResult
+system_resume( void )
+{
+     return DFB_OK;
+}
+
+static volatile void *
+system_map_mmio( unsigned int    offset,
+                 int             length )
+{
+     return NULL;
+}
+
+static void
+system_unmap_mmio( volatile void  *addr,
+                   int             length )
+{
+}
+
+static int
+system_get_accelerator( void )
+{
+     return -1;
+}
+
+static VideoMode *
+system_get_modes( void )
+{
+     return NULL;
+}
+
+static VideoMode *
+system_get_current_mode( void )
+{
+     return NULL;
+}
+
+static DFBResult
+system_thread_init( void )
+{
+     return DFB_OK;
+}
+
+static bool
+system_input_filter( CoreInputDevice *device,
+                     DFBInputEvent   *event )
+{
+     return false;
+}
+
+static unsigned long
+system_video_memory_physical( unsigned int offset )
+{
+     return 0;
+}
+
+static void *
+system_video_memory_virtual( unsigned int offset )
+{
+     return NULL;
+}
+
+static unsigned int
+system_videoram_length( void )
+{
+     return 0;
+}
+
+static unsigned long
+system_aux_memory_physical( unsigned int offset )
+{
+     return 0;
+}
+
+static void *
+system_aux_memory_virtual( unsigned int offset )
+{
+     return NULL;
+}
+
+static unsigned int
+system_auxram_length( void )
+{
+     return 0;
+}
+
+static void
+system_get_busid( int *ret_bus, int *ret_dev, int *ret_func )
+{
+}
+
+static int
+system_surface_data_size( void )
+{
+     return 0;
+}
+
+static void
+system_surface_data_init( CoreSurface *surface, void *data )
+{
+}
+
+static void
+system_surface_data_destroy( CoreSurface *surface, void *data )
+{
+}
+
+static void
+system_get_deviceid( unsigned int *ret_vendor_id,
+                     unsigned int *ret_device_id )
+{
+}
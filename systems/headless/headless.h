@@ -0,0 +1,70 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef __HEADLESS__HEADLESS_H__
+#define __HEADLESS__HEADLESS_H__
+
+#include <directfb.h>
+
+#include <core/layers.h>
+#include <core/screens.h>
+
+
+#define HEADLESS_WIDTH     1280
+#define HEADLESS_HEIGHT     720
+
+
+typedef struct {
+     DFBDimension        screen_size;
+
+     long long           vsync_start;      /* time of the first simulated vertical retrace */
+     long long           vsync_period;     /* microseconds between retraces, zero if flips never wait */
+
+     struct {
+          unsigned int   frames;           /* frames displayed via flips or updates */
+          long long      last;             /* time the last frame was displayed */
+          long long      total;            /* sum of the time between frames */
+          long long      min;
+          long long      max;
+     } stats;
+} DFBHeadlessShared;
+
+typedef struct {
+     DFBHeadlessShared  *shared;
+
+     CoreDFB            *core;
+
+     CoreScreen         *screen;
+     CoreLayer          *layer;
+} DFBHeadless;
+
+
+extern const ScreenFuncs       *headlessPrimaryScreenFuncs;
+extern const DisplayLayerFuncs *headlessPrimaryLayerFuncs;
+
+#endif
@@ -0,0 +1,327 @@
+/*
+   (c) Copyright 2001-2012  The world wide DirectFB Open Source Community (directfb.org)
+   (c) Copyright 2000-2004  Convergence (integrated media) GmbH
+
+   All rights reserved.
+
+   Written by Denis Oliver Kropp <dok@directfb.org>,
+              Andreas Hundt <andi@fischlustig.de>,
+              Sven Neumann <neo@directfb.org>,
+              Ville Syrjälä <syrjala@sci.fi> and
+              Claudio Ciccani <klan@users.sf.net>.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include <config.h>
+
+#include <directfb.h>
+#include <directfb_util.h>
+
+#include <direct/clock.h>
+#include <direct/messages.h>
+#include <direct/thread.h>
+
+#include <core/layers.h>
+#include <core/screens.h>
+#include <core/surface.h>
+
+#include <misc/conf.h>
+
+#include "headless.h"
+
+
+D_DEBUG_DOMAIN( Headless_Layer, "Headless/Layer", "Headless Layer" );
+
+/**********************************************************************************************************************/
+
+/*
+ * Returns the number of simulated vertical retraces since startup.
+ */
+static unsigned long
+vsync_count( const DFBHeadlessShared *shared )
+{
+     if (!shared->vsync_period)
+          return 0;
+
+     return (direct_clock_get_time( DIRECT_CLOCK_MONOTONIC ) - shared->vsync_start) / shared->vsync_period;
+}
+
+/*
+ * Sleeps until the next simulated vertical retrace, retraces are at fixed times since startup.
+ */
+static void
+vsync_wait( const DFBHeadlessShared *shared )
+{
+     long long now;
+     long long next;
+
+     if (!shared->vsync_period)
+          return;
+
+     now  = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+     next = shared->vsync_start + ((now - shared->vsync_start) / shared->vsync_period + 1) * shared->vsync_period;
+
+     D_DEBUG_AT( Headless_Layer, "  -> waiting %lld us for vsync\n", next - now );
+
+     direct_thread_sleep( next - now );
+}
+
+/*
+ * Accounts a displayed frame and dumps it if requested via "headless-dump".
+ */
+static void
+display_frame( DFBHeadless *headless,
+               CoreSurface *surface )
+{
+     DFBHeadlessShared *shared = headless->shared;
+     long long          now    = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+
+     if (shared->stats.frames) {
+          long long interval = now - shared->stats.last;
+
+          if (shared->stats.frames == 1 || interval < shared->stats.min)
+               shared->stats.min = interval;
+
+          if (interval > shared->stats.max)
+               shared->stats.max = interval;
+
+          shared->stats.total += interval;
+     }
+
+     shared->stats.frames++;
+     shared->stats.last = now;
+
+     if (dfb_config->headless_dump)
+          dfb_surface_dump_buffer( surface, CSBR_FRONT, dfb_config->headless_dump, "headless" );
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+primaryInitScreen( CoreScreen           *screen,
+                   CoreGraphicsDevice   *device,
+                   void                 *driver_data,
+                   void                 *screen_data,
+                   DFBScreenDescription *description )
+{
+     DFBHeadless *headless = driver_data;
+
+     /* Set the screen capabilities. */
+     description->caps = headless->shared->vsync_period ? DSCCAPS_VSYNC : DSCCAPS_NONE;
+
+     /* Set the screen name. */
+     direct_snputs( description->name, "Headless Primary Screen", DFB_SCREEN_DESC_NAME_LENGTH );
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryWaitVSync( CoreScreen *screen,
+                  void       *driver_data,
+                  void       *screen_data )
+{
+     DFBHeadless *headless = driver_data;
+
+     vsync_wait( headless->shared );
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryGetScreenSize( CoreScreen *screen,
+                      void       *driver_data,
+                      void       *screen_data,
+                      int        *ret_width,
+                      int        *ret_height )
+{
+     DFBHeadless *headless = driver_data;
+
+     *ret_width  = headless->shared->screen_size.w;
+     *ret_height = headless->shared->screen_size.h;
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryGetVSyncCount( CoreScreen    *screen,
+                      void          *driver_data,
+                      void          *screen_data,
+                      unsigned long *ret_count )
+{
+     DFBHeadless *headless = driver_data;
+
+     *ret_count = vsync_count( headless->shared );
+
+     return DFB_OK;
+}
+
+static const ScreenFuncs _headlessPrimaryScreenFuncs = {
+     .InitScreen     = primaryInitScreen,
+     .WaitVSync      = primaryWaitVSync,
+     .GetScreenSize  = primaryGetScreenSize,
+     .GetVSyncCount  = primaryGetVSyncCount,
+};
+
+const ScreenFuncs *headlessPrimaryScreenFuncs = &_headlessPrimaryScreenFuncs;
+
+/**********************************************************************************************************************/
+
+static DFBResult
+primaryInitLayer( CoreLayer                  *layer,
+                  void                       *driver_data,
+                  void                       *layer_data,
+                  DFBDisplayLayerDescription *description,
+                  DFBDisplayLayerConfig      *config,
+                  DFBColorAdjustment         *adjustment )
+{
+     DFBHeadless *headless = driver_data;
+
+     D_DEBUG_AT( Headless_Layer, "%s()\n", __FUNCTION__ );
+
+     /* set capabilities and type */
+     description->caps             = DLCAPS_SURFACE;
+     description->type             = DLTF_GRAPHICS;
+     description->surface_caps     = DSCAPS_SYSTEMONLY;
+     description->surface_accessor = CSAID_CPU;
+
+     /* set name */
+     direct_snputs( description->name, "Headless Primary Layer", DFB_DISPLAY_LAYER_DESC_NAME_LENGTH );
+
+     /* fill out the default configuration */
+     config->flags       = DLCONF_WIDTH       | DLCONF_HEIGHT |
+                           DLCONF_PIXELFORMAT | DLCONF_BUFFERMODE;
+     config->buffermode  = DLBM_TRIPLE;
+     config->width       = headless->shared->screen_size.w;
+     config->height      = headless->shared->screen_size.h;
+
+     if (dfb_config->mode.format != DSPF_UNKNOWN)
+          config->pixelformat = dfb_config->mode.format;
+     else if (dfb_config->mode.depth > 0)
+          config->pixelformat = dfb_pixelformat_for_depth( dfb_config->mode.depth );
+     else
+          config->pixelformat = DSPF_ARGB;
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryTestRegion( CoreLayer                  *layer,
+                   void                       *driver_data,
+                   void                       *layer_data,
+                   CoreLayerRegionConfig      *config,
+                   CoreLayerRegionConfigFlags *failed )
+{
+     CoreLayerRegionConfigFlags fail = CLRCF_NONE;
+
+     switch (config->buffermode) {
+          case DLBM_FRONTONLY:
+          case DLBM_BACKSYSTEM:
+          case DLBM_BACKVIDEO:
+          case DLBM_TRIPLE:
+               break;
+
+          default:
+               fail |= CLRCF_BUFFERMODE;
+               break;
+     }
+
+     if (config->options)
+          fail |= CLRCF_OPTIONS;
+
+     if (failed)
+          *failed = fail;
+
+     if (fail)
+          return DFB_UNSUPPORTED;
+
+     return DFB_OK;
+}
+
+static DFBResult
+primarySetRegion( CoreLayer                  *layer,
+                  void                       *driver_data,
+                  void                       *layer_data,
+                  void                       *region_data,
+                  CoreLayerRegionConfig      *config,
+                  CoreLayerRegionConfigFlags  updated,
+                  CoreSurface                *surface,
+                  CorePalette                *palette,
+                  CoreSurfaceBufferLock      *left_lock,
+                  CoreSurfaceBufferLock      *right_lock )
+{
+     D_DEBUG_AT( Headless_Layer, "%s( %dx%d %s, buffermode %d )\n", __FUNCTION__, config->width, config->height,
+                 dfb_pixelformat_name( config->format ), config->buffermode );
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryFlipRegion( CoreLayer             *layer,
+                   void                  *driver_data,
+                   void                  *layer_data,
+                   void                  *region_data,
+                   CoreSurface           *surface,
+                   DFBSurfaceFlipFlags    flags,
+                   CoreSurfaceBufferLock *left_lock,
+                   CoreSurfaceBufferLock *right_lock )
+{
+     DFBHeadless *headless = driver_data;
+
+     D_DEBUG_AT( Headless_Layer, "%s( 0x%08x )\n", __FUNCTION__, flags );
+
+     /* The simulated scanout switches buffers at the vertical retrace. */
+     if (flags & (DSFLIP_WAIT | DSFLIP_ONSYNC))
+          vsync_wait( headless->shared );
+
+     dfb_surface_flip( surface, false );
+
+     dfb_surface_notify_display2( surface, left_lock->allocation->index );
+
+     display_frame( headless, surface );
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryUpdateRegion( CoreLayer             *layer,
+                     void                  *driver_data,
+                     void                  *layer_data,
+                     void                  *region_data,
+                     CoreSurface           *surface,
+                     const DFBRegion       *left_update,
+                     CoreSurfaceBufferLock *left_lock,
+                     const DFBRegion       *right_update,
+                     CoreSurfaceBufferLock *right_lock )
+{
+     DFBHeadless *headless = driver_data;
+
+     D_DEBUG_AT( Headless_Layer, "%s()\n", __FUNCTION__ );
+
+     display_frame( headless, surface );
+
+     return DFB_OK;
+}
+
+static const DisplayLayerFuncs _headlessPrimaryLayerFuncs = {
+     .InitLayer      = primaryInitLayer,
+     .TestRegion     = primaryTestRegion,
+     .SetRegion      = primarySetRegion,
+     .FlipRegion     = primaryFlipRegion,
+     .UpdateRegion   = primaryUpdateRegion,
+};
+
+const DisplayLayerFuncs *headlessPrimaryLayerFuncs = &_headlessPrimaryLayerFuncs;
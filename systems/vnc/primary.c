@@ -161,6 +161,26 @@ primaryInitScreen( CoreScreen           *screen,
      vnc->rfb_screen->serverFormat.greenMax   = 255;
      vnc->rfb_screen->serverFormat.blueMax    = 255;
 
+     if (dfb_config->vnc_tile_hashing) {
+          vnc->tile_cols   = (shared->screen_size.w + VNC_TILE_SIZE - 1) / VNC_TILE_SIZE;
+          vnc->tile_rows   = (shared->screen_size.h + VNC_TILE_SIZE - 1) / VNC_TILE_SIZE;
+          vnc->tile_hashes = D_CALLOC( vnc->tile_cols * vnc->tile_rows, sizeof(u64) );
+          vnc->tile_states = D_CALLOC( vnc->tile_cols * vnc->tile_rows, sizeof(u8) );
+          if (!vnc->tile_hashes || !vnc->tile_states) {
+               D_OOM();
+
+               if (vnc->tile_hashes) {
+                    D_FREE( vnc->tile_hashes );
+                    vnc->tile_hashes = NULL;
+               }
+
+               if (vnc->tile_states) {
+                    D_FREE( vnc->tile_states );
+                    vnc->tile_states = NULL;
+               }
+          }
+     }
+
      rfbRunEventLoop( vnc->rfb_screen, -1, TRUE );
 
      return DFB_OK;
@@ -178,6 +198,16 @@ primaryShutdownScreen( CoreScreen *screen,
 
      dfb_surface_unlock_buffer( shared->screen_surface, &vnc->buffer_lock );
 
+     if (vnc->tile_hashes) {
+          D_FREE( vnc->tile_hashes );
+          vnc->tile_hashes = NULL;
+     }
+
+     if (vnc->tile_states) {
+          D_FREE( vnc->tile_states );
+          vnc->tile_states = NULL;
+     }
+
      return DFB_OK;
 }
 
@@ -300,48 +330,102 @@ primaryAddRegion( CoreLayer             *layer,
      return DFB_OK;
 }
 
+/*
+ * Maps an update of the layer surface to the screen, scaling outwards if needed.
+ */
+static bool
+MapUpdate( const VNCLayerData *data,
+           const DFBRegion    *update,
+           DFBRegion          *ret_region )
+{
+     const DFBRectangle *src    = &data->config.source;
+     const DFBRectangle *dst    = &data->config.dest;
+     DFBRegion           region = DFB_REGION_INIT_FROM_RECTANGLE( src );
+
+     if (!src->w || !src->h || !dfb_region_region_intersect( &region, update ))
+          return false;
+
+     ret_region->x1 = dst->x + (region.x1 - src->x) * dst->w / src->w;
+     ret_region->y1 = dst->y + (region.y1 - src->y) * dst->h / src->h;
+     ret_region->x2 = dst->x + ((region.x2 + 1 - src->x) * dst->w + src->w - 1) / src->w - 1;
+     ret_region->y2 = dst->y + ((region.y2 + 1 - src->y) * dst->h + src->h - 1) / src->h - 1;
+
+     return ret_region->x1 <= ret_region->x2 && ret_region->y1 <= ret_region->y2;
+}
+
+/*
+ * Copies the updated parts of the layer to the screen and marks them as modified.
+ *
+ * The updates are in layer surface coordinates, NULL updates the whole screen.
+ */
 static DFBResult
 UpdateScreen( DFBVNC                *vnc,
               VNCLayerData          *data,
-              const DFBRectangle    *update,
+              const DFBRegion       *updates,
+              unsigned int           num_updates,
               CoreSurfaceBufferLock *lock )
 {
-     DFBVNCShared *shared = vnc->shared;
-     DFBRegion     clip   = { 0, 0, shared->screen_size.w - 1, shared->screen_size.h - 1};
-     CardState     state;
+     DirectResult              ret;
+     unsigned int              i;
+     DFBVNCShared             *shared = vnc->shared;
+     DFBRegion                 screen = { 0, 0, shared->screen_size.w - 1, shared->screen_size.h - 1 };
+     CardState                 state;
+     DFBVNCMarkRectAsModified  mark;
 
-     D_DEBUG_AT( VNC_Layer, "%s()\n", __FUNCTION__ );
+     D_DEBUG_AT( VNC_Layer, "%s( %u )\n", __FUNCTION__, updates ? num_updates : 0 );
+
+     mark.num_regions = 0;
+
+     if (updates) {
+          for (i=0; i<num_updates; i++) {
+               DFBRegion region;
 
-     if (update) {
-          if (!dfb_region_rectangle_intersect( &clip, update )) {
+               if (!MapUpdate( data, &updates[i], &region ) || !dfb_region_region_intersect( &region, &screen ))
+                    continue;
+
+               D_DEBUG_AT( VNC_Layer, "  -> damage %4d,%4d-%4dx%4d\n", DFB_RECTANGLE_VALS_FROM_REGION( &region ) );
+
+               /* Merge the remaining updates if the damage list is full. */
+               if (mark.num_regions == VNC_MAX_DAMAGE)
+                    dfb_region_region_union( &mark.regions[VNC_MAX_DAMAGE-1], &region );
+               else
+                    mark.regions[mark.num_regions++] = region;
+          }
+
+          if (!mark.num_regions) {
                D_DEBUG_AT( VNC_Layer, "  -> update not intersecting with screen area!\n" );
                return DFB_OK;
           }
      }
+     else
+          mark.regions[mark.num_regions++] = screen;
 
      dfb_state_init( &state, vnc->core );
 
      state.destination = shared->screen_surface;
      state.source      = lock ? lock->buffer->surface : NULL;
-     state.clip        = clip;
-
-     if (!lock ||
-         data->config.dest.x != 0 || data->config.dest.y != 0 ||
-         data->config.dest.w != shared->screen_size.w ||
-         data->config.dest.h != shared->screen_size.h)
-     {
-          DFBRectangle rect = {
-               0, 0, shared->screen_size.w, shared->screen_size.h
-          };
-
-          dfb_gfxcard_fillrectangles( &rect, 1, &state );
-     }
 
-     if (lock) {
-          DFBRectangle src = data->config.source;
-          DFBRectangle dst = data->config.dest;
+     /* Only copy the damaged parts, clipping limits the stretched blit accordingly. */
+     for (i=0; i<mark.num_regions; i++) {
+          state.clip      = mark.regions[i];
+          state.modified |= SMF_CLIP;
+
+          if (!lock ||
+              data->config.dest.x != 0 || data->config.dest.y != 0 ||
+              data->config.dest.w != shared->screen_size.w ||
+              data->config.dest.h != shared->screen_size.h)
+          {
+               DFBRectangle rect = DFB_RECTANGLE_INIT_FROM_REGION( &mark.regions[i] );
 
-          dfb_gfxcard_stretchblit( &src, &dst, &state );
+               dfb_gfxcard_fillrectangles( &rect, 1, &state );
+          }
+
+          if (lock) {
+               DFBRectangle src = data->config.source;
+               DFBRectangle dst = data->config.dest;
+
+               dfb_gfxcard_batchstretchblit( &src, &dst, 1, &state );
+          }
      }
 
      dfb_gfxcard_sync();
@@ -351,12 +435,6 @@ UpdateScreen( DFBVNC                *vnc,
 
      dfb_state_destroy( &state );
 
-
-     DirectResult             ret;
-     DFBVNCMarkRectAsModified mark;
-
-     mark.region = clip;
-
      ret = fusion_call_execute2( &shared->call, FCEF_ONEWAY,
                                  VNC_MARK_RECT_AS_MODIFIED, &mark, sizeof(mark), NULL );
      if (ret) {
@@ -387,7 +465,7 @@ primarySetRegion( CoreLayer                  *layer,
      data->config = *config;
 
      if (data->shown)
-          return UpdateScreen( vnc, data, NULL, left_lock );
+          return UpdateScreen( vnc, data, NULL, 0, left_lock );
 
      return DFB_OK;
 }
@@ -405,7 +483,7 @@ primaryRemoveRegion( CoreLayer             *layer,
 
      data->shown = false;
 
-     return UpdateScreen( vnc, data, NULL, NULL );
+     return UpdateScreen( vnc, data, NULL, 0, NULL );
 }
 
 static DFBResult
@@ -417,17 +495,43 @@ primaryFlipRegion( CoreLayer             *layer,
                    DFBSurfaceFlipFlags    flags,
                    CoreSurfaceBufferLock *left_lock,
                    CoreSurfaceBufferLock *right_lock )
+{
+     DFBVNC       *vnc    = driver_data;
+     VNCLayerData *data   = layer_data;
+     DFBRegion     update = DFB_REGION_INIT_FROM_RECTANGLE( &data->config.source );
+
+     D_DEBUG_AT( VNC_Layer, "%s()\n", __FUNCTION__ );
+
+     dfb_surface_flip( surface, false );
+
+     data->shown = true;
+
+     /* Swapping without known damage updates the whole source area. */
+     return UpdateScreen( vnc, data, &update, 1, left_lock );
+}
+
+static DFBResult
+primaryFlipUpdate( CoreLayer             *layer,
+                   void                  *driver_data,
+                   void                  *layer_data,
+                   void                  *region_data,
+                   CoreSurface           *surface,
+                   DFBSurfaceFlipFlags    flags,
+                   const DFBRegion       *damage,
+                   unsigned int           num_damage,
+                   CoreSurfaceBufferLock *left_lock )
 {
      DFBVNC       *vnc  = driver_data;
      VNCLayerData *data = layer_data;
 
-     D_DEBUG_AT( VNC_Layer, "%s()\n", __FUNCTION__ );
+     D_DEBUG_AT( VNC_Layer, "%s( %u )\n", __FUNCTION__, num_damage );
 
      dfb_surface_flip( surface, false );
 
      data->shown = true;
 
-     return UpdateScreen( vnc, data, &data->config.dest, left_lock );
+     /* Only copy and mark what has changed since the previous flip. */
+     return UpdateScreen( vnc, data, damage, num_damage, left_lock );
 }
 
 static DFBResult
@@ -443,17 +547,16 @@ primaryUpdateRegion( CoreLayer             *layer,
 {
      DFBVNC       *vnc    = driver_data;
      VNCLayerData *data   = layer_data;
-
-     DFBRectangle  update = data->config.dest;
+     DFBRegion     update = DFB_REGION_INIT_FROM_RECTANGLE( &data->config.source );
 
      D_DEBUG_AT( VNC_Layer, "%s()\n", __FUNCTION__ );
 
-     if (left_update && !dfb_rectangle_intersect_by_region( &update, left_update ))
-          return DFB_OK;
+     if (left_update)
+          update = *left_update;
 
      data->shown = true;
 
-     return UpdateScreen( vnc, data, &update, left_lock );
+     return UpdateScreen( vnc, data, &update, 1, left_lock );
 }
 
 static const DisplayLayerFuncs _vncPrimaryLayerFuncs = {
@@ -467,6 +570,7 @@ static const DisplayLayerFuncs _vncPrimaryLayerFuncs = {
      .RemoveRegion      = primaryRemoveRegion,
      .FlipRegion        = primaryFlipRegion,
      .UpdateRegion      = primaryUpdateRegion,
+     .FlipUpdate        = primaryFlipUpdate,
 };
 
 const DisplayLayerFuncs *vncPrimaryLayerFuncs = &_vncPrimaryLayerFuncs;
@@ -297,11 +297,131 @@ system_get_deviceid( unsigned int *ret_vendor_id,
 
 /**********************************************************************************************************************/
 
+static u64
+HashTile( DFBVNC *vnc,
+          int     col,
+          int     row )
+{
+     int  x, y;
+     int  x1   = col * VNC_TILE_SIZE;
+     int  y1   = row * VNC_TILE_SIZE;
+     int  w    = MIN( VNC_TILE_SIZE, vnc->shared->screen_size.w - x1 );
+     int  h    = MIN( VNC_TILE_SIZE, vnc->shared->screen_size.h - y1 );
+     u64  hash = 0xcbf29ce484222325ULL;
+
+     /* FNV-1a over the ARGB pixels of the tile. */
+     for (y=0; y<h; y++) {
+          const u32 *src = (const u32*)((u8*) vnc->buffer_lock.addr + (y1 + y) * vnc->buffer_lock.pitch) + x1;
+
+          for (x=0; x<w; x++)
+               hash = (hash ^ src[x]) * 0x100000001b3ULL;
+     }
+
+     return hash;
+}
+
+static void
+MarkTiles( DFBVNC          *vnc,
+           const DFBRegion *region,
+           int              row,
+           int              col1,
+           int              col2 )
+{
+     int x1 = MAX( region->x1, col1 * VNC_TILE_SIZE );
+     int y1 = MAX( region->y1, row  * VNC_TILE_SIZE );
+     int x2 = MIN( region->x2, (col2 + 1) * VNC_TILE_SIZE - 1 );
+     int y2 = MIN( region->y2, (row  + 1) * VNC_TILE_SIZE - 1 );
+
+     rfbMarkRectAsModified( vnc->rfb_screen, x1, y1, x2 + 1, y2 + 1 );
+}
+
+/*
+ * Marks only the tiles within the regions whose content has changed since the last update.
+ *
+ * Each tile is hashed once per mark, so regions sharing a tile all see whether it has changed.
+ */
+static void
+MarkChangedTiles( DFBVNC                         *vnc,
+                  const DFBVNCMarkRectAsModified *mark )
+{
+     unsigned int i;
+     int          col, row;
+
+     for (i=0; i<mark->num_regions; i++) {
+          const DFBRegion *region = &mark->regions[i];
+
+          for (row = region->y1 / VNC_TILE_SIZE; row <= region->y2 / VNC_TILE_SIZE; row++) {
+               for (col = region->x1 / VNC_TILE_SIZE; col <= region->x2 / VNC_TILE_SIZE; col++) {
+                    u8  *state  = &vnc->tile_states[row * vnc->tile_cols + col];
+                    u64 *stored = &vnc->tile_hashes[row * vnc->tile_cols + col];
+                    u64  hash;
+
+                    if (*state != VNC_TILE_UNKNOWN)
+                         continue;
+
+                    hash = HashTile( vnc, col, row );
+
+                    if (hash != *stored) {
+                         *stored = hash;
+                         *state  = VNC_TILE_CHANGED;
+                    }
+                    else
+                         *state = VNC_TILE_UNCHANGED;
+               }
+          }
+     }
+
+     for (i=0; i<mark->num_regions; i++) {
+          const DFBRegion *region = &mark->regions[i];
+
+          for (row = region->y1 / VNC_TILE_SIZE; row <= region->y2 / VNC_TILE_SIZE; row++) {
+               int start = -1;
+
+               for (col = region->x1 / VNC_TILE_SIZE; col <= region->x2 / VNC_TILE_SIZE; col++) {
+                    if (vnc->tile_states[row * vnc->tile_cols + col] == VNC_TILE_CHANGED) {
+                         if (start < 0)
+                              start = col;
+                    }
+                    else if (start >= 0) {
+                         MarkTiles( vnc, region, row, start, col - 1 );
+
+                         start = -1;
+                    }
+               }
+
+               if (start >= 0)
+                    MarkTiles( vnc, region, row, start, col - 1 );
+          }
+     }
+
+     /* Forget the states for the next mark. */
+     for (i=0; i<mark->num_regions; i++) {
+          const DFBRegion *region = &mark->regions[i];
+
+          for (row = region->y1 / VNC_TILE_SIZE; row <= region->y2 / VNC_TILE_SIZE; row++)
+               for (col = region->x1 / VNC_TILE_SIZE; col <= region->x2 / VNC_TILE_SIZE; col++)
+                    vnc->tile_states[row * vnc->tile_cols + col] = VNC_TILE_UNKNOWN;
+     }
+}
+
 static int
 VNC_Dispatch_MarkRectAsModified( DFBVNC                   *vnc,
                                  DFBVNCMarkRectAsModified *mark )
 {
-     rfbMarkRectAsModified( vnc->rfb_screen, mark->region.x1, mark->region.y1, mark->region.x2 + 1, mark->region.y2 + 1 );
+     unsigned int i;
+
+     D_ASSERT( mark->num_regions <= VNC_MAX_DAMAGE );
+
+     if (vnc->tile_hashes) {
+          MarkChangedTiles( vnc, mark );
+          return 0;
+     }
+
+     for (i=0; i<mark->num_regions; i++) {
+          const DFBRegion *region = &mark->regions[i];
+
+          rfbMarkRectAsModified( vnc->rfb_screen, region->x1, region->y1, region->x2 + 1, region->y2 + 1 );
+     }
 
      return 0;
 }
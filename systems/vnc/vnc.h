@@ -40,6 +40,10 @@
 #include <core/screens.h>
 
 
+#define VNC_MAX_DAMAGE   8      /* maximum number of rectangles marked at once */
+#define VNC_TILE_SIZE   32      /* width and height of tiles compared via "vnc-tile-hashing" */
+
+
 typedef struct {
      FusionCall          call;
 
@@ -57,14 +61,26 @@ typedef struct {
 
      rfbScreenInfoPtr       rfb_screen;
      CoreSurfaceBufferLock  buffer_lock;
+
+     u64                   *tile_hashes;     /* content hash per tile of the screen, master only */
+     u8                    *tile_states;     /* per tile while processing a mark, see VNCTileState */
+     int                    tile_cols;
+     int                    tile_rows;
 } DFBVNC;
 
+typedef enum {
+     VNC_TILE_UNKNOWN,                       /* not hashed yet for the current mark */
+     VNC_TILE_UNCHANGED,
+     VNC_TILE_CHANGED
+} VNCTileState;
+
 typedef enum {
      VNC_MARK_RECT_AS_MODIFIED,
 } DFBVNCCall;
 
 typedef struct {
-     DFBRegion           region;
+     unsigned int        num_regions;
+     DFBRegion           regions[VNC_MAX_DAMAGE];
 } DFBVNCMarkRectAsModified;
 
 #endif
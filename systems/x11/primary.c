@@ -106,10 +106,14 @@ dfb_x11_destroy_window( DFBX11 *x11, X11LayerData *lds )
 
 static DFBResult
 dfb_x11_update_screen( DFBX11 *x11, X11LayerData *lds, const DFBRegion *left_region, const DFBRegion *right_region,
+                       const DFBRegion *damage, unsigned int num_damage,
                        CoreSurfaceBufferLock *left_lock, CoreSurfaceBufferLock *right_lock )
 {
      int           ret;
+     unsigned int  i;
      DFBX11Shared *shared = x11->shared;
+     DFBRegion     regions[X11_MAX_DAMAGE];
+     DFBUpdates    updates;
 
      DFB_REGION_ASSERT( left_region );
      D_ASSERT( left_lock != NULL );
@@ -118,10 +122,30 @@ dfb_x11_update_screen( DFBX11 *x11, X11LayerData *lds, const DFBRegion *left_reg
      if (shared->update.left_lock.buffer)
           return DFB_OK;
 
+     dfb_updates_init( &updates, regions, X11_MAX_DAMAGE );
+
+     /* Coalesce the damage to a few boxes within the updated region. */
+     if (num_damage && !(lds->config.options & DLOP_STEREO)) {
+          for (i=0; i<num_damage; i++) {
+               DFBRegion region = damage[i];
+
+               if (dfb_region_region_intersect( &region, left_region ))
+                    dfb_updates_add( &updates, &region );
+          }
+
+          if (!updates.num_regions)
+               return DFB_OK;
+     }
+
      shared->update.xw           = lds->xw;
      shared->update.left_region  = *left_region;
      shared->update.left_lock    = *left_lock;
 
+     shared->update.num_damage   = updates.num_regions;
+
+     for (i=0; i<updates.num_regions; i++)
+          shared->update.damage[i] = regions[i];
+
      shared->update.stereo       = (lds->config.options & DLOP_STEREO);
 
      if (shared->update.stereo) {
@@ -629,8 +653,39 @@ primaryFlipRegion( CoreLayer             *layer,
      if (lds->config.options & DLOP_STEREO)
           dfb_surface_notify_display2( surface, right_lock->allocation->index );
 
-     dfb_x11_update_screen( x11, lds, &region, &region, left_lock, right_lock );
+     dfb_x11_update_screen( x11, lds, &region, &region, NULL, 0, left_lock, right_lock );
+
+
+     return DFB_OK;
+}
+
+static DFBResult
+primaryFlipUpdate( CoreLayer             *layer,
+                   void                  *driver_data,
+                   void                  *layer_data,
+                   void                  *region_data,
+                   CoreSurface           *surface,
+                   DFBSurfaceFlipFlags    flags,
+                   const DFBRegion       *damage,
+                   unsigned int           num_damage,
+                   CoreSurfaceBufferLock *left_lock )
+{
+     DFBX11       *x11 = driver_data;
+     X11LayerData *lds = layer_data;
+
+     DFBRegion  region = DFB_REGION_INIT_FROM_DIMENSION( &surface->config.size );
+
+     D_DEBUG_AT( X11_Layer, "%s( %u )\n", __FUNCTION__, num_damage );
+
+     if (x11->shared->x_error)
+          return DFB_FAILURE;
+
+     dfb_surface_flip( surface, false );
+
+     dfb_surface_notify_display2( surface, left_lock->allocation->index );
 
+     /* Only convert and put what has changed since the previous flip. */
+     dfb_x11_update_screen( x11, lds, &region, &region, damage, num_damage, left_lock, NULL );
 
      return DFB_OK;
 }
@@ -663,7 +718,7 @@ primaryUpdateRegion( CoreLayer             *layer,
      if (right_update && !dfb_region_region_intersect( &right_region, right_update ))
           return DFB_OK;
 
-     dfb_x11_update_screen( x11, lds, &left_region, &right_region, left_lock, right_lock );
+     dfb_x11_update_screen( x11, lds, &left_region, &right_region, NULL, 0, left_lock, right_lock );
 
 
      return DFB_OK;
@@ -681,28 +736,101 @@ static DisplayLayerFuncs primaryLayerFuncs = {
      .RemoveRegion   = primaryRemoveRegion,
      .FlipRegion     = primaryFlipRegion,
      .UpdateRegion   = primaryUpdateRegion,
+     .FlipUpdate     = primaryFlipUpdate,
 };
 
 DisplayLayerFuncs *x11PrimaryLayerFuncs = &primaryLayerFuncs;
 
 /******************************************************************************/
 
-static DFBResult
-update_screen( DFBX11 *x11, const DFBRectangle *clip, CoreSurfaceBufferLock *lock, XWindow *xw )
+static void
+convert_rect( XWindow *xw, XImage *ximage, unsigned int offset, const DFBRectangle *rect, CoreSurfaceBufferLock *lock )
 {
      void                  *dst;
      void                  *src;
+     CoreSurfaceAllocation *allocation = lock->allocation;
+     DFBRectangle           aligned    = *rect;
+
+     /* Planar formats locate their chroma from the first line, YUY2/UYVY need whole macro pixels. */
+     if (DFB_PLANAR_PIXELFORMAT( allocation->config.format )) {
+          aligned.w += aligned.x;
+          aligned.h += aligned.y;
+          aligned.x  = 0;
+          aligned.y  = 0;
+     }
+     else if ((aligned.x & 1) && (allocation->config.format == DSPF_YUY2 ||
+                                  allocation->config.format == DSPF_UYVY)) {
+          aligned.x--;
+          aligned.w++;
+     }
+
+     rect = &aligned;
+
+     dst = xw->virtualscreen + rect->x * xw->bpp + (rect->y + offset) * ximage->bytes_per_line;
+     src = lock->addr + DFB_BYTES_PER_LINE( allocation->config.format, rect->x ) + rect->y * lock->pitch;
+
+     switch (xw->depth) {
+          case 32:
+               dfb_convert_to_argb( allocation->config.format, src, lock->pitch,
+                                    allocation->config.size.h, dst, ximage->bytes_per_line, rect->w, rect->h );
+               break;
+
+          case 24:
+               dfb_convert_to_rgb32( allocation->config.format, src, lock->pitch,
+                                     allocation->config.size.h, dst, ximage->bytes_per_line, rect->w, rect->h );
+               break;
+
+          case 16:
+               if (allocation->config.format == DSPF_LUT8) {
+                    int width = rect->w; int height = rect->h;
+                    const u8    *src8    = src;
+                    u16         *dst16   = dst;
+                    CorePalette *palette = allocation->surface->palette;//FIXME
+                    int          x;
+                    while (height--) {
+
+                         for (x=0; x<width; x++) {
+                              DFBColor color = palette->entries[src8[x]];
+                              dst16[x] = PIXEL_RGB16( color.r, color.g, color.b );
+                         }
+
+                         src8  += lock->pitch;
+                         dst16 += ximage->bytes_per_line / 2;
+                    }
+               }
+               else {
+               dfb_convert_to_rgb16( allocation->config.format, src, lock->pitch,
+                                     allocation->config.size.h, dst, ximage->bytes_per_line, rect->w, rect->h );
+               }
+               break;
+
+          case 15:
+               dfb_convert_to_rgb555( allocation->config.format, src, lock->pitch,
+                                      allocation->config.size.h, dst, ximage->bytes_per_line, rect->w, rect->h );
+               break;
+
+          default:
+               D_ONCE( "unsupported depth %d", xw->depth );
+     }
+}
+
+static DFBResult
+update_screen( DFBX11 *x11, const DFBRectangle *clips, unsigned int num_clips, CoreSurfaceBufferLock *lock, XWindow *xw )
+{
+     unsigned int           i;
+     unsigned int           num    = 0;
      unsigned int           offset = 0;
      XImage                *ximage;
      CoreSurfaceAllocation *allocation;
      DFBX11Shared          *shared;
-     DFBRectangle           rect;
+     DFBRectangle           rects[X11_MAX_DAMAGE];
      bool                   direct = false;
 
      D_ASSERT( x11 != NULL );
-     DFB_RECTANGLE_ASSERT( clip );
+     D_ASSERT( clips != NULL );
+     D_ASSERT( num_clips > 0 && num_clips <= X11_MAX_DAMAGE );
 
-     D_DEBUG_AT( X11_Update, "%s( %4d,%4d-%4dx%4d )\n", __FUNCTION__, DFB_RECTANGLE_VALS( clip ) );
+     D_DEBUG_AT( X11_Update, "%s( %4d,%4d-%4dx%4d [%u] )\n", __FUNCTION__, DFB_RECTANGLE_VALS( &clips[0] ), num_clips );
 
      CORE_SURFACE_BUFFER_LOCK_ASSERT( lock );
 
@@ -720,17 +848,28 @@ update_screen( DFBX11 *x11, const DFBRectangle *clip, CoreSurfaceBufferLock *loc
      CORE_SURFACE_ALLOCATION_ASSERT( allocation );
 
 
-     rect.x = rect.y = 0;
-     rect.w = xw->width;
-     rect.h = xw->height;
+     for (i=0; i<num_clips; i++) {
+          DFBRectangle *rect = &rects[num];
+
+          DFB_RECTANGLE_ASSERT( &clips[i] );
 
-     if (!dfb_rectangle_intersect( &rect, clip )) {
+          rect->x = rect->y = 0;
+          rect->w = xw->width;
+          rect->h = xw->height;
+
+          if (!dfb_rectangle_intersect( rect, &clips[i] ))
+               continue;
+
+          D_DEBUG_AT( X11_Update, "  -> %4d,%4d-%4dx%4d\n", DFB_RECTANGLE_VALS( rect ) );
+
+          num++;
+     }
+
+     if (!num) {
           XUnlockDisplay( x11->display );
           return DFB_OK;
      }
 
-     D_DEBUG_AT( X11_Update, "  -> %4d,%4d-%4dx%4d\n", DFB_RECTANGLE_VALS( &rect ) );
-
 #ifdef USE_GLX
      /* Check for GLX allocation... */
      if (allocation->pool == shared->glx_pool && lock->handle) {
@@ -747,8 +886,9 @@ update_screen( DFBX11 *x11, const DFBRectangle *clip, CoreSurfaceBufferLock *loc
 
           glXWaitGL();
 
-          XCopyArea( x11->display, pixmap->pixmap, xw->window, xw->gc,
-                     rect.x, rect.y, rect.w, rect.h, rect.x, rect.y );
+          for (i=0; i<num; i++)
+               XCopyArea( x11->display, pixmap->pixmap, xw->window, xw->gc,
+                          rects[i].x, rects[i].y, rects[i].w, rects[i].h, rects[i].x, rects[i].y );
 
           glXWaitX();
 
@@ -770,79 +910,43 @@ update_screen( DFBX11 *x11, const DFBRectangle *clip, CoreSurfaceBufferLock *loc
           direct = true;
      }
      else {
-          /* ...or copy or convert into XShmImage or XImage allocated with the XWindow. */
+          /*
+           * ...or copy or convert into XShmImage or XImage allocated with the XWindow.
+           *
+           * Its two halves are used alternately, so converting this update
+           * overlaps with the X server still reading the previous one.
+           */
           ximage = xw->ximage;
           offset = xw->ximage_offset;
 
           xw->ximage_offset = (offset ? 0 : ximage->height / 2);
 
-          /* make sure the 16-bit input formats are properly 2-pixel-clipped */
-          switch (allocation->config.format) {
-               case DSPF_I420:
-               case DSPF_YV12:
-               case DSPF_NV12:
-               case DSPF_NV21:
-                    if (rect.y & 1) {
-                         rect.y--;
-                         rect.h++;
-                    }
-                    /* fall through */
-               case DSPF_YUY2:
-               case DSPF_UYVY:
-               case DSPF_NV16:
-                    if (rect.x & 1) {
-                         rect.x--;
-                         rect.w++;
-                    }
-               default: /* no action */
-                    break;
-          }
-
-          dst = xw->virtualscreen + rect.x * xw->bpp + (rect.y + offset) * ximage->bytes_per_line;
-          src = lock->addr + DFB_BYTES_PER_LINE( allocation->config.format, rect.x ) + rect.y * lock->pitch;
-
-          switch (xw->depth) {
-               case 32:
-                    dfb_convert_to_argb( allocation->config.format, src, lock->pitch,
-                                         allocation->config.size.h, dst, ximage->bytes_per_line, rect.w, rect.h );
-                    break;
-
-               case 24:
-                    dfb_convert_to_rgb32( allocation->config.format, src, lock->pitch,
-                                          allocation->config.size.h, dst, ximage->bytes_per_line, rect.w, rect.h );
-                    break;
-
-               case 16:
-                    if (allocation->config.format == DSPF_LUT8) {
-                         int width = rect.w; int height = rect.h;
-                         const u8    *src8    = src;
-                         u16         *dst16   = dst;
-                         CorePalette *palette = allocation->surface->palette;//FIXME
-                         int          x;
-                         while (height--) {
-
-                              for (x=0; x<width; x++) {
-                                   DFBColor color = palette->entries[src8[x]];
-                                   dst16[x] = PIXEL_RGB16( color.r, color.g, color.b );
-                              }
-
-                              src8  += lock->pitch;
-                              dst16 += ximage->bytes_per_line / 2;
+          for (i=0; i<num; i++) {
+               DFBRectangle *rect = &rects[i];
+
+               /* make sure the 16-bit input formats are properly 2-pixel-clipped */
+               switch (allocation->config.format) {
+                    case DSPF_I420:
+                    case DSPF_YV12:
+                    case DSPF_NV12:
+                    case DSPF_NV21:
+                         if (rect->y & 1) {
+                              rect->y--;
+                              rect->h++;
                          }
-                    }
-                    else {
-                    dfb_convert_to_rgb16( allocation->config.format, src, lock->pitch,
-                                          allocation->config.size.h, dst, ximage->bytes_per_line, rect.w, rect.h );
-                    }
-                    break;
-
-               case 15:
-                    dfb_convert_to_rgb555( allocation->config.format, src, lock->pitch,
-                                           allocation->config.size.h, dst, ximage->bytes_per_line, rect.w, rect.h );
-                    break;
+                         /* fall through */
+                    case DSPF_YUY2:
+                    case DSPF_UYVY:
+                    case DSPF_NV16:
+                         if (rect->x & 1) {
+                              rect->x--;
+                              rect->w++;
+                         }
+                    default: /* no action */
+                         break;
+               }
 
-               default:
-                    D_ONCE( "unsupported depth %d", xw->depth );
+               convert_rect( xw, ximage, offset, rect, lock );
           }
      }
 
@@ -853,18 +957,22 @@ update_screen( DFBX11 *x11, const DFBRectangle *clip, CoreSurfaceBufferLock *loc
      XSync( x11->display, False );
 
      /* ...and immediately queue or send the next! */
-     if (x11->use_shm) {
-          /* Just queue the command, it's XShm :) */
-          XShmPutImage( xw->display, xw->window, xw->gc, ximage,
-                        rect.x, rect.y + offset, rect.x, rect.y, rect.w, rect.h, False );
+     for (i=0; i<num; i++) {
+          const DFBRectangle *rect = &rects[i];
+
+          if (x11->use_shm)
+               /* Just queue the command, it's XShm :) */
+               XShmPutImage( xw->display, xw->window, xw->gc, ximage,
+                             rect->x, rect->y + offset, rect->x, rect->y, rect->w, rect->h, False );
+          else
+               /* Initiate transfer of buffer... */
+               XPutImage( xw->display, xw->window, xw->gc, ximage,
+                          rect->x, rect->y + offset, rect->x, rect->y, rect->w, rect->h );
+     }
 
-          /* Make sure the queue has really happened! */
+     /* Make sure the queue has really happened! */
+     if (x11->use_shm)
           XFlush( x11->display );
-     }
-     else
-          /* Initiate transfer of buffer... */
-          XPutImage( xw->display, xw->window, xw->gc, ximage,
-                     rect.x, rect.y + offset, rect.x, rect.y, rect.w, rect.h );
 
      /* Wait for display if single buffered and not converted... */
      if (direct && !(allocation->config.caps & DSCAPS_FLIPPING))
@@ -1141,12 +1249,20 @@ dfb_x11_update_screen_handler( DFBX11 *x11, UpdateScreenData *data )
                update_stereo( x11, &left_rect, &right_rect, &data->left_lock, &data->right_lock, data->xw );
      }
      else {
-          DFBRectangle rect;
+          unsigned int i;
+          DFBRectangle rects[X11_MAX_DAMAGE];
+
+          D_ASSERT( data->num_damage <= X11_MAX_DAMAGE );
 
-          rect = DFB_RECTANGLE_INIT_FROM_REGION( &data->left_region );
+          if (data->num_damage) {
+               for (i=0; i<data->num_damage; i++)
+                    rects[i] = DFB_RECTANGLE_INIT_FROM_REGION( &data->damage[i] );
+          }
+          else
+               rects[0] = DFB_RECTANGLE_INIT_FROM_REGION( &data->left_region );
 
           if (data->left_lock.buffer)
-               update_screen( x11, &rect, &data->left_lock, data->xw );
+               update_screen( x11, rects, data->num_damage ? data->num_damage : 1, &data->left_lock, data->xw );
      }
 
      data->left_lock.buffer  = NULL;
@@ -44,6 +44,8 @@ typedef struct {
      XWindow               **xw;
 } SetModeData;
 
+#define X11_MAX_DAMAGE  8         /* maximum number of boxes converted and put per update */
+
 typedef struct {
      bool                   stereo;
      DFBRegion              left_region;
@@ -51,6 +53,9 @@ typedef struct {
      CoreSurfaceBufferLock  left_lock;
      CoreSurfaceBufferLock  right_lock;
      XWindow               *xw;
+
+     DFBRegion              damage[X11_MAX_DAMAGE];   /* changed parts of left_region, all of it if none */
+     unsigned int           num_damage;
 } UpdateScreenData;
 
 typedef struct {
@@ -38,6 +38,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <direct/clock.h>
 #include <direct/messages.h>
 #include <direct/util.h>
 
@@ -76,11 +77,14 @@ static IDirectFB                 *dfb;
 static IDirectFBEventBuffer      *events;
 static unsigned int               sf_to_tt = false;
 static unsigned int               spooky_output = false;
+static unsigned int               latency_output = false;
 
 /**************************************************************************************************/
 
 static bool parse_command_line( int argc, char *argv[] );
 
+static void dump_latency( void );
+
 /**************************************************************************************************/
 
 int
@@ -99,6 +103,10 @@ main( int argc, char *argv[] )
      if (!parse_command_line( argc, argv ))
           goto error;
 
+     /* Measure the latency in all stages. */
+     if (latency_output)
+          DirectFBSetOption( "input-latency-stats", NULL );
+
      /* Create the super interface. */
      ret = DirectFBCreate( &dfb );
      if (ret) {
@@ -113,6 +121,10 @@ main( int argc, char *argv[] )
           goto error;
      }
 
+     /* Dump the latency statistics instead of the events. */
+     if (latency_output)
+          dump_latency();
+
      /* Dump the events. */
      while (true) {
           DFBInputEvent event[2];
@@ -197,6 +209,95 @@ error:
 
 /**************************************************************************************************/
 
+static const char *stage_names[DILST_NUM] = {
+     "driver", "dispatch", "wm", "buffer", "client"
+};
+
+static DFBEnumerationResult
+dump_device_latency( DFBInputDeviceID           device_id,
+                     DFBInputDeviceDescription  desc,
+                     void                      *ctx )
+{
+     DFBResult             ret;
+     IDirectFBInputDevice *device;
+     DFBInputLatencyStats  stats;
+     int                   i, n;
+
+     ret = dfb->GetInputDevice( dfb, device_id, &device );
+     if (ret) {
+          D_DERROR( ret, "Tools/DumpInput: IDirectFB::GetInputDevice( %u ) failed!\n", device_id );
+          return DFENUM_OK;
+     }
+
+     ret = device->GetLatencyStatistics( device, &stats );
+
+     device->Release( device );
+
+     if (ret) {
+          D_DERROR( ret, "Tools/DumpInput: IDirectFBInputDevice::GetLatencyStatistics() failed!\n" );
+          return DFENUM_OK;
+     }
+
+     if (!stats.stages[DILST_DISPATCH].num && !stats.stages[DILST_CLIENT].num)
+          return DFENUM_OK;
+
+     printf( "\n(%02x) %s\n", device_id, desc.name );
+
+     printf( "  stage      events   avg us   max us |" );
+
+     for (n=0; n<DFB_INPUT_LATENCY_BUCKETS-1; n++) {
+          if ((32 << n) < 1000)
+               printf( " <%-4d", 32 << n );
+          else
+               printf( " <%-3dk", (32 << n) / 1000 );
+     }
+
+     printf( " more\n" );
+
+     for (i=0; i<DILST_NUM; i++) {
+          const DFBInputLatencyHistogram *histogram = &stats.stages[i];
+
+          if (!histogram->num)
+               continue;
+
+          printf( "  %-8s %8u %8llu %8u |", stage_names[i], histogram->num,
+                  histogram->total / histogram->num, histogram->max );
+
+          for (n=0; n<DFB_INPUT_LATENCY_BUCKETS; n++)
+               printf( " %5u", histogram->buckets[n] );
+
+          printf( "\n" );
+     }
+
+     return DFENUM_OK;
+}
+
+static void
+dump_latency( void )
+{
+     long long last = direct_clock_get_millis();
+
+     while (true) {
+          DFBEvent event;
+
+          events->WaitForEventWithTimeout( events, 1, 0 );
+
+          /* Fetch the events to have them measured in the client stage. */
+          while (events->GetEvent( events, &event ) == DFB_OK)
+               ;
+
+          if (direct_clock_get_millis() - last >= 1000) {
+               dfb->EnumInputDevices( dfb, dump_device_latency, NULL );
+
+               fflush( stdout );
+
+               last = direct_clock_get_millis();
+          }
+     }
+}
+
+/**************************************************************************************************/
+
 typedef struct __AnyOption AnyOption;
 
 
@@ -253,6 +354,8 @@ static const AnyOption options[] = {
        NULL,     &sf_to_tt, true, NULL, NULL },
      { "-s",   "--spooky-output",          "",           "output in spooky format instead of raw DFBInputEvents",
        NULL,     &spooky_output, true, NULL, NULL },
+     { "-l",   "--latency",                "",           "print latency histograms every second instead of events",
+       NULL,     &latency_output, true, NULL, NULL },
 };
 
 /**************************************************************************************************/
@@ -36,10 +36,12 @@
 
 #include <directfb.h>
 
+#include <direct/clock.h>
 #include <direct/debug.h>
 #include <direct/mem.h>
 #include <direct/memcpy.h>
 #include <direct/messages.h>
+#include <direct/thread.h>
 #include <direct/trace.h>
 #include <direct/util.h>
 
@@ -50,6 +52,7 @@
 #include <core/core.h>
 #include <core/gfxcard.h>
 #include <core/layer_context.h>
+#include <core/layer_control.h>
 #include <core/layer_region.h>
 #include <core/layers_internal.h>
 #include <core/surface.h>
@@ -88,11 +91,28 @@ typedef struct {
 #define MAX_UPDATE_REGIONS         8    // dirty region
 #define MAX_UPDATING_REGIONS       8    // updated region to be scheduled for display
 #define MAX_UPDATED_REGIONS        8    // updated region scheduled for display
+#define MAX_VISIBLE_REGIONS       16    // visible parts of a window (not hidden by opaque windows above)
+#define MAX_BACKGROUND_REGIONS    32    // visible parts of the background
+#define MAX_OCCLUDING_REGIONS     64    // opaque areas collected while building the visibility map
+#define MAX_CLIPPING_REGIONS     128    // temporary pieces while subtracting opaque areas
+#define MAX_BUFFER_AGE             3    // shown frames whose damage is kept for repairing back buffers
+#define COMPOSITOR_STATS_FRAMES  600    // frames between statistics of the compositor thread
+#define COMPOSITOR_LOCK_RETRY   1000    // microseconds between attempts of the compositor to lock the stack
 
 typedef struct {
      CoreDFB                      *core;
+
+     DirectMutex                   lock;               /* for the list of compositors */
+     DirectLink                   *compositors;        /* compositor threads running in this process */
 } WMData;
 
+typedef struct {
+     u32                           frame;              /* surface frame which showed the damage */
+
+     DFBUpdates                    damage;
+     DFBRegion                     damage_regions[MAX_UPDATED_REGIONS];
+} FrameDamage;
+
 typedef struct {
      int                           magic;
 
@@ -107,6 +127,12 @@ typedef struct {
      DFBUpdates                    updated;
      DFBRegion                     updated_regions[MAX_UPDATED_REGIONS];
 
+     DFBUpdates                    damage;             /* damage of the frame being rendered (stack coordinates) */
+     DFBRegion                     damage_regions[MAX_UPDATING_REGIONS];
+
+     FrameDamage                   frames[MAX_BUFFER_AGE];
+     u32                           repaired;           /* surface frame for which the back buffer has been repaired */
+
      DFBInputDeviceButtonMask      buttons;
      DFBInputDeviceModifierMask    modifiers;
      DFBInputDeviceLockState       locks;
@@ -146,8 +172,52 @@ typedef struct {
      Reaction                      surface_reaction;
 
      FusionSkirmish                update_skirmish;
+
+     bool                          visibility_valid;   /* visibility map is up to date */
+     DFBRegion                     background_regions[MAX_BACKGROUND_REGIONS];
+     int                           num_background_regions;
+     CoreWindow                   *topmost;            /* topmost visible window */
+
+     struct {
+          CoreWindow              *window;             /* window scanned out by the overlay layer */
+          CoreLayerContext        *context;            /* own context on the overlay layer */
+          CoreLayerRegion         *region;             /* region showing the window surface */
+          unsigned int             flips;              /* surface flip counter of the buffer shown */
+          CoreWindow              *rejected;           /* window the overlay could not be configured for */
+     } overlay;
 } StackData;
 
+/*
+ * Compositor thread of a stack, local to the process which initialized the stack.
+ */
+typedef struct {
+     DirectLink                    link;
+
+     StackData                    *data;
+     WMData                       *wmdata;
+
+     DirectThread                 *thread;
+
+     DirectMutex                   lock;               /* for waiting on pending updates */
+     DirectWaitQueue               wq;
+     bool                          pending;
+     bool                          stop;
+     bool                          active;             /* thread is processing the updates */
+     DFBSurfaceFlipFlags           flags;
+
+     long long                     damaged;            /* time of the first update not composited, yet */
+     long long                     last;               /* time of the last frame */
+
+     unsigned int                  frames;             /* statistics since last report */
+     unsigned int                  requests;
+     long long                     latency_total;
+     long long                     latency_max;
+     long long                     compose_total;
+     long long                     compose_max;
+     long long                     interval_total;
+     long long                     interval_max;
+} Compositor;
+
 typedef struct {
      int                           magic;
 
@@ -158,6 +228,17 @@ typedef struct {
      int                           priority;           /* derived from stacking class */
 
      CoreLayerRegionConfig         config;
+
+     DFBRegion                     visible_regions[MAX_VISIBLE_REGIONS];
+     int                           num_visible_regions;
+
+     struct {
+          CoreSurface             *surface;            /* window content in destination orientation, size and format */
+          bool                     valid;              /* content matches the window surface */
+          DFBDimension             source;             /* window surface size the content was rendered from */
+          DFBSurfacePixelFormat    format;             /* window surface format the content was rendered from */
+          int                      rotation;           /* rotation the content was rendered with */
+     } cache;
 } WindowData;
 
 /**************************************************************************************************/
@@ -180,6 +261,14 @@ update_window( CoreWindow          *window,
                bool                 force_invisible,
                bool                 scale_region );
 
+static Compositor *
+lookup_compositor( WMData    *wmdata,
+                   StackData *data );
+
+static void
+schedule_compositor( Compositor          *compositor,
+                     DFBSurfaceFlipFlags  flags );
+
 /**************************************************************************************************/
 
 static int keys_compare( const void *key1,
@@ -922,6 +1011,154 @@ draw_cursor( CoreWindowStack *stack, StackData *data, CardState *state, const DF
      state->modified |= SMF_SOURCE;
 }
 
+static bool
+window_cache_wanted( CoreWindow *window, CardState *state )
+{
+     CoreWindowStack *stack   = window->stack;
+     CoreSurface     *surface = window->surface;
+
+     if (!dfb_config->wm_window_cache)
+          return false;
+
+     /* Color keying and deinterlacing have to see the original pixels. */
+     if (window->config.options & DWOP_COLORKEYING)
+          return false;
+
+     if (surface->config.caps & DSCAPS_INTERLACED)
+          return false;
+
+     if (DFB_PIXELFORMAT_IS_INDEXED( surface->config.format ))
+          return false;
+
+     /* Only worth it if the blit does more than copying pixels. */
+     return (window->config.options & DWOP_SCALE) ||
+            (window->config.rotation + stack->rotation) % 360 ||
+            surface->config.format != state->destination->config.format;
+}
+
+static void
+release_window_cache( WindowData *data )
+{
+     D_MAGIC_ASSERT( data, WindowData );
+
+     if (data->cache.surface)
+          dfb_surface_unlink( &data->cache.surface );
+
+     data->cache.valid = false;
+}
+
+static void
+invalidate_window_cache( WindowData *data )
+{
+     D_MAGIC_ASSERT( data, WindowData );
+
+     data->cache.valid = false;
+}
+
+/*
+ * Makes sure the window cache holds the window content as it appears on the destination,
+ * i.e. rotated, scaled to the window bounds and converted to the destination format.
+ * The cache is only re-rendered after the window surface has been updated.
+ */
+static DFBResult
+update_window_cache( CoreWindow *window, CardState *state, const DFBRectangle *dst )
+{
+     DFBResult                ret;
+     WindowData              *data    = window->window_data;
+     CoreWindowStack         *stack   = window->stack;
+     CoreSurface             *surface = window->surface;
+     CoreSurface             *cache;
+     CoreSurface             *destination;
+     DFBRegion                clip;
+     DFBSurfacePixelFormat    format;
+     DFBSurfaceBlittingFlags  flags   = DSBLIT_NOFX;
+     DFBRectangle             src     = { 0, 0, surface->config.size.w, surface->config.size.h };
+     DFBRectangle             rect    = { 0, 0, dst->w, dst->h };
+     int                      rotation;
+
+     D_MAGIC_ASSERT( data, WindowData );
+
+     rotation = (window->config.rotation + stack->rotation) % 360;
+
+     /* Keep the alpha channel for blending, otherwise store in destination format. */
+     format = (window->config.options & DWOP_ALPHACHANNEL) ? surface->config.format :
+                                                              state->destination->config.format;
+
+     cache = data->cache.surface;
+
+     if (cache && (cache->config.size.w  != dst->w || cache->config.size.h != dst->h ||
+                   cache->config.format  != format ||
+                   (cache->config.caps & DSCAPS_PREMULTIPLIED) != (surface->config.caps & DSCAPS_PREMULTIPLIED)))
+          release_window_cache( data );
+
+     if (data->cache.valid && data->cache.rotation == rotation &&
+         data->cache.source.w == src.w && data->cache.source.h == src.h &&
+         data->cache.format == surface->config.format)
+          return DFB_OK;
+
+     if (!data->cache.surface) {
+          D_DEBUG_AT( WM_Default, "  -> creating window cache %dx%d %s\n",
+                      dst->w, dst->h, dfb_pixelformat_name( format ) );
+
+          ret = dfb_surface_create_simple( core_dfb, dst->w, dst->h, format, surface->config.colorspace,
+                                           surface->config.caps & DSCAPS_PREMULTIPLIED,
+                                           CSTF_SHARED | CSTF_WINDOW, window->id, NULL, &cache );
+          if (ret)
+               return ret;
+
+          ret = dfb_surface_globalize( cache );
+          D_ASSERT( ret == DFB_OK );
+
+          data->cache.surface = cache;
+     }
+
+     switch (rotation) {
+          case 90:
+               flags = DSBLIT_ROTATE90;
+               break;
+
+          case 180:
+               flags = DSBLIT_ROTATE180;
+               break;
+
+          case 270:
+               flags = DSBLIT_ROTATE270;
+               break;
+     }
+
+     /* Render into the cache instead of the destination. */
+     destination = state->destination;
+     clip        = state->clip;
+
+     state->destination  = cache;
+     state->modified    |= SMF_DESTINATION;
+
+     dfb_state_set_clip( state, &DFB_REGION_INIT_FROM_RECTANGLE( &rect ) );
+     dfb_state_set_blitting_flags( state, flags );
+
+     state->source    = surface;
+     state->modified |= SMF_SOURCE;
+
+     if (window->config.options & DWOP_SCALE)
+          dfb_gfxcard_stretchblit( &src, &rect, state );
+     else
+          dfb_gfxcard_blit( &src, 0, 0, state );
+
+     state->source       = NULL;
+     state->destination  = destination;
+     state->modified    |= SMF_SOURCE | SMF_DESTINATION;
+
+     dfb_state_set_clip( state, &clip );
+
+     data->cache.valid    = true;
+     data->cache.rotation = rotation;
+     data->cache.source.w = src.w;
+     data->cache.source.h = src.h;
+     data->cache.format   = surface->config.format;
+
+     return DFB_OK;
+}
+
 static void
 draw_window( CoreWindow *window, CardState *state,
              const DFBRegion *region, bool alpha_channel )
@@ -1043,6 +1280,36 @@ draw_window( CoreWindow *window, CardState *state,
           }
      }
 
+     /* Draw from the pre-transformed window content? */
+     if (window_cache_wanted( window, state )) {
+          DFBDimension size = { stack->width, stack->height };
+          DFBRectangle bounds;
+          DFBRectangle dst;
+
+          transform_window_to_stack( window, &config->bounds, &bounds );
+
+          dfb_rectangle_from_rotated( &dst, &bounds, &size, stack->rotation );
+
+          if (update_window_cache( window, state, &dst ) == DFB_OK) {
+               WindowData   *data = window->window_data;
+               DFBRectangle  src  = { dest.x1 - dst.x, dest.y1 - dst.y,
+                                      dest.x2 - dest.x1 + 1, dest.y2 - dest.y1 + 1 };
+
+               dfb_state_set_blitting_flags( state, flags );
+
+               state->source    = data->cache.surface;
+               state->modified |= SMF_SOURCE;
+
+               /* Plain blit from the cache to the region being updated. */
+               dfb_gfxcard_blit( &src, dest.x1, dest.y1, state );
+
+               state->source    = NULL;
+               state->modified |= SMF_SOURCE;
+
+               return;
+          }
+     }
+
      rotation = (window->config.rotation + stack->rotation) % 360;
      switch (rotation) {
           default:
@@ -1218,163 +1485,657 @@ draw_background( CoreWindowStack *stack, CardState *state, const DFBRegion *regi
                /* Restore clipping region. */
                dfb_state_set_clip( state, &clip );
 
-               /* Reset blitting source. */
-               state->source    = NULL;
-               state->modified |= SMF_SOURCE;
+               /* Reset blitting source. */
+               state->source    = NULL;
+               state->modified |= SMF_SOURCE;
+
+               break;
+          }
+
+          case DLBM_DONTCARE:
+               break;
+
+          default:
+               D_BUG( "unknown background mode" );
+               break;
+     }
+}
+
+/*
+ * Subtracts 'clip' from a list of disjoint regions, splitting each intersected region
+ * into up to four pieces (upper, lower, left, right).
+ *
+ * Returns the new number of regions or -1 if 'max' would be exceeded, in which case
+ * the list is left untouched.
+ */
+static int
+subtract_region( DFBRegion       *regions,
+                 int              num,
+                 int              max,
+                 const DFBRegion *clip )
+{
+     int       i;
+     int       n = 0;
+     DFBRegion pieces[MAX_CLIPPING_REGIONS];
+
+     D_ASSERT( max <= MAX_CLIPPING_REGIONS );
+
+     if (max > MAX_CLIPPING_REGIONS)
+          max = MAX_CLIPPING_REGIONS;
+
+     DFB_REGION_ASSERT( clip );
+
+     for (i=0; i<num; i++) {
+          const DFBRegion *r = &regions[i];
+          DFBRegion        o = *r;
+
+          if (!dfb_region_region_intersect( &o, clip )) {
+               if (n == max)
+                    return -1;
+
+               pieces[n++] = *r;
+               continue;
+          }
+
+          if (n + 4 > max)
+               return -1;
+
+          /* upper */
+          if (o.y1 > r->y1)
+               pieces[n++] = (DFBRegion) { r->x1, r->y1, r->x2, o.y1 - 1 };
+
+          /* lower */
+          if (o.y2 < r->y2)
+               pieces[n++] = (DFBRegion) { r->x1, o.y2 + 1, r->x2, r->y2 };
+
+          /* left */
+          if (o.x1 > r->x1)
+               pieces[n++] = (DFBRegion) { r->x1, o.y1, o.x1 - 1, o.y2 };
+
+          /* right */
+          if (o.x2 < r->x2)
+               pieces[n++] = (DFBRegion) { o.x2 + 1, o.y1, r->x2, o.y2 };
+     }
+
+     direct_memcpy( regions, pieces, sizeof(DFBRegion) * n );
+
+     return n;
+}
+
+/*
+ * Stores the visible pieces, collapsing them into their bounding region if there are too many.
+ *
+ * Visible regions may be larger than the exact visible area, because composition happens
+ * bottom to top and anything drawn too much gets covered by the windows above anyways.
+ * They must not overlap though, otherwise translucent windows would be blended twice.
+ */
+static int
+store_visible( DFBRegion       *dest,
+               int              max,
+               const DFBRegion *regions,
+               int              num )
+{
+     if (num > max) {
+          dfb_regions_unite( &dest[0], regions, num );
+
+          return 1;
+     }
+
+     direct_memcpy( dest, regions, sizeof(DFBRegion) * num );
+
+     return num;
+}
+
+/*
+ * Rebuilds the visibility map after windows have been restacked, moved, resized
+ * or changed their opacity or options, walking the stack once from top to bottom.
+ */
+static void
+update_visibility( CoreWindowStack *stack,
+                   StackData       *data )
+{
+     int         i, n;
+     int         num;
+     int         num_occluding = 0;
+     DFBRegion   occluding[MAX_OCCLUDING_REGIONS];
+     DFBRegion   pieces[MAX_CLIPPING_REGIONS];
+     CoreWindow *window;
+
+     D_ASSERT( stack != NULL );
+     D_ASSERT( data != NULL );
+
+     if (data->visibility_valid)
+          return;
+
+     D_DEBUG_AT( WM_Default, "%s( %p ) <- %d windows\n", __FUNCTION__, stack,
+                 fusion_vector_size( &data->windows ) );
+
+     data->topmost = NULL;
+
+     fusion_vector_foreach_reverse (window, i, data->windows) {
+          WindowData       *window_data = window->window_data;
+          CoreWindowConfig *config      = &window->config;
+          DFBRectangle      rotated;
+          DFBRegion         opaque;
+
+          D_MAGIC_ASSERT( window_data, WindowData );
+
+          window_data->num_visible_regions = 0;
+
+          if (!VISIBLE_WINDOW( window ))
+               continue;
+
+          transform_window_to_stack( window, &config->bounds, &rotated );
+
+          pieces[0] = DFB_REGION_INIT_FROM_RECTANGLE( &rotated );
+
+          if (!dfb_region_intersect( &pieces[0], 0, 0, stack->width - 1, stack->height - 1 ))
+               continue;
+
+          if (!data->topmost)
+               data->topmost = window;
+
+          /* Cut out everything hidden by opaque windows above. */
+          for (n=0, num=1; n<num_occluding && num; n++) {
+               int ret = subtract_region( pieces, num, MAX_CLIPPING_REGIONS, &occluding[n] );
+
+               if (ret < 0)
+                    break;
+
+               num = ret;
+          }
+
+          if (!num)
+               continue;
+
+          window_data->num_visible_regions = store_visible( window_data->visible_regions,
+                                                            MAX_VISIBLE_REGIONS, pieces, num );
+
+          /* Add the area this window hides from windows below. */
+          if (num_occluding == MAX_OCCLUDING_REGIONS)
+               continue;
+
+          if (!TRANSLUCENT_WINDOW( window ))
+               dfb_region_from_rectangle( &occluding[num_occluding++], &rotated );
+          else if (D_FLAGS_ARE_SET( config->options, DWOP_ALPHACHANNEL | DWOP_OPAQUE_REGION ) &&
+                   config->opacity == 0xff && !(config->options & DWOP_COLORKEYING))
+          {
+               opaque = DFB_REGION_INIT_TRANSLATED( &config->opaque, config->bounds.x, config->bounds.y );
+
+               if (dfb_region_intersect( &opaque, DFB_REGION_VALS_FROM_RECTANGLE( &rotated ) ))
+                    occluding[num_occluding++] = opaque;
+          }
+     }
+
+     /* Remaining parts of the background. */
+     pieces[0] = (DFBRegion) { 0, 0, stack->width - 1, stack->height - 1 };
+
+     for (n=0, num=1; n<num_occluding && num; n++) {
+          int ret = subtract_region( pieces, num, MAX_CLIPPING_REGIONS, &occluding[n] );
+
+          if (ret < 0)
+               break;
+
+          num = ret;
+     }
+
+     data->num_background_regions = store_visible( data->background_regions,
+                                                   MAX_BACKGROUND_REGIONS, pieces, num );
+
+     data->visibility_valid = true;
+}
+
+static inline void
+invalidate_visibility( StackData *data )
+{
+     D_ASSERT( data != NULL );
+
+     data->visibility_valid = false;
+}
+
+/**************************************************************************************************/
+
+static CoreLayer *
+find_overlay( CoreWindowStack *stack )
+{
+     int        i;
+     int        level;
+     int        overlay_level;
+     CoreLayer *primary = dfb_layer_at( stack->context->layer_id );
+
+     for (i=0; i<dfb_layer_num(); i++) {
+          DFBDisplayLayerDescription  desc;
+          CoreLayerContext           *context;
+          CoreLayer                  *layer = dfb_layer_at( i );
+
+          if (layer == primary || dfb_layer_screen( layer ) != dfb_layer_screen( primary ))
+               continue;
+
+          dfb_layer_get_description( layer, &desc );
+
+          if (!(desc.caps & DLCAPS_SURFACE))
+               continue;
+
+          /* A layer below would be hidden by the primary layer. */
+          if (dfb_layer_get_level( primary, &level ) == DFB_OK &&
+              dfb_layer_get_level( layer, &overlay_level ) == DFB_OK && overlay_level < level)
+               continue;
+
+          /* Leave layers alone that are in use. */
+          if (dfb_layer_get_active_context( layer, &context ) == DFB_OK) {
+               dfb_layer_context_unref( context );
+               continue;
+          }
+
+          return layer;
+     }
+
+     return NULL;
+}
+
+static bool
+window_promotable( CoreWindowStack *stack,
+                   StackData       *data,
+                   CoreWindow      *window )
+{
+     CoreWindowConfig *config  = &window->config;
+     CoreSurface      *surface = window->surface;
+
+     if (!surface || TRANSLUCENT_WINDOW( window ))
+          return false;
+
+     /* Hardware windows have their own region already. */
+     if (window->region)
+          return false;
+
+     if (config->rotation || stack->rotation)
+          return false;
+
+     if (surface->config.size.w != config->bounds.w || surface->config.size.h != config->bounds.h)
+          return false;
+
+     if (surface->config.caps & (DSCAPS_SYSTEMONLY | DSCAPS_STEREO))
+          return false;
+
+     if (config->bounds.x < 0 || config->bounds.x + config->bounds.w > stack->width ||
+         config->bounds.y < 0 || config->bounds.y + config->bounds.h > stack->height)
+          return false;
+
+     /* The cursor is drawn into the primary layer. */
+     if (stack->cursor.enabled && stack->cursor.opacity) {
+          DFBRegion bounds = DFB_REGION_INIT_FROM_RECTANGLE( &config->bounds );
+
+          if (dfb_region_region_intersects( &bounds, &data->cursor_region ))
+               return false;
+     }
+
+     return true;
+}
+
+/*
+ * Shows the window surface on an otherwise unused layer, taking the window out of composition.
+ * The overlay region shows the front buffer, updates of the window are passed on by update_overlay().
+ */
+static DFBResult
+promote_window( CoreWindowStack *stack,
+                StackData       *data,
+                CoreWindow      *window )
+{
+     DFBResult              ret;
+     CoreLayer             *layer;
+     CoreLayerContext      *context;
+     CoreLayerRegion       *region;
+     CoreLayerRegionConfig  config;
+     CoreSurface           *surface = window->surface;
+
+     D_ASSERT( data->overlay.window == NULL );
+
+     layer = find_overlay( stack );
+     if (!layer)
+          return DFB_UNSUPPORTED;
+
+     D_DEBUG_AT( WM_Default, "%s( %p [%d] ) <- layer %d\n", __FUNCTION__, window, window->id, dfb_layer_id( layer ) );
+
+     memset( &config, 0, sizeof(CoreLayerRegionConfig) );
+
+     config.width        = surface->config.size.w;
+     config.height       = surface->config.size.h;
+     config.format       = surface->config.format;
+     config.colorspace   = surface->config.colorspace;
+     config.source       = (DFBRectangle) { 0, 0, config.width, config.height };
+     config.dest         = window->config.bounds;
+     config.opacity      = 0xff;
+     config.surface_caps = surface->config.caps & (DSCAPS_INTERLACED | DSCAPS_SEPARATED | DSCAPS_PREMULTIPLIED);
+
+     /* The window surface is flipped by the window, before the update reaches the WM. */
+     config.buffermode   = DLBM_FRONTONLY;
+
+     ret = dfb_layer_create_context( layer, false, &context );
+     if (ret)
+          return ret;
+
+     ret = dfb_layer_activate_context( layer, context );
+     if (ret)
+          goto error_context;
+
+     ret = dfb_layer_region_create( context, &region );
+     if (ret)
+          goto error_context;
+
+     ret = dfb_layer_region_set_configuration( region, &config, CLRCF_ALL );
+     if (ret)
+          goto error_region;
+
+     ret = dfb_layer_region_set_surface( region, surface );
+     if (ret)
+          goto error_region;
+
+     ret = dfb_layer_region_enable( region );
+     if (ret)
+          goto error_region;
+
+     data->overlay.window  = window;
+     data->overlay.context = context;
+     data->overlay.region  = region;
+     data->overlay.flips   = surface->flips;
+
+     return DFB_OK;
+
+
+error_region:
+     dfb_layer_region_unref( region );
+
+error_context:
+     dfb_layer_remove_context( layer, context );
+     dfb_layer_context_unref( context );
+
+     return ret;
+}
+
+/*
+ * Puts the promoted window back into composition, if it is the given one or if window is NULL.
+ * Also lets a window that could not be promoted be tried again after it has changed.
+ */
+static void
+demote_window( StackData  *data,
+               CoreWindow *window )
+{
+     WindowData *window_data;
+     DFBRegion   region;
+
+     D_ASSERT( data != NULL );
+
+     if (data->overlay.rejected == window)
+          data->overlay.rejected = NULL;
+
+     if (!data->overlay.window || (window && window != data->overlay.window))
+          return;
+
+     window      = data->overlay.window;
+     window_data = window->window_data;
+
+     D_DEBUG_AT( WM_Default, "%s( %p [%d] )\n", __FUNCTION__, window, window->id );
+
+     dfb_layer_region_disable( data->overlay.region );
+     dfb_layer_region_unref( data->overlay.region );
+
+     dfb_layer_remove_context( dfb_layer_at( data->overlay.context->layer_id ), data->overlay.context );
+     dfb_layer_context_unref( data->overlay.context );
+
+     data->overlay.window  = NULL;
+     data->overlay.context = NULL;
+     data->overlay.region  = NULL;
+
+     /* Flips went to the overlay, composite the current content. */
+     invalidate_window_cache( window_data );
+
+     region = DFB_REGION_INIT_FROM_RECTANGLE( &window->config.bounds );
+
+     if (dfb_region_intersect( &region, 0, 0, data->stack->width - 1, data->stack->height - 1 ))
+          dfb_updates_add( &data->updates, &region );
+}
+
+/*
+ * Shows the updated content of the promoted window, which is the new front buffer after a flip.
+ */
+static void
+update_overlay( StackData           *data,
+                const DFBRegion     *update,
+                DFBSurfaceFlipFlags  flags )
+{
+     CoreSurface *surface = data->overlay.window->surface;
+
+     D_DEBUG_AT( WM_Default, "%s( %p [%d] )\n", __FUNCTION__, data->overlay.window, data->overlay.window->id );
+
+     if (data->overlay.flips != surface->flips) {
+          CoreLayerRegionConfig config;
+
+          if ((flags & DSFLIP_WAITFORSYNC) == DSFLIP_WAITFORSYNC)
+               dfb_layer_wait_vsync( dfb_layer_at( data->overlay.context->layer_id ) );
+
+          dfb_layer_region_get_configuration( data->overlay.region, &config );
+
+          /* Let the driver show the current front buffer. */
+          dfb_layer_region_set_configuration( data->overlay.region, &config, CLRCF_SURFACE );
+
+          data->overlay.flips = surface->flips;
+     }
+     else
+          dfb_layer_region_flip_update( data->overlay.region, update, flags & ~DSFLIP_BLIT );
+}
+
+/*
+ * Scans out the topmost window directly if it is opaque and matches an unused layer,
+ * instead of compositing it into the primary layer.
+ */
+static void
+update_promotion( CoreWindowStack *stack,
+                  StackData       *data )
+{
+     CoreWindow *candidate;
+
+     if (!dfb_config->wm_overlay_promotion || stack->context->config.buffermode == DLBM_WINDOWS)
+          return;
+
+     update_visibility( stack, data );
+
+     candidate = data->topmost;
+
+     if (candidate && !window_promotable( stack, data, candidate ))
+          candidate = NULL;
+
+     if (candidate == data->overlay.window)
+          return;
+
+     demote_window( data, NULL );
+
+     if (candidate && candidate != data->overlay.rejected && promote_window( stack, data, candidate ))
+          data->overlay.rejected = candidate;
+}
+
+static void
+draw_visible_region( CoreWindow      *window,
+                     CardState       *state,
+                     const DFBRegion *region )
+{
+     CoreWindowConfig *config = &window->config;
+     DFBRegion         opaque;
+
+     if (!D_FLAGS_ARE_SET( config->options, DWOP_ALPHACHANNEL | DWOP_OPAQUE_REGION )) {
+          draw_window( window, state, region, true );
+          return;
+     }
+
+     opaque = DFB_REGION_INIT_TRANSLATED( &config->opaque, config->bounds.x, config->bounds.y );
+
+     if (!dfb_region_region_intersect( &opaque, region )) {
+          draw_window( window, state, region, true );
+          return;
+     }
+
+     /* left */
+     if (opaque.x1 != region->x1) {
+          DFBRegion r = { region->x1, opaque.y1, opaque.x1 - 1, opaque.y2 };
+          draw_window( window, state, &r, true );
+     }
 
-               break;
-          }
+     /* upper */
+     if (opaque.y1 != region->y1) {
+          DFBRegion r = { region->x1, region->y1, region->x2, opaque.y1 - 1 };
+          draw_window( window, state, &r, true );
+     }
 
-          case DLBM_DONTCARE:
-               break;
+     /* right */
+     if (opaque.x2 != region->x2) {
+          DFBRegion r = { opaque.x2 + 1, opaque.y1, region->x2, opaque.y2 };
+          draw_window( window, state, &r, true );
+     }
 
-          default:
-               D_BUG( "unknown background mode" );
-               break;
+     /* lower */
+     if (opaque.y2 != region->y2) {
+          DFBRegion r = { region->x1, opaque.y2 + 1, region->x2, region->y2 };
+          draw_window( window, state, &r, true );
      }
+
+     /* inner */
+     draw_window( window, state, &opaque, false );
 }
 
+/*
+ * Composes the update (stack coordinates) by drawing the visible parts of the background
+ * and of each window from bottom to top.
+ */
 static void
 update_region( CoreWindowStack *stack,
                StackData       *data,
                CardState       *state,
-               int              start,
-               int              x1,
-               int              y1,
-               int              x2,
-               int              y2 )
+               const DFBRegion *update )
 {
-     int       i      = start;
-     DFBRegion region = { x1, y1, x2, y2 };
+     int         i, n;
+     CoreWindow *window;
 
      D_ASSERT( stack != NULL );
      D_ASSERT( data != NULL );
      D_MAGIC_ASSERT( state, CardState );
-     D_ASSERT( start < fusion_vector_size( &data->windows ) );
-     D_ASSERT( x1 <= x2 );
-     D_ASSERT( y1 <= y2 );
+     DFB_REGION_ASSERT( update );
+     D_ASSERT( data->visibility_valid );
 
-     /* Find next intersecting window. */
-     while (i >= 0) {
-          CoreWindow *window = fusion_vector_at( &data->windows, i );
+     for (n=0; n<data->num_background_regions; n++) {
+          DFBRegion region = data->background_regions[n];
 
-          if (VISIBLE_WINDOW( window )) {
-               DFBRectangle rotated;
+          if (dfb_region_region_intersect( &region, update ))
+               draw_background( stack, state, &region );
+     }
 
-               transform_window_to_stack( window, &window->config.bounds, &rotated );
+     fusion_vector_foreach (window, i, data->windows) {
+          WindowData *window_data = window->window_data;
 
-               if (dfb_region_intersect( &region,
-                                         DFB_REGION_VALS_FROM_RECTANGLE( &rotated )))
-                    break;
-          }
+          D_MAGIC_ASSERT( window_data, WindowData );
+
+          /* Shown by the overlay layer. */
+          if (window == data->overlay.window)
+               continue;
+
+          for (n=0; n<window_data->num_visible_regions; n++) {
+               DFBRegion region = window_data->visible_regions[n];
 
-          i--;
+               if (dfb_region_region_intersect( &region, update ))
+                    draw_visible_region( window, state, &region );
+          }
      }
+}
 
-     /* Intersecting window found? */
-     if (i >= 0) {
-          CoreWindow       *window = fusion_vector_at( &data->windows, i );
-          CoreWindowConfig *config = &window->config;
+/**************************************************************************************************/
+/**************************************************************************************************/
 
-          if (D_FLAGS_ARE_SET( config->options, DWOP_ALPHACHANNEL | DWOP_OPAQUE_REGION )) {
-               DFBRegion opaque = DFB_REGION_INIT_TRANSLATED( &config->opaque,
-                                                              config->bounds.x,
-                                                              config->bounds.y );
+static int
+get_buffer_age( StackData             *data,
+                CoreSurfaceBufferRole  role )
+{
+     /* Stereo regions are kept coherent by copying. */
+     if (data->region->config.options & DLOP_STEREO)
+          return 0;
 
-               if (!dfb_region_region_intersect( &opaque, &region )) {
-                    update_region( stack, data, state, i-1, x1, y1, x2, y2 );
+     return dfb_surface_buffer_age( data->surface, role );
+}
 
-                    draw_window( window, state, &region, true );
-               }
-               else {
-                    if ((config->opacity < 0xff) || (config->options & DWOP_COLORKEYING)) {
-                         /* draw everything below */
-                         update_region( stack, data, state, i-1, x1, y1, x2, y2 );
-                    }
-                    else {
-                         /* left */
-                         if (opaque.x1 != x1)
-                              update_region( stack, data, state, i-1, x1, opaque.y1, opaque.x1-1, opaque.y2 );
-
-                         /* upper */
-                         if (opaque.y1 != y1)
-                              update_region( stack, data, state, i-1, x1, y1, x2, opaque.y1-1 );
-
-                         /* right */
-                         if (opaque.x2 != x2)
-                              update_region( stack, data, state, i-1, opaque.x2+1, opaque.y1, x2, opaque.y2 );
-
-                         /* lower */
-                         if (opaque.y2 != y2)
-                              update_region( stack, data, state, i-1, x1, opaque.y2+1, x2, y2 );
-                    }
+/*
+ * Remembers the damage of the frame being shown, if buffers have been swapped.
+ */
+static void
+record_damage( StackData *data,
+               u32        last_frame )
+{
+     int i;
+     u32 frame = data->surface->frames;
 
-                    /* left */
-                    if (opaque.x1 != region.x1) {
-                         DFBRegion r = { region.x1, opaque.y1, opaque.x1 - 1, opaque.y2 };
-                         draw_window( window, state, &r, true );
-                    }
+     if (frame != last_frame) {
+          FrameDamage *shown = &data->frames[frame % MAX_BUFFER_AGE];
 
-                    /* upper */
-                    if (opaque.y1 != region.y1) {
-                         DFBRegion r = { region.x1, region.y1, region.x2, opaque.y1 - 1 };
-                         draw_window( window, state, &r, true );
-                    }
+          D_DEBUG_AT( WM_Default, "  -> recording %d damaged regions for frame %u\n", data->damage.num_regions, frame );
 
-                    /* right */
-                    if (opaque.x2 != region.x2) {
-                         DFBRegion r = { opaque.x2 + 1, opaque.y1, region.x2, opaque.y2 };
-                         draw_window( window, state, &r, true );
-                    }
+          shown->frame = frame;
 
-                    /* lower */
-                    if (opaque.y2 != region.y2) {
-                         DFBRegion r = { region.x1, opaque.y2 + 1, region.x2, region.y2 };
-                         draw_window( window, state, &r, true );
-                    }
+          dfb_updates_reset( &shown->damage );
 
-                    /* inner */
-                    draw_window( window, state, &opaque, false );
-               }
-          }
-          else {
-               if (TRANSLUCENT_WINDOW( window )) {
-                    /* draw everything below */
-                    update_region( stack, data, state, i-1, x1, y1, x2, y2 );
-               }
-               else {
-                    /* left */
-                    if (region.x1 != x1)
-                         update_region( stack, data, state, i-1, x1, region.y1, region.x1-1, region.y2 );
+          for (i=0; i<data->damage.num_regions; i++)
+               dfb_updates_add( &shown->damage, &data->damage.regions[i] );
+     }
+
+     dfb_updates_reset( &data->damage );
+}
 
-                    /* upper */
-                    if (region.y1 != y1)
-                         update_region( stack, data, state, i-1, x1, y1, x2, region.y1-1 );
+/*
+ * Collects the damage of the frames shown since the back buffer has been shown last,
+ * which needs to be repainted instead of copying updated regions back after each flip.
+ *
+ * Returns false if the damage is not known for all of these frames.
+ */
+static bool
+collect_repairs( StackData  *data,
+                 DFBUpdates *repairs )
+{
+     int i;
+     int age;
+     u32 frame;
+     u32 frames = data->surface->frames;
 
-                    /* right */
-                    if (region.x2 != x2)
-                         update_region( stack, data, state, i-1, region.x2+1, region.y1, x2, region.y2 );
+     /* Only once for each back buffer. */
+     if (data->repaired == frames)
+          return true;
 
-                    /* lower */
-                    if (region.y2 != y2)
-                         update_region( stack, data, state, i-1, x1, region.y2+1, x2, y2 );
-               }
+     data->repaired = frames;
 
-               draw_window( window, state, &region, true );
-          }
+     age = get_buffer_age( data, CSBR_BACK );
+
+     D_DEBUG_AT( WM_Default, "  -> back buffer age %d (frame %u)\n", age, frames );
+
+     /* Unknown age means the buffer is still kept coherent by copying. */
+     if (age < 2)
+          return true;
+
+     if (age - 1 > MAX_BUFFER_AGE)
+          return false;
+
+     for (frame = frames - age + 2; frame != frames + 1; frame++) {
+          FrameDamage *shown = &data->frames[frame % MAX_BUFFER_AGE];
+
+          if (shown->frame != frame)
+               return false;
+
+          for (i=0; i<shown->damage.num_regions; i++)
+               dfb_updates_add( repairs, &shown->damage.regions[i] );
      }
-     else
-          draw_background( stack, state, &region );
-}
 
-/**************************************************************************************************/
-/**************************************************************************************************/
+     return true;
+}
 
 static void
 flush_updating( StackData *data )
 {
      int i;
      int left_num_regions  = 0;
+     u32 last_frame        = data->surface->frames;
 
      D_DEBUG_AT( WM_Default, "%s( %p )\n", __FUNCTION__, data );
 
@@ -1409,6 +2170,15 @@ flush_updating( StackData *data )
      /* Flip the whole layer. */
      dfb_layer_region_flip_update( data->region, NULL, DSFLIP_ONSYNC );
 
+     record_damage( data, last_frame );
+
+     /* The new back buffer is repaired by its age before the next repaint. */
+     if (left_num_regions && get_buffer_age( data, CSBR_BACK )) {
+          D_DEBUG_AT( WM_Default, "  -> skipping copy of updated regions (F->B)\n" );
+
+          left_num_regions = 0;
+     }
+
 
      if (left_num_regions) {
           D_DEBUG_AT( WM_Default, "  -> copying %d updated regions (F->B)\n", left_num_regions );
@@ -1435,8 +2205,12 @@ repaint_stack( CoreWindowStack     *stack,
      CoreLayerRegion *region;
      CardState       *state;
      CoreSurface     *surface;
-     DFBRegion        flips[num_updates];
+     DFBRegion        flips[num_updates + MAX_UPDATED_REGIONS];
      int              num_flips = 0;
+     DFBUpdates       repairs;
+     DFBRegion        repair_regions[MAX_UPDATED_REGIONS];
+     const DFBRegion *composes  = updates;
+     int              num_composes = num_updates;
 
      D_ASSERT( stack != NULL );
      D_ASSERT( stack->context != NULL );
@@ -1455,13 +2229,39 @@ repaint_stack( CoreWindowStack     *stack,
 
      fusion_skirmish_prevail( &data->update_skirmish );
 
+     update_visibility( stack, data );
+
+     /* Repaint what the back buffer is missing instead of copying it back after each flip. */
+     if (region->config.buffermode == DLBM_TRIPLE || region->config.buffermode == DLBM_BACKVIDEO) {
+          dfb_updates_init( &repairs, repair_regions, MAX_UPDATED_REGIONS );
+
+          if (!collect_repairs( data, &repairs )) {
+               DFBRegion full = { 0, 0, stack->width - 1, stack->height - 1 };
+
+               D_DEBUG_AT( WM_Default, "  -> damage history too short, repainting everything\n" );
+
+               dfb_updates_add( &repairs, &full );
+          }
+
+          if (repairs.num_regions) {
+               for (i=0; i<num_updates; i++)
+                    dfb_updates_add( &repairs, &updates[i] );
+
+               composes     = repairs.regions;
+               num_composes = repairs.num_regions;
+          }
+
+          for (i=0; i<num_updates; i++)
+               dfb_updates_add( &data->damage, &updates[i] );
+     }
+
      /* Set destination. */
      state->destination  = surface;
      state->modified    |= SMF_DESTINATION;
 
-     for (i=0; i<num_updates; i++) {
+     for (i=0; i<num_composes; i++) {
           DFBRegion        dest;
-          const DFBRegion *update = &updates[i];
+          const DFBRegion *update = &composes[i];
 
           DFB_REGION_ASSERT( update );
 
@@ -1477,9 +2277,7 @@ repaint_stack( CoreWindowStack     *stack,
           dfb_state_set_clip( state, &dest );
 
           /* Compose updated region. */
-          update_region( stack, data, state,
-                         fusion_vector_size( &data->windows ) - 1,
-                         DFB_REGION_VALS( update ) );
+          update_region( stack, data, state, update );
 
           flips[num_flips++] = dest;
 
@@ -1511,7 +2309,7 @@ repaint_stack( CoreWindowStack     *stack,
      switch (region->config.buffermode) {
           case DLBM_TRIPLE:
                /* Add the updated region. */
-               for (i=0; i<num_updates; i++) {
+               for (i=0; i<num_flips; i++) {
                     const DFBRegion *update = &flips[i];
 
                     DFB_REGION_ASSERT( update );
@@ -1526,20 +2324,25 @@ repaint_stack( CoreWindowStack     *stack,
                     flush_updating( data );
                break;
 
-          case DLBM_BACKVIDEO:
-               /* Flip the whole region. */
-               dfb_layer_region_flip_update( region, NULL, flags | DSFLIP_WAITFORSYNC );
+          case DLBM_BACKVIDEO: {
+               u32 last_frame = surface->frames;
+
+               /* Flip the whole region, telling the driver what has actually changed. */
+               dfb_layer_region_flip_damage( region, flips, num_flips, flags | DSFLIP_WAITFORSYNC );
+
+               record_damage( data, last_frame );
 
-               /* Copy back the updated region. */
+               /* Copy back the updated region, unless the back buffer is repaired by its age. */
 
-               if (!dfb_config->wm_fullscreen_updates)
+               if (!dfb_config->wm_fullscreen_updates && !get_buffer_age( data, CSBR_BACK ))
                     dfb_gfx_copy_regions( region->surface, CSBR_FRONT, region->surface, CSBR_BACK, updates, num_updates, 0, 0 );
 
                break;
+          }
 
           default:
                /* Flip the updated region .*/
-               for (i=0; i<num_updates; i++) {
+               for (i=0; i<num_flips; i++) {
                     const DFBRegion *update = &flips[i];
 
                     DFB_REGION_ASSERT( update );
@@ -1562,6 +2365,7 @@ process_updates( StackData           *data,
      int               total;
      int               bounding;
      CoreLayerContext *context;
+     Compositor       *compositor;
      (void)context;
 
      D_ASSERT( data != NULL );
@@ -1574,6 +2378,15 @@ process_updates( StackData           *data,
      if (!data->updates.num_regions)
           return DFB_OK;
 
+     /* Leave composition to the thread, accumulating the updates until then. */
+     compositor = lookup_compositor( wmdata, data );
+     if (compositor && !compositor->active) {
+          schedule_compositor( compositor, flags );
+          return DFB_OK;
+     }
+
+     update_promotion( stack, data );
+
      if (dfb_config->wm_fullscreen_updates) {
           DFBRegion reg = { 0, 0, stack->width - 1, stack->height - 1 };
 
@@ -1615,6 +2428,249 @@ process_updates( StackData           *data,
      return DFB_OK;
 }
 
+/**************************************************************************************************/
+
+static Compositor *
+lookup_compositor( WMData    *wmdata,
+                   StackData *data )
+{
+     Compositor *compositor;
+
+     direct_mutex_lock( &wmdata->lock );
+
+     direct_list_foreach (compositor, wmdata->compositors) {
+          if (compositor->data == data)
+               break;
+     }
+
+     direct_mutex_unlock( &wmdata->lock );
+
+     return compositor;
+}
+
+static void
+schedule_compositor( Compositor          *compositor,
+                     DFBSurfaceFlipFlags  flags )
+{
+     D_ASSERT( compositor != NULL );
+
+     direct_mutex_lock( &compositor->lock );
+
+     if (!compositor->pending) {
+          compositor->pending = true;
+          compositor->damaged = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+
+          direct_waitqueue_broadcast( &compositor->wq );
+     }
+
+     compositor->flags |= flags;
+     compositor->requests++;
+
+     direct_mutex_unlock( &compositor->lock );
+}
+
+/*
+ * Prints the statistics if requested via "wm-compositor-stats" and starts over.
+ */
+static void
+report_compositor( Compositor *compositor )
+{
+     unsigned int frames = compositor->frames;
+
+     if (!frames)
+          return;
+
+     if (dfb_config->wm_compositor_stats)
+          D_INFO( "WM/Default: Compositor: %u frames for %u updates, latency %lld/%lld us, "
+                  "compose %lld/%lld us, interval %lld/%lld us (avg/max)\n", frames, compositor->requests,
+                  compositor->latency_total / frames, compositor->latency_max,
+                  compositor->compose_total / frames, compositor->compose_max,
+                  compositor->interval_total / frames, compositor->interval_max );
+     else
+          D_DEBUG_AT( WM_Default, "Compositor: %u frames for %u updates, latency %lld/%lld us, "
+                      "compose %lld/%lld us, interval %lld/%lld us (avg/max)\n", frames, compositor->requests,
+                      compositor->latency_total / frames, compositor->latency_max,
+                      compositor->compose_total / frames, compositor->compose_max,
+                      compositor->interval_total / frames, compositor->interval_max );
+
+     compositor->frames         = 0;
+     compositor->requests       = 0;
+     compositor->latency_total  = 0;
+     compositor->latency_max    = 0;
+     compositor->compose_total  = 0;
+     compositor->compose_max    = 0;
+     compositor->interval_total = 0;
+     compositor->interval_max   = 0;
+}
+
+/*
+ * Composites the accumulated updates of all windows once per vertical retrace,
+ * so that clients updating quickly do not cause one composition and flip each.
+ */
+static void *
+compositor_thread( DirectThread *thread,
+                   void         *arg )
+{
+     Compositor       *compositor = arg;
+     StackData        *data       = compositor->data;
+     CoreWindowStack  *stack      = data->stack;
+     CoreLayerContext *context    = stack->context;
+     CoreLayer        *layer      = dfb_layer_at( context->layer_id );
+
+     direct_mutex_lock( &compositor->lock );
+
+     while (true) {
+          long long           damaged;
+          long long           start, stop;
+          DFBSurfaceFlipFlags flags;
+
+          /* Wait for updates. */
+          while (!compositor->pending && !compositor->stop)
+               direct_waitqueue_wait( &compositor->wq, &compositor->lock );
+
+          if (compositor->stop)
+               break;
+
+          direct_mutex_unlock( &compositor->lock );
+
+          /* Flipping waits for the vertical retrace itself in back video mode. */
+          if (data->region->config.buffermode != DLBM_BACKVIDEO)
+               dfb_layer_wait_vsync( layer );
+
+          direct_mutex_lock( &compositor->lock );
+
+          /* Never block on the stack's lock, stop_compositor() joins the thread while holding it. */
+          while (!compositor->stop && fusion_skirmish_swoop( &context->lock ))
+               direct_waitqueue_wait_timeout( &compositor->wq, &compositor->lock, COMPOSITOR_LOCK_RETRY );
+
+          if (compositor->stop)
+               break;
+
+          damaged = compositor->damaged;
+          flags   = compositor->flags;
+
+          compositor->pending = false;
+          compositor->flags   = DSFLIP_NONE;
+
+          direct_mutex_unlock( &compositor->lock );
+
+          start = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+
+          compositor->active = true;
+
+          process_updates( data, compositor->wmdata, stack, flags & ~DSFLIP_WAITFORSYNC );
+
+          compositor->active = false;
+
+          stop = direct_clock_get_time( DIRECT_CLOCK_MONOTONIC );
+
+          /* Update statistics. */
+          compositor->frames++;
+          compositor->latency_total += stop - damaged;
+          compositor->compose_total += stop - start;
+
+          if (compositor->latency_max < stop - damaged)
+               compositor->latency_max = stop - damaged;
+
+          if (compositor->compose_max < stop - start)
+               compositor->compose_max = stop - start;
+
+          if (compositor->last) {
+               compositor->interval_total += stop - compositor->last;
+
+               if (compositor->interval_max < stop - compositor->last)
+                    compositor->interval_max = stop - compositor->last;
+          }
+
+          compositor->last = stop;
+
+          if (compositor->frames == COMPOSITOR_STATS_FRAMES)
+               report_compositor( compositor );
+
+          dfb_layer_context_unlock( context );
+
+          direct_mutex_lock( &compositor->lock );
+     }
+
+     direct_mutex_unlock( &compositor->lock );
+
+     return NULL;
+}
+
+static DFBResult
+start_compositor( StackData *data,
+                  WMData    *wmdata )
+{
+     Compositor *compositor;
+
+     D_ASSERT( data != NULL );
+     D_ASSERT( wmdata != NULL );
+
+     compositor = D_CALLOC( 1, sizeof(Compositor) );
+     if (!compositor)
+          return D_OOM();
+
+     compositor->data   = data;
+     compositor->wmdata = wmdata;
+
+     direct_mutex_init( &compositor->lock );
+     direct_waitqueue_init( &compositor->wq );
+
+     compositor->thread = direct_thread_create( DTT_OUTPUT, compositor_thread, compositor, "WM/Compositor" );
+     if (!compositor->thread) {
+          direct_waitqueue_deinit( &compositor->wq );
+          direct_mutex_deinit( &compositor->lock );
+
+          D_FREE( compositor );
+
+          return DFB_FAILURE;
+     }
+
+     direct_mutex_lock( &wmdata->lock );
+     direct_list_append( &wmdata->compositors, &compositor->link );
+     direct_mutex_unlock( &wmdata->lock );
+
+     return DFB_OK;
+}
+
+/*
+ * Stops the compositor thread of the stack, if it has been started by this process.
+ *
+ * Called with the stack locked.
+ */
+static void
+stop_compositor( StackData *data,
+                 WMData    *wmdata )
+{
+     Compositor *compositor;
+
+     compositor = lookup_compositor( wmdata, data );
+     if (!compositor)
+          return;
+
+     direct_mutex_lock( &wmdata->lock );
+     direct_list_remove( &wmdata->compositors, &compositor->link );
+     direct_mutex_unlock( &wmdata->lock );
+
+     direct_mutex_lock( &compositor->lock );
+
+     compositor->stop = true;
+
+     direct_waitqueue_broadcast( &compositor->wq );
+     direct_mutex_unlock( &compositor->lock );
+
+     /* The thread does not block on the stack's lock, so it can be joined while holding it. */
+     direct_thread_join( compositor->thread );
+     direct_thread_destroy( compositor->thread );
+
+     report_compositor( compositor );
+
+     direct_waitqueue_deinit( &compositor->wq );
+     direct_mutex_deinit( &compositor->lock );
+
+     D_FREE( compositor );
+}
+
 /*
      skipping opaque windows that are above the window that changed
 */
@@ -1717,11 +2773,34 @@ repaint_stack_for_window( CoreWindowStack     *stack,
      D_ASSERT( window < fusion_vector_size( &data->windows ) );
 
      if (fusion_vector_has_elements( &data->windows ) && window >= 0) {
-          int num = fusion_vector_size( &data->windows );
+          int           num          = fusion_vector_size( &data->windows );
+          CoreWindow   *changed      = fusion_vector_at( &data->windows, window );
+          WindowData   *changed_data = changed->window_data;
+          DFBRectangle  rotated;
+          DFBRegion     bounds;
 
           D_ASSERT( window < num );
 
-          wind_of_change( stack, data, update, flags, num - 1, window );
+          update_visibility( stack, data );
+
+          transform_window_to_stack( changed, &changed->config.bounds, &rotated );
+
+          dfb_region_from_rectangle( &bounds, &rotated );
+
+          /* Within the window the visibility map already has opaque windows above cut out. */
+          if (changed_data->num_visible_regions && dfb_region_region_contains( &bounds, update ))
+          {
+               int i;
+
+               for (i=0; i<changed_data->num_visible_regions; i++) {
+                    DFBRegion region = changed_data->visible_regions[i];
+
+                    if (dfb_region_region_intersect( &region, update ))
+                         dfb_updates_add( &data->updates, &region );
+               }
+          }
+          else
+               wind_of_change( stack, data, update, flags, num - 1, window );
      }
      else
           dfb_updates_add( &data->updates, update );
@@ -1858,6 +2937,8 @@ insert_window( WMData          *wmdata,
      /* Insert the window at the acquired position. */
      fusion_vector_insert( &data->windows, window, index );
 
+     invalidate_visibility( data );
+
      window->flags |= CWF_INSERTED;
 
      dfb_wm_dispatch_WindowState( wmdata->core, window );
@@ -1954,6 +3035,8 @@ remove_window( WMData          *wmdata,
 
      fusion_vector_remove( &data->windows, fusion_vector_index_of( &data->windows, window ) );
 
+     invalidate_visibility( data );
+
      window->flags &= ~CWF_INSERTED;
 
      dfb_wm_dispatch_WindowState( wmdata->core, window );
@@ -1971,6 +3054,8 @@ move_window( CoreWindow *window,
      DFBWindowEvent  evt;
      DFBRectangle   *bounds = &window->config.bounds;
 
+     demote_window( data->stack_data, window );
+
      if (window->region) {
           data->config.dest.x += dx;
           data->config.dest.y += dy;
@@ -1985,6 +3070,8 @@ move_window( CoreWindow *window,
 
           bounds->x += dx;
           bounds->y += dy;
+
+          invalidate_visibility( data->stack_data );
      }
      else {
           update_window( window, data, NULL, 0, false, false, false );
@@ -1992,6 +3079,8 @@ move_window( CoreWindow *window,
           bounds->x += dx;
           bounds->y += dy;
 
+          invalidate_visibility( data->stack_data );
+
           update_window( window, data, NULL, 0, false, false, false );
      }
 
@@ -2028,6 +3117,11 @@ resize_window( CoreWindow *window,
      D_ASSERT( width > 0 );
      D_ASSERT( height > 0 );
 
+     demote_window( data->stack_data, window );
+
+     /* The surface is resized below, the cached content is outdated. */
+     invalidate_window_cache( data );
+
      if (width > 4096 || height > 4096)
           return DFB_LIMITEXCEEDED;
 
@@ -2078,6 +3172,8 @@ resize_window( CoreWindow *window,
      bounds->w = width;
      bounds->h = height;
 
+     invalidate_visibility( data->stack_data );
+
      /* Send new size */
      evt.type = DWET_SIZE;
      evt.w    = bounds->w;
@@ -2114,6 +3210,11 @@ set_window_bounds( CoreWindow *window,
      D_ASSERT( width > 0 );
      D_ASSERT( height > 0 );
 
+     demote_window( data->stack_data, window );
+
+     /* The surface may be resized below, the cached content is outdated. */
+     invalidate_window_cache( data );
+
      if (width > 4096 || height > 4096)
           return DFB_LIMITEXCEEDED;
 
@@ -2142,6 +3243,8 @@ set_window_bounds( CoreWindow *window,
      if (!dfb_region_region_intersect( &window->config.opaque, &new_region ))
           window->config.opaque = new_region;
 
+     invalidate_visibility( data->stack_data );
+
      /* Update exposed area. */
      if (VISIBLE_WINDOW( window )) {
           if (dfb_region_region_intersect( &new_region, &old_region )) {
@@ -2292,6 +3395,8 @@ restack_window( WMData                 *wmdata,
      /* Actually change the stacking order now. */
      fusion_vector_move( &data->windows, old, index );
 
+     invalidate_visibility( data );
+
      dfb_wm_dispatch_WindowRestack( wmdata->core, window, index );
 
      update_window( window, window_data, NULL, DSFLIP_NONE, (index < old), false, false );
@@ -2325,8 +3430,12 @@ set_opacity( CoreWindow *window,
           bool show = !old && opacity;
           bool hide = old && !opacity;
 
+          demote_window( data, window );
+
           window->config.opacity = opacity;
 
+          invalidate_visibility( data );
+
           if (window->region) {
                window_data->config.opacity = opacity;
 
@@ -3204,6 +4313,8 @@ wm_initialize( CoreDFB *core, void *wm_data, void *shared_data )
 
      data->core = core;
 
+     direct_mutex_init( &data->lock );
+
      return DFB_OK;
 }
 
@@ -3214,18 +4325,32 @@ wm_join( CoreDFB *core, void *wm_data, void *shared_data )
 
      data->core = core;
 
+     direct_mutex_init( &data->lock );
+
      return DFB_OK;
 }
 
 static DFBResult
 wm_shutdown( bool emergency, void *wm_data, void *shared_data )
 {
+     WMData *data = wm_data;
+
+     D_ASSUME( data->compositors == NULL );
+
+     direct_mutex_deinit( &data->lock );
+
      return DFB_OK;
 }
 
 static DFBResult
 wm_leave( bool emergency, void *wm_data, void *shared_data )
 {
+     WMData *data = wm_data;
+
+     D_ASSUME( data->compositors == NULL );
+
+     direct_mutex_deinit( &data->lock );
+
      return DFB_OK;
 }
 
@@ -3276,7 +4401,17 @@ defaultwm_surface_reaction( const void *msg_data,
 
                     D_ASSUME( data->updated.num_regions > 0 );
 
+                    if (data->updated.num_regions && get_buffer_age( data, CSBR_IDLE )) {
+                         D_DEBUG_AT( WM_Default, "  -> skipping copy of updated regions (F->I)\n" );
+
+                         dfb_updates_reset( &data->updated );
+                    }
+
                     if (data->updated.num_regions) {
+                         /* Lock the surface before dfb_gfx_copy_regions() takes its copy lock, as in
+                            dfb_surface_clear_buffers(), otherwise both can deadlock. */
+                         dfb_surface_lock( data->surface );
+
                          if (data->region->config.options & DLOP_STEREO) {
                               /* Copy back the updated region. */
                               if (data->updated.num_regions) {
@@ -3306,6 +4441,8 @@ defaultwm_surface_reaction( const void *msg_data,
                               }
                          }
 
+                         dfb_surface_unlock( data->surface );
+
                          dfb_updates_reset( &data->updated );
                     }
 
@@ -3346,6 +4483,10 @@ wm_init_stack( CoreWindowStack *stack,
      dfb_updates_init( &data->updates, data->update_regions, MAX_UPDATE_REGIONS );
      dfb_updates_init( &data->updating, data->updating_regions, MAX_UPDATING_REGIONS );
      dfb_updates_init( &data->updated, data->updated_regions, MAX_UPDATED_REGIONS );
+     dfb_updates_init( &data->damage, data->damage_regions, MAX_UPDATING_REGIONS );
+
+     for (i=0; i<MAX_BUFFER_AGE; i++)
+          dfb_updates_init( &data->frames[i].damage, data->frames[i].damage_regions, MAX_UPDATED_REGIONS );
 
      fusion_vector_init( &data->windows, 64, stack->shmpool );
 
@@ -3371,6 +4512,12 @@ wm_init_stack( CoreWindowStack *stack,
 
      D_MAGIC_SET( data, StackData );
 
+     if (dfb_config->wm_compositor_thread) {
+          ret = start_compositor( data, wmdata );
+          if (ret)
+               D_DERROR( ret, "WM/Default: Could not start compositor thread, compositing synchronously!\n" );
+     }
+
      return DFB_OK;
 }
 
@@ -3387,6 +4534,11 @@ wm_close_stack( CoreWindowStack *stack,
      D_ASSERT( stack_data != NULL );
 
      D_MAGIC_ASSERT( data, StackData );
+
+     stop_compositor( data, wm_data );
+
+     demote_window( data, NULL );
+
      D_MAGIC_CLEAR( data );
 
      D_ASSUME( fusion_vector_is_empty( &data->windows ) );
@@ -3446,6 +4598,8 @@ wm_set_active( CoreWindowStack *stack,
      if (active)
           return dfb_windowstack_repaint_all( stack );
 
+     demote_window( data, NULL );
+
      /* Force release of all pressed keys. */
      return wm_flush_keys( stack, wm_data, stack_data );
 }
@@ -3461,6 +4615,8 @@ wm_resize_stack( CoreWindowStack *stack,
      D_ASSERT( wm_data != NULL );
      D_ASSERT( stack_data != NULL );
 
+     invalidate_visibility( stack_data );
+
      return DFB_OK;
 }
 
@@ -3796,8 +4952,12 @@ wm_remove_window( CoreWindowStack *stack,
      /* Send notification to windows watchers */
      dfb_wm_dispatch_WindowRemove( wmdata->core, window );
 
+     demote_window( sdata, window );
+
      remove_window( wmdata, stack, sdata, window, data );
 
+     release_window_cache( data );
+
      /* Free key list. */
      if (window->config.keys) {
           SHFREE( stack->shmpool, window->config.keys );
@@ -3831,6 +4991,14 @@ wm_set_window_config( CoreWindow             *window,
      stack = window->stack;
      D_ASSERT( stack != NULL );
 
+     if (flags & (CWCF_OPTIONS | CWCF_COLOR_KEY | CWCF_ROTATION))
+          demote_window( stack->stack_data, window );
+
+     /* Anything affecting content or geometry requires the cached content to be rendered again. */
+     if (flags & (CWCF_OPTIONS | CWCF_COLOR_KEY | CWCF_OPACITY | CWCF_SIZE | CWCF_ROTATION |
+                  CWCF_SRC_GEOMETRY | CWCF_DST_GEOMETRY))
+          invalidate_window_cache( window_data );
+
      if (flags & CWCF_OPTIONS) {
           if ((window->config.options & DWOP_SCALE) && !(config->options & DWOP_SCALE) && window->surface) {
                if (window->config.bounds.w != window->surface->config.size.w ||
@@ -3853,6 +5021,8 @@ wm_set_window_config( CoreWindow             *window,
           }
 
           window->config.options = config->options;
+
+          invalidate_visibility( stack->stack_data );
      }
 
      if (flags & CWCF_EVENTS)
@@ -3864,9 +5034,12 @@ wm_set_window_config( CoreWindow             *window,
      if (flags & CWCF_COLOR_KEY)
           window->config.color_key = config->color_key;
 
-     if (flags & CWCF_OPAQUE)
+     if (flags & CWCF_OPAQUE) {
           window->config.opaque = config->opaque;
 
+          invalidate_visibility( stack->stack_data );
+     }
+
      if (flags & CWCF_OPACITY && !config->opacity)
           set_opacity( window, window_data, wm_data, config->opacity );
 
@@ -3898,6 +5071,8 @@ wm_set_window_config( CoreWindow             *window,
 
           window->config.rotation = config->rotation;
 
+          invalidate_visibility( stack->stack_data );
+
           update_window( window, window_data, NULL, DSFLIP_NONE, false, false, false );
      }
 
@@ -4159,7 +5334,14 @@ wm_update_window( CoreWindow          *window,
 
      send_update_event( window, stack->stack_data, left_region );
 
-     update_window( window, window_data, left_region, flags, false, false, true );
+     /* Window content changed, cached content needs to be rendered again. */
+     invalidate_window_cache( window_data );
+
+     /* Nothing to composite for a promoted window. */
+     if (window == ((StackData*) stack->stack_data)->overlay.window)
+          update_overlay( stack->stack_data, left_region, flags );
+     else
+          update_window( window, window_data, left_region, flags, false, false, true );
 
      process_updates( stack->stack_data, wm_data, stack, flags );
 
@@ -4179,6 +5361,7 @@ wm_update_cursor( CoreWindowStack       *stack,
      WMData           *wmdata   = wm_data;
      StackData        *data     = stack_data;
      bool              restored = false;
+     bool              demoted  = false;
      CoreLayerContext *context;
      CoreLayerRegion  *primary;
      CoreSurface      *surface;
@@ -4210,6 +5393,17 @@ wm_update_cursor( CoreWindowStack       *stack,
           }
      }
 
+     /* The cursor is drawn into the primary layer, composite a promoted window again when it gets under the cursor. */
+     if (data->overlay.window && stack->cursor.enabled && stack->cursor.opacity) {
+          DFBRegion bounds = DFB_REGION_INIT_FROM_RECTANGLE( &data->overlay.window->config.bounds );
+
+          if (dfb_region_region_intersects( &bounds, &data->cursor_region )) {
+               demote_window( data, NULL );
+
+               demoted = true;
+          }
+     }
+
      /* Optimize case of invisible cursor moving. */
      if (!(flags & ~(CCUF_POSITION | CCUF_SHAPE)) && (!stack->cursor.opacity || !stack->cursor.enabled))
           return DFB_OK;
@@ -4298,6 +5492,10 @@ wm_update_cursor( CoreWindowStack       *stack,
           if (!dfb_region_intersect( &dest, 0, 0, surface->config.size.w - 1, surface->config.size.h - 1 )) {
                if (restored)
                     dfb_layer_region_flip_update( primary, &old_dest, DSFLIP_BLIT );
+
+               if (demoted)
+                    process_updates( data, wmdata, stack, DSFLIP_NONE );
+
                return DFB_OK;
           }
 
@@ -4379,6 +5577,13 @@ wm_update_cursor( CoreWindowStack       *stack,
                          dfb_updates_add( &data->updating, update );
                     }
 
+                    /* Remember the damage for repairing back buffers by their age. */
+                    if (restored)
+                         dfb_updates_add( &data->damage, &old_region );
+
+                    if (data->cursor_drawn)
+                         dfb_updates_add( &data->damage, &data->cursor_region );
+
                     if (!data->updated.num_regions)
                          flush_updating( data );
                     break;
@@ -4404,6 +5609,10 @@ wm_update_cursor( CoreWindowStack       *stack,
           fusion_skirmish_dismiss( &data->update_skirmish );
      }
 
+     /* Composite the demoted window, the repaint draws the cursor over it. */
+     if (demoted)
+          process_updates( data, wmdata, stack, DSFLIP_NONE );
+
      return DFB_OK;
 }
 